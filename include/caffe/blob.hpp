@@ -262,6 +262,14 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to memory, which may be larger than the
+   *        blob and shared with other blobs -- used by Net to reuse memory
+   *        between blobs that are never alive at the same time.
+   *
+   * A later Reshape beyond the size of memory allocates new data and diff.
+   */
+  void set_data_memory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -8,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/datum_view.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
@@ -19,19 +20,28 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * Records are handed out as DatumViews. Values of backends that keep them
+ * mapped while the cursor lives (LMDB) are decoded in place without a copy,
+ * the data and label bytes of the views pointing into the database.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  inline BlockingQueue<DatumView*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline BlockingQueue<DatumView*>& full() const {
     return queue_pair_->full_;
   }
 
+  // Splits the TRAIN data between count processes training together, this
+  // one reading records rank, rank + count, rank + 2 * count... of each
+  // source. Must be set before the data layers are created.
+  static void set_process_shard(int rank, int count);
+
  protected:
   // Queue pairs are shared between a body and its readers
   class QueuePair {
@@ -39,8 +49,8 @@ class DataReader {
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    BlockingQueue<DatumView*> free_;
+    BlockingQueue<DatumView*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
@@ -54,8 +64,12 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Moves the cursor records forward, restarting from the start at the end.
+    void skip(db::Cursor* cursor, int records);
 
     const LayerParameter param_;
+    // Records the cursor moves forward after each one read.
+    int stride_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
 
     friend class DataReader;
@@ -73,6 +87,8 @@ class DataReader {
   shared_ptr<Body> body_;
 
   static map<const string, boost::weak_ptr<DataReader::Body> > bodies_;
+  static int process_rank_;
+  static int process_count_;
 
 DISABLE_COPY_AND_ASSIGN(DataReader);
 };
@@ -0,0 +1,90 @@
+#ifndef CAFFE_INFERENCE_SERVER_HPP_
+#define CAFFE_INFERENCE_SERVER_HPP_
+
+#include <list>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/net_model.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/numa.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Runs requests through the nets of a NetModel, coalescing the
+ *        requests queued together into batches.
+ *
+ * Each worker thread runs its own net of the model. A worker takes the
+ * oldest request, waits up to max_latency_ms after it was queued for more
+ * requests with the same item shape, up to max_batch_size items, and runs
+ * them as one batch. The net input is reshaped only when the batch shape
+ * changes. The net must have a single input, and its outputs are split
+ * between the requests along their first axis; when they do not follow the
+ * batch size of the input, requests are run one at a time.
+ *
+ * With a NUMA placement, the workers take the NUMA nodes in turn. Each
+ * binds itself to its node, and its net is created by a thread bound to the
+ * node, from a copy of the weights made there with NUMA_REPLICATE.
+ */
+template <typename Dtype>
+class InferenceServer {
+ public:
+  /// @brief Starts num_workers threads, in the current mode.
+  InferenceServer(const NetModel<Dtype>& model, int num_workers,
+      int max_batch_size, int max_latency_ms,
+      NumaPlacement numa = NUMA_NONE);
+  ~InferenceServer();
+
+  /**
+   * @brief Runs the items of input, stacked along its first axis, and waits
+   *        for their outputs, one per net output. Can be called from any
+   *        number of threads. input must hold at least one item.
+   */
+  void Infer(const Blob<Dtype>& input,
+      vector<shared_ptr<Blob<Dtype> > >* outputs);
+  /// @brief The names of the net outputs.
+  inline const vector<string>& output_names() const { return output_names_; }
+  /// @brief The shape of the net input, as declared by the model.
+  inline const vector<int>& input_shape() const { return input_shape_; }
+  inline int max_batch_size() const { return max_batch_size_; }
+  void GetStats(ServeStats* stats) const;
+
+ protected:
+  struct Request;
+  // Moves synchronization fields out of the header, see BlockingQueue.
+  class sync;
+
+  void WorkerEntry(shared_ptr<Net<Dtype> > net, int numa_node);
+  // The items of the next batch, starting with the oldest request, called
+  // with the lock held. Its requests are taken from the queue into batch,
+  // unless batch is NULL.
+  int TakeBatch(vector<Request*>* batch);
+  void RunBatch(Net<Dtype>* net, const vector<Request*>& batch);
+
+  Caffe::Brew mode_;
+  int device_;
+  int max_batch_size_;
+  int max_latency_ms_;
+  vector<string> output_names_;
+  vector<int> input_shape_;
+  bool must_stop_;
+  std::list<Request*> queue_;
+  uint64_t num_requests_;
+  vector<uint64_t> batch_size_counts_;
+  // The latencies of the last requests, in milliseconds.
+  vector<float> latencies_;
+  int next_latency_;
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > workers_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceServer);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_SERVER_HPP_
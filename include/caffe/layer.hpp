@@ -38,7 +38,8 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-	  : layer_param_(param), is_shared_(false){
+	  : layer_param_(param), is_shared_(false), is_fused_(false),
+	    reshape_on_change_(false) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -100,6 +101,14 @@ class Layer {
    */
   virtual inline bool ShareInParallel() const { return false; }
 
+  /**
+   * @brief Whether Net may run this layer on a worker thread, next to other
+   *        layers, when parallel_layers is set. Layers relying on the
+   *        per-thread Caffe state, such as Caffe::rng_stream(), return false
+   *        and are run on the calling thread in net order.
+   */
+  virtual inline bool RunsConcurrently() const { return true; }
+
   /** @brief Return whether this layer is actually shared by other nets.
    *         If ShareInParallel() is true and using more than one GPU and the
    *         net has TRAIN phase, then this function is expected return true.
@@ -116,6 +125,40 @@ class Layer {
     is_shared_ = is_shared;
   }
 
+  /**
+   * @brief Makes this layer apply the in-place activation layer following
+   *        it to top[0] at the end of Forward_cpu, and returns true, if it
+   *        can. Net then skips the activation on the CPU, see SetFused.
+   */
+  virtual bool FuseActivation(Layer<Dtype>* activation) { return false; }
+
+  /**
+   * @brief Makes Forward_cpu run on int8 weights and inputs, the bottom
+   *        quantized with bottom_max as its largest magnitude, and returns
+   *        true, if the layer can; a bottom_max of 0 goes back to full
+   *        precision. See QuantizationParameter.
+   */
+  virtual bool Quantize(float bottom_max) { return false; }
+
+  /** @brief Return whether Forward leaves the top untouched on the CPU, the
+   *         layer being applied by the layer before it.
+   */
+  inline bool IsFused() const { return is_fused_; }
+  inline void SetFused(bool is_fused) { is_fused_ = is_fused; }
+
+  /** @brief Set whether Forward only calls Reshape when the shapes of the
+   *         bottoms differ from the last call of BottomShapesChanged. Layers
+   *         without bottoms always reshape.
+   */
+  inline void SetReshapeOnChange(bool reshape_on_change) {
+    reshape_on_change_ = reshape_on_change;
+    bottom_shapes_.clear();
+  }
+  /** @brief Return whether the shapes of bottom differ from those of the
+   *         last call, and remember them.
+   */
+  bool BottomShapesChanged(const vector<Blob<Dtype>*>& bottom);
+
   /**
    * @brief Adjust the shapes of top blobs and internal buffers to accommodate
    *        the shapes of the bottom blobs.
@@ -448,6 +491,14 @@ class Layer {
   /** Whether this layer is actually shared by other nets*/
   bool is_shared_;
 
+  /** Whether the layer before applies this layer in its Forward_cpu */
+  bool is_fused_;
+
+  /** Whether Forward skips Reshape while the bottom shapes are unchanged */
+  bool reshape_on_change_;
+  /** The bottom shapes of the last call of BottomShapesChanged */
+  vector<vector<int> > bottom_shapes_;
+
   /** The mutex for sequential forward if this layer is shared */
   shared_ptr<boost::mutex> forward_mutex_;
 
@@ -470,10 +521,14 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   // Lock during forward to ensure sequential forward
   Lock();
   Dtype loss = 0;
-  Reshape(bottom, top);
+  if (!reshape_on_change_ || BottomShapesChanged(bottom)) {
+    Reshape(bottom, top);
+  }
   switch (Caffe::mode()) {
   case Caffe::CPU:
-    Forward_cpu(bottom, top);
+    if (!is_fused_) {
+      Forward_cpu(bottom, top);
+    }
     for (int top_id = 0; top_id < top.size(); ++top_id) {
       if (!this->loss(top_id)) { continue; }
       const int count = top[top_id]->count();
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/activation_epilogue.hpp"
 #include "caffe/util/im2col.hpp"
 
 namespace caffe {
@@ -27,6 +28,7 @@ namespace caffe {
 		virtual inline int MinBottomBlobs() const { return 1; }
 		virtual inline int MinTopBlobs() const { return 1; }
 		virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+		virtual bool FuseActivation(Layer<Dtype>* activation);
 
 	protected:
 		// Helper functions that abstract away the column buffer and gemm arguments.
@@ -40,6 +42,12 @@ namespace caffe {
 		void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
 			weights);
 		void backward_cpu_bias(Dtype* bias, const Dtype* input);
+		// Applies the fused activation, if any, to the output of one image.
+		inline void forward_cpu_activation(Dtype* output) {
+			if (activation_.enabled()) {
+				activation_.Apply(num_output_, out_spatial_dim_, output);
+			}
+		}
 
 #ifndef CPU_ONLY
 		void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,6 +100,7 @@ namespace caffe {
 		bool bias_term_;
 		bool is_1x1_;
 		bool force_nd_im2col_;
+		ActivationEpilogue<Dtype> activation_;
 
 	private:
 		// wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -1,6 +1,8 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <boost/function.hpp>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -48,7 +51,11 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : read_time_(0), transform_time_(0) {}
+
   Blob<Dtype> data_, label_;
+  // Time spent reading and transforming the items of the batch, in ms.
+  double read_time_, transform_time_;
 };
 
 template <typename Dtype>
@@ -70,15 +77,37 @@ class BasePrefetchingDataLayer :
   // Prefetches batches (asynchronously if to GPU memory)
   static const int PREFETCH_COUNT = 3;
 
+  // Timing of the batch of the last forward pass, in ms.
+  inline double read_time() const { return read_time_; }
+  inline double transform_time() const { return transform_time_; }
+
  protected:
+  typedef boost::function<void(int, int, int)> TransformFunction;
+
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Whether load_batch transforms with ParallelTransform, so that the layer
+  // runs transform_param.num_threads workers rather than just one.
+  virtual inline bool UsesParallelTransform() const { return true; }
+
+  // Number of transform workers, set by transform_param.num_threads.
+  inline int num_transform_workers() const { return transformers_.size(); }
+  // Calls func(worker, begin, end) for each worker, on the transform threads.
+  // Worker w always takes the w-th of the equal slices of [0, count), so a
+  // batch is transformed the same way for a given seed however the threads
+  // are scheduled. Workers must only use transformers_[worker].
+  void ParallelTransform(int count, const TransformFunction& func);
 
   Batch<Dtype> prefetch_[PREFETCH_COUNT];
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
+  // One transformer, with its own RNG, per worker; the first one is
+  // data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  shared_ptr<ThreadPool> transform_pool_;
+  double read_time_, transform_time_;
 };
 
 }  // namespace caffe
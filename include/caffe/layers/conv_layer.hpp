@@ -8,6 +8,7 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/quantization.hpp"
 
 namespace caffe {
 
@@ -59,12 +60,22 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *    kernels + stream parallelism) engines. On the CPU, WINOGRAD computes
+   *    3x3 stride 1 convolutions with F(2x2,3x3) or F(4x4,3x3) (see
+   *    winograd_tile) and DIRECT convolves without unrolling the input, which
+   *    suits grouped and depthwise convolutions. DEFAULT chooses among them
+   *    by the shape of the layer. WINOGRAD computes the backward pass with
+   *    matrix multiplication.
+   *  - quantization_param (\b optional). Runs 2D convolutions of a single
+   *    bottom with int8 weights and inputs on the CPU, whatever the engine.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), int8_bottom_scale_(0) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual bool Quantize(float bottom_max);
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -77,6 +88,21 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  /// The algorithm of Forward_cpu and Backward_cpu: CAFFE, WINOGRAD or DIRECT.
+  ConvolutionParameter_Engine cpu_engine_;
+
+  /// Forward_cpu with int8 weights and inputs.
+  void Forward_cpu_int8(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// The scale quantizing the bottom, 0 to run in full precision.
+  float int8_bottom_scale_;
+  Int8Weights<Dtype> int8_weights_;
+  /// The quantized image, channels last, its unrolled patches and the int32
+  /// products.
+  vector<int8_t> int8_bottom_;
+  vector<int8_t> int8_rows_;
+  vector<int32_t> int8_products_;
 };
 
 }  // namespace caffe
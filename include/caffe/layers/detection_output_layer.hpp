@@ -0,0 +1,73 @@
+#ifndef CAFFE_DETECTION_OUTPUT_LAYER_HPP_
+#define CAFFE_DETECTION_OUTPUT_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/box.hpp"
+
+namespace caffe {
+	/**
+	* @brief Decodes the location predictions of a net trained with MultiBoxLoss
+	*        against the default boxes, and keeps the most confident boxes of
+	*        every class after non-maximum suppression.
+	*
+	* top[0] is 1 x 1 x K x (3 + 2D): image id, label, score and Min1 ... MinD
+	* Max1 ... MaxD of the K detections, ordered by image, label and decreasing
+	* score. A single row of -1 is output when nothing is detected.
+	*/
+	template <typename Dtype>
+	class DetectionOutputLayer : public Layer<Dtype> {
+	public:
+		explicit DetectionOutputLayer(const LayerParameter& param)
+			: Layer<Dtype>(param) {}
+		virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+			const vector<Blob<Dtype>*>& top);
+		virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+			const vector<Blob<Dtype>*>& top);
+		// bottom[3*i+0] stores the default boxes.
+		// bottom[3*i+1] stores the location predictions.
+		// bottom[3*i+2] stores the confidence predictions.
+		virtual inline int MinBottomBlobs() const { return 3; }
+		virtual inline int ExactNumTopBlobs() const { return 1; }
+		virtual inline const char* type() const { return "DetectionOutput"; }
+	protected:
+		virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+			const vector<Blob<Dtype>*>& top);
+		virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+			const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+			NOT_IMPLEMENTED;
+		}
+
+		// Turns the confidences of image n into scores_[n].
+		void ScoreImage(const int n);
+	private:
+		bool share_location_;
+		int num_pyramid_layer_;
+		int box_dimensions_;
+		int num_classes_;
+		int num_;
+		int num_boxes_;
+		int background_label_;
+		MultiBoxLossParameter_ConfLossType conf_loss_type_;
+		float confidence_threshold_;
+		float nms_threshold_;
+		int top_k_;
+		int keep_top_k_;
+
+		vector<int> pyramid_offsets_; // first box id of each pyramid layer
+		DefBoxes<Dtype> def_boxes_;
+		vector<PredBoxes<Dtype> > pred_boxes_; // pred_boxes_[image_id]
+		// decoded_boxes_[image_id][loc_class]
+		vector<vector<BoxSet<Dtype> > > decoded_boxes_;
+		// scores_[image_id][class_id * num_boxes + box_id]
+		vector<vector<Dtype> > scores_;
+		// kept_indices_[image_id * num_classes + class_id]: boxes kept by the
+		// non-maximum suppression, most confident first.
+		vector<vector<int> > kept_indices_;
+	};
+}
+
+#endif
@@ -39,6 +39,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // The mask is drawn from the calling thread's random number stream.
+  virtual inline bool RunsConcurrently() const { return false; }
 
  protected:
   /**
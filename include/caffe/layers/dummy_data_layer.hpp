@@ -24,6 +24,8 @@ class DummyDataLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   // Data layers should be shared by multiple solvers in parallel
   virtual inline bool ShareInParallel() const { return true; }
+  // Refilling draws from the calling thread's random number stream.
+  virtual inline bool RunsConcurrently() const { return false; }
   // Data layers have no bottoms, so reshaping is trivial.
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {}
@@ -6,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/activation_epilogue.hpp"
+#include "caffe/util/quantization.hpp"
 
 namespace caffe {
 
@@ -19,7 +21,7 @@ template <typename Dtype>
 class InnerProductLayer : public Layer<Dtype> {
  public:
   explicit InnerProductLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), int8_bottom_scale_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -28,6 +30,8 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual bool FuseActivation(Layer<Dtype>* activation);
+  virtual bool Quantize(float bottom_max);
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -45,6 +49,17 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  ActivationEpilogue<Dtype> activation_;
+
+  /// Forward_cpu with int8 weights and inputs.
+  void Forward_cpu_int8(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// The scale quantizing the bottom, 0 to run in full precision.
+  float int8_bottom_scale_;
+  Int8Weights<Dtype> int8_weights_;
+  /// The quantized bottom and the int32 products.
+  vector<int8_t> int8_bottom_;
+  vector<int32_t> int8_products_;
 };
 
 }  // namespace caffe
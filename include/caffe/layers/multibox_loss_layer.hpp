@@ -25,33 +25,52 @@ namespace caffe {
 		// bottom[3*i+0] stores the default boxes.
 		// bottom[3*i+1] stores the location predictions.
 		// bottom[3*i+2] stores the confidence predictions.
-		// bottom[3*n+1] stores the label truth bounding boxes.
-		// bottom[3*n+2] stores the ground truth bounding boxes.
+		// bottom[3*n+0] stores the label truth bounding boxes.
+		// bottom[3*n+1] stores the ground truth bounding boxes.
+		virtual inline int ExactNumBottomBlobs() const { return -1; }
 		virtual inline int MinBottomBlobs() const { return 5; }
 		virtual inline int ExactNumTopBlobs() const { return 1; }
 		virtual inline const char* type() const { return "MultiBoxLoss"; }
+		// Only the location and confidence predictions take gradients.
+		virtual inline bool AllowForceBackward(const int bottom_index) const {
+			return bottom_index < 3 * num_pyramid_layer_ && bottom_index % 3 != 0;
+		}
 	protected:
 		virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 			const vector<Blob<Dtype>*>& top);
 		virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
 			const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+		// Matches the predictions of image n and fills all_match_indices_[n]
+		// and conf_labels_[n].
+		void MatchImage(const int n);
 	private:
 		bool share_location_;
 		int num_pyramid_layer_;
 		int box_dimensions_;
 		int num_classes_;
 		int num_;
+		int num_boxes_;
 		int background_label_;
 		MultiBoxLossParameter_MatchType match_type_;
 		MultiBoxLossParameter_ConfLossType conf_loss_type_;
 		float overlap_threshold_;
 		float neg_pos_ratio_;
-		int min_negtive_;
+		int min_negative_;
+		int num_matches_;
 
-		vector<DefBox<Dtype>> def_boxes_;
-		vector<vector<GTBox<Dtype>>> gt_boxes_; //gt_boxes_[image_id][box_id]
-		vector<vector<vector<Box<Dtype>>>> pred_boxes_; // pred_boxes_[image_id][class_id][box_id]
+		vector<int> pyramid_offsets_; // first box id of each pyramid layer
+		DefBoxes<Dtype> def_boxes_;
+		vector<GTBoxes<Dtype> > gt_boxes_; //gt_boxes_[image_id]
+		vector<PredBoxes<Dtype> > pred_boxes_; // pred_boxes_[image_id]
+		vector<PredBoxes<Dtype> > pred_diffs_; // same layout as pred_boxes_
+		// all_match_indices_[image_id][loc_class][box_id]: matched gt or -1.
+		vector<vector<vector<int> > > all_match_indices_;
+		// conf_labels_[image_id][box_id]: target class of the confidence loss,
+		// -1 for boxes neither matched nor mined as hard negatives.
+		vector<vector<int> > conf_labels_;
+		BoxOverlaps<Dtype> overlaps_;
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -58,6 +58,8 @@ class PSROIPoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  void ComputeBins(const Blob<Dtype>* rois);
+
   Dtype spatial_scale_;
   int output_dim_;
   int group_size_;
@@ -69,6 +71,11 @@ class PSROIPoolingLayer : public Layer<Dtype> {
   int pooled_height_;
   int pooled_width_;
   Blob<int> mapping_channel_;
+  // Clipped input window of each bin of each ROI on the CPU path:
+  // bins_[((n * pooled_height_ + ph) * pooled_width_ + pw) * 4 + {0, 1, 2, 3}]
+  // holds hstart, hend, wstart, wend.
+  vector<int> bins_;
+  vector<int> roi_batch_inds_;
 };
 
 }  // namespace caffe
@@ -10,6 +10,17 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+// Holds the interpreter lock for its lifetime; pycaffe releases it while
+// nets run.
+class ScopedGILAcquire {
+ public:
+  ScopedGILAcquire() : state_(PyGILState_Ensure()) {}
+  ~ScopedGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
@@ -24,6 +35,7 @@ class PythonLayer : public Layer<Dtype> {
         && !ShareInParallel()) {
       LOG(FATAL) << "PythonLayer is not implemented in Multi-GPU training";
     }
+    ScopedGILAcquire gil;
     self_.attr("param_str") = bp::str(
         this->layer_param_.python_param().param_str());
     self_.attr("phase") = static_cast<int>(this->phase_);
@@ -31,22 +43,27 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     self_.attr("reshape")(bottom, top);
   }
 
   virtual inline bool ShareInParallel() const {
     return this->layer_param_.python_param().share_in_parallel();
   }
+  // Python code needs the interpreter lock held by the calling thread.
+  virtual inline bool RunsConcurrently() const { return false; }
 
   virtual inline const char* type() const { return "Python"; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    ScopedGILAcquire gil;
     self_.attr("forward")(bottom, top);
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    ScopedGILAcquire gil;
     self_.attr("backward")(top, propagate_down, bottom);
   }
 
@@ -36,6 +36,8 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Crops and mirrors windows itself, on the prefetch thread.
+  virtual inline bool UsesParallelTransform() const { return false; }
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
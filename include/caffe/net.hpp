@@ -1,6 +1,7 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -14,6 +15,10 @@
 
 namespace caffe {
 
+class MappedWeights;
+class TaskGraph;
+template <typename Dtype> class NetModel;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -27,10 +32,14 @@ class Net {
   explicit Net(const string& param_file, Phase phase,
       const int level = 0, const vector<string>* stages = NULL,
       const Net* root_net = NULL);
+  /// @brief Creates a net with the definition of model, sharing its
+  ///        learnable params; see NetModel.
+  explicit Net(const NetModel<Dtype>& model);
   virtual ~Net() {}
 
-  /// @brief Initialize a network with a NetParameter.
-  void Init(const NetParameter& param);
+  /// @brief Initialize a network with a NetParameter. The layers with params
+  ///        in model use them instead of setting up their own.
+  void Init(const NetParameter& param, const NetModel<Dtype>* model = NULL);
 
   /// @brief set phase
   /// enable train and test with one network, for saving memory
@@ -83,9 +92,14 @@ class Net {
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. With a reshape plan
+   * cache, see NetParameter.reshape_plan_cache_size, nothing is reshaped
+   * while the shapes of the net inputs stay the same.
    */
   void Reshape();
+  /// @brief The input shape changes whose plan was cached, or was not.
+  inline uint64_t reshape_plan_hits() const { return reshape_plan_hits_; }
+  inline uint64_t reshape_plan_misses() const { return reshape_plan_misses_; }
 
   Dtype ForwardBackward() {
     Dtype loss;
@@ -119,6 +133,32 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Points the blobs of the pre-trained layers at the values of a
+   *        mapped weights file (see caffe/util/mapped_weights.hpp) instead of
+   *        copying them, when they have the precision of the net. The mapping
+   *        is kept for the lifetime of the net.
+   */
+  void CopyTrainedLayersFromMapped(const string trained_filename);
+  /**
+   * @brief Folds the BatchNorm, Scale and Bias layers following Convolution
+   *        and InnerProduct layers into their weights, see FoldBatchNorm in
+   *        caffe/util/net_optimizer.hpp. Call it once the trained layers are
+   *        copied; the net is set up again without the folded layers, so
+   *        blobs and layers obtained before are no longer used. Returns the
+   *        number of layers folded.
+   */
+  int FoldBatchNorm();
+  /**
+   * @brief Runs the Convolution and InnerProduct layers whose bottom has a
+   *        range in table with int8 weights and inputs on the CPU, see
+   *        QuantizationParameter, and the other layers in full precision.
+   *        An empty table restores full precision. The weights are quantized
+   *        by the next Forward, and again by the first Forward after they
+   *        change, so trained layers may be copied before or after.
+   *        Returns the number of quantized layers.
+   */
+  int Quantize(const QuantizationTable& table);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -228,6 +268,36 @@ class Net {
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
   void set_debug_info(const bool value) { debug_info_ = value; }
+  /**
+   * @brief Run independent layers concurrently on ThreadPool::Global() in
+   *        CPU mode. Layers only start once every earlier layer touching the
+   *        same blobs or parameters is done, so outputs, diffs and the loss
+   *        are bit-identical to serial execution.
+   */
+  void set_parallel_layers(const bool value) { parallel_layers_ = value; }
+  inline bool parallel_layers() const { return parallel_layers_; }
+
+  /**
+   * @brief Notified by Backward as soon as the gradients of learnable params
+   *        are final, e.g. to start summing them over processes while the
+   *        earlier layers are still back-propagating.
+   */
+  class GradientCallback {
+   public:
+    virtual ~GradientCallback() {}
+    /**
+     * @brief The diffs of learnable_params()[learnable_param_ids] are final
+     *        for this Backward call: layer_id was the last layer of the call
+     *        using them, shared params included. The params no layer of the
+     *        call computes come first, with layer_id -1. With parallel
+     *        layers, it is called on the threads running the layers.
+     */
+    virtual void on_layer_gradients_ready(int layer_id,
+        const vector<int>& learnable_param_ids) = 0;
+  };
+  void add_gradient_callback(GradientCallback* value) {
+    gradient_callbacks_.push_back(value);
+  }
 
   // Helpers for Init.
   /**
@@ -254,6 +324,29 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Whether a From/To call over num_layers layers runs in parallel.
+  bool RunInParallel(int num_layers) const;
+  /// @brief Dependency graph between layer_ids, given in execution order.
+  shared_ptr<TaskGraph> BuildLayerGraph(const vector<int>& layer_ids,
+      bool backward) const;
+  Dtype ForwardFromToParallel(int start, int end);
+  void BackwardFromToParallel(int start, int end);
+
+  /// @brief Lets layers apply the in-place activation layer following them.
+  void FuseActivations();
+  /// @brief Shares memory between blobs whose lifetimes do not overlap.
+  void PlanMemory();
+  /// @brief Gives the blobs sharing planned memory memory of their own.
+  void UnplanMemory();
+  /// @brief Switches to the reshape plan of the current input shapes.
+  void ApplyReshapePlan();
+
+  /// @brief Counts the layers of a Backward call using each learnable param,
+  ///        and reports the params none of them computes.
+  void StartGradientCallbacks(int start, int end);
+  /// @brief Reports the learnable params layer_id was the last to compute.
+  void LayerGradientsReady(int layer_id);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -263,6 +356,9 @@ class Net {
 
   /// @brief The network name
   string name_;
+  /// @brief The filtered parameters the net was initialized from, without
+  ///        blobs.
+  NetParameter net_param_;
   /// @brief The phase: TRAIN or TEST
   Phase phase_;
   /// @brief Individual layers in the net
@@ -318,8 +414,51 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether to run independent layers concurrently.
+  bool parallel_layers_;
+  /// Layer graphs for the From/To ranges run so far, keyed by (start, end).
+  map<pair<int, int>, shared_ptr<TaskGraph> > forward_graphs_;
+  map<pair<int, int>, shared_ptr<TaskGraph> > backward_graphs_;
+  map<pair<int, int>, vector<int> > backward_layer_ids_;
+  /// Whether PlanMemory runs before the next complete Forward, once a
+  /// complete Forward has shown which blobs share data (memory_observed_).
+  bool plan_memory_;
+  bool memory_observed_;
+  /// The last layer run by the last Forward.
+  int last_forward_end_;
+  /// Memory shared by blobs after PlanMemory. For each blob, the group of
+  /// blobs aliasing its data and the slab they use, or -1 if not planned.
+  vector<shared_ptr<SyncedMemory> > memory_slabs_;
+  /// Blobs looked up by name keep their own memory.
+  mutable vector<bool> blob_memory_pinned_;
+  vector<int> blob_memory_groups_;
+  vector<int> blob_memory_slabs_;
+  /// The shapes of the blobs for some shapes of the net inputs, and the
+  /// memory planned for them.
+  struct ReshapePlan {
+    vector<vector<int> > input_shapes;
+    vector<vector<int> > blob_shapes;
+    bool memory_planned;
+    vector<shared_ptr<SyncedMemory> > memory_slabs;
+    vector<int> blob_memory_groups;
+    vector<int> blob_memory_slabs;
+  };
+  /// The reshape plans, the current one first and the least recently used
+  /// last.
+  std::list<ReshapePlan> reshape_plans_;
+  size_t reshape_plan_cache_size_;
+  uint64_t reshape_plan_hits_;
+  uint64_t reshape_plan_misses_;
+  vector<GradientCallback*> gradient_callbacks_;
+  /// For each learnable param, the layers of the current Backward call still
+  /// to compute its diff.
+  vector<int> gradient_pending_;
+  /// The weights files some learnable params point into.
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+
+  friend class NetModel<Dtype>;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
@@ -0,0 +1,74 @@
+#ifndef CAFFE_NET_MODEL_HPP_
+#define CAFFE_NET_MODEL_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+class MappedWeights;
+
+/**
+ * @brief The definition and the trained weights of a net, from which any
+ *        number of nets can be created, e.g. one per serving thread. The
+ *        nets share the learnable params of the model, each owning only its
+ *        activations, so memory grows as weights + N x activations.
+ *
+ * Creating a net neither parses its definition again nor runs the fillers
+ * of its params. The params are reference counted: they live as long as the
+ * model or any net created from it. Nets sharing params must only be run
+ * forward, in the TEST phase; nothing may write to the params while they
+ * run.
+ *
+ * The nets of a model can run Forward concurrently, each in its own thread,
+ * and nets can be created while others run. Caffe's mode and device are per
+ * thread, so a thread running a net on the GPU sets them first; the model
+ * must be created in the mode its nets run in.
+ */
+template <typename Dtype>
+class NetModel {
+ public:
+  /// @brief Takes the definition and the learnable params of net, which
+  ///        can then be destroyed.
+  explicit NetModel(const Net<Dtype>& net);
+  /// @brief Sets up the net of param_file with the weights of
+  ///        trained_filename, in any format Net::CopyTrainedLayersFrom reads.
+  NetModel(const string& param_file, const string& trained_filename,
+      Phase phase = TEST);
+
+  /// @brief Creates a net sharing the learnable params of the model.
+  shared_ptr<Net<Dtype> > CreateNet() const;
+  /// @brief Creates a model with copies of the learnable params, placed
+  ///        where the calling thread allocates, e.g. on its NUMA node.
+  shared_ptr<NetModel<Dtype> > Replicate() const;
+
+  /// @brief The filtered definition of the nets, without blobs.
+  inline const NetParameter& param() const { return param_; }
+  /// @brief The learnable params of a layer, or NULL if it has none.
+  const vector<shared_ptr<Blob<Dtype> > >* layer_blobs(
+      const string& layer_name) const;
+  /// @brief The weights files some learnable params point into.
+  inline const vector<shared_ptr<MappedWeights> >& mapped_weights() const {
+    return mapped_weights_;
+  }
+
+ private:
+  NetModel() {}
+  void Init(const Net<Dtype>& net);
+
+  NetParameter param_;
+  map<string, vector<shared_ptr<Blob<Dtype> > > > layer_blobs_;
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
+
+  DISABLE_COPY_AND_ASSIGN(NetModel);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_NET_MODEL_HPP_
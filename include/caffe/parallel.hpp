@@ -3,19 +3,24 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <ostream>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
+class SocketRing;
+
 // Represents a net parameters. Once a net is created, its parameter buffers can
 // be replaced by ones from Params, to allow parallelization. Params ensures
 // parameters are allocated in one consecutive array.
@@ -59,6 +64,27 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory. Every solver gets its own gradient buffer,
+// the parameter buffer can be shared by the solvers of one process.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  // Copies the parameters of root_solver into a new buffer, or uses the one
+  // of shared if it is given.
+  CPUParams(shared_ptr<Solver<Dtype> > root_solver,
+            const CPUParams<Dtype>* shared);
+  virtual ~CPUParams();
+
+  void configure(Solver<Dtype>* solver) const;
+
+ protected:
+  const bool own_data_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
@@ -116,6 +142,185 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   using Params<Dtype>::diff_;
 };
 
+// Synchronous data parallelism between solver replicas on CPU threads. The
+// replicas read one parameter buffer, which only the root solver updates.
+// Once all the gradients are ready, each replica sums its cache line aligned
+// slice of them into the root gradients, so the reduction runs on all the
+// replica threads at once and no two threads write the same cache line.
+template<typename Dtype>
+class CPUSync : public CPUParams<Dtype>, public Solver<Dtype>::Callback,
+    public InternalThread {
+ public:
+  explicit CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                   CPUSync<Dtype>* root, const SolverParameter& param);
+  virtual ~CPUSync();
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+
+  // Trains with replicas solvers, the root one on the calling thread. Data
+  // layers split batches between Caffe::solver_count() solvers, which must
+  // be set to replicas before the root solver is created. The first
+  // baseline_iters iterations run the replicas one at a time, to compare
+  // the replicas running in parallel with a single one.
+  void Run(int replicas, int baseline_iters = 0);
+  void Prepare(int replicas, vector<shared_ptr<CPUSync<Dtype> > >* syncs);
+  inline const int initial_iter() const { return initial_iter_; }
+
+  // Milliseconds per iteration of all the replicas, when they run one at a
+  // time and in parallel, or 0 if no such iteration was timed. The first
+  // iteration of each is left out as a warm up.
+  inline double serial_iteration_ms() const {
+    return serial_iters_ ? serial_ms_ / serial_iters_ : 0;
+  }
+  inline double parallel_iteration_ms() const {
+    return parallel_iters_ ? parallel_ms_ / parallel_iters_ : 0;
+  }
+  // The speedup of the replicas over a single one divided by their number,
+  // or 0 if not measured.
+  double scaling_efficiency() const;
+
+ protected:
+  // Moves synchronization fields out of the header, see BlockingQueue.
+  class sync;
+
+  void on_start();
+  void on_gradients_ready();
+
+  void InternalThreadEntry();
+
+  inline const CPUSync<Dtype>* root() const {
+    return root_ ? root_ : this;
+  }
+  // Whether the current iteration runs the replicas one at a time.
+  inline bool serial() const {
+    return iterations_ < root()->baseline_iters_;
+  }
+
+  CPUSync<Dtype>* root_;
+  // 0 for the root.
+  const int replica_;
+  // All the replicas, on the root while they run.
+  vector<CPUSync<Dtype>*> replicas_;
+  int num_replicas_;
+  shared_ptr<sync> sync_;
+  const int initial_iter_;
+  // Iterations run by this replica.
+  int iterations_;
+  int baseline_iters_;
+  double serial_ms_;
+  int serial_iters_;
+  double parallel_ms_;
+  int parallel_iters_;
+  shared_ptr<Solver<Dtype> > solver_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+// Synchronous data parallelism between processes, possibly on different
+// machines, each training one solver on CPU. The processes sum their
+// gradients with a ring all-reduce over sockets, then apply the same update
+// to their own copies of the parameters, which start from those of rank 0.
+// Resuming from a snapshot needs every process to restore it, so that they
+// also share the solver history.
+//
+// With bucket_bytes, the parameters are grouped in buckets of about that
+// size, from the last layers to the first, and a communication thread sums
+// each bucket as soon as Backward has computed its gradients, while the
+// earlier layers are still back-propagating. Every rank reduces the buckets
+// in the same order.
+template<typename Dtype>
+class RingSync : public CPUParams<Dtype>, public Solver<Dtype>::Callback,
+    public Net<Dtype>::GradientCallback, public InternalThread {
+ public:
+  RingSync(shared_ptr<Solver<Dtype> > root_solver, SocketRing* ring,
+           size_t bucket_bytes = 0);
+  virtual ~RingSync();
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+
+  // Only rank 0 tests and snapshots: this clears testing and snapshots from
+  // the solver parameters of the other ranks, before they create solvers.
+  static void ConfigureRank(int rank, SolverParameter* param);
+
+  void Run();
+
+  inline int num_buckets() const { return buckets_.size(); }
+  // Milliseconds per iteration computing the gradients, and summing them
+  // over the processes, part of which is hidden behind the computation when
+  // the gradients are reduced in buckets.
+  inline double compute_iteration_ms() const {
+    return iters_ ? compute_ms_ / iters_ : 0;
+  }
+  inline double comm_iteration_ms() const {
+    return iters_ ? comm_ms_ / iters_ : 0;
+  }
+  inline double hidden_comm_iteration_ms() const {
+    return iters_ ? hidden_ms_ / iters_ : 0;
+  }
+
+  // Writes the backward passes and the bucket reductions of the first
+  // iterations as a Chrome trace (chrome://tracing).
+  void WriteChromeTrace(std::ostream* out) const;
+
+ protected:
+  // Moves synchronization fields out of the header, see BlockingQueue.
+  class sync;
+
+  // A range of learnable params, contiguous in the buffers.
+  struct Bucket {
+    int first_param;
+    int end_param;
+    size_t offset;
+    size_t count;
+  };
+  // The reduction of a bucket in one iteration, in milliseconds from the
+  // start of the iteration.
+  struct TraceEvent {
+    int iteration;
+    int bucket;
+    double ready_ms;
+    double start_ms;
+    double end_ms;
+  };
+  // Iterations recorded for WriteChromeTrace.
+  static const int kTraceIterations = 100;
+
+  void on_start();
+  void on_gradients_ready();
+  void on_layer_gradients_ready(int layer_id,
+      const vector<int>& learnable_param_ids);
+
+  // Reduces the buckets in order, as they get ready.
+  void InternalThreadEntry();
+
+  SocketRing* ring_;
+  shared_ptr<Solver<Dtype> > solver_;
+  vector<Bucket> buckets_;
+  // The bucket of each learnable param.
+  vector<int> param_buckets_;
+  shared_ptr<sync> sync_;
+  CPUTimer timer_;
+  double compute_ms_;
+  double comm_ms_;
+  double hidden_ms_;
+  int iters_;
+  // The start of the recorded iterations from the first one, and the end of
+  // their backward from their start.
+  vector<double> iteration_start_ms_;
+  vector<double> backward_ms_;
+  vector<TraceEvent> events_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 }  // namespace caffe
 
 #endif
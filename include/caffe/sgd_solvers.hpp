@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -31,16 +32,69 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  /// @brief The scale ClipGradients applies to the gradients, 1 if their L2
+  ///        norm is within clip_gradients.
+  Dtype GradientClipScale();
+
+  /// @brief A learnable param in the fused CPU update.
+  struct FusedParam {
+    Dtype* data;
+    Dtype* diff;
+    /// The param in history_, then in its second half for the solvers
+    /// keeping two histories, or NULL.
+    Dtype* history[2];
+    Dtype local_rate;
+    Dtype local_decay;
+  };
+  /**
+   * @brief Runs ClipGradients, Normalize, Regularize, ComputeUpdateValue
+   *        and Net::Update in a single pass over the values of the params,
+   *        laid end to end and split between the threads of
+   *        ThreadPool::Global(). The L2 norm of the gradients for clipping
+   *        still takes a pass of its own.
+   */
+  void ApplyUpdateFused(Dtype rate);
+  /// @brief Moves the history of all the params to one buffer, in the
+  ///        order of history_.
+  void FlattenHistory();
+  /// @brief The gradient of value i of param once clipped, normalized and
+  ///        regularized, computed as the separate passes do.
+  inline Dtype FusedGradient(const FusedParam& param, int i) const {
+    Dtype gradient = param.diff[i] * fused_clip_scale_;
+    gradient *= fused_normalization_;
+    if (param.local_decay) {
+      gradient += param.local_decay * (fused_l1_ ?
+          Dtype(caffe_sign(param.data[i])) : param.data[i]);
+    }
+    return gradient;
+  }
+  /**
+   * @brief The fused counterpart of ComputeUpdateValue on CPU, for values
+   *        [begin, end) of param: computes the update from FusedGradient and
+   *        the history, writes it to the diff and subtracts it from the data.
+   */
+  virtual void ComputeUpdateValueFused(const FusedParam& param, int begin,
+      int end);
+
   virtual void SnapshotSolverState(const string& model_filename);
+  virtual void SolverStateToProto(const string& model_filename,
+      SolverState* state);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
+  virtual void RestoreSolverStateFromProto(const SolverState& state);
   // history maintains the historical momentum data.
   // update maintains update related data and is not needed in snapshots.
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // The memory of history_ once flattened.
+  shared_ptr<SyncedMemory> history_flat_;
+  // The gradient scales and regularization of the current fused update.
+  Dtype fused_clip_scale_;
+  Dtype fused_normalization_;
+  bool fused_l1_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +110,8 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueFused(
+      const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +127,8 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueFused(
+      const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +149,8 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueFused(
+      const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +175,8 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueFused(
+      const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +201,8 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueFused(
+      const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
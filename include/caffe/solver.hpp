@@ -31,6 +31,8 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+class OrderedWorker;
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -61,12 +63,19 @@ class Solver {
   // RestoreSolverStateFrom___ protected methods. You should implement these
   // methods to restore the state from the appropriate snapshot type.
   void Restore(const char* resume_file);
+  // Copies the iteration, the learning rate step and the history of the
+  // solver, without the weights, e.g. for other solvers to continue in step.
+  void GetState(SolverState* state);
+  void SetState(const SolverState& state);
   // The Solver::Snapshot function implements the basic snapshotting utility
   // that stores the learned net. You should implement the SnapshotSolverState()
   // function that produces a SolverState protocol buffer that needs to be
-  // written to disk together with the learned net.
+  // written to disk together with the learned net. With async_snapshot, it
+  // only copies them, waiting for room among the max_pending_snapshots.
   void Snapshot();
-  virtual ~Solver() {}
+  // Waits for the asynchronous snapshots to be written.
+  void WaitForSnapshots();
+  virtual ~Solver();
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
@@ -101,12 +110,27 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  string SnapshotToMapped();
+  // Copies the net and the solver state for the snapshot writer. Returns
+  // false without a copy if max_pending_snapshots are being written and wait
+  // is false.
+  bool SnapshotAsync(bool wait);
+  // A snapshot requested by the client, which skips it rather than wait for
+  // the asynchronous ones.
+  void RequestedSnapshot();
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
+  // Fills state with the iteration, the learning rate step and the history
+  // of the solver, naming model_filename as its learned_net.
+  virtual void SolverStateToProto(const string& model_filename,
+      SolverState* state);
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
+  // Restores the state filled by SolverStateToProto, and the weights from
+  // its learned_net if it has one.
+  virtual void RestoreSolverStateFromProto(const SolverState& state);
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
 
@@ -130,6 +154,9 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes the asynchronous snapshots in order, started with the first one.
+  shared_ptr<OrderedWorker> snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -149,9 +176,15 @@ class WorkerSolver : public Solver<Dtype> {
   void SnapshotSolverState(const string& model_filename) {
     LOG(FATAL) << "Should not be called on worker solver.";
   }
+  void SolverStateToProto(const string& model_filename, SolverState* state) {
+    LOG(FATAL) << "Should not be called on worker solver.";
+  }
   void RestoreSolverStateFromBinaryProto(const string& state_file) {
     LOG(FATAL) << "Should not be called on worker solver.";
   }
+  void RestoreSolverStateFromProto(const SolverState& state) {
+    LOG(FATAL) << "Should not be called on worker solver.";
+  }
   void RestoreSolverStateFromHDF5(const string& state_file) {
     LOG(FATAL) << "Should not be called on worker solver.";
   }
@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_ACTIVATION_EPILOGUE_HPP_
+#define CAFFE_UTIL_ACTIVATION_EPILOGUE_HPP_
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief An elementwise activation layer applied by the layer producing its
+ *        bottom, while its output is still in cache, instead of by a pass
+ *        of its own. See Layer::FuseActivation.
+ *
+ * Computes the same values as the Forward_cpu of ReLULayer, PReLULayer and
+ * ELULayer.
+ */
+template <typename Dtype>
+class ActivationEpilogue {
+ public:
+  ActivationEpilogue() : type_(NONE), alpha_(0), channel_shared_(false) {}
+
+  /// @brief Returns false if activation is not a ReLU, PReLU or ELU layer.
+  bool Init(Layer<Dtype>* activation);
+  /// @brief Whether Apply should run: an activation is set and the layers
+  ///        run on the CPU, where the fused layer is skipped.
+  inline bool enabled() const {
+    return type_ != NONE && Caffe::mode() == Caffe::CPU;
+  }
+  /// @brief Whether the activation depends on the channel.
+  inline bool per_channel() const {
+    return type_ == PRELU && !channel_shared_;
+  }
+
+  /// @brief Applies the activation in place to count values of channel c.
+  void ApplyChannel(int c, int count, Dtype* data) const;
+  /// @brief Applies the activation in place to the channels x inner values
+  ///        of one item.
+  void Apply(int channels, int inner, Dtype* data) const;
+  /// @brief Applies the activation in place to a blob with its channels
+  ///        along axis 1.
+  void Apply(Blob<Dtype>* blob) const;
+
+ private:
+  enum Type { NONE, RELU, PRELU, ELU };
+  Type type_;
+  /// The ReLU negative slope or the ELU alpha.
+  Dtype alpha_;
+  /// The PReLU slopes, shared with the layer.
+  shared_ptr<Blob<Dtype> > slopes_;
+  bool channel_shared_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ACTIVATION_EPILOGUE_HPP_
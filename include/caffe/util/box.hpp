@@ -1,89 +1,208 @@
 #ifndef CAFFE_UTIL_BOX_H_
 #define CAFFE_UTIL_BOX_H_
-#include <map>
-#include <list>
+#include <utility>
+#include <vector>
 #include "caffe/blob.hpp"
 #include "caffe/proto/caffe.pb.h"
-using std::list;
+
 namespace caffe {
-	template  <typename Dtype>
-	class Box<Dtype>;
-	template  <typename Dtype>
-	class GTBox<Dtype>;
-	template <typename Dtype>
-	class DefBox<Dtype>;
-	template <typename Dtype>
-	class DRBox<Dtype>;
 
+	// Structure-of-arrays store for axis aligned N-D boxes.
+	// Coordinates are kept dimension-major: min_location(d)[i] is the lower
+	// corner of box i along axis d, so the overlap kernels sweep contiguous
+	// memory instead of chasing one pointer per coordinate.
 	template <typename Dtype>
-	struct Box {
-		vector<const Dtype*> min_location_;
-		vector<const Dtype*> max_location_;
+	class BoxSet {
+	public:
+		BoxSet() : box_dimensions_(0), size_(0) {}
+		// Resizes the store. The coordinates are left uninitialized.
+		void Reshape(const int box_dimensions, const int size);
+		// Recomputes the cached volumes after the coordinates were written.
+		void UpdateVolumes();
+
+		inline int box_dimensions() const { return box_dimensions_; }
+		inline int size() const { return size_; }
+		inline const Dtype* min_location(const int d) const {
+			return &min_location_[d * size_];
+		}
+		inline const Dtype* max_location(const int d) const {
+			return &max_location_[d * size_];
+		}
+		inline Dtype* mutable_min_location(const int d) {
+			return &min_location_[d * size_];
+		}
+		inline Dtype* mutable_max_location(const int d) {
+			return &max_location_[d * size_];
+		}
+		inline const Dtype* volumes() const { return &volumes_[0]; }
+
+	private:
+		int box_dimensions_;
+		int size_;
+		vector<Dtype> min_location_;
+		vector<Dtype> max_location_;
+		vector<Dtype> volumes_;
 	};
 
-	//Ground True Box
+	// Ground truth boxes of one image.
 	template <typename Dtype>
-	struct GTBox: public Box<Dtype>{
-		const Dtype *lable_;
-		map<const DefBox<Dtype> *, Dtype> def_boxes_;
+	struct GTBoxes {
+		BoxSet<Dtype> boxes;
+		vector<int> labels;
 	};
 
-	//Default Box
+	// Default (prior) boxes of all pyramid layers, concatenated.
 	template <typename Dtype>
-	struct DefBox : public Box<Dtype>{
-		map<const GTBox<Dtype> *, Dtype> gt_boxes_;
-		vector<const DRBox<Dtype>*> dr_boxes_;
-		vector<const Dtype*> min_variances_;
-		vector<const Dtype*> max_variances_;
+	struct DefBoxes {
+		BoxSet<Dtype> boxes;
+		// The variances share the layout of the boxes: min_location holds the
+		// variances of the lower corner and max_location the upper one.
+		BoxSet<Dtype> variances;
 	};
 
-	//Decation Result Box
+	// Predictions of one image, concatenated over all pyramid layers.
 	template <typename Dtype>
-	struct DRBox : public Box<Dtype>{
-		const DefBox<Dtype> *def_box_;
-		const Dtype* conf_;
+	struct PredBoxes {
+		// locations[loc_class]: one set if share_location, else one per class.
+		vector<BoxSet<Dtype> > locations;
+		// confidences[class_id * num_boxes + box_id]
+		vector<Dtype> confidences;
 	};
 
+	// Overlaps between the ground truth and the predicted boxes of one image,
+	// stored as a CSR matrix: row g holds the predictions that overlap ground
+	// truth g in pred_indices[row_offsets[g] .. row_offsets[g + 1]).
+	// Pairs without intersection are not stored.
+	template <typename Dtype>
+	struct BoxOverlaps {
+		int num_gt;
+		int num_pred;
+		vector<int> row_offsets;
+		vector<int> pred_indices;
+		vector<Dtype> values;
+	};
 
+	// Number of boxes described by a default box blob [2 x (2*D*K) x ...].
+	template <typename Dtype>
+	int CountDefBoxes(const Blob<Dtype> *def_location, const int box_dimensions);
 
+	//@input data:
+	//  label:    N x 1 x G1 x ... x Gm, labels < 0 mark padding.
+	//  location: N x 2D x G1 x ... x Gm, Min1 ... MinD Max1 ... MaxD.
+	//@return data:
+	//  boxes[image_id]
 	template <typename Dtype>
 	void ExtractGroundTruth(const Blob<Dtype> *label, const Blob<Dtype> *location,
-		const int box_dimensions, vector<vector<GTBox<Dtype>>> &boxes);
+		const int box_dimensions, vector<GTBoxes<Dtype> > &boxes);
+
+	//@input data:
+	//  def_location: 2 x (K1 K2 ... KN) x S1 x ... x SD, [0] boxes, [1] variances.
+	//  Each Ki is 2D channels: Min1 ... MinD Max1 ... MaxD.
+	//  Box id of kind k at spatial position s is s*K + k.
+	//  Boxes are written starting at offset.
+	template <typename Dtype>
+	void ExtractDefBoxes(const Blob<Dtype> *def_location, const int box_dimensions,
+		const int offset, DefBoxes<Dtype> &def_boxes);
 
 	//@input data:
 	//  if shared_location is true, the class_id = 0;
-	//  def_location: K1 K2 ... KN
-	//  pred_location: 
+	//  pred_location:
 	//    share_location = true:  K1 K2 ... KN.
 	//    share_location = false: K1C1 K1C2 ... K1CN K2C1 K2C2 ... K3CN ...... KMC1 KMC2 ... KMCM.
 	//  pred_confidence: K1C1 K1C2 ... K1CN K2C1 K2C2 ... K3CN ...... KMC1 KMC2 ... KMCM.
+	//  Boxes are written starting at offset, the sets must already be sized
+	//  for all pyramid layers (see ReshapePredBoxes).
 	//@return data:
-	// dr_boxes[image_id][class_id][box_id]
+	// pred_boxes[image_id]
 	template <typename Dtype>
-	void ExtractPredBoxes(const Blob<Dtype> *def_location, const Blob<Dtype> *pred_location,
+	void ExtractPredBoxes(const Blob<Dtype> *pred_location,
 		const Blob<Dtype> *pred_confidence, const int box_dimensions,
-		const bool share_location, const int num_classes, int &num,
-		vector<vector<DefBox<Dtype>>> &def_boxes,
-		vector<vector<vector<DRBox<Dtype>>>> &dr_boxes);
+		const bool share_location, const int num_classes, const int offset,
+		vector<PredBoxes<Dtype> > &pred_boxes);
 
 	template <typename Dtype>
-	Dtype JaccardOverlap(const Box<Dtype> *box1, const Box<Dtype> *box2);
+	void ReshapePredBoxes(const int num, const int box_dimensions,
+		const bool share_location, const int num_classes, const int num_boxes,
+		vector<PredBoxes<Dtype> > &pred_boxes);
 
+	// Inverse of ExtractPredBoxes: writes the gradients held in pred_diffs into
+	// the diffs of pred_location and pred_confidence.
+	template <typename Dtype>
+	void ScatterPredDiffs(const vector<PredBoxes<Dtype> > &pred_diffs,
+		const int box_dimensions, const bool share_location, const int num_classes,
+		const int offset, Blob<Dtype> *pred_location, Blob<Dtype> *pred_confidence);
+
+	// Corner encoding of a ground truth box against a default box:
+	//   code[d]     = (gt_min[d] - def_min[d]) / (def_extent[d] * min_variance[d])
+	//   code[D + d] = (gt_max[d] - def_max[d]) / (def_extent[d] * max_variance[d])
+	template <typename Dtype>
+	void EncodeBox(const BoxSet<Dtype> &gt_boxes, const int gt_index,
+		const DefBoxes<Dtype> &def_boxes, const int def_index, Dtype *code);
 
+	// Inverse of EncodeBox for all the boxes: decodes the location predictions
+	// codes against the default boxes into boxes, whose volumes are updated.
 	template <typename Dtype>
-	void JaccardOverlaps(const vector<Box<Dtype>> *gt_boxes, const vector<vector<Box<Dtype>>> *pred_boxes,
-		const MultiBoxLossParameter_MatchType match_type, const bool share_location, const int background_label,
-		vector<map<int, map<const Box<Dtype> *, map<const Box<Dtype>*, Dtype>>>> &overlaps);
-	
+	void DecodeBoxes(const DefBoxes<Dtype> &def_boxes, const BoxSet<Dtype> &codes,
+		BoxSet<Dtype> &boxes);
+
 	template <typename Dtype>
-	void MathBoxes(const vector<map<int, map<const Box<Dtype> *, map<const Box<Dtype>*, Dtype>>>> *overlaps,
+	Dtype JaccardOverlap(const BoxSet<Dtype> &boxes1, const int index1,
+		const BoxSet<Dtype> &boxes2, const int index2);
+
+	// Vectorized kernel: overlaps[j] = IoU(boxes1[index1], boxes2[j]) for all j.
+	template <typename Dtype>
+	void JaccardOverlaps(const BoxSet<Dtype> &boxes1, const int index1,
+		const BoxSet<Dtype> &boxes2, Dtype *overlaps);
+
+	// SSE path for 2-D float boxes.
+	template <>
+	void JaccardOverlaps(const BoxSet<float> &boxes1, const int index1,
+		const BoxSet<float> &boxes2, float *overlaps);
+
+	// Overlaps of every ground truth with a label in [0, num_classes) and not
+	// equal to background_label against the predictions. If label_filter >= 0
+	// only the ground truth with that label take part (per class matching).
+	template <typename Dtype>
+	void JaccardOverlaps(const GTBoxes<Dtype> &gt_boxes, const BoxSet<Dtype> &pred_boxes,
+		const int background_label, const int label_filter,
+		BoxOverlaps<Dtype> &overlaps);
+
+	//@return data:
+	//  match_indices[pred_id]: matched ground truth or -1.
+	//  match_overlaps[pred_id]: overlap with the matched ground truth.
+	template <typename Dtype>
+	void MatchBoxes(const BoxOverlaps<Dtype> &overlaps,
 		const MultiBoxLossParameter_MatchType match_type, const float overlap_threshold,
-		map<const Box<Dtype> *, const Box<Dtype> *> &match_boxes);
+		vector<int> &match_indices, vector<Dtype> &match_overlaps);
 
+	// Maximum overlap of every prediction against any ground truth.
+	template <typename Dtype>
+	void MaxOverlaps(const BoxOverlaps<Dtype> &overlaps, vector<Dtype> &max_overlaps);
+
+	//@return data:
+	//  negatives: (confidence, box_id) of the predictions that are not matched,
+	//    overlap every ground truth less than overlap_threshold and whose most
+	//    confident class is not the background, most confident first.
+	template <typename Dtype>
+	void ExtractNegativeBoxes(const PredBoxes<Dtype> &pred_boxes, const int num_classes,
+		const int background_label, const vector<int> &match_indices,
+		const vector<Dtype> &max_overlaps, const float overlap_threshold,
+		vector<pair<Dtype, int> > &negatives);
+
+	// Keeps the num_negatives most confident entries of negatives, in order.
+	template <typename Dtype>
+	void SelectHardNegatives(const int num_negatives, vector<pair<Dtype, int> > &negatives);
+
+	// Greedy non-maximum suppression of the boxes scoring above score_threshold.
+	// Only the top_k most confident ones (all if top_k < 0), selected with a
+	// heap, are considered.
+	//@return data:
+	//  indices: the boxes kept, most confident first. A box is dropped if it
+	//    overlaps a more confident kept box by more than nms_threshold.
 	template <typename Dtype>
-	void ExtractNegtiveBox(const vector<vector<Box<Dtype>>> *pred_boxes,
-		const bool share_location, const int background_label,
-		list<pair<const int, const Box<Dtype> *>> &negatives);
+	void ApplyNMS(const BoxSet<Dtype> &boxes, const Dtype *scores,
+		const float score_threshold, const float nms_threshold, const int top_k,
+		vector<int> &indices);
 
 }
-#endif
\ No newline at end of file
+#endif
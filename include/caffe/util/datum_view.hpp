@@ -0,0 +1,58 @@
+#ifndef CAFFE_UTIL_DATUM_VIEW_HPP_
+#define CAFFE_UTIL_DATUM_VIEW_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A read-only Datum whose data and label bytes are not copied.
+ *
+ * Parse decodes the protobuf wire format directly: the shapes are copied and
+ * the bytes fields point into the serialized buffer, e.g. a value in the
+ * memory map of an LMDB read transaction.
+ */
+class DatumView {
+ public:
+  DatumView() { Clear(); }
+
+  /**
+   * @brief Decodes a serialized Datum in place. buffer must outlive the view.
+   *        Returns false if buffer is not a valid Datum.
+   */
+  bool Parse(const char* buffer, size_t size);
+  /// @brief Takes the contents of buffer and decodes them in place, for
+  ///        values that do not outlive the view.
+  bool ParseOwned(string* buffer);
+  /// @brief Points at the fields of datum, which must outlive the view.
+  void Reset(const Datum& datum);
+
+  const DatumShape& data_shape() const { return data_shape_; }
+  const DatumShape& label_shape() const { return label_shape_; }
+  const char* data() const { return data_; }
+  size_t data_size() const { return data_size_; }
+  const char* label() const { return label_; }
+  size_t label_size() const { return label_size_; }
+  bool encoded() const { return encoded_; }
+
+ protected:
+  void Clear();
+
+  DatumShape data_shape_;
+  DatumShape label_shape_;
+  const char* data_;
+  size_t data_size_;
+  const char* label_;
+  size_t label_size_;
+  bool encoded_;
+  string buffer_;
+
+  DISABLE_COPY_AND_ASSIGN(DatumView);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATUM_VIEW_HPP_
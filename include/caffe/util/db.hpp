@@ -18,6 +18,14 @@ class Cursor {
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  /**
+   * @brief Points data at the current value without copying it, if the
+   *        backend keeps values valid for the lifetime of the cursor.
+   *        Returns false otherwise; value() must then be used.
+   */
+  virtual bool value_in_place(const char** data, size_t* size) {
+    return false;
+  }
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
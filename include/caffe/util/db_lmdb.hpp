@@ -34,6 +34,13 @@ class LMDBCursor : public Cursor {
     return string(static_cast<const char*>(mdb_value_.mv_data),
         mdb_value_.mv_size);
   }
+  // Values live in the memory map, which the read-only transaction of the
+  // cursor keeps valid until it is aborted.
+  virtual bool value_in_place(const char** data, size_t* size) {
+    *data = static_cast<const char*>(mdb_value_.mv_data);
+    *size = mdb_value_.mv_size;
+    return true;
+  }
   virtual bool valid() { return valid_; }
 
  private:
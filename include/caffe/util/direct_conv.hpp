@@ -0,0 +1,44 @@
+#ifndef _CAFFE_UTIL_DIRECT_CONV_HPP_
+#define _CAFFE_UTIL_DIRECT_CONV_HPP_
+
+namespace caffe {
+
+/**
+ * @brief Direct 2D convolution of num images, without unrolling the input.
+ *        Meant for grouped and depthwise convolutions, whose per-group
+ *        matrix products are too small for im2col + gemm to pay off.
+ *
+ * Weights are num_output x (channels / group) x kernel_h x kernel_w as in
+ * ConvolutionLayer, bias is NULL or has num_output entries. The output is
+ * overwritten.
+ */
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* data_im, const int num, const int channels,
+    const int height, const int width, const Dtype* weights, const Dtype* bias,
+    const int num_output, const int group, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_out);
+
+/// @brief Gradient of direct_conv_cpu w.r.t. its input, overwriting diff_im.
+template <typename Dtype>
+void direct_conv_backward_data_cpu(const Dtype* diff_out, const int num,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* diff_im);
+
+/// @brief Gradient of direct_conv_cpu w.r.t. its weights, accumulated into
+///        diff_weights.
+template <typename Dtype>
+void direct_conv_backward_weights_cpu(const Dtype* data_im,
+    const Dtype* diff_out, const int num, const int channels,
+    const int height, const int width, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* diff_weights);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_DIRECT_CONV_HPP_
@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Keeps freed host memory for the next allocations of the same size
+ *        class, behind CaffeMallocHost and CaffeFreeHost.
+ *
+ * Sizes are rounded up to powers of two, from 64 bytes to 64 MB, and
+ * memory is 64-byte aligned; blocks of 2 MB and up are aligned to huge
+ * pages, which Linux is advised to back them with. Larger allocations go
+ * straight to the system. Each thread keeps a few blocks of the classes up
+ * to 1 MB without locking; the other freed blocks go to free lists shared
+ * by the threads of the same NUMA node, see BindThreadToNumaNode, so that
+ * memory is reused on the node it was placed on. Blocks remember the node
+ * of the thread that allocated them from the system, and return to its
+ * lists whichever thread frees them. Freed blocks are returned
+ * to the system instead once the cache holds cache_limit() bytes.
+ */
+class HostAllocator {
+ public:
+  // The allocator used by CaffeMallocHost and CaffeFreeHost.
+  static HostAllocator& Global();
+
+  void* Allocate(size_t size);
+  // size must be the size ptr was allocated with.
+  void Free(void* ptr, size_t size);
+  // Returns the blocks of the shared free lists and of the calling thread to
+  // the system. Blocks cached by other threads stay with them.
+  void ReleaseCachedMemory();
+
+  // 0 disables the cache. Lowering the limit releases cached memory.
+  void set_cache_limit(size_t bytes);
+  size_t cache_limit() const;
+
+  // The bytes of the blocks allocated and not freed, and of the blocks
+  // cached for reuse.
+  size_t bytes_in_use() const;
+  size_t bytes_cached() const;
+  // Allocations served from the cache, and from the system.
+  uint64_t hits() const;
+  uint64_t misses() const;
+  float hit_rate() const;
+
+ protected:
+  HostAllocator();
+
+  struct ThreadCache;
+  // Moves synchronization fields out of the header, see BlockingQueue.
+  class sync;
+
+  // The blocks cached by the calling thread, created on first use.
+  ThreadCache* thread_cache();
+  // The shared free lists of a NUMA node, plus 1, or 0 for the threads bound
+  // to none, by size class, called with the lock held.
+  vector<vector<void*> >& shared_free_lists(int slot);
+  // Caches a block of size class cls in the shared free lists, or frees it.
+  void FreeShared(void* ptr, int cls);
+
+  shared_ptr<sync> sync_;
+  // The shared free lists, by NUMA node, unbound threads first, and size
+  // class.
+  vector<vector<vector<void*> > > free_lists_;
+
+  DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
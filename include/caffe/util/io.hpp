@@ -10,6 +10,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
 #include "caffe/util/format.hpp"
 
 #ifndef CAFFE_TMP_DIR_RETRIES
@@ -109,6 +110,11 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Moves the complete file temp_filename over filename, which readers then
+// find whole or not at all. On POSIX systems, processes mapping the old
+// file keep its contents; Windows fails to replace a mapped file.
+void RenameFileOver(const string& temp_filename, const string& filename);
+
 bool ReadFileToDatum(const string& filename, const std::vector<char>& label, Datum* datum, 
 	DatumShape::DataDepth label_depth = DatumShape::DEPTH_32S);
 
@@ -236,6 +242,8 @@ cv::Mat ReadImageToCVMat(const string& filename);
 
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
+cv::Mat DecodeDatumToCVMatNative(const DatumView& datum);
+cv::Mat DecodeDatumToCVMat(const DatumView& datum, bool is_color);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum, bool is_label = false);
 #endif  // USE_OPENCV
@@ -0,0 +1,65 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+
+#include <string>
+
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A weights file that blobs can use in place once it is mapped into
+ *        memory, instead of parsing and copying a NetParameter.
+ *
+ * The file starts with a MappedWeightsHeader, followed by the raw values of
+ * every blob, each starting at a multiple of kMappedWeightsAlignment bytes,
+ * and ends with a serialized MappedWeightsIndex giving the shape and offset
+ * of the blobs of every layer. Values are stored in the byte order of the
+ * machine writing the file.
+ */
+const size_t kMappedWeightsAlignment = 64;
+
+struct MappedWeightsHeader {
+  char magic[8];  // "CAFFEMAP"
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t index_offset;
+  uint64_t index_size;
+};
+
+/// @brief Writes the blobs of the layers of param as a mapped weights file,
+///        through filename.tmp renamed over filename once complete.
+void WriteMappedWeights(const NetParameter& param, const string& filename);
+
+/// @brief Whether filename names a mapped weights file, by its extension.
+bool IsMappedWeightsFile(const string& filename);
+
+/**
+ * @brief Maps a weights file copy-on-write: the pages are read lazily and
+ *        shared with the page cache, and with other processes mapping the
+ *        file, until a blob using them is written.
+ */
+class MappedWeights {
+ public:
+  explicit MappedWeights(const string& filename);
+
+  inline const MappedWeightsIndex& index() const { return index_; }
+  /// @brief The values of a blob of the index.
+  void* data(const MappedWeightsIndex_Blob& blob);
+
+ private:
+  string filename_;
+  boost::interprocess::file_mapping file_;
+  boost::interprocess::mapped_region region_;
+  MappedWeightsIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
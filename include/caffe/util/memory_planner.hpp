@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_MEMORY_PLANNER_HPP_
+#define CAFFE_UTIL_MEMORY_PLANNER_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Packs buffers with known lifetimes into as little memory as
+ *        possible.
+ *
+ * Buffers are live from step begin to step end, both included. Plan() walks
+ * the buffers in order of their first step and puts each one into a slab no
+ * live buffer uses: the smallest free slab large enough, or else the largest
+ * free slab grown to fit, or else a new slab.
+ */
+class MemoryPlanner {
+ public:
+  MemoryPlanner() {}
+
+  // Returns the id of the new buffer.
+  int AddBuffer(size_t size, int begin, int end);
+  void Plan();
+
+  inline int num_buffers() const { return buffers_.size(); }
+  inline int num_slabs() const { return slab_sizes_.size(); }
+  // Valid after Plan().
+  inline int slab(int buffer) const { return buffers_[buffer].slab; }
+  inline size_t slab_size(int slab) const { return slab_sizes_[slab]; }
+
+  // The memory taken by the buffers on their own.
+  size_t buffer_bytes() const;
+  // The memory taken by the slabs.
+  size_t slab_bytes() const;
+
+ protected:
+  struct Buffer {
+    size_t size;
+    int begin;
+    int end;
+    int slab;
+  };
+
+  vector<Buffer> buffers_;
+  vector<size_t> slab_sizes_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryPlanner);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MEMORY_PLANNER_HPP_
@@ -0,0 +1,24 @@
+#ifndef CAFFE_UTIL_NET_OPTIMIZER_HPP_
+#define CAFFE_UTIL_NET_OPTIMIZER_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Folds the BatchNorm layers using global statistics, and the Scale
+ *        and Bias layers, that directly follow a Convolution or InnerProduct
+ *        layer into its weights and bias.
+ *
+ * param is a filtered net definition holding the trained blobs of its
+ * layers. folded gets the same net without the folded layers, the producing
+ * layer writing the top of the last layer folded into it. Only chains of
+ * consecutive single bottom, single top layers are folded, and only when no
+ * other layer reads their intermediate tops. Every fusion is logged. Returns
+ * the number of layers folded.
+ */
+int FoldBatchNorm(const NetParameter& param, NetParameter* folded);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NET_OPTIMIZER_HPP_
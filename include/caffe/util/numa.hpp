@@ -0,0 +1,41 @@
+#ifndef CAFFE_UTIL_NUMA_HPP_
+#define CAFFE_UTIL_NUMA_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief How the nets of a model are spread over the NUMA nodes of a
+ *        multi-socket host.
+ *
+ * NUMA_BIND binds the threads running the nets, and the ThreadPool workers
+ * they use, to the nodes in turn, so that the activations they first touch
+ * live on their node. NUMA_REPLICATE also gives each node its own copy of
+ * the weights.
+ */
+enum NumaPlacement { NUMA_NONE, NUMA_BIND, NUMA_REPLICATE };
+
+// Parses "none", "bind" or "replicate".
+NumaPlacement NumaPlacementFromString(const string& placement);
+
+// The number of NUMA nodes, 1 where they cannot be told apart.
+int NumaNodeCount();
+// The CPUs of a node.
+vector<int> NumaNodeCpus(int node);
+
+// Runs the calling thread on the CPUs of node, and allocates the memory it
+// first touches there. Returns false if the system does not support it.
+bool BindThreadToNumaNode(int node);
+// The node the calling thread was bound to, or -1.
+int NumaNodeOfThread();
+
+// Describes the nodes and their CPUs, e.g. "2 nodes: 0 [0-15] 1 [16-31]".
+string NumaTopologyString();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NUMA_HPP_
@@ -0,0 +1,58 @@
+#ifndef CAFFE_UTIL_ORDERED_WORKER_HPP_
+#define CAFFE_UTIL_ORDERED_WORKER_HPP_
+
+#include <boost/function.hpp>
+
+#include <deque>
+
+#include "caffe/common.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A background thread running tasks one at a time, in the order they
+ *        were pushed.
+ *
+ * The caller can bound the tasks in flight by taking a slot with Reserve()
+ * before each Push(), for instance to bound the memory the tasks hold.
+ */
+class OrderedWorker {
+ public:
+  // max_pending bounds the tasks reserved, queued or running for Reserve(),
+  // 0 for no bound.
+  explicit OrderedWorker(int max_pending = 0);
+  // Runs the tasks queued so far, then stops the thread.
+  ~OrderedWorker();
+
+  // Takes a slot for the next Push, waiting for one if wait, otherwise
+  // returning false if there is none.
+  bool Reserve(bool wait);
+  // Queues task, in the slot taken by the last Reserve if there is one.
+  void Push(const boost::function<void()>& task);
+  // Waits for the tasks queued so far.
+  void Flush();
+
+ protected:
+  // Moves synchronization fields out of the header, see BlockingQueue.
+  class sync;
+
+  void Entry();
+
+  const int max_pending_;
+  // Slots taken by Reserve and not pushed yet.
+  int reserved_;
+  // Tasks queued or running.
+  int pending_;
+  bool must_stop_;
+  std::deque<boost::function<void()> > tasks_;
+  shared_ptr<sync> sync_;
+  shared_ptr<boost::thread> thread_;
+
+  DISABLE_COPY_AND_ASSIGN(OrderedWorker);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ORDERED_WORKER_HPP_
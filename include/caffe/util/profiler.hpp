@@ -0,0 +1,129 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/// @brief Estimated work of one pass of a layer.
+struct LayerCost {
+  LayerCost() : flops(0), bytes_read(0), bytes_written(0) {}
+
+  double flops;
+  double bytes_read;
+  double bytes_written;
+};
+
+/**
+ * @brief Estimates the forward pass of a layer: FLOPs for Convolution,
+ *        Deconvolution, InnerProduct and Pooling layers (zero for the others),
+ *        bytes of the bottoms and parameters read and of the tops written.
+ */
+template <typename Dtype>
+LayerCost EstimateForwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+/**
+ * @brief Estimates the backward pass of a layer: the gradients of the data
+ *        and of the parameters each cost as much as the forward pass for the
+ *        layers with FLOPs, the top diffs, bottom data and parameters are read
+ *        and the bottom and parameter diffs written.
+ */
+template <typename Dtype>
+LayerCost EstimateBackwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down);
+
+/// @brief The p-th percentile (0 to 100) of samples, interpolating linearly
+///        between the closest ranks.
+double Percentile(vector<double> samples, double p);
+
+/// @brief Throughput of the machine in the current Caffe mode.
+struct MachinePeak {
+  MachinePeak() : gflops(0), gbytes_per_second(0) {}
+
+  double gflops;
+  double gbytes_per_second;
+};
+
+/**
+ * @brief Measures the peak of the machine with a large single precision gemm
+ *        and a large copy, taking the best of a few repetitions.
+ */
+MachinePeak MeasureMachinePeak();
+
+/// @brief Timings and estimated costs of one layer of a profiled net.
+struct LayerProfile {
+  string name;
+  string type;
+  vector<string> bottom_names;
+  vector<double> bottom_bytes;
+  vector<string> top_names;
+  vector<double> top_bytes;
+  double param_bytes;
+  LayerCost forward_cost;
+  LayerCost backward_cost;
+  /// One sample per iteration, in microseconds.
+  vector<double> forward_us;
+  vector<double> backward_us;
+};
+
+/**
+ * @brief Times a net layer by layer over iterations of forward and backward
+ *        passes, and reports per layer percentiles, estimated FLOPs and bytes
+ *        and the achieved rates against a MachinePeak, as JSON or as a Chrome
+ *        trace (chrome://tracing).
+ */
+template <typename Dtype>
+class NetProfiler {
+ public:
+  explicit NetProfiler(Net<Dtype>* net);
+
+  /// @brief Runs and times iterations, adding to the previous samples.
+  void Run(int iterations);
+  void set_peak(const MachinePeak& peak) { peak_ = peak; has_peak_ = true; }
+
+  const vector<LayerProfile>& layers() const { return layers_; }
+  /// The forward and backward time of each iteration, in microseconds.
+  const vector<double>& forward_us() const { return forward_us_; }
+  const vector<double>& backward_us() const { return backward_us_; }
+
+  /// @brief Logs the percentiles and rates of each layer.
+  void LogSummary() const;
+  void WriteJson(std::ostream* out) const;
+  void WriteChromeTrace(std::ostream* out) const;
+
+ protected:
+  struct TraceEvent {
+    int layer;
+    int iteration;
+    bool backward;
+    double start_us;
+    double duration_us;
+  };
+
+  void WritePass(std::ostream* out, const LayerCost& cost,
+      const vector<double>& samples) const;
+
+  Net<Dtype>* net_;
+  vector<LayerProfile> layers_;
+  vector<double> forward_us_;
+  vector<double> backward_us_;
+  vector<TraceEvent> events_;
+  double clock_us_;
+  MachinePeak peak_;
+  bool has_peak_;
+
+  DISABLE_COPY_AND_ASSIGN(NetProfiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
@@ -0,0 +1,126 @@
+#ifndef CAFFE_UTIL_QUANTIZATION_HPP_
+#define CAFFE_UTIL_QUANTIZATION_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+template <typename Dtype> class Net;
+
+/**
+ * @brief Quantizes count values to int8 as round(x * scale), saturated to
+ *        [-127, 127].
+ */
+template <typename Dtype>
+void quantize_cpu(const int count, const Dtype* data, const float scale,
+    int8_t* quantized);
+
+/**
+ * @brief Quantizes a rows x cols matrix, each row with the scale mapping its
+ *        largest magnitude to 127, stored in scales. A transposed matrix is
+ *        read cols x rows, and written rows x cols.
+ */
+template <typename Dtype>
+void quantize_rows_cpu(const int rows, const int cols, const Dtype* data,
+    const bool transposed, int8_t* quantized, float* scales);
+
+/**
+ * @brief Quantizes channels x spatial_dim values as quantize_cpu, writing
+ *        them channels last: spatial_dim x channels.
+ */
+template <typename Dtype>
+void quantize_channels_last_cpu(const int channels, const int spatial_dim,
+    const Dtype* data, const float scale, int8_t* quantized);
+
+/**
+ * @brief Unrolls the patches of the 2D convolution of one quantized image,
+ *        stored channels last (height x width x channels), as the rows of
+ *        data_row: one row per output pixel, holding for each of the group
+ *        groups kernel_h x kernel_w x channels / group values, padded
+ *        with 0.
+ */
+void im2row_s8_cpu(const int8_t* data_im, const int channels, const int group,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, int8_t* data_row);
+
+/**
+ * @brief C = A B^T for int8 A (M x K) and B (N x K), accumulated in int32.
+ *        lda, ldb and ldc are the row strides of A, B and C.
+ *
+ * Runs the SSE2, AVX2 or AVX-512 VNNI kernel the processor supports, all of
+ * them exact.
+ */
+void gemm_s8_cpu(const int M, const int N, const int K, const int8_t* A,
+    const int lda, const int8_t* B, const int ldb, int32_t* C, const int ldc);
+
+/**
+ * @brief The int8 weights of a layer with their per output channel scales,
+ *        quantized from its floating point weights when they are first used,
+ *        and again after they change.
+ */
+template <typename Dtype>
+class Int8Weights {
+ public:
+  Int8Weights() : version_(0) {}
+
+  /// @brief Quantizes the rows x cols weights one output channel (row) at a
+  ///        time, unless they were quantized already and have not been
+  ///        written since, as their SyncedMemory::version tells: copying
+  ///        or sharing trained layers and solver updates all quantize again.
+  ///        Rows of cols / kernel_size channels of kernel_size values are
+  ///        stored kernel_size x channels, the order of im2row_s8_cpu.
+  void Update(const Blob<Dtype>& weights, const int rows, const int cols,
+      const bool transposed, const int kernel_size = 1);
+  /// @brief Drops the int8 weights, so that the next Update quantizes again.
+  void Clear();
+
+  inline const int8_t* data() const { return &data_[0]; }
+  inline const float* scales() const { return &scales_[0]; }
+
+ private:
+  uint64_t version_;
+  vector<int8_t> data_;
+  vector<float> scales_;
+};
+
+/**
+ * @brief Measures the range of every blob of a net over the batches it runs,
+ *        for Net::Quantize.
+ *
+ * Call Observe after each Forward of the net. Blobs are read once Forward
+ * is done, so the net must not share activation memory (optimize_memory),
+ * and in-place layers are measured by the last value of their blob, the one
+ * the layers after them read. The tops of Split layers are the blobs they
+ * copy and are left out.
+ */
+template <typename Dtype>
+class QuantizationCalibrator {
+ public:
+  explicit QuantizationCalibrator(const Net<Dtype>& net);
+
+  /// @brief Widens the ranges to the current values of the blobs.
+  void Observe();
+  /// @brief Writes the ranges measured so far.
+  void ToProto(QuantizationTable* table) const;
+
+ private:
+  vector<string> names_;
+  vector<const Blob<Dtype>*> blobs_;
+  vector<float> min_;
+  vector<float> max_;
+  int iterations_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizationCalibrator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZATION_HPP_
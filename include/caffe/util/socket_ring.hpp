@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_SOCKET_RING_HPP_
+#define CAFFE_UTIL_SOCKET_RING_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Connects processes in a ring of sockets, each rank to the next one,
+ *        to sum buffers across them, e.g. their gradients.
+ *
+ * Endpoints are tcp:<address>:<port> or unix:<path>. Rank r listens on
+ * endpoints[r], connects to rank r + 1 and accepts rank r - 1, modulo the
+ * world size, waiting for the other ranks to start.
+ *
+ * AllReduce runs the ring algorithm: the buffer is split into a segment per
+ * rank, which the ranks reduce-scatter then all-gather in world size - 1
+ * steps each, so that every rank sends and receives about twice the buffer
+ * whatever the world size. Segments travel in chunks of chunk_bytes, each
+ * forwarded as soon as it is received and summed, while a sender thread
+ * writes out the previous ones: sending, receiving and summing overlap.
+ */
+class SocketRing {
+ public:
+  SocketRing(const vector<string>& endpoints, int rank,
+      size_t chunk_bytes = 256 << 10);
+  ~SocketRing();
+
+  /// @brief The endpoints of world_size ranks, from a list of one per rank
+  ///        separated by ',', or from a single one, rank r then using
+  ///        port + r or path.r.
+  static vector<string> Endpoints(const string& spec, int world_size);
+
+  inline int rank() const { return rank_; }
+  inline int world_size() const { return world_size_; }
+
+  /// @brief Replaces data with its sum over the ranks, which all call it
+  ///        with the same count.
+  template <typename Dtype>
+  void AllReduce(Dtype* data, size_t count);
+  /// @brief Replaces data with the one of rank root. Dtype is float, double,
+  ///        char or uint64_t.
+  template <typename Dtype>
+  void Broadcast(Dtype* data, size_t count, int root);
+
+ protected:
+  // Moves the sockets and the sender thread out of the header.
+  class sync;
+
+  const int rank_;
+  const int world_size_;
+  const size_t chunk_bytes_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(SocketRing);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SOCKET_RING_HPP_
@@ -0,0 +1,52 @@
+#ifndef CAFFE_UTIL_TASK_GRAPH_HPP_
+#define CAFFE_UTIL_TASK_GRAPH_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A set of tasks with dependencies between them, run on a ThreadPool.
+ *
+ * Run() starts one lane per pool thread. A lane pushes the tasks made ready
+ * by its own tasks onto its deque and works from the back of it; an idle lane
+ * steals from the front of the others, so a chain of dependent tasks tends to
+ * stay on one thread while independent branches spread out.
+ */
+class TaskGraph {
+ public:
+  typedef boost::function<void(int)> TaskFunction;
+
+  explicit TaskGraph(int num_tasks);
+
+  inline int num_tasks() const { return successors_.size(); }
+
+  // Task after starts only once task before has finished, before < after.
+  void AddDependency(int before, int after);
+  // Runs task on the thread calling Run(), e.g. because it uses the calling
+  // thread's Caffe state.
+  void PinToCaller(int task);
+
+  // Calls func(task) once for every task and returns when all are done.
+  void Run(ThreadPool* pool, const TaskFunction& func) const;
+
+ protected:
+  struct State;
+
+  void RunLane(State* state, int lane, const TaskFunction& func) const;
+
+  vector<vector<int> > successors_;
+  vector<int> num_predecessors_;
+  vector<bool> pinned_;
+
+  DISABLE_COPY_AND_ASSIGN(TaskGraph);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TASK_GRAPH_HPP_
@@ -0,0 +1,73 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads splitting index ranges between them.
+ *
+ * Run() hands out chunks of [0, count) to the workers and to the calling
+ * thread, and returns once every chunk has been processed. Several threads
+ * may call Run() at the same time and Run() may be nested; a caller always
+ * works on its own job while it waits, so neither case can deadlock.
+ */
+class ThreadPool {
+ public:
+  typedef boost::function<void(int, int)> RangeFunction;
+
+  // num_threads counts the calling thread, so num_threads - 1 workers are
+  // started. A pool of one thread runs everything on the caller. Workers
+  // bind themselves to numa_node, unless it is -1.
+  explicit ThreadPool(int num_threads, int numa_node = -1);
+  ~ThreadPool();
+
+  inline int num_threads() const { return num_threads_; }
+
+  // Calls func(begin, end) on disjoint chunks covering [0, count). Chunks
+  // hold at least grain indices.
+  void Run(int count, const RangeFunction& func, int grain = 1);
+
+  // The pool shared by the CPU layers. Its size defaults to the number of
+  // hardware threads. Threads bound to a NUMA node share a pool of their
+  // node instead, with a worker per CPU of the node.
+  static ThreadPool& Global();
+  // Resizes the global pool, 0 picks the number of hardware threads, and
+  // drops the pools of the NUMA nodes. Must not be called while these pools
+  // are running jobs.
+  static void SetGlobalThreads(int num_threads);
+
+ protected:
+  struct Job;
+  // Moves synchronization fields out of the header, see BlockingQueue.
+  class sync;
+
+  void WorkerEntry();
+  // Takes the next chunk of job, called with the lock held.
+  bool ClaimChunk(Job* job, int* begin, int* end);
+
+  int num_threads_;
+  int numa_node_;
+  bool must_stop_;
+  std::deque<Job*> jobs_;
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > workers_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+// Shorthand for ThreadPool::Global().Run(count, func, grain).
+void ParallelFor(int count, const ThreadPool::RangeFunction& func,
+    int grain = 1);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,23 @@
+#ifndef _CAFFE_UTIL_WINOGRAD_HPP_
+#define _CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+/**
+ * @brief 3x3 stride 1 convolution of num images with the Winograd minimal
+ *        filtering algorithm F(tile x tile, 3x3), tile being 2 or 4.
+ *
+ * Weights are num_output x (channels / group) x 3 x 3 as in
+ * ConvolutionLayer, bias is NULL or has num_output entries. The output is
+ * (height + 2 * pad_h - 2) x (width + 2 * pad_w - 2) and overwritten.
+ */
+template <typename Dtype>
+void winograd_conv_cpu(const Dtype* data_im, const int num,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const Dtype* bias, const int num_output,
+    const int group, const int pad_h, const int pad_w, const int tile,
+    Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_WINOGRAD_HPP_
@@ -133,6 +133,36 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
   return net;
 }
 
+// Releases the interpreter lock for its lifetime, so that other Python
+// threads, e.g. running nets of their own, proceed while a net runs.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+};
+
+Dtype Net_Forward(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_Backward(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  net->BackwardFromTo(start, end);
+}
+
+// NetModel constructor
+shared_ptr<NetModel<Dtype> > NetModel_Init(string network_file,
+    string weights, int phase) {
+  CheckFile(network_file);
+  CheckFile(weights);
+  return shared_ptr<NetModel<Dtype> >(new NetModel<Dtype>(network_file,
+      weights, static_cast<Phase>(phase)));
+}
+
 void Net_Save(const Net<Dtype>& net, string filename) {
   NetParameter net_param;
   net.ToProto(&net_param, false);
@@ -282,6 +312,9 @@ BOOST_PYTHON_MODULE(_caffe) {
 
   bp::scope().attr("__version__") = AS_STRING(CAFFE_VERSION);
 
+  // Create the interpreter lock, which nets release while they run.
+  PyEval_InitThreads();
+
   // Caffe utility functions
   bp::def("set_mode_cpu", &set_mode_cpu);
   bp::def("set_mode_gpu", &set_mode_gpu);
@@ -300,8 +333,8 @@ BOOST_PYTHON_MODULE(_caffe) {
             bp::arg("weights")=bp::object())))
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
+    .def("_forward", &Net_Forward)
+    .def("_backward", &Net_Backward)
     .def("reshape", &Net<Dtype>::Reshape)
     .def("clear_param_diffs", &Net<Dtype>::ClearParamDiffs)
     // The cast is to select a particular overload.
@@ -334,6 +367,14 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("load_hdf5", &Net_LoadHDF5);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Net<Dtype>);
 
+  bp::class_<NetModel<Dtype>, shared_ptr<NetModel<Dtype> >,
+    boost::noncopyable>("NetModel", bp::no_init)
+    .def("__init__", bp::make_constructor(&NetModel_Init,
+          bp::default_call_policies(), (bp::arg("network_file"), "weights",
+            bp::arg("phase")=static_cast<int>(TEST))))
+    .def("create_net", &NetModel<Dtype>::CreateNet);
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(NetModel<Dtype>);
+
   bp::class_<Blob<Dtype>, shared_ptr<Blob<Dtype> >, boost::noncopyable>(
     "Blob", bp::no_init)
     .add_property("shape",
@@ -14,6 +14,15 @@ using boost::weak_ptr;
 
 map<const string, weak_ptr<DataReader::Body> > DataReader::bodies_;
 static boost::mutex bodies_mutex_;
+int DataReader::process_rank_ = 0;
+int DataReader::process_count_ = 1;
+
+void DataReader::set_process_shard(int rank, int count) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, count);
+  process_rank_ = rank;
+  process_count_ = count;
+}
 
 DataReader::DataReader(const LayerParameter& param)
     : queue_pair_(new QueuePair(  //
@@ -44,12 +53,12 @@ DataReader::~DataReader() {
 DataReader::QueuePair::QueuePair(int size) {
   // Initialize the free queue with requested number of datums
   for (int i = 0; i < size; ++i) {
-    free_.push(new Datum());
+    free_.push(new DatumView());
   }
 }
 
 DataReader::QueuePair::~QueuePair() {
-  Datum* datum;
+  DatumView* datum;
   while (free_.try_pop(&datum)) {
     delete datum;
   }
@@ -62,6 +71,7 @@ DataReader::QueuePair::~QueuePair() {
 
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
+      stride_(1),
       new_queue_pairs_() {
   StartInternalThread();
 }
@@ -77,6 +87,11 @@ void DataReader::Body::InternalThreadEntry() {
   vector<shared_ptr<QueuePair> > qps;
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
+    // Other processes read the records in between.
+    if (param_.phase() == TRAIN) {
+      stride_ = process_count_;
+      skip(cursor.get(), process_rank_);
+    }
 
     // To ensure deterministic runs, only start running once all solvers
     // are ready. But solvers need to peek on one item during initialization,
@@ -103,16 +118,28 @@ void DataReader::Body::InternalThreadEntry() {
 }
 
 void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
-  Datum* datum = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  datum->ParseFromString(cursor->value());
+  DatumView* datum = qp->free_.pop();
+  const char* data;
+  size_t size;
+  if (cursor->value_in_place(&data, &size)) {
+    CHECK(datum->Parse(data, size)) << "Invalid Datum at " << cursor->key();
+  } else {
+    string value = cursor->value();
+    CHECK(datum->ParseOwned(&value)) << "Invalid Datum at " << cursor->key();
+  }
   qp->full_.push(datum);
 
   // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+  skip(cursor, stride_);
+}
+
+void DataReader::Body::skip(db::Cursor* cursor, int records) {
+  for (int i = 0; i < records; ++i) {
+    cursor->Next();
+    if (!cursor->valid()) {
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      cursor->SeekToFirst();
+    }
   }
 }
 
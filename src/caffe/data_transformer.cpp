@@ -38,10 +38,54 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
   }
 }
 
+// Transforms the data of a datum stored as T, one row at a time.
+template <typename Dtype, typename T>
+static void TransformDatumData(const char* bytes, const size_t size,
+    const int channels, const int datum_height, const int datum_width,
+    const int height, const int width, const int h_off, const int w_off,
+    const bool do_mirror, const Dtype scale, const Dtype* mean,
+    const Dtype* mean_values, Dtype* transformed_data) {
+  CHECK_GE(size, channels * datum_height * datum_width * sizeof(T))
+      << "Datum is smaller than its shape.";
+  if (sizeof(Dtype) < sizeof(T)) {
+    LOG_FIRST_N(WARNING, 1) << "Conversion of datum data to Dtype, "
+        << "possible loss of data.";
+  }
+  // Values decoded in place may not be aligned for T.
+  vector<T> aligned;
+  if (reinterpret_cast<size_t>(bytes) % sizeof(T)) {
+    aligned.resize(channels * datum_height * datum_width);
+    memcpy(&aligned[0], bytes, aligned.size() * sizeof(T));
+    bytes = reinterpret_cast<const char*>(&aligned[0]);
+  }
+  const T* data = reinterpret_cast<const T*>(bytes);
+  const int step = do_mirror ? -1 : 1;
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      const int data_index =
+          (c * datum_height + h_off + h) * datum_width + w_off;
+      const T* row = data + data_index;
+      Dtype* top_row = transformed_data + (c * height + h) * width +
+          (do_mirror ? width - 1 : 0);
+      if (mean) {
+        const Dtype* mean_row = mean + data_index;
+        for (int w = 0; w < width; ++w) {
+          top_row[w * step] =
+              (static_cast<Dtype>(row[w]) - mean_row[w]) * scale;
+        }
+      } else {
+        const Dtype mean_value = mean_values ? mean_values[c] : Dtype(0);
+        for (int w = 0; w < width; ++w) {
+          top_row[w * step] = (static_cast<Dtype>(row[w]) - mean_value) * scale;
+        }
+      }
+    }
+  }
+}
+
 template<typename Dtype>
-void DataTransformer<Dtype>::Transform(const Datum& datum,
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
                                        Dtype* transformed_data) {
-//  const string& data = datum.data();
   const int datum_channels = datum.data_shape().channels();
   const int datum_height = datum.data_shape().height();
   const int datum_width = datum.data_shape().width();
@@ -50,7 +94,6 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
   const bool has_mean_file = param_.has_mean_file();
-// const bool has_uint8 = data.size() > 0;
   const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
@@ -74,6 +117,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
       }
     }
   }
+  const Dtype* mean_values = has_mean_values ? &mean_values_[0] : NULL;
 
   int height = datum_height;
   int width = datum_width;
@@ -93,97 +137,50 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
-  Dtype datum_element;
-  int top_index, data_index;
-  for (int c = 0; c < datum_channels; ++c) {
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-
-		const DatumShape::DataDepth data_depth = datum.data_shape().data_depth();
-		if (data_depth == DatumShape::DEPTH_8S) {
-			if (sizeof(Dtype) < sizeof(char)) {
-				LOG(WARNING) << "Conversion from 'char' to 'Dtype', possible loss of data.";
-			}
-			const char *pRead = (const char *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else if (data_depth == DatumShape::DEPTH_8U) {
-			if (sizeof(Dtype) < sizeof(unsigned char)) {
-				LOG(WARNING) << "Conversion from 'unsigned char' to 'Dtype', possible loss of data.";
-			}
-			const unsigned char *pRead = (unsigned char *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else if (data_depth == DatumShape::DEPTH_16S) {
-			if (sizeof(Dtype) < sizeof(short)) {
-				LOG(WARNING) << "Conversion from 'short' to 'Dtype', possible loss of data.";
-			}
-			const short *pRead = (const short *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else if (data_depth == DatumShape::DEPTH_16U) {
-			if (sizeof(Dtype) < sizeof(unsigned short)) {
-				LOG(WARNING) << "Conversion from 'unsigned short' to 'Dtype', possible loss of data.";
-			}
-			const unsigned short *pRead = (const unsigned short *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else if (data_depth == DatumShape::DEPTH_32S) {
-			if (sizeof(Dtype) < sizeof(int)) {
-				LOG(WARNING) << "Conversion from 'int' to 'Dtype', possible loss of data.";
-			}
-			const int *pRead = (const int *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else if (data_depth == DatumShape::DEPTH_32F) {
-			if (sizeof(Dtype) < sizeof(float)) {
-				LOG(WARNING) << "Conversion from 'float' to 'Dtype', possible loss of data.";
-			}
-			const float *pRead = (const float *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else if (data_depth == DatumShape::DEPTH_64F) {
-			if (sizeof(Dtype) < sizeof(double)) {
-				LOG(WARNING) << "Conversion from 'double' to 'Dtype', possible loss of data.";
-			}
-			const double *pRead = (const double *)datum.data().data();
-			datum_element = pRead[data_index];
-		}
-		else LOG(FATAL) << "Unknow deth of label!";
-
-
-//      if (has_uint8) {
-//        datum_element =
-//          static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-//      } else {
-//        datum_element = datum.label_float_data(data_index);
-//      }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
-      }
-    }
+  // Dispatch on the depth once, not per element.
+#define TRANSFORM_DATUM_DATA(T) \
+  TransformDatumData<Dtype, T>(datum.data(), datum.data_size(), \
+      datum_channels, datum_height, datum_width, height, width, h_off, \
+      w_off, do_mirror, scale, mean, mean_values, transformed_data)
+  switch (datum.data_shape().data_depth()) {
+  case DatumShape::DEPTH_8S:
+    TRANSFORM_DATUM_DATA(char);
+    break;
+  case DatumShape::DEPTH_8U:
+    TRANSFORM_DATUM_DATA(unsigned char);
+    break;
+  case DatumShape::DEPTH_16S:
+    TRANSFORM_DATUM_DATA(short);  // NOLINT(runtime/int)
+    break;
+  case DatumShape::DEPTH_16U:
+    TRANSFORM_DATUM_DATA(unsigned short);  // NOLINT(runtime/int)
+    break;
+  case DatumShape::DEPTH_32S:
+    TRANSFORM_DATUM_DATA(int);
+    break;
+  case DatumShape::DEPTH_32F:
+    TRANSFORM_DATUM_DATA(float);
+    break;
+  case DatumShape::DEPTH_64F:
+    TRANSFORM_DATUM_DATA(double);
+    break;
+  default:
+    LOG(FATAL) << "Unknown depth of datum.";
   }
+#undef TRANSFORM_DATUM_DATA
 }
 
-
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
+  DatumView view;
+  view.Reset(datum);
+  Transform(view, transformed_blob);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
+                                       Blob<Dtype>* transformed_blob) {
   // If datum is encoded, decoded and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
@@ -212,18 +209,6 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const int datum_height = datum.data_shape().height();
   const int datum_width = datum.data_shape().width();
 
-//  if (param_.mulit_size_support() == true)
-//  {
-//	  const int channels = transformed_blob->channels();
-//	  const int height = transformed_blob->height();
-//	  const int width = transformed_blob->width();
-//	  const int num = transformed_blob->num();
-//	  CHECK_EQ(channels, datum_channels);
-//	  CHECK_GE(num, 1);
-//	  if(height != datum_height || width != datum_width)
-//		  transformed_blob->Reshape(1, datum_channels, datum_height, datum_width);
-//  }
-  
   // Check dimensions.
   const int channels = transformed_blob->channels();
   const int height = transformed_blob->height();
@@ -506,6 +491,13 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
 
 template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
+  DatumView view;
+  view.Reset(datum);
+  return InferBlobShape(view);
+}
+
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferBlobShape(const DatumView& datum) {
   if (datum.encoded()) {
 #ifdef USE_OPENCV
     CHECK(!(param_.force_color() && param_.force_gray()))
@@ -0,0 +1,312 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/inference_server.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The number of recent requests the latency percentiles are computed over.
+static const int kLatencySamples = 1024;
+
+template <typename Dtype>
+struct InferenceServer<Dtype>::Request {
+  const Blob<Dtype>* input;
+  vector<shared_ptr<Blob<Dtype> > >* outputs;
+  boost::system_time queued;
+  bool done;
+};
+
+template <typename Dtype>
+class InferenceServer<Dtype>::sync {
+ public:
+  boost::mutex mutex_;
+  // Signaled when a request is queued or the server stops.
+  boost::condition_variable request_queued_;
+  // Signaled when the requests of a batch are done.
+  boost::condition_variable request_done_;
+};
+
+// Whether two inputs hold items of the same shape, i.e. only differ in their
+// first axis.
+template <typename Dtype>
+static bool SameItemShape(const Blob<Dtype>& a, const Blob<Dtype>& b) {
+  if (a.num_axes() != b.num_axes()) { return false; }
+  for (int i = 1; i < a.num_axes(); ++i) {
+    if (a.shape(i) != b.shape(i)) { return false; }
+  }
+  return true;
+}
+
+// Creates the nets of the workers on node, every num_nodes-th one, from a
+// thread bound to the node.
+template <typename Dtype>
+static void CreateNodeNets(const NetModel<Dtype>* model, NumaPlacement numa,
+    int node, int num_nodes, Caffe::Brew mode, int device,
+    vector<shared_ptr<Net<Dtype> > >* nets) {
+  Caffe::set_mode(mode);
+#ifndef CPU_ONLY
+  if (mode == Caffe::GPU) {
+    Caffe::SetDevice(device);
+  }
+#endif
+  if (!BindThreadToNumaNode(node)) {
+    LOG(WARNING) << "Cannot bind to NUMA node " << node;
+  }
+  shared_ptr<NetModel<Dtype> > replica;
+  if (numa == NUMA_REPLICATE) {
+    replica = model->Replicate();
+  }
+  for (int i = node; i < nets->size(); i += num_nodes) {
+    (*nets)[i] = replica ? replica->CreateNet() : model->CreateNet();
+  }
+}
+
+template <typename Dtype>
+InferenceServer<Dtype>::InferenceServer(const NetModel<Dtype>& model,
+    int num_workers, int max_batch_size, int max_latency_ms,
+    NumaPlacement numa)
+    : mode_(Caffe::mode()), device_(0),
+      max_batch_size_(std::max(max_batch_size, 1)),
+      max_latency_ms_(std::max(max_latency_ms, 0)), must_stop_(false),
+      num_requests_(0), next_latency_(0), sync_(new sync()) {
+#ifndef CPU_ONLY
+  if (mode_ == Caffe::GPU) {
+    CUDA_CHECK(cudaGetDevice(&device_));
+  }
+#endif
+  vector<shared_ptr<Net<Dtype> > > nets(std::max(num_workers, 1));
+  const int num_nodes = numa == NUMA_NONE ? 1 :
+      std::min<int>(NumaNodeCount(), nets.size());
+  if (numa == NUMA_NONE) {
+    for (int i = 0; i < nets.size(); ++i) {
+      nets[i] = model.CreateNet();
+    }
+  } else {
+    LOG(INFO) << "NUMA topology: " << NumaTopologyString();
+    for (int node = 0; node < num_nodes; ++node) {
+      boost::thread thread(&CreateNodeNets<Dtype>, &model, numa, node,
+          num_nodes, mode_, device_, &nets);
+      thread.join();
+    }
+    LOG(INFO) << nets.size() << " workers over " << num_nodes
+        << " NUMA nodes, with "
+        << (numa == NUMA_REPLICATE ? "a copy of the weights per node" :
+            "the weights shared by all nodes");
+  }
+  Net<Dtype>* net = nets[0].get();
+  CHECK_EQ(net->num_inputs(), 1) << "Serving needs a net with one input";
+  Blob<Dtype>* input = net->input_blobs()[0];
+  input_shape_ = input->shape();
+  CHECK_GT(input_shape_.size(), 0) << "The net input has no batch axis";
+  for (int i = 0; i < net->num_outputs(); ++i) {
+    output_names_.push_back(net->blob_names()[net->output_blob_indices()[i]]);
+  }
+  if (max_batch_size_ > 1) {
+    // Check that the outputs follow the batch size of the input.
+    vector<int> shape = input_shape_;
+    shape[0] = shape[0] == 2 ? 3 : 2;
+    input->Reshape(shape);
+    net->Reshape();
+    for (int i = 0; i < net->num_outputs(); ++i) {
+      const Blob<Dtype>& output = *net->output_blobs()[i];
+      if (output.num_axes() == 0 || output.shape(0) != shape[0]) {
+        LOG(WARNING) << "Output " << output_names_[i] << " does not follow "
+            << "the batch size of the input; requests run one at a time";
+        max_batch_size_ = 1;
+        break;
+      }
+    }
+    input->Reshape(input_shape_);
+    net->Reshape();
+  }
+  for (int i = 0; i < nets.size(); ++i) {
+    workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &InferenceServer<Dtype>::WorkerEntry, this, nets[i],
+        numa == NUMA_NONE ? -1 : i % num_nodes)));
+  }
+}
+
+template <typename Dtype>
+InferenceServer<Dtype>::~InferenceServer() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    must_stop_ = true;
+  }
+  sync_->request_queued_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::Infer(const Blob<Dtype>& input,
+    vector<shared_ptr<Blob<Dtype> > >* outputs) {
+  CHECK_GT(input.num_axes(), 0) << "The input has no batch axis";
+  CHECK_GT(input.shape(0), 0) << "The input holds no items";
+  Request request;
+  request.input = &input;
+  request.outputs = outputs;
+  request.queued = boost::get_system_time();
+  request.done = false;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  queue_.push_back(&request);
+  sync_->request_queued_.notify_all();
+  while (!request.done) {
+    sync_->request_done_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+int InferenceServer<Dtype>::TakeBatch(vector<Request*>* batch) {
+  const Blob<Dtype>& first = *queue_.front()->input;
+  int items = 0;
+  typename std::list<Request*>::iterator it = queue_.begin();
+  while (it != queue_.end() && items < max_batch_size_) {
+    const int num = (*it)->input->shape(0);
+    // The oldest request is run even when it holds too many items.
+    if (!SameItemShape(*(*it)->input, first) ||
+        (items > 0 && items + num > max_batch_size_)) {
+      ++it;
+      continue;
+    }
+    items += num;
+    if (batch) {
+      batch->push_back(*it);
+      it = queue_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return items;
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::WorkerEntry(shared_ptr<Net<Dtype> > net,
+    int numa_node) {
+  Caffe::set_mode(mode_);
+#ifndef CPU_ONLY
+  if (mode_ == Caffe::GPU) {
+    Caffe::SetDevice(device_);
+  }
+#endif
+  if (numa_node >= 0) {
+    BindThreadToNumaNode(numa_node);
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!must_stop_ && queue_.empty()) {
+      sync_->request_queued_.wait(lock);
+    }
+    // Requests still queued are run before stopping.
+    if (queue_.empty()) {
+      return;
+    }
+    // Wait for the batch to fill, until the deadline of its oldest request.
+    while (!queue_.empty() && !must_stop_ &&
+        TakeBatch(NULL) < max_batch_size_) {
+      const boost::system_time deadline = queue_.front()->queued +
+          boost::posix_time::milliseconds(max_latency_ms_);
+      if (boost::get_system_time() >= deadline) {
+        break;
+      }
+      sync_->request_queued_.timed_wait(lock, deadline);
+    }
+    // Another worker may have taken the requests.
+    if (queue_.empty()) {
+      continue;
+    }
+    vector<Request*> batch;
+    const int items = TakeBatch(&batch);
+    lock.unlock();
+    RunBatch(net.get(), batch);
+    lock.lock();
+    const boost::system_time done = boost::get_system_time();
+    for (int i = 0; i < batch.size(); ++i) {
+      const float latency =
+          (done - batch[i]->queued).total_microseconds() / 1000.f;
+      if (latencies_.size() < kLatencySamples) {
+        latencies_.push_back(latency);
+      } else {
+        latencies_[next_latency_] = latency;
+      }
+      next_latency_ = (next_latency_ + 1) % kLatencySamples;
+      batch[i]->done = true;
+    }
+    num_requests_ += batch.size();
+    if (batch_size_counts_.size() < items) {
+      batch_size_counts_.resize(items, 0);
+    }
+    ++batch_size_counts_[items - 1];
+    sync_->request_done_.notify_all();
+  }
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::RunBatch(Net<Dtype>* net,
+    const vector<Request*>& batch) {
+  int items = 0;
+  for (int i = 0; i < batch.size(); ++i) {
+    items += batch[i]->input->shape(0);
+  }
+  // Reshape the net only when the batch shape changes.
+  Blob<Dtype>* input = net->input_blobs()[0];
+  vector<int> shape = batch[0]->input->shape();
+  shape[0] = items;
+  if (input->shape() != shape) {
+    input->Reshape(shape);
+    net->Reshape();
+  }
+  Dtype* input_data = input->mutable_cpu_data();
+  for (int i = 0; i < batch.size(); ++i) {
+    caffe_copy(batch[i]->input->count(), batch[i]->input->cpu_data(),
+        input_data);
+    input_data += batch[i]->input->count();
+  }
+  const vector<Blob<Dtype>*>& outputs = net->Forward();
+  int offset = 0;
+  for (int i = 0; i < batch.size(); ++i) {
+    const int num = batch[i]->input->shape(0);
+    batch[i]->outputs->resize(outputs.size());
+    for (int j = 0; j < outputs.size(); ++j) {
+      const Blob<Dtype>& output = *outputs[j];
+      vector<int> output_shape = output.shape();
+      int begin = 0;
+      int count = output.count();
+      // Outputs not following the batch size come from single requests.
+      if (output.num_axes() > 0 && output.shape(0) == items) {
+        output_shape[0] = num;
+        begin = offset * output.count(1);
+        count = num * output.count(1);
+      }
+      (*batch[i]->outputs)[j].reset(new Blob<Dtype>(output_shape));
+      caffe_copy(count, output.cpu_data() + begin,
+          (*batch[i]->outputs)[j]->mutable_cpu_data());
+    }
+    offset += num;
+  }
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::GetStats(ServeStats* stats) const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  stats->Clear();
+  stats->set_requests(num_requests_);
+  stats->set_queue_depth(queue_.size());
+  for (int i = 0; i < batch_size_counts_.size(); ++i) {
+    stats->add_batch_size_count(batch_size_counts_[i]);
+  }
+  if (latencies_.size() > 0) {
+    vector<float> sorted(latencies_);
+    std::sort(sorted.begin(), sorted.end());
+    stats->set_latency_p50_ms(sorted[(sorted.size() - 1) / 2]);
+    stats->set_latency_p99_ms(sorted[(sorted.size() - 1) * 99 / 100]);
+  }
+}
+
+INSTANTIATE_CLASS(InferenceServer);
+
+}  // namespace caffe
@@ -22,6 +22,19 @@ void Layer<Dtype>::Unlock() {
   }
 }
 
+template <typename Dtype>
+bool Layer<Dtype>::BottomShapesChanged(const vector<Blob<Dtype>*>& bottom) {
+  bool changed = bottom.empty() || bottom.size() != bottom_shapes_.size();
+  bottom_shapes_.resize(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (bottom[i]->shape() != bottom_shapes_[i]) {
+      bottom_shapes_[i] = bottom[i]->shape();
+      changed = true;
+    }
+  }
+  return changed;
+}
+
 INSTANTIATE_CLASS(Layer);
 
 }  // namespace caffe
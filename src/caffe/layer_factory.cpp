@@ -55,7 +55,10 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
     }
 #endif
   }
-  if (engine == ConvolutionParameter_Engine_CAFFE) {
+  if (engine == ConvolutionParameter_Engine_CAFFE ||
+      engine == ConvolutionParameter_Engine_WINOGRAD ||
+      engine == ConvolutionParameter_Engine_DIRECT) {
+    // ConvolutionLayer picks its CPU algorithm from the engine itself.
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
@@ -265,6 +265,13 @@ namespace caffe {
 		}
 	}
 
+	template <typename Dtype>
+	bool BaseConvolutionLayer<Dtype>::FuseActivation(Layer<Dtype>* activation) {
+		// The activation sees the channels along axis 1 of a single top.
+		return channel_axis_ == 1 && this->layer_param_.top_size() == 1 &&
+			activation_.Init(activation);
+	}
+
 	template <typename Dtype>
 	void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
 		const Dtype* weights, Dtype* output, bool skip_im2col) {
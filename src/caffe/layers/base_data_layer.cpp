@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -36,7 +37,7 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
+      prefetch_free_(), prefetch_full_(), read_time_(0), transform_time_(0) {
   for (int i = 0; i < PREFETCH_COUNT; ++i) {
     prefetch_free_.push(&prefetch_[i]);
   }
@@ -68,6 +69,22 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
 #endif
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  // Seed the other workers in order, after the first one, so that their
+  // streams only depend on the Caffe seed.
+  int num_workers = std::max<int>(1, this->transform_param_.num_threads());
+  if (num_workers > 1 && !UsesParallelTransform()) {
+    LOG(WARNING) << this->type() << " layer " << this->layer_param_.name()
+        << " transforms on one thread, ignoring transform_param.num_threads";
+    num_workers = 1;
+  }
+  transformers_.clear();
+  transformers_.push_back(this->data_transformer_);
+  for (int i = 1; i < num_workers; ++i) {
+    transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    transformers_.back()->InitRand();
+  }
+  transform_pool_.reset(new ThreadPool(num_workers));
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
@@ -121,9 +138,27 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
         top[1]->mutable_cpu_data());
   }
 
+  read_time_ = batch->read_time_;
+  transform_time_ = batch->transform_time_;
+
   prefetch_free_.push(batch);
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ParallelTransform(int count,
+    const TransformFunction& func) {
+  const int num_workers = num_transform_workers();
+  transform_pool_->Run(num_workers, [&](int begin, int end) {
+    for (int w = begin; w < end; ++w) {
+      const int item_begin = count * w / num_workers;
+      const int item_end = count * (w + 1) / num_workers;
+      if (item_begin < item_end) {
+        func(w, item_begin, item_end);
+      }
+    }
+  });
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(BasePrefetchingDataLayer, Forward);
 #endif
@@ -23,6 +23,8 @@ void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
   // Ensure the copy is synchronous wrt the host, so that the next batch isn't
   // copied in meanwhile.
   CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
+  read_time_ = batch->read_time_;
+  transform_time_ = batch->transform_time_;
   prefetch_free_.push(batch);
 }
 
@@ -3,6 +3,7 @@
 // Written by Yi Li
 // ------------------------------------------------------------------
 
+#include <algorithm>
 #include <cfloat>
 
 #include <string>
@@ -14,6 +15,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/box_annotator_ohem_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using std::max;
 using std::min;
@@ -66,14 +69,72 @@ namespace caffe {
   template <typename Dtype>
   void BoxAnnotatorOHEMLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-    NOT_IMPLEMENTED;
+    const Dtype* bottom_rois = bottom[0]->cpu_data();
+    const Dtype* bottom_loss = bottom[1]->cpu_data();
+    const Dtype* bottom_labels = bottom[2]->cpu_data();
+    const Dtype* bottom_bbox_loss_weights = bottom[3]->cpu_data();
+    Dtype* top_labels = top[0]->mutable_cpu_data();
+    Dtype* top_bbox_loss_weights = top[1]->mutable_cpu_data();
+    caffe_set(top[0]->count(), Dtype(ignore_label_), top_labels);
+    caffe_set(top[1]->count(), Dtype(0), top_bbox_loss_weights);
+
+    const int num_rois = bottom[1]->count();
+    const int spatial_dim = spatial_dim_;
+    const int bbox_channels = bbox_channels_;
+    const int roi_per_img = roi_per_img_;
+
+    // Bucket the rois by image, in index order.
+    vector<vector<int> > image_rois;
+    for (int index = 0; index < num_rois; ++index) {
+      const int s = index % spatial_dim;
+      const int n = index / spatial_dim;
+      const int batch_ind = bottom_rois[n * 5 * spatial_dim + s];
+      CHECK_GE(batch_ind, 0);
+      if (batch_ind >= image_rois.size()) {
+        image_rois.resize(batch_ind + 1);
+      }
+      image_rois[batch_ind].push_back(index);
+    }
+    CHECK_GT(image_rois.size(), 0)
+      << "number of images must be greater than 0 at BoxAnnotatorOHEMLayer";
+
+    // Keep the roi_per_img rois with the largest loss of every image. Only
+    // the kept rois need to be found, so a partial selection replaces the
+    // full sort; ties go to the lower index.
+    ParallelFor(image_rois.size(), [&](int begin, int end) {
+      for (int b = begin; b < end; ++b) {
+        vector<int>& rois = image_rois[b];
+        const auto harder = [bottom_loss](int i1, int i2) {
+          return bottom_loss[i1] > bottom_loss[i2] ||
+            (bottom_loss[i1] == bottom_loss[i2] && i1 < i2);
+        };
+        if (rois.size() > roi_per_img) {
+          std::nth_element(rois.begin(), rois.begin() + roi_per_img,
+            rois.end(), harder);
+          rois.resize(roi_per_img);
+        }
+        // Generate output labels for scoring and loss_weights for bbox
+        // regression
+        for (int i = 0; i < rois.size(); ++i) {
+          const int index = rois[i];
+          const int s = index % spatial_dim;
+          const int n = index / spatial_dim;
+          top_labels[index] = bottom_labels[index];
+          for (int j = 0; j < bbox_channels; j++) {
+            int bbox_index = (n*bbox_channels + j)*spatial_dim + s;
+            top_bbox_loss_weights[bbox_index] =
+              bottom_bbox_loss_weights[bbox_index];
+          }
+        }
+      }
+    });
   }
 
   template <typename Dtype>
   void BoxAnnotatorOHEMLayer<Dtype>::Backward_cpu(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-    NOT_IMPLEMENTED;
+    return;
   }
 
 
@@ -1,9 +1,69 @@
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/direct_conv.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/winograd.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  CHECK(conv_param.winograd_tile() == 0 || conv_param.winograd_tile() == 2 ||
+      conv_param.winograd_tile() == 4) << "winograd_tile must be 0, 2 or 4.";
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  const bool is_2d = this->num_spatial_axes_ == 2;
+  const bool winograd_applies = is_2d &&
+      kernel_shape_data[0] == 3 && kernel_shape_data[1] == 3 &&
+      stride_data[0] == 1 && stride_data[1] == 1 &&
+      dilation_data[0] == 1 && dilation_data[1] == 1;
+  cpu_engine_ = conv_param.engine();
+  if (cpu_engine_ == ConvolutionParameter_Engine_DEFAULT ||
+      cpu_engine_ == ConvolutionParameter_Engine_CUDNN) {
+    // WINOGRAD and DIRECT round differently from im2col, so they only run
+    // when the layer asks for them.
+    cpu_engine_ = ConvolutionParameter_Engine_CAFFE;
+  } else if (cpu_engine_ == ConvolutionParameter_Engine_WINOGRAD &&
+      !winograd_applies) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D 3x3 "
+        << "stride 1 convolution, falling back to the CAFFE engine.";
+    cpu_engine_ = ConvolutionParameter_Engine_CAFFE;
+  } else if (cpu_engine_ == ConvolutionParameter_Engine_DIRECT && !is_2d) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D "
+        << "convolution, falling back to the CAFFE engine.";
+    cpu_engine_ = ConvolutionParameter_Engine_CAFFE;
+  }
+  if (this->layer_param_.has_quantization_param() &&
+      !Quantize(this->layer_param_.quantization_param().bottom_max())) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D "
+        << "convolution of a single bottom, not quantizing it.";
+  }
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::Quantize(float bottom_max) {
+  if (bottom_max > 0 && (this->num_spatial_axes_ != 2 ||
+      this->layer_param_.bottom_size() != 1)) {
+    return false;
+  }
+  if (bottom_max > 0) {
+    this->layer_param_.mutable_quantization_param()->set_bottom_max(
+        bottom_max);
+    int8_bottom_scale_ = 127 / bottom_max;
+  } else {
+    this->layer_param_.clear_quantization_param();
+    int8_bottom_scale_ = 0;
+  }
+  int8_weights_.Clear();
+  return true;
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -24,21 +84,113 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (int8_bottom_scale_ > 0) {
+    Forward_cpu_int8(bottom, top);
+    return;
+  }
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int* pad_data = this->pad_.cpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+    if (cpu_engine_ == ConvolutionParameter_Engine_WINOGRAD) {
+      int tile = this->layer_param_.convolution_param().winograd_tile();
+      if (tile == 0) {
+        tile = (this->output_shape_[0] >= 8 && this->output_shape_[1] >= 8)
+            ? 4 : 2;
+      }
+      winograd_conv_cpu(bottom_data, this->num_, this->channels_,
+          this->input_shape(1), this->input_shape(2), weight, bias,
+          this->num_output_, this->group_, pad_data[0], pad_data[1], tile,
+          top_data);
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_activation(top_data + n * this->top_dim_);
+      }
+      continue;
+    }
+    if (cpu_engine_ == ConvolutionParameter_Engine_DIRECT) {
+      const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+      const int* stride_data = this->stride_.cpu_data();
+      const int* dilation_data = this->dilation_.cpu_data();
+      direct_conv_cpu(bottom_data, this->num_, this->channels_,
+          this->input_shape(1), this->input_shape(2), weight, bias,
+          this->num_output_, this->group_, kernel_shape_data[0],
+          kernel_shape_data[1], pad_data[0], pad_data[1], stride_data[0],
+          stride_data[1], dilation_data[0], dilation_data[1], top_data);
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_activation(top_data + n * this->top_dim_);
+      }
+      continue;
+    }
     for (int n = 0; n < this->num_; ++n) {
       this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
           top_data + n * this->top_dim_);
       if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
+      this->forward_cpu_activation(top_data + n * this->top_dim_);
     }
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::Forward_cpu_int8(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int kernel_dim = this->channels_ / this->group_ *
+      kernel_shape_data[0] * kernel_shape_data[1];
+  const int row_size = kernel_dim * this->group_;
+  const int spatial_dim = this->out_spatial_dim_;
+  int8_weights_.Update(*this->blobs_[0], this->num_output_, kernel_dim,
+      false, kernel_shape_data[0] * kernel_shape_data[1]);
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  int8_bottom_.resize(this->bottom_dim_);
+  int8_rows_.resize(spatial_dim * row_size);
+  int8_products_.resize(this->top_dim_);
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int n = 0; n < this->num_; ++n) {
+    quantize_channels_last_cpu(this->channels_,
+        this->input_shape(1) * this->input_shape(2),
+        bottom_data + n * this->bottom_dim_, int8_bottom_scale_,
+        &int8_bottom_[0]);
+    im2row_s8_cpu(&int8_bottom_[0], this->channels_, this->group_,
+        this->input_shape(1), this->input_shape(2), kernel_shape_data[0],
+        kernel_shape_data[1], pad_data[0], pad_data[1], stride_data[0],
+        stride_data[1], dilation_data[0], dilation_data[1], &int8_rows_[0]);
+    for (int g = 0; g < this->group_; ++g) {
+      gemm_s8_cpu(outputs_per_group, spatial_dim, kernel_dim,
+          int8_weights_.data() + g * outputs_per_group * kernel_dim,
+          kernel_dim, &int8_rows_[0] + g * kernel_dim, row_size,
+          &int8_products_[0] + g * outputs_per_group * spatial_dim,
+          spatial_dim);
+    }
+    // Scale back, add the bias and activate each channel while it is in
+    // cache.
+    Dtype* output = top_data + n * this->top_dim_;
+    ParallelFor(this->num_output_, [&](int begin, int end) {
+      for (int o = begin; o < end; ++o) {
+        const Dtype scale =
+            1 / (int8_bottom_scale_ * int8_weights_.scales()[o]);
+        const Dtype shift = bias ? bias[o] : Dtype(0);
+        const int32_t* products = &int8_products_[0] + o * spatial_dim;
+        Dtype* out = output + o * spatial_dim;
+        for (int i = 0; i < spatial_dim; ++i) {
+          out[i] = products[i] * scale + shift;
+        }
+        if (this->activation_.enabled()) {
+          this->activation_.ApplyChannel(o, spatial_dim, out);
+        }
+      }
+    });
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -55,6 +207,28 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
+    if (cpu_engine_ == ConvolutionParameter_Engine_DIRECT) {
+      const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+      const int* stride_data = this->stride_.cpu_data();
+      const int* pad_data = this->pad_.cpu_data();
+      const int* dilation_data = this->dilation_.cpu_data();
+      if (this->param_propagate_down_[0]) {
+        direct_conv_backward_weights_cpu(bottom_data, top_diff, this->num_,
+            this->channels_, this->input_shape(1), this->input_shape(2),
+            this->num_output_, this->group_, kernel_shape_data[0],
+            kernel_shape_data[1], pad_data[0], pad_data[1], stride_data[0],
+            stride_data[1], dilation_data[0], dilation_data[1], weight_diff);
+      }
+      if (propagate_down[i]) {
+        direct_conv_backward_data_cpu(top_diff, this->num_, this->channels_,
+            this->input_shape(1), this->input_shape(2), weight,
+            this->num_output_, this->group_, kernel_shape_data[0],
+            kernel_shape_data[1], pad_data[0], pad_data[1], stride_data[0],
+            stride_data[1], dilation_data[0], dilation_data[1], bottom_diff);
+      }
+      continue;
+    }
+    // WINOGRAD shares the matrix multiplication backward pass.
     if (this->param_propagate_down_[0] || propagate_down[i]) {
       for (int n = 0; n < this->num_; ++n) {
         // gradient w.r.t. weight. Note that we will accumulate diffs.
@@ -2,6 +2,7 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <string.h>
 
 #include <vector>
 
@@ -11,6 +12,57 @@
 
 namespace caffe {
 
+// Copies count labels stored as T, which may not be aligned in the view.
+template <typename Dtype, typename T>
+static void CopyLabel(const DatumView& datum, const int count,
+	Dtype* top_label) {
+	CHECK_GE(datum.label_size(), count * sizeof(T))
+		<< "Label is smaller than its shape.";
+	if (sizeof(Dtype) < sizeof(T)) {
+		LOG_FIRST_N(WARNING, 1) << "Conversion of label to 'Dtype', possible loss of data.";
+	}
+	const char* label = datum.label();
+	for (int i = 0; i < count; ++i) {
+		T value;
+		memcpy(&value, label + i * sizeof(T), sizeof(T));
+		top_label[i] = value;
+	}
+}
+
+// Copies the labels of the item_id-th datum of a batch, whatever their depth.
+template <typename Dtype>
+static void CopyLabels(const DatumView& datum, const int item_id,
+	Dtype* top_label) {
+	const int label_count = datum.label_shape().channels() *
+		datum.label_shape().height() * datum.label_shape().width();
+	top_label += item_id * label_count;
+	switch (datum.label_shape().data_depth()) {
+	case DatumShape::DEPTH_8S:
+		CopyLabel<Dtype, char>(datum, label_count, top_label);
+		break;
+	case DatumShape::DEPTH_8U:
+		CopyLabel<Dtype, unsigned char>(datum, label_count, top_label);
+		break;
+	case DatumShape::DEPTH_16S:
+		CopyLabel<Dtype, short>(datum, label_count, top_label);
+		break;
+	case DatumShape::DEPTH_16U:
+		CopyLabel<Dtype, unsigned short>(datum, label_count, top_label);
+		break;
+	case DatumShape::DEPTH_32S:
+		CopyLabel<Dtype, int>(datum, label_count, top_label);
+		break;
+	case DatumShape::DEPTH_32F:
+		CopyLabel<Dtype, float>(datum, label_count, top_label);
+		break;
+	case DatumShape::DEPTH_64F:
+		CopyLabel<Dtype, double>(datum, label_count, top_label);
+		break;
+	default:
+		LOG(FATAL) << "Unknow deth of label!";
+	}
+}
+
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
@@ -27,7 +79,7 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
-  Datum& datum = *(reader_.full().peek());
+  DatumView& datum = *(reader_.full().peek());
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -82,7 +134,7 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // Reshape according to the first datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
-  Datum& datum = *(reader_.full().peek());
+  DatumView& datum = *(reader_.full().peek());
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
   this->transformed_data_.Reshape(top_shape);
@@ -96,96 +148,40 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
+  // Read the whole batch, then transform its items on the transform threads.
+  timer.Start();
+  vector<DatumView*> datums(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-
-    // Copy label.
-    if (this->output_labels_) {
-//     top_label[item_id] = datum.label();
-		const DatumShape::DataDepth label_depth = datum.label_shape().data_depth();
-		const int label_channels = datum.label_shape().channels();
-		const int label_height = datum.label_shape().height();
-		const int label_width = datum.label_shape().width();
-
-		const int top_label_offset = item_id*label_channels*label_height*label_width;
-			// ((n * channels() + c) * height() + h) * width() + w
-		for (int c = 0; c < label_channels; c++) {
-			int cs = c * label_height;
-			for (int h = 0; h < label_height; h++) {
-				int hs = (cs + h) * label_width;
-				for (int w = 0; w < label_width; w++) {
-					int id = hs + w;
-					if (label_depth == DatumShape::DEPTH_8S) {
-						if (sizeof(Dtype) < sizeof(char)) {
-							LOG(WARNING) << "Conversion from 'char' to 'Dtype', possible loss of data.";
-						}
-						const char *pRead = (const char *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else if (label_depth == DatumShape::DEPTH_8U) {
-						if (sizeof(Dtype) < sizeof(unsigned char)) {
-							LOG(WARNING) << "Conversion from 'unsigned char' to 'Dtype', possible loss of data.";
-						}
-						const unsigned char *pRead = (unsigned char *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else if (label_depth == DatumShape::DEPTH_16S) {
-						if (sizeof(Dtype) < sizeof(short)) {
-							LOG(WARNING) << "Conversion from 'short' to 'Dtype', possible loss of data.";
-						}
-						const short *pRead = (const short *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else if (label_depth == DatumShape::DEPTH_16U) {
-						if (sizeof(Dtype) < sizeof(unsigned short)) {
-							LOG(WARNING) << "Conversion from 'unsigned short' to 'Dtype', possible loss of data.";
-						}
-						const unsigned short *pRead = (const unsigned short *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else if (label_depth == DatumShape::DEPTH_32S) {
-						if (sizeof(Dtype) < sizeof(int)) {
-							LOG(WARNING) << "Conversion from 'int' to 'Dtype', possible loss of data.";
-						}
-						const int *pRead = (const int *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else if (label_depth == DatumShape::DEPTH_32F) {
-						if (sizeof(Dtype) < sizeof(float)) {
-							LOG(WARNING) << "Conversion from 'float' to 'Dtype', possible loss of data.";
-						}
-						const float *pRead = (const float *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else if (label_depth == DatumShape::DEPTH_64F) {
-						if (sizeof(Dtype) < sizeof(double)) {
-							LOG(WARNING) << "Conversion from 'double' to 'Dtype', possible loss of data.";
-						}
-						const double *pRead = (const double *)datum.label().data();
-						top_label[top_label_offset + id] = pRead[id];
-					}
-					else LOG(FATAL) << "Unknow deth of label!";
-				}
-			}
-		}
+    datums[item_id] = reader_.full().pop("Waiting for data");
+  }
+  read_time = timer.MicroSeconds();
+  timer.Start();
+  this->ParallelTransform(batch_size, [&](int worker, int begin, int end) {
+    DataTransformer<Dtype>* transformer = this->transformers_[worker].get();
+    Blob<Dtype> transformed_data(this->transformed_data_.shape());
+    for (int item_id = begin; item_id < end; ++item_id) {
+      const DatumView& datum = *datums[item_id];
+      // Apply data transformations (mirror, scale, crop...)
+      int offset = batch->data_.offset(item_id);
+      transformed_data.set_cpu_data(top_data + offset);
+      transformer->Transform(datum, &transformed_data);
+      // Copy label.
+      if (this->output_labels_) {
+        CopyLabels(datum, item_id, top_label);
+      }
     }
-    trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<Datum*>(&datum));
+  });
+  trans_time = timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    reader_.free().push(datums[item_id]);
   }
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  batch->read_time_ = read_time / 1000;
+  batch->transform_time_ = trans_time / 1000;
 }
 
 INSTANTIATE_CLASS(DataLayer);
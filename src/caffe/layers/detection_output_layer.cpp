@@ -0,0 +1,206 @@
+#include "caffe/layers/detection_output_layer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+	template <typename Dtype>
+	void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+		const vector<Blob<Dtype>*>& top) {
+		const DetectionParameter &detection_param = this->public_param_.detection_param();
+		box_dimensions_ = detection_param.range().dim_size();
+		CHECK_GT(box_dimensions_, 0) << "detection_param.range must describe the box space.";
+		share_location_ = detection_param.share_location();
+		num_classes_ = detection_param.num_classes();
+		CHECK_GT(num_classes_, 0);
+		const DetectionOutputParameter &detection_output_param =
+			this->layer_param_.detection_output_param();
+		conf_loss_type_ = detection_output_param.conf_loss_type();
+		background_label_ = detection_output_param.background_label();
+		CHECK_LT(background_label_, num_classes_);
+		confidence_threshold_ = detection_output_param.confidence_threshold();
+		nms_threshold_ = detection_output_param.nms_threshold();
+		CHECK_GE(nms_threshold_, 0);
+		top_k_ = detection_output_param.top_k();
+		keep_top_k_ = detection_output_param.keep_top_k();
+	}
+
+	template <typename Dtype>
+	void DetectionOutputLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+		const vector<Blob<Dtype>*>& top) {
+		CHECK_EQ(bottom.size() % 3, 0);
+		num_pyramid_layer_ = bottom.size() / 3;
+		num_ = bottom[1]->shape(0);
+		pyramid_offsets_.resize(num_pyramid_layer_ + 1);
+		pyramid_offsets_[0] = 0;
+		for (int i = 0; i < num_pyramid_layer_; ++i){
+			const int id = 3 * i;
+			const int count = CountDefBoxes(bottom[id], box_dimensions_);
+			CHECK_EQ(bottom[id + 1]->shape(0), num_);
+			CHECK_EQ(bottom[id + 2]->shape(0), num_);
+			CHECK_EQ(bottom[id + 2]->count(1), count * num_classes_)
+				<< "The confidence predictions do not match the default boxes.";
+			pyramid_offsets_[i + 1] = pyramid_offsets_[i] + count;
+		}
+		num_boxes_ = pyramid_offsets_[num_pyramid_layer_];
+		def_boxes_.boxes.Reshape(box_dimensions_, num_boxes_);
+		def_boxes_.variances.Reshape(box_dimensions_, num_boxes_);
+		ReshapePredBoxes(num_, box_dimensions_, share_location_, num_classes_, num_boxes_, pred_boxes_);
+		decoded_boxes_.resize(num_);
+		scores_.resize(num_);
+		for (int n = 0; n < num_; ++n) {
+			decoded_boxes_[n].resize(share_location_ ? 1 : num_classes_);
+			scores_[n].resize(num_classes_ * num_boxes_);
+		}
+		kept_indices_.resize(num_ * num_classes_);
+		// The number of detections is only known after the forward pass.
+		vector<int> top_shape(4, 1);
+		top_shape[3] = 3 + 2 * box_dimensions_;
+		top[0]->Reshape(top_shape);
+	}
+
+	template <typename Dtype>
+	void DetectionOutputLayer<Dtype>::ScoreImage(const int n) {
+		const Dtype *conf = &pred_boxes_[n].confidences[0];
+		Dtype *scores = &scores_[n][0];
+		const int count = num_classes_ * num_boxes_;
+		if (conf_loss_type_ == MultiBoxLossParameter_ConfLossType_SOFTMAX) {
+			// Softmax over the classes of every box, sweeping one class at a time.
+			vector<Dtype> max_conf(conf, conf + num_boxes_);
+			for (int c = 1; c < num_classes_; ++c) {
+				for (int i = 0; i < num_boxes_; ++i) {
+					max_conf[i] = std::max(max_conf[i], conf[c * num_boxes_ + i]);
+				}
+			}
+			vector<Dtype> sum(num_boxes_, Dtype(0));
+			for (int c = 0; c < num_classes_; ++c) {
+				for (int i = 0; i < num_boxes_; ++i) {
+					scores[c * num_boxes_ + i] = std::exp(conf[c * num_boxes_ + i] - max_conf[i]);
+					sum[i] += scores[c * num_boxes_ + i];
+				}
+			}
+			for (int c = 0; c < num_classes_; ++c) {
+				for (int i = 0; i < num_boxes_; ++i) {
+					scores[c * num_boxes_ + i] /= sum[i];
+				}
+			}
+		}
+		else if (conf_loss_type_ == MultiBoxLossParameter_ConfLossType_LOGISTIC) {
+			for (int i = 0; i < count; ++i) {
+				scores[i] = 1 / (1 + std::exp(-conf[i]));
+			}
+		}
+		else {
+			LOG(FATAL) << "Unknown confidence loss type.";
+		}
+	}
+
+	// Most confident first.
+	template <typename Dtype>
+	static bool MoreConfident(const pair<Dtype, pair<int, int> > &a,
+		const pair<Dtype, pair<int, int> > &b) {
+		return a.first > b.first;
+	}
+
+	// Label first, then most confident first.
+	template <typename Dtype>
+	static bool DetectionOrder(const pair<Dtype, pair<int, int> > &a,
+		const pair<Dtype, pair<int, int> > &b) {
+		return a.second.first < b.second.first ||
+			(a.second.first == b.second.first && a.first > b.first);
+	}
+
+	template <typename Dtype>
+	void DetectionOutputLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+		const vector<Blob<Dtype>*>& top) {
+		for (int i = 0; i < num_pyramid_layer_; ++i){
+			const int id = 3 * i;
+			ExtractDefBoxes(bottom[id], box_dimensions_, pyramid_offsets_[i], def_boxes_);
+			ExtractPredBoxes(bottom[id + 1], bottom[id + 2], box_dimensions_,
+				share_location_, num_classes_, pyramid_offsets_[i], pred_boxes_);
+		}
+		const int loc_classes = share_location_ ? 1 : num_classes_;
+		ParallelFor(num_ * loc_classes, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				const int n = i / loc_classes;
+				const int c = i % loc_classes;
+				DecodeBoxes(def_boxes_, pred_boxes_[n].locations[c], decoded_boxes_[n][c]);
+			}
+		});
+		ParallelFor(num_, [&](int begin, int end) {
+			for (int n = begin; n < end; ++n) {
+				ScoreImage(n);
+			}
+		});
+		// The classes of all images are suppressed independently.
+		ParallelFor(num_ * num_classes_, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				const int n = i / num_classes_;
+				const int c = i % num_classes_;
+				if (c == background_label_) {
+					kept_indices_[i].clear();
+					continue;
+				}
+				ApplyNMS(decoded_boxes_[n][share_location_ ? 0 : c],
+					&scores_[n][c * num_boxes_], confidence_threshold_, nms_threshold_,
+					top_k_, kept_indices_[i]);
+			}
+		});
+
+		// (score, (label, box_id)) of the detections kept for each image.
+		vector<vector<pair<Dtype, pair<int, int> > > > detections(num_);
+		int num_detections = 0;
+		for (int n = 0; n < num_; ++n) {
+			vector<pair<Dtype, pair<int, int> > > &image_detections = detections[n];
+			for (int c = 0; c < num_classes_; ++c) {
+				const vector<int> &indices = kept_indices_[n * num_classes_ + c];
+				for (int j = 0; j < indices.size(); ++j) {
+					image_detections.push_back(make_pair(
+						scores_[n][c * num_boxes_ + indices[j]], make_pair(c, indices[j])));
+				}
+			}
+			if (keep_top_k_ >= 0 && image_detections.size() > keep_top_k_) {
+				std::stable_sort(image_detections.begin(), image_detections.end(),
+					MoreConfident<Dtype>);
+				image_detections.resize(keep_top_k_);
+			}
+			std::stable_sort(image_detections.begin(), image_detections.end(),
+				DetectionOrder<Dtype>);
+			num_detections += image_detections.size();
+		}
+
+		const int row_size = 3 + 2 * box_dimensions_;
+		vector<int> top_shape(4, 1);
+		top_shape[2] = std::max(num_detections, 1);
+		top_shape[3] = row_size;
+		top[0]->Reshape(top_shape);
+		Dtype *top_data = top[0]->mutable_cpu_data();
+		if (num_detections == 0) {
+			caffe_set(row_size, Dtype(-1), top_data);
+			return;
+		}
+		for (int n = 0; n < num_; ++n) {
+			for (int j = 0; j < detections[n].size(); ++j) {
+				const int c = detections[n][j].second.first;
+				const int i = detections[n][j].second.second;
+				const BoxSet<Dtype> &boxes = decoded_boxes_[n][share_location_ ? 0 : c];
+				top_data[0] = n;
+				top_data[1] = c;
+				top_data[2] = detections[n][j].first;
+				for (int d = 0; d < box_dimensions_; ++d) {
+					top_data[3 + d] = boxes.min_location(d)[i];
+					top_data[3 + box_dimensions_ + d] = boxes.max_location(d)[i];
+				}
+				top_data += row_size;
+			}
+		}
+	}
+
+	INSTANTIATE_CLASS(DetectionOutputLayer);
+	REGISTER_LAYER_CLASS(DetectionOutput);
+
+}  // namespace caffe
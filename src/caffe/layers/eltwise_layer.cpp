@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cfloat>
 #include <vector>
 
@@ -41,6 +42,41 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+bool EltwiseLayer<Dtype>::FuseActivation(Layer<Dtype>* activation) {
+  return op_ == EltwiseParameter_EltwiseOp_SUM && activation_.Init(activation);
+}
+
+template <typename Dtype>
+void EltwiseLayer<Dtype>::ForwardSumActivation(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Sums one block at a time, one channel of one item for per channel
+  // activations, and activates it while it is still in cache.
+  const int channels = top[0]->num_axes() > 1 ? top[0]->shape(1) : 1;
+  const int inner = top[0]->num_axes() > 2 ? top[0]->count(2) : 1;
+  const int count = top[0]->count();
+  const int block = activation_.per_channel() ? inner : 4096;
+  vector<const Dtype*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int offset = 0; offset < count; offset += block) {
+    const int size = std::min(block, count - offset);
+    Dtype* sum = top_data + offset;
+    for (int j = 0; j < size; ++j) {
+      sum[j] = coeffs_[0] * bottom_data[0][offset + j];
+    }
+    for (int i = 1; i < bottom.size(); ++i) {
+      const Dtype* data = bottom_data[i] + offset;
+      for (int j = 0; j < size; ++j) {
+        sum[j] += coeffs_[i] * data[j];
+      }
+    }
+    activation_.ApplyChannel(offset / inner % channels, size, sum);
+  }
+}
+
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -57,6 +93,10 @@ void EltwiseLayer<Dtype>::Forward_cpu(
     }
     break;
   case EltwiseParameter_EltwiseOp_SUM:
+    if (activation_.enabled()) {
+      ForwardSumActivation(bottom, top);
+      break;
+    }
     caffe_set(count, Dtype(0), top_data);
     // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
     for (int i = 0; i < bottom.size(); ++i) {
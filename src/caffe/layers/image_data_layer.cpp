@@ -107,7 +107,6 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   batch_timer.Start();
   double read_time = 0;
   double trans_time = 0;
-  CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
   ImageDataParameter image_data_param = this->layer_param_.image_data_param();
@@ -132,23 +131,13 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-  // datum scales
+  // Take the lines of the batch, then read and transform their images on the
+  // transform threads.
   const int lines_size = lines_.size();
+  vector<std::pair<std::string, int> > batch_lines(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
+    batch_lines[item_id] = lines_[lines_id_];
     prefetch_label[item_id] = lines_[lines_id_].second;
     // go to the next iter
     lines_id_++;
@@ -161,10 +150,38 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  // The time each worker spends reading and transforming, summed.
+  vector<double> read_times(this->num_transform_workers(), 0);
+  vector<double> trans_times(this->num_transform_workers(), 0);
+  this->ParallelTransform(batch_size, [&](int worker, int begin, int end) {
+    DataTransformer<Dtype>* transformer = this->transformers_[worker].get();
+    Blob<Dtype> transformed_data(this->transformed_data_.shape());
+    CPUTimer worker_timer;
+    for (int item_id = begin; item_id < end; ++item_id) {
+      worker_timer.Start();
+      cv::Mat cv_img = ReadImageToCVMat(
+          root_folder + batch_lines[item_id].first,
+          new_height, new_width, is_color);
+      CHECK(cv_img.data) << "Could not load " << batch_lines[item_id].first;
+      read_times[worker] += worker_timer.MicroSeconds();
+      worker_timer.Start();
+      // Apply transformations (mirror, crop...) to the image
+      int offset = batch->data_.offset(item_id);
+      transformed_data.set_cpu_data(prefetch_data + offset);
+      transformer->Transform(cv_img, &transformed_data);
+      trans_times[worker] += worker_timer.MicroSeconds();
+    }
+  });
+  for (int w = 0; w < read_times.size(); ++w) {
+    read_time += read_times[w];
+    trans_time += trans_times[w];
+  }
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  batch->read_time_ = read_time / 1000;
+  batch->transform_time_ = trans_time / 1000;
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
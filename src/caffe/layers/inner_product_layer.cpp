@@ -3,6 +3,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -52,6 +53,9 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  if (this->layer_param_.has_quantization_param()) {
+    Quantize(this->layer_param_.quantization_param().bottom_max());
+  }
 }
 
 template <typename Dtype>
@@ -83,6 +87,10 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (int8_bottom_scale_ > 0) {
+    Forward_cpu_int8(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
@@ -94,6 +102,60 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         bias_multiplier_.cpu_data(),
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
+  if (activation_.enabled()) {
+    activation_.Apply(top[0]);
+  }
+}
+
+template <typename Dtype>
+bool InnerProductLayer<Dtype>::FuseActivation(Layer<Dtype>* activation) {
+  return activation_.Init(activation);
+}
+
+template <typename Dtype>
+bool InnerProductLayer<Dtype>::Quantize(float bottom_max) {
+  if (bottom_max > 0) {
+    this->layer_param_.mutable_quantization_param()->set_bottom_max(
+        bottom_max);
+    int8_bottom_scale_ = 127 / bottom_max;
+  } else {
+    this->layer_param_.clear_quantization_param();
+    int8_bottom_scale_ = 0;
+  }
+  int8_weights_.Clear();
+  return true;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::Forward_cpu_int8(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  int8_weights_.Update(*this->blobs_[0], N_, K_, transpose_);
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  int8_bottom_.resize(M_ * K_);
+  int8_products_.resize(M_ * N_);
+  quantize_cpu(M_ * K_, bottom[0]->cpu_data(), int8_bottom_scale_,
+      &int8_bottom_[0]);
+  gemm_s8_cpu(M_, N_, K_, &int8_bottom_[0], K_, int8_weights_.data(), K_,
+      &int8_products_[0], N_);
+  // Scale back, add the bias and activate each item while it is in cache.
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  ParallelFor(M_, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const int32_t* products = &int8_products_[0] + i * N_;
+      Dtype* out = top_data + i * N_;
+      for (int j = 0; j < N_; ++j) {
+        out[j] = products[j] / (int8_bottom_scale_ *
+            int8_weights_.scales()[j]) + (bias ? bias[j] : Dtype(0));
+      }
+      if (activation_.enabled() && !activation_.per_channel()) {
+        activation_.Apply(N_, 1, out);
+      }
+    }
+  });
+  // The channels of a per channel activation are along axis 1 of the top.
+  if (activation_.enabled() && activation_.per_channel()) {
+    activation_.Apply(top[0]);
+  }
 }
 
 template <typename Dtype>
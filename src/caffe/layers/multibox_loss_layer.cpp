@@ -1,101 +1,244 @@
 #include "caffe/layers/multibox_loss_layer.hpp"
 #include <algorithm>
-#include <map>
+#include <cfloat>
+#include <cmath>
 #include <utility>
 #include <vector>
-#include <list>
 #include "caffe/util/math_functions.hpp"
 
-using std::list;
-
 namespace caffe {
 
 	template <typename Dtype>
 	void MultiBoxLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 		const vector<Blob<Dtype>*>& top) {
-		// bottom[3*i+0] stores the default boxes.
-		// bottom[3*i+1] stores the location predictions.
-		// bottom[3*i+2] stores the confidence predictions.
-		// bottom[3*n+1] stores the label truth bounding boxes.
-		// bottom[3*n+2] stores the ground truth bounding boxes.
+		LossLayer<Dtype>::LayerSetUp(bottom, top);
 		const DetectionParameter &detection_param = this->public_param_.detection_param();
 		box_dimensions_ = detection_param.range().dim_size();
+		CHECK_GT(box_dimensions_, 0) << "detection_param.range must describe the box space.";
 		share_location_ = detection_param.share_location();
 		num_classes_ = detection_param.num_classes();
+		CHECK_GT(num_classes_, 0);
 		const MultiBoxLossParameter &multibox_loss_param = this->layer_param_.multibox_loss_param();
-	    match_type_ = multibox_loss_param.match_type();
+		match_type_ = multibox_loss_param.match_type();
 		overlap_threshold_ = multibox_loss_param.overlap_threshold();
 		conf_loss_type_ = multibox_loss_param.conf_loss_type();
 		background_label_ = multibox_loss_param.background_label();
-		CHECK_GT(background_label_, 0);
+		CHECK_GE(background_label_, 0);
+		CHECK_LT(background_label_, num_classes_);
+		neg_pos_ratio_ = multibox_loss_param.neg_pos_ratio();
+		min_negative_ = multibox_loss_param.min_negatives();
+		CHECK_GE(neg_pos_ratio_, 0);
+		CHECK_GE(min_negative_, 0);
 	}
 
 	template <typename Dtype>
 	void MultiBoxLossLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 		const vector<Blob<Dtype>*>& top) {
-		gt_boxes_.clear();
-		pred_boxes_.clear();
 		const int pyramid_box_size = bottom.size() - 2;
-		ExtractGroundTruth(bottom[pyramid_box_size], bottom[pyramid_box_size + 1], box_dimensions_, gt_boxes_);
 		CHECK_EQ(pyramid_box_size % 3, 0);
 		num_pyramid_layer_ = pyramid_box_size / 3;
-
+		num_ = bottom[1]->shape(0);
+		CHECK_EQ(bottom[pyramid_box_size]->shape(0), num_);
+		pyramid_offsets_.resize(num_pyramid_layer_ + 1);
+		pyramid_offsets_[0] = 0;
 		for (int i = 0; i < num_pyramid_layer_; ++i){
 			const int id = 3 * i;
-			ExtractPredBoxes(bottom[id + 0], bottom[id + 1], bottom[id + 2], box_dimensions_,
-				share_location_, num_classes_, num_, pred_boxes_);
+			const int count = CountDefBoxes(bottom[id], box_dimensions_);
+			CHECK_EQ(bottom[id + 1]->shape(0), num_);
+			CHECK_EQ(bottom[id + 2]->shape(0), num_);
+			CHECK_EQ(bottom[id + 2]->count(1), count * num_classes_)
+				<< "The confidence predictions do not match the default boxes.";
+			pyramid_offsets_[i + 1] = pyramid_offsets_[i] + count;
 		}
-		int box_classes = share_location_ ? 1 : num_classes_;
+		num_boxes_ = pyramid_offsets_[num_pyramid_layer_];
+		def_boxes_.boxes.Reshape(box_dimensions_, num_boxes_);
+		def_boxes_.variances.Reshape(box_dimensions_, num_boxes_);
+		ReshapePredBoxes(num_, box_dimensions_, share_location_, num_classes_, num_boxes_, pred_boxes_);
+		ReshapePredBoxes(num_, box_dimensions_, share_location_, num_classes_, num_boxes_, pred_diffs_);
+		all_match_indices_.resize(num_);
+		conf_labels_.resize(num_);
 		vector<int> loss_shape(0);  // Loss layers output a scalar; 0 axes.
 		top[0]->Reshape(loss_shape);
 	}
 
+	template <typename Dtype>
+	void MultiBoxLossLayer<Dtype>::MatchImage(const int n) {
+		// The ground truth is matched against the default boxes; the location
+		// predictions are offsets relative to them.
+		const int loc_classes = share_location_ ? 1 : num_classes_;
+		const GTBoxes<Dtype> &gt = gt_boxes_[n];
+		vector<vector<int> > &match_indices = all_match_indices_[n];
+		vector<int> &conf_labels = conf_labels_[n];
+		match_indices.resize(loc_classes);
+		conf_labels.assign(num_boxes_, -1);
+		vector<int> matched(num_boxes_, -1);
+		vector<Dtype> best_overlaps(num_boxes_, Dtype(0));
+		vector<Dtype> max_overlaps(num_boxes_, Dtype(0));
+		vector<Dtype> match_overlaps;
+		vector<Dtype> class_max_overlaps;
+		for (int c = 0; c < loc_classes; ++c) {
+			if (!share_location_ && c == background_label_) {
+				match_indices[c].assign(num_boxes_, -1);
+				continue;
+			}
+			JaccardOverlaps(gt, def_boxes_.boxes, background_label_,
+				share_location_ ? -1 : c, overlaps_);
+			MatchBoxes(overlaps_, match_type_, overlap_threshold_, match_indices[c], match_overlaps);
+			MaxOverlaps(overlaps_, class_max_overlaps);
+			for (int i = 0; i < num_boxes_; ++i) {
+				max_overlaps[i] = std::max(max_overlaps[i], class_max_overlaps[i]);
+				const int g = match_indices[c][i];
+				if (g < 0) {
+					continue;
+				}
+				++num_matches_;
+				// A box matched for several classes is labelled with the best one.
+				if (matched[i] < 0 || match_overlaps[i] > best_overlaps[i]) {
+					matched[i] = g;
+					best_overlaps[i] = match_overlaps[i];
+					conf_labels[i] = gt.labels[g];
+				}
+			}
+		}
+		int num_positives = 0;
+		for (int i = 0; i < num_boxes_; ++i) {
+			num_positives += matched[i] >= 0;
+		}
+		vector<pair<Dtype, int> > negatives;
+		ExtractNegativeBoxes(pred_boxes_[n], num_classes_, background_label_, matched,
+			max_overlaps, overlap_threshold_, negatives);
+		int num_negatives = static_cast<int>(num_positives * neg_pos_ratio_ + 0.5);
+		num_negatives = std::max(num_negatives, min_negative_);
+		SelectHardNegatives(num_negatives, negatives);
+		for (int i = 0; i < negatives.size(); ++i) {
+			conf_labels[negatives[i].second] = background_label_;
+		}
+	}
+
 	template <typename Dtype>
 	void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 		const vector<Blob<Dtype>*>& top) {
-		for (int i = 0; i < bottom.size();++i){
-			//Copy data from GPU to CPU;
-			bottom[i]->cpu_data();
+		const int pyramid_box_size = 3 * num_pyramid_layer_;
+		ExtractGroundTruth(bottom[pyramid_box_size], bottom[pyramid_box_size + 1],
+			box_dimensions_, gt_boxes_);
+		for (int i = 0; i < num_pyramid_layer_; ++i){
+			const int id = 3 * i;
+			ExtractDefBoxes(bottom[id], box_dimensions_, pyramid_offsets_[i], def_boxes_);
+			ExtractPredBoxes(bottom[id + 1], bottom[id + 2], box_dimensions_,
+				share_location_, num_classes_, pyramid_offsets_[i], pred_boxes_);
 		}
-		//match_boxes[pred_box][gt_box]
+		def_boxes_.boxes.UpdateVolumes();
+
+		num_matches_ = 0;
 		for (int n = 0; n < num_; ++n) {
-			// overlaps[0][class_id][gt_box][pred_box]
-			// overlaps[1][class_id][pred_box][gt_box]
-			map<const Box<Dtype> *, const Box<Dtype> *> match_boxes;
-			vector<map<int, map<const Box<Dtype> *, map<const Box<Dtype>*, Dtype>>>> overlaps;
-			list<pair<const int, const Box<Dtype> *>> negtives;
-			JaccardOverlaps(&gt_boxes_[n], &pred_boxes_[n], match_type_, share_location_,
-				background_label_, overlaps);
-			MathBoxes(&overlaps, match_type_, overlap_threshold_, match_boxes);
-			ExtractNegtiveBox(&pred_boxes_[n], share_location_, background_label_, negtives);
-			int num_negtive = negtives.size();
-			int num_train_negtive =static_cast<int>(static_cast<float>(match_boxes.size())*neg_pos_ratio_ + 0.5);
-			if (neg_pos_ratio_ > 0){
-				num_train_negtive = std::min(num_train_negtive, num_negtive);
+			MatchImage(n);
+		}
+		const Dtype normalizer = std::max(num_matches_, 1);
+
+		const int loc_classes = share_location_ ? 1 : num_classes_;
+		vector<Dtype> code(2 * box_dimensions_);
+		vector<Dtype> prob(num_classes_);
+		Dtype loc_loss = 0;
+		Dtype conf_loss = 0;
+		for (int n = 0; n < num_; ++n) {
+			const PredBoxes<Dtype> &pred = pred_boxes_[n];
+			PredBoxes<Dtype> &diff = pred_diffs_[n];
+			// Location loss: smooth L1 between the predictions and the encoded
+			// ground truth of the matched boxes.
+			for (int c = 0; c < loc_classes; ++c) {
+				BoxSet<Dtype> &loc_diff = diff.locations[c];
+				for (int d = 0; d < box_dimensions_; ++d) {
+					caffe_set(num_boxes_, Dtype(0), loc_diff.mutable_min_location(d));
+					caffe_set(num_boxes_, Dtype(0), loc_diff.mutable_max_location(d));
+				}
+				const vector<int> &match_indices = all_match_indices_[n][c];
+				for (int i = 0; i < num_boxes_; ++i) {
+					if (match_indices[i] < 0) {
+						continue;
+					}
+					EncodeBox(gt_boxes_[n].boxes, match_indices[i], def_boxes_, i, &code[0]);
+					for (int j = 0; j < 2 * box_dimensions_; ++j) {
+						const int d = j % box_dimensions_;
+						const bool is_min = j < box_dimensions_;
+						const Dtype value = is_min ? pred.locations[c].min_location(d)[i]
+							: pred.locations[c].max_location(d)[i];
+						const Dtype x = value - code[j];
+						Dtype grad;
+						if (std::abs(x) < 1) {
+							loc_loss += 0.5 * x * x;
+							grad = x;
+						}
+						else {
+							loc_loss += std::abs(x) - 0.5;
+							grad = x > 0 ? Dtype(1) : Dtype(-1);
+						}
+						(is_min ? loc_diff.mutable_min_location(d) : loc_diff.mutable_max_location(d))[i] =
+							grad / normalizer;
+					}
+				}
 			}
-			CHECK_LE(min_negtive_, num_negtive);
-			num_train_negtive = std::max(num_negtive, min_negtive_);
-			vector<Box<Dtype> *> train_negtives;
-			
-			for (const auto &negtive : negtives)
-			for (int i = 0; i < num_negtive; i++){
-				if (num_train_negtive <= 0)
-					break;
-				if (overlaps[0][negtive.first][negtive.second].begin()->second < overlap_threshold_) {
-					train_negtives.push_back(overlap_threshold_);
-					if (train_negtives.)
+			// Confidence loss over the positives and the mined hard negatives.
+			std::fill(diff.confidences.begin(), diff.confidences.end(), Dtype(0));
+			const vector<int> &conf_labels = conf_labels_[n];
+			for (int i = 0; i < num_boxes_; ++i) {
+				const int label = conf_labels[i];
+				if (label < 0) {
+					continue;
+				}
+				if (conf_loss_type_ == MultiBoxLossParameter_ConfLossType_SOFTMAX) {
+					Dtype max_conf = -FLT_MAX;
+					for (int c = 0; c < num_classes_; ++c) {
+						max_conf = std::max(max_conf, pred.confidences[c * num_boxes_ + i]);
+					}
+					Dtype sum = 0;
+					for (int c = 0; c < num_classes_; ++c) {
+						prob[c] = std::exp(pred.confidences[c * num_boxes_ + i] - max_conf);
+						sum += prob[c];
+					}
+					for (int c = 0; c < num_classes_; ++c) {
+						prob[c] /= sum;
+						diff.confidences[c * num_boxes_ + i] = (prob[c] - (c == label)) / normalizer;
+					}
+					conf_loss -= std::log(std::max(prob[label], Dtype(FLT_MIN)));
+				}
+				else if (conf_loss_type_ == MultiBoxLossParameter_ConfLossType_LOGISTIC) {
+					for (int c = 0; c < num_classes_; ++c) {
+						const Dtype x = pred.confidences[c * num_boxes_ + i];
+						const Dtype target = c == label;
+						conf_loss += std::max(x, Dtype(0)) - x * target +
+							std::log(1 + std::exp(-std::abs(x)));
+						diff.confidences[c * num_boxes_ + i] =
+							(1 / (1 + std::exp(-x)) - target) / normalizer;
+					}
+				}
+				else {
+					LOG(FATAL) << "Unknown confidence loss type.";
 				}
 			}
 		}
-		
+		top[0]->mutable_cpu_data()[0] = (loc_loss + conf_loss) / normalizer;
 	}
 
 	template <typename Dtype>
 	void MultiBoxLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 		const vector<bool>& propagate_down,
 		const vector<Blob<Dtype>*>& bottom) {
-		
-
+		const int pyramid_box_size = 3 * num_pyramid_layer_;
+		if (propagate_down[pyramid_box_size] || propagate_down[pyramid_box_size + 1]) {
+			LOG(FATAL) << this->type()
+				<< " Layer cannot backpropagate to the ground truth inputs.";
+		}
+		const Dtype loss_weight = top[0]->cpu_diff()[0];
+		for (int i = 0; i < num_pyramid_layer_; ++i){
+			const int id = 3 * i;
+			if (!propagate_down[id + 1] && !propagate_down[id + 2]) {
+				continue;
+			}
+			ScatterPredDiffs(pred_diffs_, box_dimensions_, share_location_, num_classes_,
+				pyramid_offsets_[i], bottom[id + 1], bottom[id + 2]);
+			caffe_scal(bottom[id + 1]->count(), loss_weight, bottom[id + 1]->mutable_cpu_diff());
+			caffe_scal(bottom[id + 2]->count(), loss_weight, bottom[id + 2]->mutable_cpu_diff());
+		}
 	}
 
 	INSTANTIATE_CLASS(MultiBoxLossLayer);
@@ -10,6 +10,8 @@
 #include <vector>
 
 #include "caffe/layers/psroi_pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using std::max;
 using std::min;
@@ -50,16 +52,156 @@ namespace caffe {
       bottom[1]->num(), output_dim_, pooled_height_, pooled_width_);
   }
 
+  // Computes the [hstart, hend) x [wstart, wend) input window of every bin
+  // of every ROI, in the same arithmetic as the CUDA kernels.
+  template <typename Dtype>
+  void PSROIPoolingLayer<Dtype>::ComputeBins(const Blob<Dtype>* rois) {
+    const int num_rois = rois->num();
+    const Dtype* bottom_rois = rois->cpu_data();
+    bins_.resize(num_rois * pooled_height_ * pooled_width_ * 4);
+    roi_batch_inds_.resize(num_rois);
+    for (int n = 0; n < num_rois; ++n, bottom_rois += 5) {
+      roi_batch_inds_[n] = bottom_rois[0];
+      Dtype roi_start_w =
+        static_cast<Dtype>(round(bottom_rois[1])) * spatial_scale_;
+      Dtype roi_start_h =
+        static_cast<Dtype>(round(bottom_rois[2])) * spatial_scale_;
+      Dtype roi_end_w =
+        static_cast<Dtype>(round(bottom_rois[3]) + 1.) * spatial_scale_;
+      Dtype roi_end_h =
+        static_cast<Dtype>(round(bottom_rois[4]) + 1.) * spatial_scale_;
+
+      // Force too small ROIs to be 1x1
+      Dtype roi_width = max(roi_end_w - roi_start_w, Dtype(0.1));  // avoid 0
+      Dtype roi_height = max(roi_end_h - roi_start_h, Dtype(0.1));
+
+      // Compute w and h at bottom
+      Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height_);
+      Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width_);
+
+      int* roi_bins = &bins_[n * pooled_height_ * pooled_width_ * 4];
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = floor(static_cast<Dtype>(ph) * bin_size_h
+                              + roi_start_h);
+          int wstart = floor(static_cast<Dtype>(pw) * bin_size_w
+                              + roi_start_w);
+          int hend = ceil(static_cast<Dtype>(ph + 1) * bin_size_h
+                            + roi_start_h);
+          int wend = ceil(static_cast<Dtype>(pw + 1) * bin_size_w
+                            + roi_start_w);
+          // Add roi offsets and clip to input boundaries
+          int* bin = roi_bins + (ph * pooled_width_ + pw) * 4;
+          bin[0] = min(max(hstart, 0), height_);
+          bin[1] = min(max(hend, 0), height_);
+          bin[2] = min(max(wstart, 0), width_);
+          bin[3] = min(max(wend, 0), width_);
+        }
+      }
+    }
+  }
+
   template <typename Dtype>
   void PSROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-    NOT_IMPLEMENTED;
+    ComputeBins(bottom[1]);
+    const Dtype* bottom_data = bottom[0]->cpu_data();
+    Dtype* top_data = top[0]->mutable_cpu_data();
+    int* mapping_channel = mapping_channel_.mutable_cpu_data();
+    const int bins_per_roi = pooled_height_ * pooled_width_;
+    // One task per (roi, ctop): its group_size^2 bins read disjoint input
+    // channels and write one contiguous block of the output.
+    ParallelFor(top[0]->num() * output_dim_, [&](int begin, int end) {
+      for (int task = begin; task < end; ++task) {
+        const int n = task / output_dim_;
+        const int ctop = task % output_dim_;
+        const int* roi_bins = &bins_[n * bins_per_roi * 4];
+        const Dtype* batch_data = bottom_data +
+          roi_batch_inds_[n] * channels_ * height_ * width_;
+        for (int ph = 0; ph < pooled_height_; ++ph) {
+          for (int pw = 0; pw < pooled_width_; ++pw) {
+            const int* bin = roi_bins + (ph * pooled_width_ + pw) * 4;
+            const int hstart = bin[0], hend = bin[1];
+            const int wstart = bin[2], wend = bin[3];
+            bool is_empty = (hend <= hstart) || (wend <= wstart);
+            int c = (ctop*group_size_ + ph)*group_size_ + pw;
+            const Dtype* channel_data = batch_data + c * height_ * width_;
+            Dtype out_sum = 0;
+            for (int h = hstart; h < hend; ++h) {
+              const Dtype* row = channel_data + h * width_;
+              for (int w = wstart; w < wend; ++w) {
+                out_sum += row[w];
+              }
+            }
+            Dtype bin_area = (hend - hstart)*(wend - wstart);
+            const int index = (task * pooled_height_ + ph) * pooled_width_ + pw;
+            top_data[index] = is_empty ? 0. : out_sum / bin_area;
+            mapping_channel[index] = c;
+          }
+        }
+      }
+    });
   }
 
   template <typename Dtype>
   void PSROIPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-    NOT_IMPLEMENTED;
+    if (!propagate_down[0]) {
+      return;
+    }
+    ComputeBins(bottom[1]);
+    const Dtype* top_diff = top[0]->cpu_diff();
+    const int* mapping_channel = mapping_channel_.cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    caffe_set(bottom[1]->count(), Dtype(0), bottom[1]->mutable_cpu_diff());
+    caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+    const int num_rois = top[0]->num();
+    const int batch_size = bottom[0]->num();
+    const int bins_per_roi = pooled_height_ * pooled_width_;
+    // Group the ROIs by image so that each input plane is owned by a single
+    // task. Every plane then accumulates its ROIs in index order, which
+    // makes the result deterministic without atomics or a reduction.
+    vector<vector<int> > image_rois(batch_size);
+    for (int n = 0; n < num_rois; ++n) {
+      CHECK_GE(roi_batch_inds_[n], 0);
+      CHECK_LT(roi_batch_inds_[n], batch_size);
+      image_rois[roi_batch_inds_[n]].push_back(n);
+    }
+    ParallelFor(batch_size * output_dim_, [&](int begin, int end) {
+      for (int task = begin; task < end; ++task) {
+        const int b = task / output_dim_;
+        const int ctop = task % output_dim_;
+        const vector<int>& rois = image_rois[b];
+        for (int i = 0; i < rois.size(); ++i) {
+          const int n = rois[i];
+          const int* roi_bins = &bins_[n * bins_per_roi * 4];
+          for (int ph = 0; ph < pooled_height_; ++ph) {
+            for (int pw = 0; pw < pooled_width_; ++pw) {
+              const int* bin = roi_bins + (ph * pooled_width_ + pw) * 4;
+              const int hstart = bin[0], hend = bin[1];
+              const int wstart = bin[2], wend = bin[3];
+              bool is_empty = (hend <= hstart) || (wend <= wstart);
+              if (is_empty) {
+                continue;
+              }
+              const int index =
+                ((n * output_dim_ + ctop) * pooled_height_ + ph) * pooled_width_ + pw;
+              int c = mapping_channel[index];
+              Dtype* offset_bottom_diff = bottom_diff +
+                (b * channels_ + c) * height_ * width_;
+              Dtype bin_area = (hend - hstart)*(wend - wstart);
+              Dtype diff_val = top_diff[index] / bin_area;
+              for (int h = hstart; h < hend; ++h) {
+                Dtype* row = offset_bottom_diff + h * width_;
+                for (int w = wstart; w < wend; ++w) {
+                  row[w] += diff_val;
+                }
+              }
+            }
+          }
+        }
+      }
+    });
   }
 #ifdef CPU_ONLY
   STUB_GPU(PSROIPoolingLayer);
@@ -55,10 +55,19 @@ void ScaleLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     bias_layer_ = LayerRegistry<Dtype>::CreateLayer(layer_param);
     bias_bottom_vec_.resize(1);
     bias_bottom_vec_[0] = bottom[0];
+    // The bias is given along with the scale, the bias layer then uses it.
+    const bool bias_given = this->blobs_.size() == (bottom.size() == 1 ? 2 : 1);
+    if (bias_given) {
+      bias_layer_->blobs().push_back(this->blobs_.back());
+    }
     bias_layer_->SetUp(bias_bottom_vec_, top);
-    bias_param_id_ = this->blobs_.size();
-    this->blobs_.resize(bias_param_id_ + 1);
-    this->blobs_[bias_param_id_] = bias_layer_->blobs()[0];
+    if (bias_given) {
+      bias_param_id_ = this->blobs_.size() - 1;
+    } else {
+      bias_param_id_ = this->blobs_.size();
+      this->blobs_.resize(bias_param_id_ + 1);
+      this->blobs_[bias_param_id_] = bias_layer_->blobs()[0];
+    }
     bias_propagate_down_.resize(1, false);
   }
   this->param_propagate_down_.resize(this->blobs_.size(), true);
@@ -4,12 +4,14 @@
 // --------------------------------------------------------
 
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "caffe/layers/smooth_l1_loss_ohem_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -89,14 +91,81 @@ Dtype SmoothL1LossOHEMLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SmoothL1LossOHEMLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  const int channels = bottom[0]->channels();
+  const int dim = channels * inner_num_;
+  const Dtype* b0 = bottom[0]->cpu_data();
+  const Dtype* b1 = bottom[1]->cpu_data();
+  const Dtype* weights = has_weights_ ? bottom[2]->cpu_data() : NULL;
+  Dtype* diff = diff_.mutable_cpu_data();
+  Dtype* errors = errors_.mutable_cpu_data();
+  Dtype* instance_loss = top.size() >= 2 ? top[1]->mutable_cpu_data() : NULL;
+  const int inner_num = inner_num_;
+  // One task per image; the per-instance loss only reads its own image.
+  ParallelFor(outer_num_, [=](int begin, int end) {
+    for (int i = begin * dim; i < end * dim; ++i) {
+      // d := w * (b0 - b1)
+      Dtype val = b0[i] - b1[i];
+      if (weights) {
+        val *= weights[i];
+      }
+      diff[i] = val;
+      // f(x) = 0.5 * x^2    if |x| < 1
+      //        |x| - 0.5    otherwise
+      Dtype abs_val = std::abs(val);
+      errors[i] = abs_val < 1 ? Dtype(0.5 * val * val) : Dtype(abs_val - 0.5);
+    }
+    if (instance_loss) {
+      // Output per-instance loss
+      for (int n = begin; n < end; ++n) {
+        for (int s = 0; s < inner_num; ++s) {
+          Dtype sum = 0;
+          for (int c = 0; c < channels; ++c) {
+            sum += errors[(n * channels + c) * inner_num + s];
+          }
+          instance_loss[n * inner_num + s] = sum;
+        }
+      }
+    }
+  });
+
+  Dtype loss = caffe_cpu_asum(errors_.count(), errors_.cpu_data());
+  Dtype pre_fixed_normalizer =
+    this->layer_param_.loss_param().pre_fixed_normalizer();
+  top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_,
+    pre_fixed_normalizer);
 }
 
 template <typename Dtype>
 void SmoothL1LossOHEMLayer<Dtype>::Backward_cpu(
   const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
   const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  const int count = diff_.count();
+  Dtype* diff = diff_.mutable_cpu_data();
+  ParallelFor(count, [=](int begin, int end) {
+    // f'(x) = x         if |x| < 1
+    //       = sign(x)   otherwise
+    for (int i = begin; i < end; ++i) {
+      Dtype val = diff[i];
+      if (std::abs(val) >= 1) {
+        diff[i] = (Dtype(0) < val) - (val < Dtype(0));
+      }
+    }
+  }, 4096);
+  for (int i = 0; i < 2; ++i) {
+    if (propagate_down[i]) {
+      const Dtype sign = (i == 0) ? 1 : -1;
+      Dtype pre_fixed_normalizer =
+        this->layer_param_.loss_param().pre_fixed_normalizer();
+      Dtype normalizer = get_normalizer(normalization_, pre_fixed_normalizer);
+      Dtype alpha = sign * top[0]->cpu_diff()[0] / normalizer;
+      caffe_cpu_axpby(
+        bottom[i]->count(),              // count
+        alpha,                           // alpha
+        diff_.cpu_data(),                // x
+        Dtype(0),                        // beta
+        bottom[i]->mutable_cpu_diff());  // y
+    }
+  }
 }
 
 #ifdef CPU_ONLY
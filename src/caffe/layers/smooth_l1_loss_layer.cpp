@@ -1,6 +1,9 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/smooth_l1_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -43,16 +46,82 @@ void SmoothL1LossLayer<Dtype>::Reshape(
   }
 }
 
+// Elementwise chunks handed to each thread of the pool.
+static const int kSmoothL1Grain = 4096;
+
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  const int count = bottom[0]->count();
+  const Dtype* b0 = bottom[0]->cpu_data();
+  const Dtype* b1 = bottom[1]->cpu_data();
+  const Dtype* inside_weights = has_weights_ ? bottom[2]->cpu_data() : NULL;
+  const Dtype* outside_weights = has_weights_ ? bottom[3]->cpu_data() : NULL;
+  Dtype* diff = diff_.mutable_cpu_data();
+  Dtype* errors = errors_.mutable_cpu_data();
+  const Dtype sigma2 = sigma2_;
+  ParallelFor(count, [=](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      // d := w_in * (b0 - b1)
+      Dtype val = b0[i] - b1[i];
+      if (inside_weights) {
+        val *= inside_weights[i];
+      }
+      diff[i] = val;
+      // f(x) = 0.5 * (sigma * x)^2          if |x| < 1 / sigma / sigma
+      //        |x| - 0.5 / sigma / sigma    otherwise
+      Dtype abs_val = std::abs(val);
+      Dtype error = abs_val < 1.0 / sigma2 ?
+          Dtype(0.5 * val * val * sigma2) : Dtype(abs_val - 0.5 / sigma2);
+      if (outside_weights) {
+        // d := w_out * SmoothL1(w_in * (b0 - b1))
+        error *= outside_weights[i];
+      }
+      errors[i] = error;
+    }
+  }, kSmoothL1Grain);
+  Dtype loss = caffe_cpu_dot(count, ones_.cpu_data(), errors_.cpu_data());
+  top[0]->mutable_cpu_data()[0] = loss / bottom[0]->num();
 }
 
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  // after forwards, diff_ holds w_in * (b0 - b1)
+  const int count = diff_.count();
+  Dtype* diff = diff_.mutable_cpu_data();
+  const Dtype sigma2 = sigma2_;
+  ParallelFor(count, [=](int begin, int end) {
+    // f'(x) = sigma * sigma * x         if |x| < 1 / sigma / sigma
+    //       = sign(x)                   otherwise
+    for (int i = begin; i < end; ++i) {
+      Dtype val = diff[i];
+      if (std::abs(val) < 1.0 / sigma2) {
+        diff[i] = sigma2 * val;
+      } else {
+        diff[i] = (Dtype(0) < val) - (val < Dtype(0));
+      }
+    }
+  }, kSmoothL1Grain);
+  for (int i = 0; i < 2; ++i) {
+    if (propagate_down[i]) {
+      const Dtype sign = (i == 0) ? 1 : -1;
+      const Dtype alpha = sign * top[0]->cpu_diff()[0] / bottom[i]->num();
+      const Dtype* inside_weights = has_weights_ ? bottom[2]->cpu_data() : NULL;
+      const Dtype* outside_weights = has_weights_ ? bottom[3]->cpu_data() : NULL;
+      Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      ParallelFor(count, [=](int begin, int end) {
+        for (int j = begin; j < end; ++j) {
+          Dtype val = alpha * diff[j];
+          if (inside_weights) {
+            // Scale by "inside" and "outside" weight
+            val = val * inside_weights[j] * outside_weights[j];
+          }
+          bottom_diff[j] = val;
+        }
+      }, kSmoothL1Grain);
+    }
+  }
 }
 
 #ifdef CPU_ONLY
@@ -4,6 +4,7 @@
 
 #include "caffe/layers/softmax_loss_ohem_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -95,14 +96,103 @@ Dtype SoftmaxWithLossOHEMLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SoftmaxWithLossOHEMLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  // The forward pass computes the softmax prob values.
+  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
+  const Dtype* prob_data = prob_.cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const int dim = prob_.count() / outer_num_;
+  const int inner_num = inner_num_;
+  const int channels = prob_.shape(softmax_axis_);
+  const bool has_ignore_label = has_ignore_label_;
+  const int ignore_label = ignore_label_;
+  // Per-instance losses are written to the bottom diff first, as on the GPU;
+  // it is cleared below before Backward fills it.
+  Dtype* loss_data = bottom[0]->mutable_cpu_diff();
+  ParallelFor(outer_num_, [=](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      for (int j = 0; j < inner_num; ++j) {
+        const int index = i * inner_num + j;
+        const int label_value = static_cast<int>(label[index]);
+        if (has_ignore_label && label_value == ignore_label) {
+          loss_data[index] = 0;
+          continue;
+        }
+        DCHECK_GE(label_value, 0);
+        DCHECK_LT(label_value, channels);
+        loss_data[index] = -log(std::max(
+            prob_data[i * dim + label_value * inner_num + j], Dtype(FLT_MIN)));
+      }
+    }
+  });
+  const int nthreads = outer_num_ * inner_num_;
+  Dtype loss = caffe_cpu_asum(nthreads, loss_data);
+  int valid_count = -1;
+  if (normalization_ == LossParameter_NormalizationMode_VALID &&
+      has_ignore_label_) {
+    valid_count = 0;
+    for (int i = 0; i < nthreads; ++i) {
+      valid_count += static_cast<int>(label[i]) != ignore_label_;
+    }
+  }
+  top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_,
+                                                        valid_count);
+  if (top.size() >= 2) {
+    top[1]->ShareData(prob_);
+  }
+  if (top.size() >= 3) {
+    // Output per-instance loss
+    caffe_copy(top[2]->count(), loss_data, top[2]->mutable_cpu_data());
+  }
+
+  // Fix a bug, which happens when propagate_down[0] = false in backward
+  caffe_set(bottom[0]->count(), Dtype(0), bottom[0]->mutable_cpu_diff());
 }
 
 template <typename Dtype>
 void SoftmaxWithLossOHEMLayer<Dtype>::Backward_cpu(
   const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
   const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (propagate_down[0]) {
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const Dtype* prob_data = prob_.cpu_data();
+    const Dtype* label = bottom[1]->cpu_data();
+    const int dim = prob_.count() / outer_num_;
+    const int inner_num = inner_num_;
+    const int channels = prob_.shape(softmax_axis_);
+    const bool has_ignore_label = has_ignore_label_;
+    const int ignore_label = ignore_label_;
+    ParallelFor(outer_num_, [=](int begin, int end) {
+      caffe_copy((end - begin) * dim, prob_data + begin * dim,
+          bottom_diff + begin * dim);
+      for (int i = begin; i < end; ++i) {
+        for (int j = 0; j < inner_num; ++j) {
+          const int label_value = static_cast<int>(label[i * inner_num + j]);
+          if (has_ignore_label && label_value == ignore_label) {
+            for (int c = 0; c < channels; ++c) {
+              bottom_diff[i * dim + c * inner_num + j] = 0;
+            }
+          } else {
+            bottom_diff[i * dim + label_value * inner_num + j] -= 1;
+          }
+        }
+      }
+    });
+    int valid_count = -1;
+    if (normalization_ == LossParameter_NormalizationMode_VALID &&
+        has_ignore_label_) {
+      valid_count = 0;
+      for (int i = 0; i < outer_num_ * inner_num_; ++i) {
+        valid_count += static_cast<int>(label[i]) != ignore_label_;
+      }
+    }
+    const Dtype loss_weight = top[0]->cpu_diff()[0] /
+                              get_normalizer(normalization_, valid_count);
+    caffe_scal(prob_.count(), loss_weight, bottom_diff);
+  }
 }
 
 #ifdef CPU_ONLY
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include <set>
 #include <string>
@@ -10,11 +11,17 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
+#include "caffe/net_model.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/memory_planner.hpp"
+#include "caffe/util/net_optimizer.hpp"
+#include "caffe/util/task_graph.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -46,7 +53,15 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
 }
 
 template <typename Dtype>
-void Net<Dtype>::Init(const NetParameter& in_param) {
+Net<Dtype>::Net(const NetModel<Dtype>& model)
+    : root_net_(NULL) {
+  mapped_weights_ = model.mapped_weights();
+  Init(model.param(), &model);
+}
+
+template <typename Dtype>
+void Net<Dtype>::Init(const NetParameter& in_param,
+    const NetModel<Dtype>* model) {
   CHECK(Caffe::root_solver() || root_net_)
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
@@ -58,6 +73,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
+  net_param_.CopyFrom(filtered_param);
+  for (int i = 0; i < net_param_.layer_size(); ++i) {
+    net_param_.mutable_layer(i)->clear_blobs();
+  }
   // Create a copy of filtered_param with splits added where necessary.
   NetParameter param;
   InsertSplits(filtered_param, &param);
@@ -96,6 +115,13 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     }
+    // Layers given params skip their fillers.
+    const vector<shared_ptr<Blob<Dtype> > >* model_blobs =
+        model && !share_from_root ? model->layer_blobs(layer_param.name()) :
+        NULL;
+    if (model_blobs) {
+      layers_[layer_id]->blobs() = *model_blobs;
+    }
     layer_names_.push_back(layer_param.name());
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating Layer " << layer_param.name();
@@ -123,7 +149,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     // specified fewer than the required number (as specified by
     // ExactNumTopBlobs() or MinTopBlobs()), allocate them here.
     Layer<Dtype>* layer = layers_[layer_id].get();
-	if (layer->type() == "SSD" || layer->type() == "MulitiBoxLoss"){
+	const string layer_type = layer->type();
+	if (layer_type == "SSD" || layer_type == "MultiBoxLoss" ||
+		layer_type == "DetectionOutput"){
 		layer->set_public_param(param.public_param());
 	}
 
@@ -151,6 +179,21 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
+    if (model_blobs) {
+      // Layers replacing the params they are given, e.g. with those of an
+      // inner net, share the data of the model's instead.
+      vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[layer_id]->blobs();
+      CHECK_EQ(blobs.size(), model_blobs->size())
+          << "Incompatible number of blobs for layer " << layer_param.name();
+      for (int j = 0; j < blobs.size(); ++j) {
+        if (blobs[j] != (*model_blobs)[j]) {
+          CHECK(blobs[j]->shape() == (*model_blobs)[j]->shape())
+              << "Cannot share param " << j << " of layer "
+              << layer_param.name() << "; shape mismatch";
+          blobs[j]->ShareData(*(*model_blobs)[j]);
+        }
+      }
+    }
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -283,12 +326,240 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  FuseActivations();
   debug_info_ = param.debug_info();
+  parallel_layers_ = param.parallel_layers();
+  forward_graphs_.clear();
+  backward_graphs_.clear();
+  backward_layer_ids_.clear();
+  plan_memory_ = param.optimize_memory();
+  memory_observed_ = false;
+  last_forward_end_ = -1;
+  memory_slabs_.clear();
+  blob_memory_pinned_.assign(blobs_.size(), false);
+  blob_memory_groups_.assign(blobs_.size(), -1);
+  blob_memory_slabs_.assign(blobs_.size(), -1);
+  reshape_plan_cache_size_ = param.reshape_plan_cache_size();
+  reshape_plan_hits_ = 0;
+  reshape_plan_misses_ = 0;
+  reshape_plans_.clear();
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    layers_[layer_id]->SetReshapeOnChange(reshape_plan_cache_size_ > 0);
+  }
+  if (reshape_plan_cache_size_ > 0) {
+    reshape_plans_.push_back(ReshapePlan());
+    ReshapePlan& plan = reshape_plans_.front();
+    for (int i = 0; i < net_input_blobs_.size(); ++i) {
+      plan.input_shapes.push_back(net_input_blobs_[i]->shape());
+    }
+    plan.memory_planned = false;
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::FuseActivations() {
+  for (int layer_id = 1; layer_id < layers_.size(); ++layer_id) {
+    const int producer_id = layer_id - 1;
+    // Only in-place activations of the single top of the layer just before,
+    // so that no other layer sees that top before the activation.
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    if (bottom_ids.size() != 1 || top_ids.size() != 1 ||
+        bottom_ids[0] != top_ids[0] ||
+        top_id_vecs_[producer_id].size() != 1 ||
+        top_id_vecs_[producer_id][0] != bottom_ids[0]) {
+      continue;
+    }
+    // Backward needs the layers apart.
+    if (layer_need_backward_[layer_id] || layer_need_backward_[producer_id] ||
+        !layers_[layer_id]->layer_param().fuse_activation() ||
+        !layers_[producer_id]->layer_param().fuse_activation()) {
+      continue;
+    }
+    if (layers_[producer_id]->FuseActivation(layers_[layer_id].get())) {
+      layers_[layer_id]->SetFused(true);
+      LOG_IF(INFO, Caffe::root_solver()) << "Fusing " << layer_names_[layer_id]
+          << " into " << layer_names_[producer_id];
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemory() {
+  if (phase_ != TEST || std::find(layer_need_backward_.begin(),
+      layer_need_backward_.end(), true) != layer_need_backward_.end()) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Not planning memory of " << name_
+        << ", only TEST nets without backward can share blob memory.";
+    return;
+  }
+  // Blobs sharing data after a complete Forward (Split, Flatten, Reshape...)
+  // form one group, alive from its first top to its last bottom.
+  map<SyncedMemory*, int> group_ids;
+  vector<int> blob_groups(blobs_.size());
+  int num_groups = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    // Empty blobs have no data yet and stay out of the plan.
+    if (blobs_[blob_id]->count() == 0) {
+      blob_groups[blob_id] = num_groups++;
+      continue;
+    }
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (group_ids.find(memory) == group_ids.end()) {
+      group_ids[memory] = num_groups++;
+    }
+    blob_groups[blob_id] = group_ids[memory];
+  }
+  vector<int> begins(num_groups, layers_.size());
+  vector<int> ends(num_groups, -1);
+  vector<size_t> sizes(num_groups, 0);
+  vector<bool> pinned(num_groups, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    for (int i = 0; i < bottom_ids.size(); ++i) {
+      const int group_id = blob_groups[bottom_ids[i]];
+      ends[group_id] = std::max(ends[group_id], layer_id);
+    }
+    for (int i = 0; i < top_ids.size(); ++i) {
+      const int group_id = blob_groups[top_ids[i]];
+      begins[group_id] = std::min(begins[group_id], layer_id);
+      ends[group_id] = std::max(ends[group_id], layer_id);
+      sizes[group_id] = std::max(sizes[group_id],
+          blobs_[top_ids[i]]->count() * sizeof(Dtype));
+      // Data layers may point their tops at memory of their own.
+      if (bottom_ids.empty()) {
+        pinned[group_id] = true;
+      }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    pinned[blob_groups[net_input_blob_indices_[i]]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    pinned[blob_groups[net_output_blob_indices_[i]]] = true;
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blob_memory_pinned_[blob_id]) {
+      pinned[blob_groups[blob_id]] = true;
+    }
+  }
+  MemoryPlanner planner;
+  vector<int> group_buffers(num_groups, -1);
+  for (int group_id = 0; group_id < num_groups; ++group_id) {
+    if (!pinned[group_id] && sizes[group_id] > 0) {
+      group_buffers[group_id] = planner.AddBuffer(sizes[group_id],
+          begins[group_id], ends[group_id]);
+    }
+  }
+  planner.Plan();
+  memory_slabs_.resize(planner.num_slabs());
+  for (int slab = 0; slab < planner.num_slabs(); ++slab) {
+    memory_slabs_[slab].reset(new SyncedMemory(planner.slab_size(slab)));
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int buffer = group_buffers[blob_groups[blob_id]];
+    if (buffer >= 0) {
+      blob_memory_groups_[blob_id] = blob_groups[blob_id];
+      blob_memory_slabs_[blob_id] = planner.slab(buffer);
+      blobs_[blob_id]->set_data_memory(memory_slabs_[planner.slab(buffer)]);
+    }
+  }
+  // The layer graphs must now also order the blobs sharing a slab.
+  forward_graphs_.clear();
+  backward_graphs_.clear();
+  backward_layer_ids_.clear();
+  LOG_IF(INFO, Caffe::root_solver()) << "Planned memory of "
+      << planner.num_buffers() << " blobs into " << planner.num_slabs()
+      << " shared buffers: " << planner.buffer_bytes() << " bytes down to "
+      << planner.slab_bytes() << ", saved "
+      << planner.buffer_bytes() - planner.slab_bytes() << " bytes.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::UnplanMemory() {
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int slab = blob_memory_slabs_[blob_id];
+    if (slab >= 0 && blobs_[blob_id]->data() == memory_slabs_[slab]) {
+      blobs_[blob_id]->set_data_memory(shared_ptr<SyncedMemory>(
+          new SyncedMemory(blobs_[blob_id]->count() * sizeof(Dtype))));
+    }
+  }
+  memory_slabs_.clear();
+  blob_memory_groups_.assign(blobs_.size(), -1);
+  blob_memory_slabs_.assign(blobs_.size(), -1);
+  forward_graphs_.clear();
+  backward_graphs_.clear();
+  backward_layer_ids_.clear();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ApplyReshapePlan() {
+  vector<vector<int> > input_shapes(net_input_blobs_.size());
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    input_shapes[i] = net_input_blobs_[i]->shape();
+  }
+  if (reshape_plans_.front().input_shapes == input_shapes) {
+    return;
+  }
+  typename std::list<ReshapePlan>::iterator it = reshape_plans_.begin();
+  while (it != reshape_plans_.end() && it->input_shapes != input_shapes) {
+    ++it;
+  }
+  UnplanMemory();
+  if (it != reshape_plans_.end()) {
+    ++reshape_plan_hits_;
+    reshape_plans_.splice(reshape_plans_.begin(), reshape_plans_, it);
+  } else {
+    ++reshape_plan_misses_;
+    reshape_plans_.push_front(ReshapePlan());
+    reshape_plans_.front().input_shapes = input_shapes;
+    reshape_plans_.front().memory_planned = false;
+    if (reshape_plans_.size() > reshape_plan_cache_size_) {
+      reshape_plans_.pop_back();
+    }
+  }
+  ReshapePlan& plan = reshape_plans_.front();
+  if (plan.memory_planned) {
+    // Blobs sharing data with a blob looked up by name since keep their own
+    // memory.
+    set<int> pinned_groups;
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      if (blob_memory_pinned_[blob_id]) {
+        pinned_groups.insert(plan.blob_memory_groups[blob_id]);
+      }
+    }
+    // The memory goes back before the layers reshape, as Split and others
+    // share the data of their bottoms then.
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      const int slab = plan.blob_memory_slabs[blob_id];
+      if (slab < 0 || pinned_groups.count(plan.blob_memory_groups[blob_id])) {
+        continue;
+      }
+      blobs_[blob_id]->Reshape(plan.blob_shapes[blob_id]);
+      blobs_[blob_id]->set_data_memory(plan.memory_slabs[slab]);
+      blob_memory_groups_[blob_id] = plan.blob_memory_groups[blob_id];
+      blob_memory_slabs_[blob_id] = slab;
+    }
+    memory_slabs_ = plan.memory_slabs;
+  } else {
+    plan_memory_ = net_param_.optimize_memory();
+    memory_observed_ = false;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->BottomShapesChanged(bottom_vecs_[i]);
+    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+  }
+  plan.blob_shapes.resize(blobs_.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    plan.blob_shapes[blob_id] = blobs_[blob_id]->shape();
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::SetPhase(Phase phase) {
+  CHECK(phase == TEST || memory_slabs_.empty())
+      << "Blobs of " << name_ << " share memory and cannot be trained.";
   // set all layers
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->set_phase(phase);
@@ -554,17 +825,175 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+template <typename Dtype>
+bool Net<Dtype>::RunInParallel(int num_layers) const {
+  // The debug info is printed in layer order, and on the GPU the layers are
+  // already serialized on the default stream.
+  return parallel_layers_ && !debug_info_ && num_layers > 1 &&
+      Caffe::mode() == Caffe::CPU && ThreadPool::Global().num_threads() > 1;
+}
+
+template <typename Dtype>
+shared_ptr<TaskGraph> Net<Dtype>::BuildLayerGraph(
+    const vector<int>& layer_ids, bool backward) const {
+  // Each layer reads and writes some blobs and parameters. A layer waits for
+  // the last earlier layer writing anything it touches, and a writer also
+  // waits for the readers since that write, so every blob sees the same
+  // sequence of accesses as in serial execution.
+  const int param_offset = blobs_.size();
+  // Layers that must stay on the calling thread also keep their order.
+  const int caller_resource = param_offset + learnable_params_.size();
+  // Blobs sharing planned memory are one resource.
+  const int slab_offset = caller_resource + 1;
+  const int num_resources = slab_offset + memory_slabs_.size();
+  vector<int> last_writer(num_resources, -1);
+  vector<vector<int> > readers(num_resources);
+  shared_ptr<TaskGraph> graph(new TaskGraph(layer_ids.size()));
+  for (int task = 0; task < layer_ids.size(); ++task) {
+    const int layer_id = layer_ids[task];
+    vector<int> reads, writes;
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    if (backward) {
+      // Backward reads the top diffs and the data on both sides, and writes
+      // the bottom diffs.
+      reads.insert(reads.end(), top_ids.begin(), top_ids.end());
+      reads.insert(reads.end(), bottom_ids.begin(), bottom_ids.end());
+      writes.insert(writes.end(), bottom_ids.begin(), bottom_ids.end());
+    } else {
+      reads.insert(reads.end(), bottom_ids.begin(), bottom_ids.end());
+      writes.insert(writes.end(), top_ids.begin(), top_ids.end());
+    }
+    for (int i = 0; i < reads.size(); ++i) {
+      if (blob_memory_slabs_[reads[i]] >= 0) {
+        reads[i] = slab_offset + blob_memory_slabs_[reads[i]];
+      }
+    }
+    for (int i = 0; i < writes.size(); ++i) {
+      if (blob_memory_slabs_[writes[i]] >= 0) {
+        writes[i] = slab_offset + blob_memory_slabs_[writes[i]];
+      }
+    }
+    // Shared parameters accumulate their diffs in order, and some layers
+    // update their blobs in Forward (e.g. BatchNorm statistics).
+    const vector<int>& param_ids = param_id_vecs_[layer_id];
+    for (int i = 0; i < param_ids.size(); ++i) {
+      writes.push_back(param_offset + learnable_param_ids_[param_ids[i]]);
+    }
+    if (!layers_[layer_id]->RunsConcurrently()) {
+      writes.push_back(caller_resource);
+      graph->PinToCaller(task);
+    }
+    for (int i = 0; i < reads.size(); ++i) {
+      if (last_writer[reads[i]] >= 0) {
+        graph->AddDependency(last_writer[reads[i]], task);
+      }
+      readers[reads[i]].push_back(task);
+    }
+    for (int i = 0; i < writes.size(); ++i) {
+      const int resource = writes[i];
+      if (last_writer[resource] >= 0 && last_writer[resource] != task) {
+        graph->AddDependency(last_writer[resource], task);
+      }
+      for (int j = 0; j < readers[resource].size(); ++j) {
+        if (readers[resource][j] != task) {
+          graph->AddDependency(readers[resource][j], task);
+        }
+      }
+      readers[resource].clear();
+      last_writer[resource] = task;
+    }
+  }
+  return graph;
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardFromToParallel(int start, int end) {
+  shared_ptr<TaskGraph>& graph = forward_graphs_[make_pair(start, end)];
+  if (!graph) {
+    vector<int> layer_ids;
+    for (int i = start; i <= end; ++i) {
+      layer_ids.push_back(i);
+    }
+    graph = BuildLayerGraph(layer_ids, false);
+  }
+  vector<Dtype> layer_losses(end - start + 1, Dtype(0));
+  graph->Run(&ThreadPool::Global(), [&](int task) {
+    const int i = start + task;
+    layer_losses[task] = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+  });
+  // Summed in layer order so the total matches serial execution exactly.
+  Dtype loss = 0;
+  for (int i = 0; i < layer_losses.size(); ++i) {
+    loss += layer_losses[i];
+  }
+  return loss;
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardFromToParallel(int start, int end) {
+  shared_ptr<TaskGraph>& graph = backward_graphs_[make_pair(start, end)];
+  vector<int>& layer_ids = backward_layer_ids_[make_pair(start, end)];
+  if (!graph) {
+    layer_ids.clear();
+    for (int i = start; i >= end; --i) {
+      if (layer_need_backward_[i]) {
+        layer_ids.push_back(i);
+      }
+    }
+    graph = BuildLayerGraph(layer_ids, true);
+  }
+  graph->Run(&ThreadPool::Global(), [&](int task) {
+    const int i = layer_ids[task];
+    layers_[i]->Backward(top_vecs_[i], bottom_need_backward_[i],
+        bottom_vecs_[i]);
+    // Layers sharing a param are ordered by the graph, so the others only
+    // touch the counts of other params.
+    if (!gradient_callbacks_.empty()) { LayerGradientsReady(i); }
+  });
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  if (reshape_plan_cache_size_ > 0 && start == 0) {
+    ApplyReshapePlan();
+  }
+  const bool complete = start == 0 && end == layers_.size() - 1;
+  if (plan_memory_ && memory_observed_ && complete) {
+    // Layers such as Flatten only share data with their bottoms in Forward,
+    // so the plan follows the first complete pass. It applies from the start
+    // of the next one, which leaves the blobs of the first their values.
+    plan_memory_ = false;
+    PlanMemory();
+    if (reshape_plan_cache_size_ > 0) {
+      ReshapePlan& plan = reshape_plans_.front();
+      plan.memory_planned = true;
+      plan.memory_slabs = memory_slabs_;
+      plan.blob_memory_groups = blob_memory_groups_;
+      plan.blob_memory_slabs = blob_memory_slabs_;
+      plan.blob_shapes.resize(blobs_.size());
+      for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+        plan.blob_shapes[blob_id] = blobs_[blob_id]->shape();
+      }
+    }
+  }
   Dtype loss = 0;
-  for (int i = start; i <= end; ++i) {
-    // LOG(ERROR) << "Forwarding " << layer_names_[i];
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
-    loss += layer_loss;
-    if (debug_info_) { ForwardDebugInfo(i); }
+  if (RunInParallel(end - start + 1)) {
+    loss = ForwardFromToParallel(start, end);
+  } else {
+    for (int i = start; i <= end; ++i) {
+      // LOG(ERROR) << "Forwarding " << layer_names_[i];
+      Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      loss += layer_loss;
+      if (debug_info_) { ForwardDebugInfo(i); }
+    }
+  }
+  if (plan_memory_ && complete) {
+    memory_observed_ = true;
   }
+  last_forward_end_ = end;
   return loss;
 }
 
@@ -604,11 +1033,58 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (!gradient_callbacks_.empty()) {
+    StartGradientCallbacks(start, end);
+  }
+  if (RunInParallel(start - end + 1)) {
+    BackwardFromToParallel(start, end);
+    return;
+  }
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
+      if (!gradient_callbacks_.empty()) { LayerGradientsReady(i); }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::StartGradientCallbacks(int start, int end) {
+  gradient_pending_.assign(learnable_params_.size(), 0);
+  for (int i = start; i >= end; --i) {
+    if (layer_need_backward_[i]) {
+      for (int j = 0; j < param_id_vecs_[i].size(); ++j) {
+        ++gradient_pending_[learnable_param_ids_[param_id_vecs_[i][j]]];
+      }
+    }
+  }
+  vector<int> ready;
+  for (int i = 0; i < gradient_pending_.size(); ++i) {
+    if (gradient_pending_[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  if (!ready.empty()) {
+    for (int i = 0; i < gradient_callbacks_.size(); ++i) {
+      gradient_callbacks_[i]->on_layer_gradients_ready(-1, ready);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::LayerGradientsReady(int layer_id) {
+  vector<int> ready;
+  for (int j = 0; j < param_id_vecs_[layer_id].size(); ++j) {
+    const int learnable_id = learnable_param_ids_[param_id_vecs_[layer_id][j]];
+    if (--gradient_pending_[learnable_id] == 0) {
+      ready.push_back(learnable_id);
+    }
+  }
+  if (!ready.empty()) {
+    for (int i = 0; i < gradient_callbacks_.size(); ++i) {
+      gradient_callbacks_[i]->on_layer_gradients_ready(layer_id, ready);
     }
   }
 }
@@ -722,6 +1198,9 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       target_blobs[j]->ShareData(*source_blob);
     }
   }
+  // Keep the weights files the shared data may point into.
+  mapped_weights_.insert(mapped_weights_.end(),
+      other->mapped_weights_.begin(), other->mapped_weights_.end());
 }
 
 template <typename Dtype>
@@ -755,6 +1234,10 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  if (reshape_plan_cache_size_ > 0) {
+    ApplyReshapePlan();
+    return;
+  }
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
@@ -803,6 +1286,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (IsMappedWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromMapped(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -816,6 +1301,55 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
   CopyTrainedLayersFrom(param);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMapped(const string trained_filename) {
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  const MappedWeightsIndex& index = weights->index();
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const MappedWeightsIndex_Layer& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[layer_names_index_[source_layer_name]]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const MappedWeightsIndex_Blob& source_blob = source_layer.blobs(j);
+      vector<int> source_shape(source_blob.shape().dim_size());
+      for (int k = 0; k < source_shape.size(); ++k) {
+        source_shape[k] = source_blob.shape().dim(k);
+      }
+      Blob<Dtype>* target_blob = target_blobs[j].get();
+      if (source_shape != target_blob->shape()) {
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << Blob<Dtype>(source_shape).shape_string()
+            << "; target param shape is " << target_blob->shape_string()
+            << ". To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      void* data = weights->data(source_blob);
+      if (source_blob.double_data() == (sizeof(Dtype) == sizeof(double))) {
+        // Use the mapped pages in place; they are copied on write.
+        target_blob->set_cpu_data(static_cast<Dtype*>(data));
+      } else {
+        // Convert the values to the precision of the net.
+        Dtype* target_data = target_blob->mutable_cpu_data();
+        for (int k = 0; k < target_blob->count(); ++k) {
+          target_data[k] = source_blob.double_data() ?
+              static_cast<const double*>(data)[k] :
+              static_cast<const float*>(data)[k];
+        }
+      }
+    }
+  }
+  mapped_weights_.push_back(weights);
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
@@ -866,6 +1400,100 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+int Net<Dtype>::Quantize(const QuantizationTable& table) {
+  map<string, float> bottom_max;
+  for (int i = 0; i < table.blob_size(); ++i) {
+    bottom_max[table.blob(i).name()] = std::max(
+        std::fabs(table.blob(i).min()), std::fabs(table.blob(i).max()));
+  }
+  // The layers of net_param_ read the blobs by the names of the table, before
+  // splits were inserted.
+  int num_quantized = 0;
+  for (int i = 0; i < net_param_.layer_size(); ++i) {
+    LayerParameter* layer_param = net_param_.mutable_layer(i);
+    Layer<Dtype>* layer =
+        layers_[layer_names_index_[layer_param->name()]].get();
+    const float max = layer_param->bottom_size() == 1 &&
+        bottom_max.count(layer_param->bottom(0)) ?
+        bottom_max[layer_param->bottom(0)] : 0;
+    if (max > 0 && layer->Quantize(max)) {
+      layer_param->mutable_quantization_param()->set_bottom_max(max);
+      ++num_quantized;
+      LOG_IF(INFO, Caffe::root_solver()) << "Quantizing "
+          << layer_param->name() << " to int8, " << layer_param->bottom(0)
+          << " within +-" << max;
+    } else {
+      layer->Quantize(0);
+      layer_param->clear_quantization_param();
+    }
+  }
+  return num_quantized;
+}
+
+template <typename Dtype>
+int Net<Dtype>::FoldBatchNorm() {
+  CHECK(Caffe::root_solver()) << "Only root nets can be folded.";
+  NetParameter trained(net_param_);
+  for (int i = 0; i < trained.layer_size(); ++i) {
+    LayerParameter* layer_param = trained.mutable_layer(i);
+    const vector<shared_ptr<Blob<Dtype> > >& layer_blobs =
+        layers_[layer_names_index_[layer_param->name()]]->blobs();
+    for (int j = 0; j < layer_blobs.size(); ++j) {
+      layer_blobs[j]->ToProto(layer_param->add_blobs());
+    }
+  }
+  NetParameter folded;
+  const int num_folded = caffe::FoldBatchNorm(trained, &folded);
+  if (num_folded == 0) {
+    return 0;
+  }
+  // Set the net up again from the folded definition, then load the folded
+  // weights, so that they are not logged by Init.
+  NetParameter definition(folded);
+  for (int i = 0; i < definition.layer_size(); ++i) {
+    definition.mutable_layer(i)->clear_blobs();
+  }
+  const bool debug_info = debug_info_;
+  const bool parallel_layers = parallel_layers_;
+  layers_.clear();
+  layer_names_.clear();
+  layer_names_index_.clear();
+  layer_need_backward_.clear();
+  blobs_.clear();
+  blob_names_.clear();
+  blob_names_index_.clear();
+  blob_need_backward_.clear();
+  bottom_vecs_.clear();
+  bottom_id_vecs_.clear();
+  bottom_need_backward_.clear();
+  top_vecs_.clear();
+  top_id_vecs_.clear();
+  blob_loss_weights_.clear();
+  param_id_vecs_.clear();
+  param_owners_.clear();
+  param_display_names_.clear();
+  param_layer_indices_.clear();
+  param_names_index_.clear();
+  net_input_blob_indices_.clear();
+  net_output_blob_indices_.clear();
+  net_input_blobs_.clear();
+  net_output_blobs_.clear();
+  params_.clear();
+  learnable_params_.clear();
+  learnable_param_ids_.clear();
+  params_lr_.clear();
+  has_params_lr_.clear();
+  params_weight_decay_.clear();
+  has_params_decay_.clear();
+  Init(definition);
+  CopyTrainedLayersFrom(folded);
+  debug_info_ = debug_info;
+  parallel_layers_ = parallel_layers;
+  LOG(INFO) << "Folded " << num_folded << " layers of " << name_;
+  return num_folded;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -967,6 +1595,12 @@ template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
   for (int i = 0; i < params_.size(); ++i) {
     if (param_owners_[i] < 0) { continue; }
+    // Params given by a NetModel are already shared, and may be read by
+    // nets running in other threads.
+    if (params_[i]->data() == params_[param_owners_[i]]->data() &&
+        params_[i]->diff() == params_[param_owners_[i]]->diff()) {
+      continue;
+    }
     params_[i]->ShareData(*params_[param_owners_[i]]);
     params_[i]->ShareDiff(*params_[param_owners_[i]]);
   }
@@ -982,7 +1616,53 @@ const shared_ptr<Blob<Dtype> > Net<Dtype>::blob_by_name(
     const string& blob_name) const {
   shared_ptr<Blob<Dtype> > blob_ptr;
   if (has_blob(blob_name)) {
-    blob_ptr = blobs_[blob_names_index_.find(blob_name)->second];
+    const int blob_id = blob_names_index_.find(blob_name)->second;
+    blob_ptr = blobs_[blob_id];
+    blob_memory_pinned_[blob_id] = true;
+    const int group = blob_memory_groups_[blob_id];
+    const int slab = blob_memory_slabs_[blob_id];
+    if (group >= 0 && blob_ptr->data() == memory_slabs_[slab]) {
+      // The caller may read the blob after Forward, so from now on it gets
+      // memory of its own, as does every blob sharing data with it. It keeps
+      // the values of the last Forward, unless a group computed after it in
+      // that pass has reused the slab since.
+      vector<int> group_begins(blobs_.size(), layers_.size());
+      for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+        for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+          const int top_group = blob_memory_groups_[top_id_vecs_[layer_id][i]];
+          if (top_group >= 0) {
+            group_begins[top_group] = layer_id;
+          }
+        }
+      }
+      size_t size = 0;
+      bool overwritten = false;
+      for (int i = 0; i < blobs_.size(); ++i) {
+        const int other = blob_memory_groups_[i];
+        if (other == group) {
+          size = std::max(size, blobs_[i]->count() * sizeof(Dtype));
+        } else if (other >= 0 && blob_memory_slabs_[i] == slab &&
+            blobs_[i]->data() == memory_slabs_[slab] &&
+            group_begins[other] > group_begins[group] &&
+            group_begins[other] <= last_forward_end_) {
+          overwritten = true;
+        }
+      }
+      shared_ptr<SyncedMemory> memory(new SyncedMemory(size));
+      if (overwritten) {
+        LOG(WARNING) << "Blob " << blob_name << " of " << name_
+            << " shared memory with blobs computed after it, its values are"
+            << " those of the next Forward.";
+      } else {
+        memcpy(memory->mutable_cpu_data(), memory_slabs_[slab]->cpu_data(),
+            size);
+      }
+      for (int i = 0; i < blobs_.size(); ++i) {
+        if (blob_memory_groups_[i] == group) {
+          blobs_[i]->set_data_memory(memory);
+        }
+      }
+    }
   } else {
     blob_ptr.reset((Blob<Dtype>*)(NULL));
     LOG(WARNING) << "Unknown blob name " << blob_name;
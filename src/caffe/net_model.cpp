@@ -0,0 +1,79 @@
+#include <string>
+#include <vector>
+
+#include "caffe/net_model.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+NetModel<Dtype>::NetModel(const Net<Dtype>& net) {
+  Init(net);
+}
+
+template <typename Dtype>
+NetModel<Dtype>::NetModel(const string& param_file,
+    const string& trained_filename, Phase phase) {
+  Net<Dtype> net(param_file, phase);
+  net.CopyTrainedLayersFrom(trained_filename);
+  Init(net);
+}
+
+template <typename Dtype>
+void NetModel<Dtype>::Init(const Net<Dtype>& net) {
+  param_.CopyFrom(net.net_param_);
+  for (int i = 0; i < net.layers().size(); ++i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = net.layers()[i]->blobs();
+    if (blobs.size() == 0) { continue; }
+    layer_blobs_[net.layer_names()[i]] = blobs;
+    // Put the params where the nets read them now, so that reading them
+    // from several threads never allocates or copies them.
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->cpu_data();
+#ifndef CPU_ONLY
+      if (Caffe::mode() == Caffe::GPU) {
+        blobs[j]->gpu_data();
+      }
+#endif
+    }
+  }
+  mapped_weights_ = net.mapped_weights_;
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > NetModel<Dtype>::CreateNet() const {
+  return shared_ptr<Net<Dtype> >(new Net<Dtype>(*this));
+}
+
+template <typename Dtype>
+shared_ptr<NetModel<Dtype> > NetModel<Dtype>::Replicate() const {
+  shared_ptr<NetModel<Dtype> > replica(new NetModel<Dtype>());
+  replica->param_.CopyFrom(param_);
+  typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+      it = layer_blobs_.begin();
+  for (; it != layer_blobs_.end(); ++it) {
+    vector<shared_ptr<Blob<Dtype> > >& blobs =
+        replica->layer_blobs_[it->first];
+    for (int i = 0; i < it->second.size(); ++i) {
+      blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      blobs[i]->CopyFrom(*it->second[i], false, true);
+#ifndef CPU_ONLY
+      if (Caffe::mode() == Caffe::GPU) {
+        blobs[i]->cpu_data();
+      }
+#endif
+    }
+  }
+  return replica;
+}
+
+template <typename Dtype>
+const vector<shared_ptr<Blob<Dtype> > >* NetModel<Dtype>::layer_blobs(
+    const string& layer_name) const {
+  typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+      it = layer_blobs_.find(layer_name);
+  return it == layer_blobs_.end() ? NULL : &it->second;
+}
+
+INSTANTIATE_CLASS(NetModel);
+
+}  // namespace caffe
@@ -4,13 +4,18 @@
 #include <glog/logging.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "boost/thread.hpp"
+#include "boost/thread/barrier.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/socket_ring.hpp"
 
 namespace caffe {
 
@@ -114,6 +119,43 @@ void GPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
   apply_buffers(net, diff_, size_, replace_gpu_diff);
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver,
+                            const CPUParams<Dtype>* shared)
+    : Params<Dtype>(root_solver),
+      own_data_(shared == NULL) {
+  if (shared) {
+    CHECK_EQ(shared->size_, size_);
+    data_ = shared->data_;
+  } else {
+    data_ = static_cast<Dtype*>(
+        HostAllocator::Global().Allocate(size_ * sizeof(Dtype)));
+    // Copy blob values
+    const vector<Blob<Dtype>*>& net =
+        root_solver->net()->learnable_params();
+    apply_buffers(net, data_, size_, copy);
+  }
+  diff_ = static_cast<Dtype*>(
+      HostAllocator::Global().Allocate(size_ * sizeof(Dtype)));
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  if (own_data_) {
+    HostAllocator::Global().Free(data_, size_ * sizeof(Dtype));
+  }
+  HostAllocator::Global().Free(diff_, size_ * sizeof(Dtype));
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+      solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
 void DevicePair::compute(const vector<int> devices, vector<DevicePair>* pairs) {
 #ifndef CPU_ONLY
   vector<int> remaining(devices);
@@ -436,8 +478,473 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
   }
 }
 
+//
+
+// HostAllocator aligns buffers to cache lines of this size.
+static const int kCacheLineSize = 64;
+
+template<typename Dtype>
+class CPUSync<Dtype>::sync {
+ public:
+  explicit sync(int replicas)
+      : barrier_(replicas) {
+  }
+
+  boost::barrier barrier_;
+  // Held by the replica running forward and backward, when they run one at
+  // a time.
+  boost::mutex serial_mutex_;
+  CPUTimer timer_;
+};
+
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                        CPUSync<Dtype>* root, const SolverParameter& param)
+    : CPUParams<Dtype>(root_solver, root),
+      root_(root),
+      replica_(root ? root->replicas_.size() : 0),
+      replicas_(),
+      num_replicas_(root ? root->num_replicas_ : 1),
+      sync_(root ? root->sync_ : shared_ptr<sync>()),
+      initial_iter_(root_solver->iter()),
+      iterations_(0),
+      baseline_iters_(0),
+      serial_ms_(0),
+      serial_iters_(0),
+      parallel_ms_(0),
+      parallel_iters_(0),
+      solver_() {
+  if (root == NULL) {
+    solver_ = root_solver;
+  } else {
+    Caffe::set_root_solver(false);
+    solver_.reset(new WorkerSolver<Dtype>(param, root_solver.get()));
+    Caffe::set_root_solver(true);
+  }
+  this->configure(solver_.get());
+  solver_->add_callback(this);
+}
+
+template<typename Dtype>
+CPUSync<Dtype>::~CPUSync() {
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::InternalThreadEntry() {
+  CHECK(Caffe::root_solver());
+  Caffe::set_root_solver(false);
+  // Give each replica its own random state, as P2PSync does for GPUs.
+  if (solver_->param().random_seed() >= 0) {
+    Caffe::set_random_seed(solver_->param().random_seed() + replica_);
+  }
+  solver_->Step(solver_->param().max_iter() - initial_iter_);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_start() {
+  // Wait for the root to update the shared parameters.
+  sync_->barrier_.wait();
+  // Start timing before the serial lock, which the root may wait for while
+  // the other replicas compute.
+  if (!root_) {
+    sync_->timer_.Start();
+  }
+  if (serial()) {
+    sync_->serial_mutex_.lock();
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  const bool serial = this->serial();
+  if (serial) {
+    sync_->serial_mutex_.unlock();
+  }
+  // Wait for the gradients of all the replicas.
+  sync_->barrier_.wait();
+
+  const vector<CPUSync<Dtype>*>& replicas = root()->replicas_;
+  const int count = replicas.size();
+  const size_t line = kCacheLineSize / sizeof(Dtype);
+  const size_t lines = (size_ + line - 1) / line;
+  const size_t begin = std::min(size_, lines * replica_ / count * line);
+  const size_t end = std::min(size_, lines * (replica_ + 1) / count * line);
+  if (end > begin) {
+    const int n = end - begin;
+    Dtype* dst = replicas[0]->diff_ + begin;
+    for (int i = 1; i < count; ++i) {
+      caffe_axpy<Dtype>(n, Dtype(1), replicas[i]->diff_ + begin, dst);
+    }
+    // Loss functions divide gradients by the batch size, so to compensate
+    // for split batch, divide by number of replicas.
+    caffe_scal<Dtype>(n, Dtype(1) / count, dst);
+  }
+  // Wait for the root gradients to be complete, and the other gradients to
+  // be read before they are cleared.
+  sync_->barrier_.wait();
+
+  if (!root_ && iterations_ != 0 && iterations_ != baseline_iters_) {
+    const double ms = sync_->timer_.MicroSeconds() / 1000;
+    if (serial) {
+      serial_ms_ += ms;
+      ++serial_iters_;
+    } else {
+      parallel_ms_ += ms;
+      ++parallel_iters_;
+    }
+  }
+  ++iterations_;
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Prepare(int replicas,
+            vector<shared_ptr<CPUSync<Dtype> > >* syncs) {
+  CHECK(root_ == NULL) << "Only the root replica prepares the others.";
+  CHECK_GE(replicas, 1);
+  num_replicas_ = replicas;
+  sync_.reset(new sync(replicas));
+  replicas_.assign(1, this);
+  syncs->resize(replicas);
+  SolverParameter param(solver_->param());
+  for (int i = 1; i < replicas; ++i) {
+    syncs->at(i).reset(new CPUSync<Dtype>(solver_, this, param));
+    replicas_.push_back(syncs->at(i).get());
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int replicas, int baseline_iters) {
+  baseline_iters_ = baseline_iters;
+  vector<shared_ptr<CPUSync<Dtype> > > syncs(replicas);
+  Prepare(replicas, &syncs);
+
+  LOG(INFO)<< "Starting Optimization on " << replicas << " CPU replicas";
+
+  for (int i = 1; i < syncs.size(); ++i) {
+    syncs[i]->StartInternalThread();
+  }
+
+  // Run root solver on current thread
+  solver_->Solve();
+
+  for (int i = 1; i < syncs.size(); ++i) {
+    syncs[i]->StopInternalThread();
+  }
+  replicas_.clear();
+
+  if (parallel_iters_) {
+    LOG(INFO) << replicas << " replicas: " << parallel_iteration_ms()
+              << " ms per iteration, "
+              << parallel_iteration_ms() / replicas << " ms per batch";
+  }
+  if (serial_iters_) {
+    LOG(INFO) << "One replica: " << serial_iteration_ms() / replicas
+              << " ms per batch";
+  }
+  if (parallel_iters_ && serial_iters_) {
+    LOG(INFO) << "Speedup " << scaling_efficiency() * replicas
+              << "x, scaling efficiency " << scaling_efficiency() * 100
+              << "%";
+  }
+}
+
+template<typename Dtype>
+double CPUSync<Dtype>::scaling_efficiency() const {
+  if (!parallel_ms_ || !serial_ms_) {
+    return 0;
+  }
+  // An iteration processes a batch per replica either way.
+  return serial_iteration_ms() / (parallel_iteration_ms() * num_replicas_);
+}
+
+//
+
+template<typename Dtype>
+class RingSync<Dtype>::sync {
+ public:
+  explicit sync(int buckets)
+      : pending_(buckets),
+        ready_(buckets),
+        ready_ms_(buckets),
+        reduced_(0),
+        comm_ms_(0) {
+  }
+
+  // Milliseconds from time to now.
+  static double elapsed_ms(const boost::posix_time::ptime& time) {
+    return (boost::posix_time::microsec_clock::local_time() - time)
+        .total_microseconds() / 1000.;
+  }
+
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  // The start of the first and of the current iteration.
+  boost::posix_time::ptime trace_start_;
+  boost::posix_time::ptime iteration_start_;
+  // The gradients of each bucket still to compute in the iteration, one per
+  // param and backward pass.
+  vector<int> pending_;
+  vector<bool> ready_;
+  vector<double> ready_ms_;
+  // Buckets reduced in the iteration, and the time it took.
+  int reduced_;
+  double comm_ms_;
+};
+
+template<typename Dtype>
+RingSync<Dtype>::RingSync(shared_ptr<Solver<Dtype> > root_solver,
+                          SocketRing* ring, size_t bucket_bytes)
+    : CPUParams<Dtype>(root_solver, NULL),
+      ring_(ring),
+      solver_(root_solver),
+      buckets_(),
+      param_buckets_(),
+      sync_(),
+      timer_(),
+      compute_ms_(0),
+      comm_ms_(0),
+      hidden_ms_(0),
+      iters_(0) {
+  this->configure(solver_.get());
+  solver_->add_callback(this);
+  if (bucket_bytes == 0) {
+    return;
+  }
+  // From the last params, whose gradients Backward computes first.
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  vector<size_t> offsets(params.size() + 1, 0);
+  for (int i = 0; i < params.size(); ++i) {
+    offsets[i + 1] = offsets[i] + params[i]->count();
+  }
+  param_buckets_.resize(params.size());
+  for (int i = params.size() - 1; i >= 0; --i) {
+    const size_t count = params[i]->count();
+    if (buckets_.empty() || (buckets_.back().count > 0 &&
+        (buckets_.back().count + count) * sizeof(Dtype) > bucket_bytes)) {
+      Bucket bucket;
+      bucket.end_param = i + 1;
+      bucket.count = 0;
+      buckets_.push_back(bucket);
+    }
+    Bucket& bucket = buckets_.back();
+    bucket.first_param = i;
+    bucket.offset = offsets[i];
+    bucket.count += count;
+    param_buckets_[i] = buckets_.size() - 1;
+  }
+  sync_.reset(new sync(buckets_.size()));
+  solver_->net()->add_gradient_callback(this);
+}
+
+template<typename Dtype>
+RingSync<Dtype>::~RingSync() {
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_start() {
+  timer_.Start();
+  if (sync_) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->iteration_start_ = boost::posix_time::microsec_clock::local_time();
+    if (iters_ == 0) {
+      sync_->trace_start_ = sync_->iteration_start_;
+    }
+    if (iters_ < kTraceIterations) {
+      iteration_start_ms_.push_back(sync::elapsed_ms(sync_->trace_start_));
+    }
+    // Gradients accumulate over the iter_size backward passes, the buckets
+    // are only ready after the last one.
+    const int passes = solver_->param().iter_size();
+    for (int i = 0; i < buckets_.size(); ++i) {
+      sync_->pending_[i] =
+          (buckets_[i].end_param - buckets_[i].first_param) * passes;
+    }
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_layer_gradients_ready(int layer_id,
+    const vector<int>& learnable_param_ids) {
+  bool ready = false;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    for (int i = 0; i < learnable_param_ids.size(); ++i) {
+      const int bucket = param_buckets_[learnable_param_ids[i]];
+      if (--sync_->pending_[bucket] == 0) {
+        sync_->ready_[bucket] = true;
+        sync_->ready_ms_[bucket] = sync::elapsed_ms(sync_->iteration_start_);
+        ready = true;
+      }
+    }
+  }
+  if (ready) {
+    sync_->condition_.notify_all();
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      for (int i = 0; i < buckets_.size(); ++i) {
+        TraceEvent event;
+        {
+          boost::mutex::scoped_lock lock(sync_->mutex_);
+          while (!sync_->ready_[i]) {
+            sync_->condition_.wait(lock);
+          }
+          sync_->ready_[i] = false;
+          event.iteration = iters_;
+          event.bucket = i;
+          event.ready_ms = sync_->ready_ms_[i];
+          event.start_ms = sync::elapsed_ms(sync_->iteration_start_);
+        }
+        const Bucket& bucket = buckets_[i];
+        if (bucket.count > 0) {
+          ring_->AllReduce(diff_ + bucket.offset, bucket.count);
+          caffe_scal<Dtype>(bucket.count, Dtype(1) / ring_->world_size(),
+              diff_ + bucket.offset);
+        }
+        {
+          boost::mutex::scoped_lock lock(sync_->mutex_);
+          event.end_ms = sync::elapsed_ms(sync_->iteration_start_);
+          sync_->comm_ms_ += event.end_ms - event.start_ms;
+          if (event.iteration < kTraceIterations) {
+            events_.push_back(event);
+          }
+          ++sync_->reduced_;
+        }
+        sync_->condition_.notify_all();
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_gradients_ready() {
+  compute_ms_ += timer_.MicroSeconds() / 1000;
+  timer_.Start();
+  if (!sync_) {
+    ring_->AllReduce(diff_, size_);
+    // Loss functions divide gradients by the batch size, so to compensate
+    // for split batch, divide by number of processes.
+    caffe_scal<Dtype>(size_, Dtype(1) / ring_->world_size(), diff_);
+    comm_ms_ += timer_.MicroSeconds() / 1000;
+    ++iters_;
+    return;
+  }
+  // The communication thread scales the buckets it reduces.
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (iters_ < kTraceIterations) {
+    backward_ms_.push_back(sync::elapsed_ms(sync_->iteration_start_));
+  }
+  while (sync_->reduced_ < buckets_.size()) {
+    sync_->condition_.wait(lock);
+  }
+  // Only the reductions left after backward delay the update.
+  const double exposed_ms = timer_.MicroSeconds() / 1000;
+  comm_ms_ += sync_->comm_ms_;
+  hidden_ms_ += std::max(sync_->comm_ms_ - exposed_ms, 0.);
+  sync_->reduced_ = 0;
+  sync_->comm_ms_ = 0;
+  ++iters_;
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::ConfigureRank(int rank, SolverParameter* param) {
+  if (rank > 0) {
+    param->set_test_interval(0);
+    param->set_test_initialization(false);
+    param->set_snapshot(0);
+    param->set_snapshot_after_train(false);
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::Run() {
+  // Start from the same parameters and solver state, however the processes
+  // initialized them or whichever snapshot they resumed from: the ranks then
+  // run as many iterations, with the same learning rates and history.
+  ring_->Broadcast(data_, size_, 0);
+  string state;
+  if (ring_->rank() == 0) {
+    SolverState proto;
+    solver_->GetState(&proto);
+    proto.SerializeToString(&state);
+  }
+  uint64_t state_size = state.size();
+  ring_->Broadcast(&state_size, 1, 0);
+  state.resize(state_size);
+  if (state_size > 0) {
+    ring_->Broadcast(&state[0], state_size, 0);
+  }
+  if (ring_->rank() > 0) {
+    SolverState proto;
+    CHECK(proto.ParseFromString(state)) << "Corrupt solver state from rank 0";
+    solver_->SetState(proto);
+  }
+  if (sync_) {
+    StartInternalThread();
+  }
+
+  LOG(INFO)<< "Starting Optimization as rank " << ring_->rank() << " of "
+           << ring_->world_size();
+  solver_->Solve();
+  if (sync_) {
+    StopInternalThread();
+  }
+  LOG(INFO) << "Rank " << ring_->rank() << ": compute "
+            << compute_iteration_ms() << " ms, communication "
+            << comm_iteration_ms() << " ms per iteration";
+  if (sync_ && comm_ms_ > 0) {
+    LOG(INFO) << "Rank " << ring_->rank() << ": "
+              << hidden_comm_iteration_ms() << " ms ("
+              << hidden_ms_ / comm_ms_ * 100 << "%) of communication per "
+              << "iteration hidden behind backward, in " << buckets_.size()
+              << " buckets";
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::WriteChromeTrace(std::ostream* out) const {
+  const std::streamsize precision = out->precision(15);
+  *out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  // Thread 0 computes, thread 1 communicates.
+  for (int i = 0; i < backward_ms_.size(); ++i) {
+    *out << (i ? ",\n" : "\n")
+        << "  {\"name\": \"forward backward\", \"cat\": \"compute\""
+        << ", \"ph\": \"X\", \"pid\": " << ring_->rank()
+        << ", \"tid\": 0, \"ts\": " << iteration_start_ms_[i] * 1000
+        << ", \"dur\": " << backward_ms_[i] * 1000
+        << ", \"args\": {\"iteration\": " << i << "}}";
+  }
+  for (int i = 0; i < events_.size(); ++i) {
+    const TraceEvent& event = events_[i];
+    const Bucket& bucket = buckets_[event.bucket];
+    const double start_ms = iteration_start_ms_[event.iteration];
+    *out << (i || backward_ms_.size() ? ",\n" : "\n")
+        << "  {\"name\": \"bucket " << event.bucket
+        << "\", \"cat\": \"all-reduce\", \"ph\": \"X\", \"pid\": "
+        << ring_->rank() << ", \"tid\": 1"
+        << ", \"ts\": " << (start_ms + event.start_ms) * 1000
+        << ", \"dur\": " << (event.end_ms - event.start_ms) * 1000
+        << ", \"args\": {\"iteration\": " << event.iteration
+        << ", \"params\": \"" << bucket.first_param << "-"
+        << bucket.end_param - 1 << "\", \"bytes\": "
+        << bucket.count * sizeof(Dtype) << ", \"ready_ms\": "
+        << event.ready_ms << "}}";
+  }
+  *out << "\n]}\n";
+  out->precision(precision);
+}
+
 INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(CPUParams);
+INSTANTIATE_CLASS(CPUSync);
+INSTANTIATE_CLASS(RingSync);
 
 }  // namespace caffe
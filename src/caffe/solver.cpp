@@ -7,10 +7,18 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/ordered_worker.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
 
+// Whether param has Solver::Snapshot copy the snapshots for the writer.
+static bool SnapshotsAsync(const SolverParameter& param) {
+  return param.async_snapshot() &&
+      param.snapshot_format() != SolverParameter_SnapshotFormat_HDF5;
+}
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -41,6 +49,11 @@ Solver<Dtype>::Solver(const string& param_file, const Solver* root_solver)
   Init(param);
 }
 
+template <typename Dtype>
+Solver<Dtype>::~Solver() {
+  WaitForSnapshots();
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Init(const SolverParameter& param) {
   CHECK(Caffe::root_solver() || root_solver_)
@@ -50,6 +63,8 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
   CheckSnapshotWritePermissions();
+  LOG_IF(WARNING, Caffe::root_solver() && param_.async_snapshot() &&
+      !SnapshotsAsync(param_)) << "HDF5 snapshots are written synchronously.";
   if (Caffe::root_solver() && param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed());
   }
@@ -259,11 +274,12 @@ void Solver<Dtype>::Step(int iters) {
     SolverAction::Enum request = GetRequestedAction();
 
     // Save a snapshot if needed.
-    if ((param_.snapshot()
-         && iter_ % param_.snapshot() == 0
-         && Caffe::root_solver()) ||
-         (request == SolverAction::SNAPSHOT)) {
+    if (param_.snapshot()
+        && iter_ % param_.snapshot() == 0
+        && Caffe::root_solver()) {
       Snapshot();
+    } else if (request == SolverAction::SNAPSHOT) {
+      RequestedSnapshot();
     }
     if (SolverAction::STOP == request) {
       requested_early_exit_ = true;
@@ -298,6 +314,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     Snapshot();
   }
   if (requested_early_exit_) {
+    WaitForSnapshots();
     LOG(INFO) << "Optimization stopped early.";
     return;
   }
@@ -319,6 +336,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForSnapshots();
   LOG(INFO) << "Optimization Done.";
 }
 
@@ -347,7 +365,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
     // Check to see if stoppage of testing/training has been requested.
     while (request != SolverAction::NONE) {
         if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
+          RequestedSnapshot();
         } else if (SolverAction::STOP == request) {
           requested_early_exit_ = true;
         }
@@ -409,6 +427,10 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (SnapshotsAsync(param_)) {
+    SnapshotAsync(true);
+    return;
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -417,6 +439,9 @@ void Solver<Dtype>::Snapshot() {
   case caffe::SolverParameter_SnapshotFormat_HDF5:
     model_filename = SnapshotToHDF5();
     break;
+  case caffe::SolverParameter_SnapshotFormat_MAPPED:
+    model_filename = SnapshotToMapped();
+    break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
@@ -424,6 +449,90 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+void Solver<Dtype>::RequestedSnapshot() {
+  if (!SnapshotsAsync(param_)) {
+    Snapshot();
+  } else if (!SnapshotAsync(false)) {
+    LOG(WARNING) << "Skipping the requested snapshot, "
+        << param_.max_pending_snapshots() << " are still being written.";
+  }
+}
+
+template <typename Dtype>
+bool Solver<Dtype>::SnapshotAsync(bool wait) {
+  CHECK(Caffe::root_solver());
+  if (!snapshot_writer_) {
+    // A snapshot holds a slot from its copy until it is written, which
+    // bounds the memory of the copies.
+    CHECK_GE(param_.max_pending_snapshots(), 1)
+        << "max_pending_snapshots must be positive.";
+    snapshot_writer_.reset(
+        new OrderedWorker(param_.max_pending_snapshots()));
+  }
+  if (!snapshot_writer_->Reserve(wait)) {
+    return false;
+  }
+  // The weights and the history do not change until the next iteration, so
+  // the copies are consistent; only the writer uses them from now on.
+  const bool mapped =
+      param_.snapshot_format() == SolverParameter_SnapshotFormat_MAPPED;
+  const string model_filename =
+      SnapshotFilename(mapped ? ".caffeweights" : ".caffemodel");
+  const string state_filename = SnapshotFilename(".solverstate");
+  shared_ptr<NetParameter> net_param(new NetParameter());
+  net_->ToProto(net_param.get(), !mapped && param_.snapshot_diff());
+  shared_ptr<SolverState> state(new SolverState());
+  SolverStateToProto(model_filename, state.get());
+  LOG(INFO) << "Snapshotting to " << model_filename << " and "
+      << state_filename << " in the background";
+  snapshot_writer_->Push([=]() {
+    // The model first, so that a solver state is never found without it.
+    if (mapped) {
+      WriteMappedWeights(*net_param, model_filename);
+    } else {
+      const string model_temp = model_filename + ".tmp";
+      WriteProtoToBinaryFile(*net_param, model_temp);
+      RenameFileOver(model_temp, model_filename);
+    }
+    const string state_temp = state_filename + ".tmp";
+    WriteProtoToBinaryFile(*state, state_temp);
+    RenameFileOver(state_temp, state_filename);
+    LOG(INFO) << "Wrote snapshot " << state_filename;
+  });
+  return true;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshots() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Flush();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SolverStateToProto(const string& model_filename,
+    SolverState* state) {
+  LOG(FATAL) << type() << " solver cannot copy its state to a SolverState.";
+}
+
+template <typename Dtype>
+void Solver<Dtype>::RestoreSolverStateFromProto(const SolverState& state) {
+  LOG(FATAL) << type() << " solver cannot restore a SolverState.";
+}
+
+template <typename Dtype>
+void Solver<Dtype>::GetState(SolverState* state) {
+  SolverStateToProto("", state);
+  state->clear_learned_net();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SetState(const SolverState& state) {
+  CHECK(!state.has_learned_net()) << "SetState does not load weights.";
+  RestoreSolverStateFromProto(state);
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -466,6 +575,16 @@ string Solver<Dtype>::SnapshotToHDF5() {
   return model_filename;
 }
 
+template <typename Dtype>
+string Solver<Dtype>::SnapshotToMapped() {
+  string model_filename = SnapshotFilename(".caffeweights");
+  LOG(INFO) << "Snapshotting to mapped weights file " << model_filename;
+  NetParameter net_param;
+  net_->ToProto(&net_param);
+  WriteMappedWeights(net_param, model_filename);
+  return model_filename;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
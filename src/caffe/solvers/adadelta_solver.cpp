@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -106,6 +107,27 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeUpdateValueFused(
+    const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end) {
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  Dtype* gradient_history = param.history[0];
+  Dtype* update_history = param.history[1];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(param, i);
+    gradient_history[i] = momentum * gradient_history[i] +
+        (Dtype(1) - momentum) * (gradient * gradient);
+    // the RMS of the history of updates over the one of gradients
+    const Dtype update = gradient * std::sqrt(
+        (delta + update_history[i]) / (delta + gradient_history[i]));
+    update_history[i] = momentum * update_history[i] +
+        (Dtype(1) - momentum) * (update * update);
+    param.diff[i] = param.local_rate * update;
+    param.data[i] -= param.diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
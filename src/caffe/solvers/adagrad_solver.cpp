@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -64,6 +65,20 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ComputeUpdateValueFused(
+    const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end) {
+  const Dtype delta = this->param_.delta();
+  Dtype* history = param.history[0];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(param, i);
+    history[i] += gradient * gradient;
+    param.diff[i] = param.local_rate *
+        (gradient / (std::sqrt(history[i]) + delta));
+    param.data[i] -= param.diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
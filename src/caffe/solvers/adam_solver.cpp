@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -88,6 +89,27 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeUpdateValueFused(
+    const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end) {
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const Dtype eps_hat = this->param_.delta();
+  const Dtype rate = param.local_rate * correction;
+  Dtype* val_m = param.history[0];
+  Dtype* val_v = param.history[1];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(param, i);
+    val_m[i] = beta1 * val_m[i] + (Dtype(1) - beta1) * gradient;
+    val_v[i] = beta2 * val_v[i] + (Dtype(1) - beta2) * (gradient * gradient);
+    param.diff[i] = rate * (val_m[i] / (std::sqrt(val_v[i]) + eps_hat));
+    param.data[i] -= param.diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -56,6 +56,21 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeUpdateValueFused(
+    const typename SGDSolver<Dtype>::FusedParam& param, int begin, int end) {
+  const Dtype momentum = this->param_.momentum();
+  Dtype* history = param.history[0];
+  for (int i = begin; i < end; ++i) {
+    // step back then over step
+    const Dtype previous = history[i];
+    history[i] = momentum * history[i] +
+        param.local_rate * this->FusedGradient(param, i);
+    param.diff[i] = (Dtype(1) + momentum) * history[i] - momentum * previous;
+    param.data[i] -= param.diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -78,9 +80,9 @@ void SGDSolver<Dtype>::PreSolve() {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
+Dtype SGDSolver<Dtype>::GradientClipScale() {
   const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+  if (clip_gradients < 0) { return 1; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
@@ -92,9 +94,18 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+    return scale_factor;
+  }
+  return 1;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype scale_factor = GradientClipScale();
+  if (scale_factor == 1) { return; }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->scale_diff(scale_factor);
   }
 }
 
@@ -105,6 +116,12 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  // Net::Update only logs its debug info in the separate passes.
+  if (Caffe::mode() == Caffe::CPU && this->param_.fused_update() &&
+      !this->param_.debug_info()) {
+    ApplyUpdateFused(rate);
+    return;
+  }
   ClipGradients();
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
@@ -115,6 +132,67 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::FlattenHistory() {
+  if (history_flat_ || history_.empty()) { return; }
+  size_t count = 0;
+  for (int i = 0; i < history_.size(); ++i) {
+    count += history_[i]->count();
+  }
+  history_flat_.reset(new SyncedMemory(std::max(count, size_t(1)) *
+      sizeof(Dtype)));
+  Dtype* flat = static_cast<Dtype*>(history_flat_->mutable_cpu_data());
+  for (int i = 0; i < history_.size(); ++i) {
+    caffe_copy(history_[i]->count(), history_[i]->cpu_data(), flat);
+    history_[i]->data()->set_cpu_data(flat);
+    flat += history_[i]->count();
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyUpdateFused(Dtype rate) {
+  FlattenHistory();
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  Dtype weight_decay = this->param_.weight_decay();
+  const string& regularization_type = this->param_.regularization_type();
+  fused_clip_scale_ = GradientClipScale();
+  fused_normalization_ = Dtype(1.) / this->param_.iter_size();
+  fused_l1_ = regularization_type == "L1";
+  const int num_params = net_params.size();
+  vector<FusedParam> params(num_params);
+  vector<int> offsets(num_params + 1, 0);
+  for (int i = 0; i < num_params; ++i) {
+    FusedParam& param = params[i];
+    param.data = net_params[i]->mutable_cpu_data();
+    param.diff = net_params[i]->mutable_cpu_diff();
+    for (int j = 0; j < 2; ++j) {
+      param.history[j] = (j + 1) * num_params <= history_.size() ?
+          history_[j * num_params + i]->mutable_cpu_data() : NULL;
+    }
+    param.local_rate = rate * net_params_lr[i];
+    param.local_decay = weight_decay * net_params_weight_decay[i];
+    if (param.local_decay && !fused_l1_ && regularization_type != "L2") {
+      LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+    }
+    offsets[i + 1] = offsets[i] + net_params[i]->count();
+  }
+  // Enough values per chunk to amortize finding their params.
+  ParallelFor(offsets.back(), [&](int begin, int end) {
+    int i = std::upper_bound(offsets.begin(), offsets.end(), begin) -
+        offsets.begin() - 1;
+    for (; i < num_params && offsets[i] < end; ++i) {
+      const int param_begin = std::max(begin, offsets[i]) - offsets[i];
+      const int param_end = std::min(end, offsets[i + 1]) - offsets[i];
+      if (param_begin < param_end) {
+        ComputeUpdateValueFused(params[i], param_begin, param_end);
+      }
+    }
+  }, 4096);
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -242,10 +320,24 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeUpdateValueFused(const FusedParam& param,
+    int begin, int end) {
+  const Dtype momentum = this->param_.momentum();
+  Dtype* history = param.history[0];
+  for (int i = begin; i < end; ++i) {
+    history[i] = momentum * history[i] +
+        param.local_rate * FusedGradient(param, i);
+    param.diff[i] = history[i];
+    param.data[i] -= history[i];
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    case caffe::SolverParameter_SnapshotFormat_MAPPED:
       SnapshotSolverStateToBinaryProto(model_filename);
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
@@ -257,18 +349,24 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
-    const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
+void SGDSolver<Dtype>::SolverStateToProto(const string& model_filename,
+    SolverState* state) {
+  state->set_iter(this->iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(this->current_step_);
+  state->clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->ToProto(history_blob);
   }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
+    const string& model_filename) {
+  SolverState state;
+  SolverStateToProto(model_filename, &state);
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
@@ -306,6 +404,11 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
     const string& state_file) {
   SolverState state;
   ReadProtoFromBinaryFile(state_file, &state);
+  RestoreSolverStateFromProto(state);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::RestoreSolverStateFromProto(const SolverState& state) {
   this->iter_ = state.iter();
   if (state.has_learned_net()) {
     NetParameter net_param;
@@ -0,0 +1,156 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Transforms the same datum into every item, labelled by its worker.
+template <typename Dtype>
+class CropDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  CropDataLayer(const LayerParameter& param, const Datum& datum)
+      : BasePrefetchingDataLayer<Dtype>(param), datum_(datum) {}
+  virtual ~CropDataLayer() { this->StopInternalThread(); }
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    vector<int> shape = this->data_transformer_->InferBlobShape(datum_);
+    this->transformed_data_.Reshape(shape);
+    shape[0] = kBatchSize;
+    top[0]->Reshape(shape);
+    top[1]->Reshape(vector<int>(1, kBatchSize));
+    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
+      this->prefetch_[i].data_.Reshape(shape);
+      this->prefetch_[i].label_.Reshape(vector<int>(1, kBatchSize));
+    }
+  }
+
+  virtual inline const char* type() const { return "CropData"; }
+
+  static const int kBatchSize = 10;
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    Dtype* top_data = batch->data_.mutable_cpu_data();
+    Dtype* top_label = batch->label_.mutable_cpu_data();
+    this->ParallelTransform(kBatchSize, [&](int worker, int begin, int end) {
+      Blob<Dtype> transformed_data(this->transformed_data_.shape());
+      for (int item_id = begin; item_id < end; ++item_id) {
+        transformed_data.set_cpu_data(top_data + batch->data_.offset(item_id));
+        this->transformers_[worker]->Transform(datum_, &transformed_data);
+        top_label[item_id] = worker;
+      }
+    });
+  }
+
+  Datum datum_;
+};
+
+// A layer transforming its batches on the prefetch thread only.
+template <typename Dtype>
+class SerialCropDataLayer : public CropDataLayer<Dtype> {
+ public:
+  SerialCropDataLayer(const LayerParameter& param, const Datum& datum)
+      : CropDataLayer<Dtype>(param, datum) {}
+
+ protected:
+  virtual inline bool UsesParallelTransform() const { return false; }
+};
+
+template <typename Dtype>
+class BasePrefetchingDataLayerTest : public ::testing::Test {
+ protected:
+  BasePrefetchingDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    DatumShape* shape = datum_.mutable_data_shape();
+    shape->set_data_depth(DatumShape::DEPTH_8U);
+    shape->set_height(6);
+    shape->set_width(6);
+    for (int i = 0; i < 36; ++i) {
+      datum_.mutable_data()->push_back(static_cast<char>(i));
+    }
+    TransformationParameter* transform_param =
+        layer_param_.mutable_transform_param();
+    transform_param->set_crop_size(3);
+    transform_param->set_mirror(true);
+    transform_param->set_num_threads(4);
+    layer_param_.set_phase(TRAIN);
+  }
+  virtual ~BasePrefetchingDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Runs a few batches of a new layer, seeded with seed.
+  vector<Dtype> RunBatches(int seed) {
+    Caffe::set_random_seed(seed);
+    CropDataLayer<Dtype> layer(layer_param_, datum_);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    vector<Dtype> data;
+    for (int i = 0; i < 3; ++i) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      data.insert(data.end(), blob_top_data_->cpu_data(),
+          blob_top_data_->cpu_data() + blob_top_data_->count());
+    }
+    return data;
+  }
+
+  Datum datum_;
+  LayerParameter layer_param_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BasePrefetchingDataLayerTest, TestDtypes);
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestWorkerSlices) {
+  CropDataLayer<TypeParam> layer(this->layer_param_, this->datum_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int workers[] = {0, 0, 1, 1, 1, 2, 2, 3, 3, 3};
+  for (int i = 0; i < CropDataLayer<TypeParam>::kBatchSize; ++i) {
+    EXPECT_EQ(this->blob_top_label_->cpu_data()[i], workers[i]);
+  }
+  // Every item is a crop of the datum, possibly mirrored.
+  const TypeParam* data = this->blob_top_data_->cpu_data();
+  for (int i = 0; i < CropDataLayer<TypeParam>::kBatchSize; ++i) {
+    const TypeParam* item = data + i * 9;
+    const bool mirrored = item[0] > item[1];
+    const int left = static_cast<int>(item[mirrored ? 2 : 0]);
+    for (int h = 0; h < 3; ++h) {
+      for (int w = 0; w < 3; ++w) {
+        EXPECT_EQ(item[h * 3 + (mirrored ? 2 - w : w)], left + h * 6 + w);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestSerialLayerIgnoresThreads) {
+  SerialCropDataLayer<TypeParam> layer(this->layer_param_, this->datum_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < CropDataLayer<TypeParam>::kBatchSize; ++i) {
+    EXPECT_EQ(this->blob_top_label_->cpu_data()[i], 0);
+  }
+}
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestReproducible) {
+  const vector<TypeParam> first = this->RunBatches(1701);
+  const vector<TypeParam> second = this->RunBatches(1701);
+  EXPECT_TRUE(first == second);
+  // The crops are random.
+  EXPECT_FALSE(first == this->RunBatches(1702));
+}
+
+}  // namespace caffe
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/box.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class BoxTest : public ::testing::Test {
+ protected:
+  // Fills boxes with count 2-D boxes given as xmin, ymin, xmax, ymax.
+  void SetBoxes(const Dtype* coords, const int count, BoxSet<Dtype>* boxes) {
+    boxes->Reshape(2, count);
+    for (int i = 0; i < count; ++i) {
+      boxes->mutable_min_location(0)[i] = coords[4 * i + 0];
+      boxes->mutable_min_location(1)[i] = coords[4 * i + 1];
+      boxes->mutable_max_location(0)[i] = coords[4 * i + 2];
+      boxes->mutable_max_location(1)[i] = coords[4 * i + 3];
+    }
+    boxes->UpdateVolumes();
+  }
+
+  void RandomBoxes(const int box_dimensions, const int count,
+      BoxSet<Dtype>* boxes) {
+    boxes->Reshape(box_dimensions, count);
+    vector<Dtype> corner(count);
+    vector<Dtype> extent(count);
+    for (int d = 0; d < box_dimensions; ++d) {
+      caffe_rng_uniform<Dtype>(count, 0, 1, &corner[0]);
+      caffe_rng_uniform<Dtype>(count, 0.05, 0.5, &extent[0]);
+      for (int i = 0; i < count; ++i) {
+        boxes->mutable_min_location(d)[i] = corner[i];
+        boxes->mutable_max_location(d)[i] = corner[i] + extent[i];
+      }
+    }
+    boxes->UpdateVolumes();
+  }
+};
+
+TYPED_TEST_CASE(BoxTest, TestDtypes);
+
+TYPED_TEST(BoxTest, TestJaccardOverlap) {
+  const TypeParam coords[] = {
+    0, 0, 2, 2,
+    1, 1, 3, 3,
+    2, 2, 4, 4,
+    0, 0, 2, 2,
+  };
+  BoxSet<TypeParam> boxes;
+  this->SetBoxes(coords, 4, &boxes);
+  EXPECT_NEAR(JaccardOverlap(boxes, 0, boxes, 1), 1. / 7., 1e-6);
+  EXPECT_EQ(JaccardOverlap(boxes, 0, boxes, 2), 0);
+  EXPECT_EQ(JaccardOverlap(boxes, 0, boxes, 3), 1);
+}
+
+TYPED_TEST(BoxTest, TestJaccardOverlapsKernel) {
+  Caffe::set_random_seed(1701);
+  for (int box_dimensions = 1; box_dimensions <= 3; ++box_dimensions) {
+    BoxSet<TypeParam> boxes1;
+    BoxSet<TypeParam> boxes2;
+    // An odd size exercises the scalar tail of the vector kernel.
+    this->RandomBoxes(box_dimensions, 5, &boxes1);
+    this->RandomBoxes(box_dimensions, 37, &boxes2);
+    vector<TypeParam> overlaps(boxes2.size());
+    for (int i = 0; i < boxes1.size(); ++i) {
+      JaccardOverlaps(boxes1, i, boxes2, &overlaps[0]);
+      for (int j = 0; j < boxes2.size(); ++j) {
+        EXPECT_NEAR(overlaps[j], JaccardOverlap(boxes1, i, boxes2, j), 1e-6);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BoxTest, TestMatchBoxes) {
+  // Two ground truth boxes against four predictions.
+  const TypeParam gt_coords[] = {
+    0, 0, 4, 4,
+    2, 0, 6, 4,
+  };
+  const TypeParam pred_coords[] = {
+    0, 0, 4, 4,
+    1, 0, 5, 4,
+    3, 0, 7, 4,
+    10, 10, 11, 11,
+  };
+  GTBoxes<TypeParam> gt;
+  this->SetBoxes(gt_coords, 2, &gt.boxes);
+  gt.labels.push_back(1);
+  gt.labels.push_back(2);
+  BoxSet<TypeParam> pred;
+  this->SetBoxes(pred_coords, 4, &pred);
+  BoxOverlaps<TypeParam> overlaps;
+  JaccardOverlaps(gt, pred, 0, -1, overlaps);
+  // The disjoint prediction is not stored.
+  EXPECT_EQ(overlaps.values.size(), 6);
+
+  vector<int> match_indices;
+  vector<TypeParam> match_overlaps;
+  MatchBoxes(overlaps, MultiBoxLossParameter_MatchType_BIPARTITE, 0.5,
+      match_indices, match_overlaps);
+  EXPECT_EQ(match_indices[0], 0);
+  EXPECT_EQ(match_indices[1], -1);
+  EXPECT_EQ(match_indices[2], 1);
+  EXPECT_EQ(match_indices[3], -1);
+
+  MatchBoxes(overlaps, MultiBoxLossParameter_MatchType_PER_PREDICTION, 0.5,
+      match_indices, match_overlaps);
+  EXPECT_EQ(match_indices[0], 0);
+  EXPECT_EQ(match_indices[1], 0);
+  EXPECT_NEAR(match_overlaps[1], 0.6, 1e-6);
+  EXPECT_EQ(match_indices[2], 1);
+  EXPECT_EQ(match_indices[3], -1);
+
+  // Per class matching only sees the ground truth of that class.
+  JaccardOverlaps(gt, pred, 0, 2, overlaps);
+  MatchBoxes(overlaps, MultiBoxLossParameter_MatchType_PER_PREDICTION, 0.5,
+      match_indices, match_overlaps);
+  EXPECT_EQ(match_indices[0], -1);
+  EXPECT_EQ(match_indices[1], 1);
+  EXPECT_EQ(match_indices[2], 1);
+}
+
+TYPED_TEST(BoxTest, TestSelectHardNegatives) {
+  vector<pair<TypeParam, int> > negatives;
+  negatives.push_back(std::make_pair(TypeParam(0.2), 0));
+  negatives.push_back(std::make_pair(TypeParam(0.9), 1));
+  negatives.push_back(std::make_pair(TypeParam(0.5), 2));
+  negatives.push_back(std::make_pair(TypeParam(0.9), 3));
+  negatives.push_back(std::make_pair(TypeParam(0.1), 4));
+  SelectHardNegatives(3, negatives);
+  ASSERT_EQ(negatives.size(), 3);
+  EXPECT_EQ(negatives[0].second, 1);
+  EXPECT_EQ(negatives[1].second, 3);
+  EXPECT_EQ(negatives[2].second, 2);
+}
+
+TYPED_TEST(BoxTest, TestDecodeBoxes) {
+  Caffe::set_random_seed(1701);
+  for (int box_dimensions = 1; box_dimensions <= 3; ++box_dimensions) {
+    DefBoxes<TypeParam> def_boxes;
+    BoxSet<TypeParam> gt;
+    this->RandomBoxes(box_dimensions, 7, &def_boxes.boxes);
+    this->RandomBoxes(box_dimensions, 7, &def_boxes.variances);
+    this->RandomBoxes(box_dimensions, 7, &gt);
+    // Decoding the encoded ground truth gives it back.
+    BoxSet<TypeParam> codes;
+    codes.Reshape(box_dimensions, 7);
+    vector<TypeParam> code(2 * box_dimensions);
+    for (int i = 0; i < 7; ++i) {
+      EncodeBox(gt, i, def_boxes, i, &code[0]);
+      for (int d = 0; d < box_dimensions; ++d) {
+        codes.mutable_min_location(d)[i] = code[d];
+        codes.mutable_max_location(d)[i] = code[box_dimensions + d];
+      }
+    }
+    BoxSet<TypeParam> decoded;
+    DecodeBoxes(def_boxes, codes, decoded);
+    for (int i = 0; i < 7; ++i) {
+      for (int d = 0; d < box_dimensions; ++d) {
+        EXPECT_NEAR(decoded.min_location(d)[i], gt.min_location(d)[i], 1e-5);
+        EXPECT_NEAR(decoded.max_location(d)[i], gt.max_location(d)[i], 1e-5);
+      }
+      EXPECT_NEAR(decoded.volumes()[i], gt.volumes()[i], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(BoxTest, TestApplyNMS) {
+  const TypeParam coords[] = {
+    0, 0, 4, 4,
+    0, 1, 4, 5,
+    5, 5, 6, 6,
+    1, 0, 5, 4,
+    10, 10, 11, 11,
+  };
+  const TypeParam scores[] = { 0.8, 0.9, 0.7, 0.6, 0.05 };
+  BoxSet<TypeParam> boxes;
+  this->SetBoxes(coords, 5, &boxes);
+  vector<int> indices;
+  // Box 0 overlaps the more confident box 1 by 0.6, box 3 overlaps box 1 by
+  // 0.39 and box 4 is below the score threshold.
+  ApplyNMS(boxes, scores, 0.1, 0.5, -1, indices);
+  ASSERT_EQ(indices.size(), 3);
+  EXPECT_EQ(indices[0], 1);
+  EXPECT_EQ(indices[1], 2);
+  EXPECT_EQ(indices[2], 3);
+  ApplyNMS(boxes, scores, 0.1, 0.3, -1, indices);
+  ASSERT_EQ(indices.size(), 2);
+  EXPECT_EQ(indices[1], 2);
+  // Only the top 2 scoring boxes are candidates.
+  ApplyNMS(boxes, scores, 0.1, 0.7, 2, indices);
+  ASSERT_EQ(indices.size(), 2);
+  EXPECT_EQ(indices[0], 1);
+  EXPECT_EQ(indices[1], 0);
+}
+
+TYPED_TEST(BoxTest, TestApplyNMSRandom) {
+  Caffe::set_random_seed(1701);
+  BoxSet<TypeParam> boxes;
+  this->RandomBoxes(2, 101, &boxes);
+  vector<TypeParam> scores(101);
+  caffe_rng_uniform<TypeParam>(101, 0, 1, &scores[0]);
+  vector<int> indices;
+  ApplyNMS(boxes, &scores[0], 0.2, 0.4, 50, indices);
+  // Reference: sort all, keep the top 50 above the threshold, then suppress.
+  vector<pair<TypeParam, int> > sorted;
+  for (int i = 0; i < 101; ++i) {
+    if (scores[i] > TypeParam(0.2)) {
+      sorted.push_back(std::make_pair(-scores[i], i));
+    }
+  }
+  std::sort(sorted.begin(), sorted.end());
+  sorted.resize(std::min<int>(sorted.size(), 50));
+  vector<int> expected;
+  for (int j = 0; j < sorted.size(); ++j) {
+    bool keep = true;
+    for (int k = 0; k < expected.size(); ++k) {
+      keep &= JaccardOverlap(boxes, sorted[j].second, boxes, expected[k]) <=
+          TypeParam(0.4);
+    }
+    if (keep) {
+      expected.push_back(sorted[j].second);
+    }
+  }
+  EXPECT_TRUE(indices == expected);
+}
+
+}  // namespace caffe
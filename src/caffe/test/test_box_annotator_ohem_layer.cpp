@@ -0,0 +1,103 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/box_annotator_ohem_layer.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class BoxAnnotatorOHEMLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  BoxAnnotatorOHEMLayerTest()
+      : blob_bottom_rois_(new Blob<Dtype>(kNumRois, 5, 1, 1)),
+        blob_bottom_loss_(new Blob<Dtype>(kNumRois, 1, 1, 1)),
+        blob_bottom_labels_(new Blob<Dtype>(kNumRois, 1, 1, 1)),
+        blob_bottom_bbox_weights_(new Blob<Dtype>(kNumRois, 8, 1, 1)),
+        blob_top_labels_(new Blob<Dtype>()),
+        blob_top_bbox_weights_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_rois_);
+    filler.Fill(this->blob_bottom_loss_);
+    filler.Fill(this->blob_bottom_bbox_weights_);
+    // Rois alternate between two images; two of them tie on the loss.
+    for (int n = 0; n < kNumRois; ++n) {
+      blob_bottom_rois_->mutable_cpu_data()[5 * n] = n % 2;
+      blob_bottom_labels_->mutable_cpu_data()[n] = n % 4 + 1;
+    }
+    blob_bottom_loss_->mutable_cpu_data()[4] = 10;
+    blob_bottom_loss_->mutable_cpu_data()[8] = 10;
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_bottom_vec_.push_back(blob_bottom_loss_);
+    blob_bottom_vec_.push_back(blob_bottom_labels_);
+    blob_bottom_vec_.push_back(blob_bottom_bbox_weights_);
+    blob_top_vec_.push_back(blob_top_labels_);
+    blob_top_vec_.push_back(blob_top_bbox_weights_);
+  }
+  virtual ~BoxAnnotatorOHEMLayerTest() {
+    delete blob_bottom_rois_;
+    delete blob_bottom_loss_;
+    delete blob_bottom_labels_;
+    delete blob_bottom_bbox_weights_;
+    delete blob_top_labels_;
+    delete blob_top_bbox_weights_;
+  }
+
+  static const int kNumRois = 20;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_bottom_loss_;
+  Blob<Dtype>* const blob_bottom_labels_;
+  Blob<Dtype>* const blob_bottom_bbox_weights_;
+  Blob<Dtype>* const blob_top_labels_;
+  Blob<Dtype>* const blob_top_bbox_weights_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BoxAnnotatorOHEMLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BoxAnnotatorOHEMLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumRois = this->kNumRois;
+  const int roi_per_img = 3;
+  const int ignore_label = -1;
+  LayerParameter layer_param;
+  BoxAnnotatorOHEMParameter* ohem_param =
+      layer_param.mutable_box_annotator_ohem_param();
+  ohem_param->set_roi_per_img(roi_per_img);
+  ohem_param->set_ignore_label(ignore_label);
+  BoxAnnotatorOHEMLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* loss = this->blob_bottom_loss_->cpu_data();
+  const Dtype* top_labels = this->blob_top_labels_->cpu_data();
+  const Dtype* top_weights = this->blob_top_bbox_weights_->cpu_data();
+  const Dtype* bottom_weights = this->blob_bottom_bbox_weights_->cpu_data();
+  int kept[2] = { 0, 0 };
+  for (int n = 0; n < kNumRois; ++n) {
+    // A roi is kept iff fewer than roi_per_img rois of its image are harder.
+    int harder = 0;
+    for (int m = n % 2; m < kNumRois; m += 2) {
+      harder += loss[m] > loss[n] || (loss[m] == loss[n] && m < n);
+    }
+    const bool keep = harder < roi_per_img;
+    kept[n % 2] += keep;
+    EXPECT_EQ(top_labels[n], keep ? n % 4 + 1 : ignore_label);
+    for (int j = 0; j < 8; ++j) {
+      EXPECT_EQ(top_weights[n * 8 + j], keep ? bottom_weights[n * 8 + j] : 0);
+    }
+  }
+  EXPECT_EQ(kept[0], roi_per_img);
+  EXPECT_EQ(kept[1], roi_per_img);
+  EXPECT_NE(top_labels[4], ignore_label);
+  EXPECT_NE(top_labels[8], ignore_label);
+}
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -811,6 +813,204 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestWinogradConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape;
+  bottom_shape.push_back(2);
+  bottom_shape.push_back(16);
+  bottom_shape.push_back(11);
+  bottom_shape.push_back(9);
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // Both tiles, with and without padding, over ragged edge tiles.
+  for (int tile = 2; tile <= 4; tile += 2) {
+    for (int pad = 0; pad <= 1; ++pad) {
+      for (int group = 1; group <= 2; ++group) {
+        LayerParameter layer_param;
+        ConvolutionParameter* convolution_param =
+            layer_param.mutable_convolution_param();
+        convolution_param->add_kernel_size(3);
+        convolution_param->add_pad(pad);
+        convolution_param->set_num_output(6);
+        convolution_param->set_group(group);
+        convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+        convolution_param->set_winograd_tile(tile);
+        convolution_param->mutable_weight_filler()->set_type("gaussian");
+        convolution_param->mutable_bias_filler()->set_type("gaussian");
+        shared_ptr<Layer<Dtype> > layer(
+            new ConvolutionLayer<Dtype>(layer_param));
+        layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+            this->MakeReferenceTop(this->blob_top_));
+        const Dtype* top_data = this->blob_top_->cpu_data();
+        const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+        for (int i = 0; i < this->blob_top_->count(); ++i) {
+          EXPECT_NEAR(top_data[i], ref_top_data[i],
+              1e-4 * std::max(Dtype(1), std::fabs(ref_top_data[i])));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape;
+  bottom_shape.push_back(2);
+  bottom_shape.push_back(6);
+  bottom_shape.push_back(7);
+  bottom_shape.push_back(8);
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // Depthwise and grouped, with strides, padding and dilation.
+  for (int group = 2; group <= 6; group += 4) {
+    for (int stride = 1; stride <= 2; ++stride) {
+      for (int dilation = 1; dilation <= 2; ++dilation) {
+        LayerParameter layer_param;
+        ConvolutionParameter* convolution_param =
+            layer_param.mutable_convolution_param();
+        convolution_param->add_kernel_size(3);
+        convolution_param->add_pad(1);
+        convolution_param->add_stride(stride);
+        convolution_param->add_dilation(dilation);
+        convolution_param->set_num_output(group == 6 ? 6 : 4);
+        convolution_param->set_group(group);
+        convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+        convolution_param->mutable_weight_filler()->set_type("gaussian");
+        convolution_param->mutable_bias_filler()->set_type("gaussian");
+        shared_ptr<Layer<Dtype> > layer(
+            new ConvolutionLayer<Dtype>(layer_param));
+        layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+            this->MakeReferenceTop(this->blob_top_));
+        const Dtype* top_data = this->blob_top_->cpu_data();
+        const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+        for (int i = 0; i < this->blob_top_->count(); ++i) {
+          EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestInt8Convolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape;
+  bottom_shape.push_back(2);
+  bottom_shape.push_back(4);
+  bottom_shape.push_back(7);
+  bottom_shape.push_back(8);
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  filler_param.set_min(-2);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // Grouped, with strides, padding and dilation.
+  for (int group = 1; group <= 2; ++group) {
+    for (int stride = 1; stride <= 2; ++stride) {
+      for (int dilation = 1; dilation <= 2; ++dilation) {
+        LayerParameter layer_param;
+        ConvolutionParameter* convolution_param =
+            layer_param.mutable_convolution_param();
+        convolution_param->add_kernel_size(3);
+        convolution_param->add_pad(1);
+        convolution_param->add_stride(stride);
+        convolution_param->add_dilation(dilation);
+        convolution_param->set_num_output(6);
+        convolution_param->set_group(group);
+        convolution_param->mutable_weight_filler()->set_type("gaussian");
+        convolution_param->mutable_bias_filler()->set_type("gaussian");
+        layer_param.mutable_quantization_param()->set_bottom_max(2);
+        shared_ptr<Layer<Dtype> > layer(
+            new ConvolutionLayer<Dtype>(layer_param));
+        layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+            this->MakeReferenceTop(this->blob_top_));
+        const Dtype* top_data = this->blob_top_->cpu_data();
+        const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+        Dtype max_abs = 0;
+        for (int i = 0; i < this->blob_top_->count(); ++i) {
+          max_abs = std::max(max_abs, std::fabs(ref_top_data[i]));
+        }
+        for (int i = 0; i < this->blob_top_->count(); ++i) {
+          EXPECT_NEAR(top_data[i], ref_top_data[i], 0.02 * max_abs);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradFallback) {
+  // Stride 2 is not supported by Winograd, the layer convolves by im2col.
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -0,0 +1,151 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DatumViewTest : public ::testing::Test {
+ protected:
+  DatumViewTest() {
+    DatumShape* data_shape = datum_.mutable_data_shape();
+    data_shape->set_data_depth(DatumShape::DEPTH_32F);
+    data_shape->set_channels(2);
+    data_shape->set_height(4);
+    data_shape->set_width(5);
+    for (int i = 0; i < 2 * 4 * 5; ++i) {
+      const float value = i * 0.5f;
+      datum_.mutable_data()->append(reinterpret_cast<const char*>(&value),
+          sizeof(value));
+    }
+    DatumShape* label_shape = datum_.mutable_label_shape();
+    label_shape->set_data_depth(DatumShape::DEPTH_8U);
+    label_shape->set_channels(3);
+    datum_.set_label("\x01\x02\x03");
+  }
+
+  void ExpectMatches(const DatumView& view) {
+    EXPECT_EQ(view.data_shape().DebugString(),
+        datum_.data_shape().DebugString());
+    EXPECT_EQ(view.label_shape().DebugString(),
+        datum_.label_shape().DebugString());
+    EXPECT_EQ(string(view.data(), view.data_size()), datum_.data());
+    EXPECT_EQ(string(view.label(), view.label_size()), datum_.label());
+    EXPECT_EQ(view.encoded(), datum_.encoded());
+  }
+
+  Datum datum_;
+};
+
+TEST_F(DatumViewTest, TestParse) {
+  const string serialized = datum_.SerializeAsString();
+  DatumView view;
+  ASSERT_TRUE(view.Parse(serialized.data(), serialized.size()));
+  ExpectMatches(view);
+  // The bytes are not copied.
+  EXPECT_GE(view.data(), serialized.data());
+  EXPECT_LT(view.data(), serialized.data() + serialized.size());
+}
+
+TEST_F(DatumViewTest, TestParseEncoded) {
+  datum_.set_encoded(true);
+  const string serialized = datum_.SerializeAsString();
+  DatumView view;
+  ASSERT_TRUE(view.Parse(serialized.data(), serialized.size()));
+  ExpectMatches(view);
+  // A view can be reused.
+  datum_.set_encoded(false);
+  datum_.clear_label();
+  datum_.clear_label_shape();
+  const string other = datum_.SerializeAsString();
+  ASSERT_TRUE(view.Parse(other.data(), other.size()));
+  ExpectMatches(view);
+}
+
+TEST_F(DatumViewTest, TestSkipsUnknownFields) {
+  string serialized = datum_.SerializeAsString();
+  // Field 15 varint, 16 fixed32, 17 fixed64 and 18 length delimited.
+  serialized.append("\x78\x96\x01", 3);
+  serialized.append("\x85\x01" "abcd", 6);
+  serialized.append("\x89\x01" "abcdefgh", 10);
+  serialized.append("\x92\x01\x02" "ab", 5);
+  DatumView view;
+  ASSERT_TRUE(view.Parse(serialized.data(), serialized.size()));
+  ExpectMatches(view);
+}
+
+TEST_F(DatumViewTest, TestRejectsTruncated) {
+  const string serialized = datum_.SerializeAsString();
+  DatumView view;
+  EXPECT_FALSE(view.Parse(serialized.data(), serialized.size() - 1));
+  EXPECT_FALSE(view.Parse(serialized.data(), 1));
+}
+
+TEST_F(DatumViewTest, TestParseOwned) {
+  string serialized = datum_.SerializeAsString();
+  DatumView view;
+  ASSERT_TRUE(view.ParseOwned(&serialized));
+  serialized.assign(serialized.size(), 'x');
+  ExpectMatches(view);
+}
+
+TEST_F(DatumViewTest, TestReset) {
+  DatumView view;
+  view.Reset(datum_);
+  ExpectMatches(view);
+  EXPECT_EQ(view.data(), datum_.data().data());
+}
+
+template <typename Dtype>
+class DatumViewTransformTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(DatumViewTransformTest, TestDtypes);
+
+TYPED_TEST(DatumViewTransformTest, TestTransformUnaligned) {
+  Datum datum;
+  DatumShape* data_shape = datum.mutable_data_shape();
+  data_shape->set_data_depth(DatumShape::DEPTH_32F);
+  data_shape->set_channels(2);
+  data_shape->set_height(4);
+  data_shape->set_width(5);
+  for (int i = 0; i < 2 * 4 * 5; ++i) {
+    const float value = i;
+    datum.mutable_data()->append(reinterpret_cast<const char*>(&value),
+        sizeof(value));
+  }
+  // Parse at an odd offset so that the floats are not aligned.
+  const string buffer = "x" + datum.SerializeAsString();
+  DatumView view;
+  ASSERT_TRUE(view.Parse(buffer.data() + 1, buffer.size() - 1));
+
+  TransformationParameter transform_param;
+  transform_param.set_crop_size(3);
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  transform_param.set_scale(0.5);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  EXPECT_EQ(transformer.InferBlobShape(view),
+      transformer.InferBlobShape(datum));
+  Blob<TypeParam> blob(1, 2, 3, 3);
+  transformer.Transform(view, &blob);
+  // The center crop starts at row 0, column 1.
+  for (int c = 0; c < 2; ++c) {
+    for (int h = 0; h < 3; ++h) {
+      for (int w = 0; w < 3; ++w) {
+        const int source = (c * 4 + h) * 5 + w + 1;
+        EXPECT_EQ(blob.data_at(0, c, h, w), (source - (c + 1)) * 0.5);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
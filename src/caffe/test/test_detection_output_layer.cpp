@@ -0,0 +1,157 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/detection_output_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class DetectionOutputLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  DetectionOutputLayerTest()
+      : blob_bottom_def_(new Blob<Dtype>(2, 4, 1, 3)),
+        blob_bottom_loc_(new Blob<Dtype>()),
+        blob_bottom_conf_(new Blob<Dtype>(2, 3, 1, 3)),
+        blob_top_(new Blob<Dtype>()) {
+    // Three 2-D default boxes, the first two overlapping, variance 1.
+    const Dtype def[] = {
+      0, 0.2, 3,
+      0, 0, 3,
+      2, 2.2, 4,
+      2, 2, 4,
+    };
+    caffe_copy(12, def, blob_bottom_def_->mutable_cpu_data());
+    caffe_set(12, Dtype(1), blob_bottom_def_->mutable_cpu_data() + 12);
+    // Channel c of the confidences holds class c of every box: box 0 and 1
+    // are class 1, box 2 is class 2 in image 0. Image 1 only sees class 2.
+    const Dtype conf[] = {
+      0, 0, 0,
+      5, 4, 0,
+      0, 0, 5,
+      5, 5, 0,
+      0, 0, 0,
+      0, 0, 5,
+    };
+    caffe_copy(18, conf, blob_bottom_conf_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_def_);
+    blob_bottom_vec_.push_back(blob_bottom_loc_);
+    blob_bottom_vec_.push_back(blob_bottom_conf_);
+    blob_top_vec_.push_back(blob_top_);
+    public_param_.mutable_detection_param()->mutable_range()->add_dim(4);
+    public_param_.mutable_detection_param()->mutable_range()->add_dim(4);
+    public_param_.mutable_detection_param()->set_num_classes(3);
+    layer_param_.mutable_detection_output_param()->set_confidence_threshold(
+        0.1);
+  }
+  virtual ~DetectionOutputLayerTest() {
+    delete blob_bottom_def_;
+    delete blob_bottom_loc_;
+    delete blob_bottom_conf_;
+    delete blob_top_;
+  }
+
+  void Forward() {
+    DetectionOutputLayer<Dtype> layer(layer_param_);
+    layer.set_public_param(public_param_);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  }
+
+  void ExpectDetection(const int row, const Dtype* expected) {
+    ASSERT_LT(row, blob_top_->height());
+    for (int i = 0; i < 7; ++i) {
+      EXPECT_NEAR(blob_top_->data_at(0, 0, row, i), expected[i], 1e-4)
+          << "row " << row << " column " << i;
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_def_;
+  Blob<Dtype>* const blob_bottom_loc_;
+  Blob<Dtype>* const blob_bottom_conf_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+  PublicParameter public_param_;
+};
+
+TYPED_TEST_CASE(DetectionOutputLayerTest, TestDtypes);
+
+TYPED_TEST(DetectionOutputLayerTest, TestSharedLocation) {
+  this->blob_bottom_loc_->Reshape(2, 4, 1, 3);
+  caffe_set(this->blob_bottom_loc_->count(), TypeParam(0),
+      this->blob_bottom_loc_->mutable_cpu_data());
+  // Image 1 moves the lower x corner of box 2 by half its extent.
+  this->blob_bottom_loc_->mutable_cpu_data()[12 + 2] = 0.5;
+  this->Forward();
+  ASSERT_EQ(this->blob_top_->height(), 3);
+  const TypeParam score = std::exp(5.) / (std::exp(5.) + 2);
+  // Box 1 is suppressed by the more confident box 0.
+  const TypeParam expected0[] = { 0, 1, score, 0, 0, 2, 2 };
+  const TypeParam expected1[] = { 0, 2, score, 3, 3, 4, 4 };
+  const TypeParam expected2[] = { 1, 2, score, 3.5, 3, 4, 4 };
+  this->ExpectDetection(0, expected0);
+  this->ExpectDetection(1, expected1);
+  this->ExpectDetection(2, expected2);
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestKeepTopK) {
+  this->blob_bottom_loc_->Reshape(2, 4, 1, 3);
+  caffe_set(this->blob_bottom_loc_->count(), TypeParam(0),
+      this->blob_bottom_loc_->mutable_cpu_data());
+  this->blob_bottom_conf_->mutable_cpu_data()[8] = 6;
+  DetectionOutputParameter* detection_output_param =
+      this->layer_param_.mutable_detection_output_param();
+  detection_output_param->set_keep_top_k(1);
+  detection_output_param->set_nms_threshold(0.9);
+  this->Forward();
+  // Only the most confident detection of each image is left.
+  ASSERT_EQ(this->blob_top_->height(), 2);
+  EXPECT_EQ(this->blob_top_->data_at(0, 0, 0, 0), 0);
+  EXPECT_EQ(this->blob_top_->data_at(0, 0, 0, 1), 2);
+  EXPECT_EQ(this->blob_top_->data_at(0, 0, 1, 0), 1);
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestPerClassLocation) {
+  this->public_param_.mutable_detection_param()->set_share_location(false);
+  // Class c of every box uses channels 4c to 4c + 3.
+  this->blob_bottom_loc_->Reshape(2, 12, 1, 3);
+  caffe_set(this->blob_bottom_loc_->count(), TypeParam(0),
+      this->blob_bottom_loc_->mutable_cpu_data());
+  // Class 1 moves the upper y corner of the boxes of image 0 down by half
+  // their extent, so box 1 is no longer suppressed by box 0.
+  for (int i = 0; i < 3; ++i) {
+    this->blob_bottom_loc_->mutable_cpu_data()[(4 + 3) * 3 + i] = -0.5;
+  }
+  this->blob_bottom_loc_->mutable_cpu_data()[(4 + 3) * 3 + 1] = 0.5;
+  this->Forward();
+  ASSERT_EQ(this->blob_top_->height(), 4);
+  const TypeParam score0 = std::exp(5.) / (std::exp(5.) + 2);
+  const TypeParam score1 = std::exp(4.) / (std::exp(4.) + 2);
+  const TypeParam expected0[] = { 0, 1, score0, 0, 0, 2, 1 };
+  const TypeParam expected1[] = { 0, 1, score1, 0.2, 0, 2.2, 3 };
+  const TypeParam expected2[] = { 0, 2, score0, 3, 3, 4, 4 };
+  this->ExpectDetection(0, expected0);
+  this->ExpectDetection(1, expected1);
+  this->ExpectDetection(2, expected2);
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestNoDetection) {
+  this->blob_bottom_loc_->Reshape(2, 4, 1, 3);
+  this->layer_param_.mutable_detection_output_param()->
+      set_confidence_threshold(0.999);
+  this->Forward();
+  ASSERT_EQ(this->blob_top_->count(), 7);
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(this->blob_top_->cpu_data()[i], -1);
+  }
+}
+
+}  // namespace caffe
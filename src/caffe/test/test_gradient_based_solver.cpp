@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,7 +12,9 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -19,6 +22,10 @@ using std::ostringstream;
 
 namespace caffe {
 
+static SolverAction::Enum RequestSnapshot() {
+  return SolverAction::SNAPSHOT;
+}
+
 template <typename TypeParam>
 class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -26,7 +33,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), async_snapshot_(false) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -37,11 +44,13 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   string snapshot_prefix_;
   shared_ptr<SGDSolver<Dtype> > solver_;
   shared_ptr<P2PSync<Dtype> > sync_;
+  shared_ptr<CPUSync<Dtype> > cpu_sync_;
   int seed_;
   // Dimensions are determined by generate_sample_data.py
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool async_snapshot_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -181,6 +190,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     std::replace(snapshot_prefix_.begin(), snapshot_prefix_.end(), '\\', '/');
 #endif
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
+    proto << "async_snapshot: " << async_snapshot_ << " ";
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
@@ -194,6 +204,14 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     }
     if (devices == 1) {
       this->solver_->Solve();
+    } else if (Caffe::mode() == Caffe::CPU) {
+      LOG(INFO) << "CPU data parallel test on " << devices << " replicas";
+      Caffe::set_solver_count(devices);
+      this->cpu_sync_.reset(new CPUSync<Dtype>(
+          this->solver_, NULL, this->solver_->param()));
+      // Run the first two iterations one replica at a time.
+      this->cpu_sync_->Run(devices, 2);
+      Caffe::set_solver_count(1);
     } else {
       LOG(INFO) << "Multi-GPU test on " << devices << " devices";
       vector<int> gpus;
@@ -215,6 +233,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       resume_file << snapshot_prefix_ << "/_iter_" << num_iters
                   << ".solverstate";
       string resume_filename = resume_file.str();
+      // Solve waits for the asynchronous snapshots, renamed once written.
+      EXPECT_TRUE(boost::filesystem::exists(resume_filename));
+      EXPECT_FALSE(boost::filesystem::exists(resume_filename + ".tmp"));
       return resume_filename;
     }
     return string();
@@ -438,6 +459,45 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  // Replicas on CPU threads share the HDF5 data layer, so each reads its own
+  // batch, and they must update the parameters as a single solver does with
+  // their batches together.
+  void CheckCPUReplicas(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kReplicas) {
+    const double kPrecision = 1e-4;
+    const double kMinPrecision = 1e-7;
+    const int kNum = num_;
+    num_ = kNum * kReplicas;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters);
+    num_ = kNum;
+    Net<Dtype>& net = *this->solver_->net();
+    const vector<shared_ptr<Blob<Dtype> > >& param_blobs =
+        net.layer_by_name("innerprod")->blobs();
+    vector<shared_ptr<Blob<Dtype> > > single_params(param_blobs.size());
+    for (int i = 0; i < param_blobs.size(); ++i) {
+      single_params[i].reset(new Blob<Dtype>());
+      single_params[i]->CopyFrom(*param_blobs[i], false, true);
+    }
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, 1, kReplicas);
+    Net<Dtype>& net_replicas = *this->solver_->net();
+    const vector<shared_ptr<Blob<Dtype> > >& replica_params =
+        net_replicas.layer_by_name("innerprod")->blobs();
+    ASSERT_EQ(single_params.size(), replica_params.size());
+    for (int i = 0; i < single_params.size(); ++i) {
+      ASSERT_EQ(single_params[i]->count(), replica_params[i]->count());
+      for (int j = 0; j < single_params[i]->count(); ++j) {
+        const Dtype expected_param = single_params[i]->cpu_data()[j];
+        const Dtype replica_param = replica_params[i]->cpu_data()[j];
+        const Dtype error_margin = std::max(kMinPrecision, kPrecision *
+            std::min(fabs(expected_param), fabs(replica_param)));
+        EXPECT_NEAR(expected_param, replica_param, error_margin);
+      }
+    }
+    EXPECT_GT(this->cpu_sync_->scaling_efficiency(), 0);
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -559,6 +619,146 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       }
     }
   }
+
+  // A net_param of an inner product with 300 x 20 weights, which span several
+  // chunks of the fused update, fitting random targets.
+  static string InnerProductNetParam() {
+    return
+       "net_param { "
+       "  name: 'InnerProductNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      shape { dim: 4 dim: 300 } "
+       "      shape { dim: 4 dim: 20 } "
+       "      data_filler { type: 'gaussian' std: 1.0 } "
+       "      data_filler { type: 'gaussian' std: 1.0 } "
+       "    } "
+       "    top: 'data' "
+       "    top: 'targets' "
+       "  } "
+       "  layer { "
+       "    name: 'innerprod' "
+       "    type: 'InnerProduct' "
+       "    param { lr_mult: 1 decay_mult: 1 } "
+       "    param { lr_mult: 2 decay_mult: 0 } "
+       "    inner_product_param { "
+       "      num_output: 20 "
+       "      weight_filler { type: 'gaussian' std: 0.1 } "
+       "      bias_filler { type: 'gaussian' std: 0.1 } "
+       "    } "
+       "    bottom: 'data' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'innerprod' "
+       "    bottom: 'targets' "
+       "  } "
+       "} ";
+  }
+
+  // Requests a snapshot at every iteration. The asynchronous snapshots skip
+  // those that come while another is being written, and never leave a
+  // partial file.
+  void TestRequestedAsyncSnapshots() {
+    const int kNumIters = 10;
+    MakeTempDir(&snapshot_prefix_);
+#if defined(_MSC_VER)
+    std::replace(snapshot_prefix_.begin(), snapshot_prefix_.end(), '\\', '/');
+#endif
+    ostringstream proto;
+    proto <<
+       "max_iter: " << kNumIters << " "
+       "base_lr: 0.01 "
+       "lr_policy: 'fixed' "
+       "momentum: 0.9 "
+       "snapshot_after_train: false "
+       "async_snapshot: true "
+       "snapshot_prefix: '" << snapshot_prefix_ << "/' "
+       << InnerProductNetParam();
+    Caffe::set_random_seed(this->seed_);
+    this->InitSolverFromProtoString(proto.str());
+    this->solver_->SetActionFunction(&RequestSnapshot);
+    this->solver_->Solve();
+    int num_snapshots = 0;
+    for (int i = 1; i <= kNumIters; ++i) {
+      const string prefix = snapshot_prefix_ + "/_iter_" + format_int(i);
+      EXPECT_FALSE(boost::filesystem::exists(prefix + ".caffemodel.tmp"));
+      EXPECT_FALSE(boost::filesystem::exists(prefix + ".solverstate.tmp"));
+      if (!boost::filesystem::exists(prefix + ".solverstate")) {
+        continue;
+      }
+      ++num_snapshots;
+      SolverState state;
+      ReadProtoFromBinaryFileOrDie(prefix + ".solverstate", &state);
+      EXPECT_EQ(state.iter(), i);
+      EXPECT_EQ(state.learned_net(), prefix + ".caffemodel");
+      EXPECT_EQ(state.history_size(), 2);
+      NetParameter net_param;
+      ReadProtoFromBinaryFileOrDie(prefix + ".caffemodel", &net_param);
+      EXPECT_EQ(net_param.layer_size(), 3);
+    }
+    // The first request finds no snapshot being written.
+    EXPECT_GE(num_snapshots, 1);
+  }
+
+  // Trains a net whose params span several chunks of the fused CPU update,
+  // clipping, regularizing with L1 and accumulating gradients, with the
+  // fused update and with the separate passes, which should agree up to
+  // rounding.
+  void TestFusedUpdate(const Dtype momentum) {
+    if (Caffe::mode() != Caffe::CPU) {
+      return;
+    }
+    ThreadPool::SetGlobalThreads(4);
+    vector<vector<Dtype> > params(2), history(2);
+    for (int run = 0; run < 2; ++run) {
+      ostringstream proto;
+      proto <<
+         "max_iter: 5 "
+         "base_lr: 0.01 "
+         "lr_policy: 'fixed' "
+         "iter_size: 2 "
+         "momentum: " << momentum << " "
+         "rms_decay: 0.95 "
+         "weight_decay: 0.01 "
+         "regularization_type: 'L1' "
+         "clip_gradients: 0.1 "
+         "snapshot_after_train: false "
+         "fused_update: " << (run == 0) << " "
+         << InnerProductNetParam();
+      Caffe::set_random_seed(this->seed_);
+      this->InitSolverFromProtoString(proto.str());
+      this->solver_->Solve();
+      const vector<Blob<Dtype>*>& net_params =
+          this->solver_->net()->learnable_params();
+      for (int i = 0; i < net_params.size(); ++i) {
+        params[run].insert(params[run].end(), net_params[i]->cpu_data(),
+            net_params[i]->cpu_data() + net_params[i]->count());
+      }
+      for (int i = 0; i < this->solver_->history().size(); ++i) {
+        const Blob<Dtype>& blob = *this->solver_->history()[i];
+        history[run].insert(history[run].end(), blob.cpu_data(),
+            blob.cpu_data() + blob.count());
+      }
+    }
+    ThreadPool::SetGlobalThreads(0);
+    ASSERT_EQ(params[0].size(), params[1].size());
+    for (int i = 0; i < params[0].size(); ++i) {
+      EXPECT_NEAR(params[0][i], params[1][i],
+          1e-5 * std::max(Dtype(1), std::fabs(params[1][i])))
+          << "param value " << i;
+    }
+    ASSERT_EQ(history[0].size(), history[1].size());
+    for (int i = 0; i < history[0].size(); ++i) {
+      EXPECT_NEAR(history[0][i], history[1][i],
+          1e-5 * std::max(Dtype(1), std::fabs(history[1][i])))
+          << "history value " << i;
+    }
+  }
 };
 
 
@@ -674,6 +874,35 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateCPUReplicas) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 6;
+  const int kReplicas = 3;
+  this->CheckCPUReplicas(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kReplicas);
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateCPUReplicasShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 6;
+  const int kReplicas = 3;
+  this->share_ = true;
+  this->CheckCPUReplicas(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kReplicas);
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -685,6 +914,26 @@ TYPED_TEST(SGDSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestAsyncSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->async_snapshot_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestRequestedAsyncSnapshots) {
+  this->TestRequestedAsyncSnapshots();
+}
+
+TYPED_TEST(SGDSolverTest, TestFusedUpdate) {
+  this->TestFusedUpdate(0.9);
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -785,6 +1034,10 @@ TYPED_TEST(AdaGradSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(AdaGradSolverTest, TestFusedUpdate) {
+  this->TestFusedUpdate(0);
+}
+
 TYPED_TEST(AdaGradSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -919,6 +1172,10 @@ TYPED_TEST(NesterovSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(NesterovSolverTest, TestFusedUpdate) {
+  this->TestFusedUpdate(0.9);
+}
+
 TYPED_TEST(NesterovSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1048,6 +1305,10 @@ TYPED_TEST(AdaDeltaSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(AdaDeltaSolverTest, TestFusedUpdate) {
+  this->TestFusedUpdate(0.95);
+}
+
 TYPED_TEST(AdaDeltaSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.1;
@@ -1150,6 +1411,10 @@ TYPED_TEST(AdamSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestFusedUpdate) {
+  this->TestFusedUpdate(0.9);
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1253,6 +1518,10 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(RMSPropSolverTest, TestFusedUpdate) {
+  this->TestFusedUpdate(0);
+}
+
 TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
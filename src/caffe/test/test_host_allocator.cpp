@@ -0,0 +1,89 @@
+#include <boost/thread.hpp>
+
+#include <stdint.h>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Allocates and frees a block in its own thread, which then exits.
+static void AllocateInThread(size_t size, void** ptr) {
+  *ptr = HostAllocator::Global().Allocate(size);
+  HostAllocator::Global().Free(*ptr, size);
+}
+
+class HostAllocatorTest : public ::testing::Test {};
+
+TEST_F(HostAllocatorTest, TestAlignment) {
+  HostAllocator& allocator = HostAllocator::Global();
+  const size_t kSizes[] = {1, 100, 4096, 100000, 3 << 20, 100 << 20};
+  for (int i = 0; i < 6; ++i) {
+    void* ptr = allocator.Allocate(kSizes[i]);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 64, 0);
+    if (kSizes[i] >= (2 << 20)) {
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % (2 << 20), 0);
+    }
+    memset(ptr, 1, kSizes[i]);
+    allocator.Free(ptr, kSizes[i]);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestReuseSizeClass) {
+  HostAllocator& allocator = HostAllocator::Global();
+  const size_t in_use = allocator.bytes_in_use();
+  void* ptr = allocator.Allocate(1000);
+  EXPECT_EQ(allocator.bytes_in_use(), in_use + 1024);
+  allocator.Free(ptr, 1000);
+  EXPECT_EQ(allocator.bytes_in_use(), in_use);
+  const uint64_t hits = allocator.hits();
+  const size_t cached = allocator.bytes_cached();
+  // 1000 and 900 bytes share the 1 KB class.
+  void* other = allocator.Allocate(900);
+  EXPECT_EQ(other, ptr);
+  EXPECT_EQ(allocator.hits(), hits + 1);
+  EXPECT_EQ(allocator.bytes_cached(), cached - 1024);
+  allocator.Free(other, 900);
+  EXPECT_GT(allocator.hit_rate(), 0);
+}
+
+TEST_F(HostAllocatorTest, TestCacheLimit) {
+  HostAllocator& allocator = HostAllocator::Global();
+  const size_t limit = allocator.cache_limit();
+  void* ptr = allocator.Allocate(5000);
+  allocator.set_cache_limit(0);
+  EXPECT_EQ(allocator.cache_limit(), 0);
+  const size_t cached = allocator.bytes_cached();
+  allocator.Free(ptr, 5000);
+  EXPECT_EQ(allocator.bytes_cached(), cached);
+  allocator.set_cache_limit(limit);
+}
+
+TEST_F(HostAllocatorTest, TestReleaseCachedMemory) {
+  HostAllocator& allocator = HostAllocator::Global();
+  void* small = allocator.Allocate(64);
+  void* large = allocator.Allocate(8 << 20);
+  allocator.Free(small, 64);
+  allocator.Free(large, 8 << 20);
+  const size_t cached = allocator.bytes_cached();
+  EXPECT_GE(cached, (8 << 20) + 64);
+  allocator.ReleaseCachedMemory();
+  EXPECT_LE(allocator.bytes_cached(), cached - (8 << 20) - 64);
+}
+
+TEST_F(HostAllocatorTest, TestThreadCacheHandedOverOnExit) {
+  HostAllocator& allocator = HostAllocator::Global();
+  allocator.ReleaseCachedMemory();
+  void* ptr = NULL;
+  boost::thread thread(&AllocateInThread, 512 << 10, &ptr);
+  thread.join();
+  void* other = allocator.Allocate(512 << 10);
+  EXPECT_EQ(other, ptr);
+  allocator.Free(other, 512 << 10);
+}
+
+}  // namespace caffe
@@ -97,6 +97,31 @@ TYPED_TEST(ImageDataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(false);
+  vector<Dtype> data[2];
+  for (int run = 0; run < 2; ++run) {
+    // The images are read and transformed on 3 threads in the second run.
+    param.mutable_transform_param()->set_num_threads(run ? 3 : 1);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+      }
+      data[run].insert(data[run].end(), this->blob_top_data_->cpu_data(),
+          this->blob_top_data_->cpu_data() + this->blob_top_data_->count());
+    }
+  }
+  EXPECT_TRUE(data[0] == data[1]);
+}
+
 TYPED_TEST(ImageDataLayerTest, TestResize) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
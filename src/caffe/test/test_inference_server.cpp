@@ -0,0 +1,174 @@
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_server.hpp"
+#include "caffe/net.hpp"
+#include "caffe/net_model.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Runs one request through server, from its own thread.
+template <typename Dtype>
+void InferInThread(InferenceServer<Dtype>* server, Caffe::Brew mode,
+    const Blob<Dtype>* input, vector<shared_ptr<Blob<Dtype> > >* outputs) {
+  Caffe::set_mode(mode);
+  server->Infer(*input, outputs);
+}
+
+template <typename TypeParam>
+class InferenceServerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  InferenceServerTest() {
+    const string proto =
+        "name: 'TestNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 1 dim: 3 dim: 4 } } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  // The output of net_ for input.
+  shared_ptr<Blob<Dtype> > Forward(const Blob<Dtype>& input) {
+    net_->input_blobs()[0]->CopyFrom(input, false, true);
+    net_->Reshape();
+    net_->Forward();
+    shared_ptr<Blob<Dtype> > output(new Blob<Dtype>());
+    output->CopyFrom(*net_->output_blobs()[0], false, true);
+    return output;
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(InferenceServerTest, TestDtypesAndDevices);
+
+TYPED_TEST(InferenceServerTest, TestConcurrentRequests) {
+  typedef typename TypeParam::Dtype Dtype;
+  NetModel<Dtype> model(*this->net_);
+  // Requests of 1 or 2 items, batched up to 4 items.
+  const int kRequests = 8;
+  vector<shared_ptr<Blob<Dtype> > > inputs(kRequests);
+  vector<shared_ptr<Blob<Dtype> > > expected(kRequests);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int r = 0; r < kRequests; ++r) {
+    vector<int> shape(3);
+    shape[0] = 1 + r % 2;
+    shape[1] = 3;
+    shape[2] = 4;
+    inputs[r].reset(new Blob<Dtype>(shape));
+    filler.Fill(inputs[r].get());
+    expected[r] = this->Forward(*inputs[r]);
+  }
+  vector<vector<shared_ptr<Blob<Dtype> > > > outputs(kRequests);
+  ServeStats stats;
+  {
+    InferenceServer<Dtype> server(model, 2, 4, 50);
+    EXPECT_EQ(server.max_batch_size(), 4);
+    ASSERT_EQ(server.output_names().size(), 1);
+    EXPECT_EQ(server.output_names()[0], "ip");
+    vector<shared_ptr<boost::thread> > threads(kRequests);
+    for (int r = 0; r < kRequests; ++r) {
+      threads[r].reset(new boost::thread(&InferInThread<Dtype>, &server,
+          Caffe::mode(), inputs[r].get(), &outputs[r]));
+    }
+    for (int r = 0; r < kRequests; ++r) {
+      threads[r]->join();
+    }
+    server.GetStats(&stats);
+  }
+  for (int r = 0; r < kRequests; ++r) {
+    ASSERT_EQ(outputs[r].size(), 1);
+    ASSERT_EQ(outputs[r][0]->shape(), expected[r]->shape());
+    for (int i = 0; i < expected[r]->count(); ++i) {
+      EXPECT_NEAR(outputs[r][0]->cpu_data()[i], expected[r]->cpu_data()[i],
+          1e-4);
+    }
+  }
+  EXPECT_EQ(stats.requests(), kRequests);
+  EXPECT_EQ(stats.queue_depth(), 0);
+  EXPECT_LE(stats.batch_size_count_size(), 4);
+  int items = 0;
+  for (int i = 0; i < stats.batch_size_count_size(); ++i) {
+    items += (i + 1) * stats.batch_size_count(i);
+  }
+  EXPECT_EQ(items, 12);
+  EXPECT_GE(stats.latency_p99_ms(), stats.latency_p50_ms());
+}
+
+TYPED_TEST(InferenceServerTest, TestReshapesPerBatchShape) {
+  typedef typename TypeParam::Dtype Dtype;
+  NetModel<Dtype> model(*this->net_);
+  InferenceServer<Dtype> server(model, 1, 4, 0);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int num = 1; num <= 3; ++num) {
+    vector<int> shape(3);
+    shape[0] = num;
+    shape[1] = 3;
+    shape[2] = 4;
+    Blob<Dtype> input(shape);
+    filler.Fill(&input);
+    shared_ptr<Blob<Dtype> > expected = this->Forward(input);
+    vector<shared_ptr<Blob<Dtype> > > outputs;
+    server.Infer(input, &outputs);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_EQ(outputs[0]->shape(), expected->shape());
+    for (int i = 0; i < expected->count(); ++i) {
+      EXPECT_NEAR(outputs[0]->cpu_data()[i], expected->cpu_data()[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(InferenceServerTest, TestNumaReplicate) {
+  typedef typename TypeParam::Dtype Dtype;
+  NetModel<Dtype> model(*this->net_);
+  InferenceServer<Dtype> server(model, 2, 4, 0, NUMA_REPLICATE);
+  vector<int> shape(3);
+  shape[0] = 2;
+  shape[1] = 3;
+  shape[2] = 4;
+  Blob<Dtype> input(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  shared_ptr<Blob<Dtype> > expected = this->Forward(input);
+  for (int n = 0; n < 4; ++n) {
+    vector<shared_ptr<Blob<Dtype> > > outputs;
+    server.Infer(input, &outputs);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_EQ(outputs[0]->shape(), expected->shape());
+    for (int i = 0; i < expected->count(); ++i) {
+      EXPECT_NEAR(outputs[0]->cpu_data()[i], expected->cpu_data()[i], 1e-4);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -239,6 +241,43 @@ TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    shared_ptr<InnerProductLayer<Dtype> > layer(
+        new InnerProductLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*this->blob_top_, false, true);
+    // The uniform bottom is within [0, 1].
+    EXPECT_TRUE(layer->Quantize(1));
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Dtype max_abs = 0;
+    for (int i = 0; i < expected.count(); ++i) {
+      max_abs = std::max(max_abs, std::fabs(expected.cpu_data()[i]));
+    }
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], expected.cpu_data()[i],
+          0.02 * max_abs);
+    }
+    // Back to full precision.
+    EXPECT_TRUE(layer->Quantize(0));
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(this->blob_top_->cpu_data()[i], expected.cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_);
@@ -0,0 +1,65 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/memory_planner.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class MemoryPlannerTest : public ::testing::Test {};
+
+TEST_F(MemoryPlannerTest, TestChain) {
+  // Each buffer is read by the next step only, so two slabs alternate.
+  MemoryPlanner planner;
+  for (int i = 0; i < 6; ++i) {
+    planner.AddBuffer(100, i, i + 1);
+  }
+  planner.Plan();
+  EXPECT_EQ(planner.num_slabs(), 2);
+  EXPECT_EQ(planner.buffer_bytes(), 600);
+  EXPECT_EQ(planner.slab_bytes(), 200);
+  for (int i = 2; i < 6; ++i) {
+    EXPECT_EQ(planner.slab(i), planner.slab(i - 2));
+  }
+}
+
+TEST_F(MemoryPlannerTest, TestOverlappingBuffersGetOwnSlabs) {
+  MemoryPlanner planner;
+  planner.AddBuffer(10, 0, 5);
+  planner.AddBuffer(20, 1, 3);
+  planner.AddBuffer(30, 3, 4);
+  planner.AddBuffer(40, 5, 6);
+  planner.Plan();
+  for (int i = 0; i < planner.num_buffers(); ++i) {
+    for (int j = 0; j < i; ++j) {
+      const bool overlap = !(j == 1 && i == 3) && !(j == 2 && i == 3);
+      if (overlap) {
+        EXPECT_NE(planner.slab(i), planner.slab(j)) << i << " " << j;
+      }
+    }
+  }
+  for (int i = 0; i < planner.num_buffers(); ++i) {
+    EXPECT_GE(planner.slab_size(planner.slab(i)), 10 * (i + 1));
+  }
+}
+
+TEST_F(MemoryPlannerTest, TestBestFit) {
+  MemoryPlanner planner;
+  planner.AddBuffer(100, 0, 0);
+  planner.AddBuffer(10, 0, 0);
+  planner.AddBuffer(50, 0, 0);
+  // Both 50 and 100 fit, the smaller slab is taken.
+  planner.AddBuffer(40, 1, 1);
+  // Nothing fits any more, the largest free slab grows.
+  planner.AddBuffer(200, 1, 1);
+  planner.Plan();
+  EXPECT_EQ(planner.num_slabs(), 3);
+  EXPECT_EQ(planner.slab(3), planner.slab(2));
+  EXPECT_EQ(planner.slab(4), planner.slab(0));
+  EXPECT_EQ(planner.slab_size(planner.slab(4)), 200);
+  EXPECT_EQ(planner.slab_bytes(), 260);
+}
+
+}  // namespace caffe
@@ -0,0 +1,142 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/multibox_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MultiBoxLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  MultiBoxLossLayerTest()
+      : blob_bottom_def_(new Blob<Dtype>(2, 4, 2, 2)),
+        blob_bottom_loc_(new Blob<Dtype>()),
+        blob_bottom_conf_(new Blob<Dtype>(2, 3, 2, 2)),
+        blob_bottom_label_(new Blob<Dtype>(2, 1, 2, 1)),
+        blob_bottom_gt_(new Blob<Dtype>(2, 4, 2, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // One 1x1 default box per cell of a 2x2 grid, variance 0.5.
+    Dtype* def = blob_bottom_def_->mutable_cpu_data();
+    for (int s = 0; s < 4; ++s) {
+      def[0 * 4 + s] = s % 2;
+      def[1 * 4 + s] = s / 2;
+      def[2 * 4 + s] = s % 2 + 1;
+      def[3 * 4 + s] = s / 2 + 1;
+      for (int c = 0; c < 4; ++c) {
+        def[16 + c * 4 + s] = 0.5;
+      }
+    }
+    // Image 0 holds two ground truth boxes, image 1 one and a padding entry.
+    const Dtype labels[] = { 1, 2, 2, -1 };
+    const Dtype gt[] = {
+      0.1, 1.0, 0.0, 0.9, 1.1, 2.0, 0.9, 2.0,
+      1.0, 0.0, 1.0, 0.0, 2.0, 0.0, 1.9, 0.0,
+    };
+    caffe_copy(4, labels, blob_bottom_label_->mutable_cpu_data());
+    caffe_copy(16, gt, blob_bottom_gt_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_def_);
+    blob_bottom_vec_.push_back(blob_bottom_loc_);
+    blob_bottom_vec_.push_back(blob_bottom_conf_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_bottom_vec_.push_back(blob_bottom_gt_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~MultiBoxLossLayerTest() {
+    delete blob_bottom_def_;
+    delete blob_bottom_loc_;
+    delete blob_bottom_conf_;
+    delete blob_bottom_label_;
+    delete blob_bottom_gt_;
+    delete blob_top_loss_;
+  }
+
+  void TestGradient(const bool share_location,
+      const MultiBoxLossParameter_ConfLossType conf_loss_type) {
+    Caffe::set_random_seed(1701);
+    blob_bottom_loc_->Reshape(2, share_location ? 4 : 12, 2, 2);
+    FillerParameter filler_param;
+    filler_param.set_std(0.3);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_loc_);
+    filler.Fill(blob_bottom_conf_);
+    LayerParameter layer_param;
+    MultiBoxLossParameter* multibox_loss_param =
+        layer_param.mutable_multibox_loss_param();
+    multibox_loss_param->set_overlap_threshold(0.3);
+    multibox_loss_param->set_conf_loss_type(conf_loss_type);
+    // Hard negative mining depends on the confidences, keep it out of the
+    // finite differences.
+    multibox_loss_param->set_neg_pos_ratio(0);
+    multibox_loss_param->set_min_negatives(0);
+    PublicParameter public_param;
+    DetectionParameter* detection_param = public_param.mutable_detection_param();
+    detection_param->mutable_range()->add_dim(2);
+    detection_param->mutable_range()->add_dim(2);
+    detection_param->set_num_classes(3);
+    detection_param->set_share_location(share_location);
+    MultiBoxLossLayer<Dtype> layer(layer_param);
+    layer.set_public_param(public_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+    checker.CheckGradientExhaustive(&layer, blob_bottom_vec_,
+        blob_top_vec_, 1);
+    checker.CheckGradientExhaustive(&layer, blob_bottom_vec_,
+        blob_top_vec_, 2);
+  }
+
+  Blob<Dtype>* const blob_bottom_def_;
+  Blob<Dtype>* const blob_bottom_loc_;
+  Blob<Dtype>* const blob_bottom_conf_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_gt_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MultiBoxLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MultiBoxLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_loc_->Reshape(2, 4, 2, 2);
+  caffe_set(this->blob_bottom_loc_->count(), Dtype(0),
+      this->blob_bottom_loc_->mutable_cpu_data());
+  caffe_set(this->blob_bottom_conf_->count(), Dtype(0),
+      this->blob_bottom_conf_->mutable_cpu_data());
+  LayerParameter layer_param;
+  layer_param.mutable_multibox_loss_param()->set_overlap_threshold(0.3);
+  PublicParameter public_param;
+  public_param.mutable_detection_param()->mutable_range()->add_dim(2);
+  public_param.mutable_detection_param()->mutable_range()->add_dim(2);
+  public_param.mutable_detection_param()->set_num_classes(3);
+  MultiBoxLossLayer<Dtype> layer(layer_param);
+  layer.set_public_param(public_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // With uniform confidences no prediction is mined as a hard negative, so
+  // the confidence loss is log(3) per match. Three default boxes are matched
+  // and the location loss is positive.
+  EXPECT_GT(this->blob_top_loss_->cpu_data()[0], log(3.));
+}
+
+TYPED_TEST(MultiBoxLossLayerTest, TestGradientSharedLocation) {
+  this->TestGradient(true, MultiBoxLossParameter_ConfLossType_SOFTMAX);
+}
+
+TYPED_TEST(MultiBoxLossLayerTest, TestGradientPerClassLocation) {
+  this->TestGradient(false, MultiBoxLossParameter_ConfLossType_SOFTMAX);
+}
+
+TYPED_TEST(MultiBoxLossLayerTest, TestGradientLogistic) {
+  this->TestGradient(true, MultiBoxLossParameter_ConfLossType_LOGISTIC);
+}
+
+}  // namespace caffe
@@ -1,3 +1,8 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,8 +14,11 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -839,6 +847,425 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  virtual void InitBranchyNet(const bool parallel_layers) {
+    // Three branches between conv1 and the concat, two of them sharing
+    // weights, followed by a dropout the net must run on the caller.
+    string proto =
+        "name: 'BranchyNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 3 dim: 6 dim: 6 } "
+        "    shape { dim: 4 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "    data_filler { type: 'constant' value: 2 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'label' "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv_a' "
+        "  type: 'Convolution' "
+        "  param { name: 'shared_1x1' } "
+        "  convolution_param { "
+        "    num_output: 4 kernel_size: 1 bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv1' "
+        "  top: 'conv_a' "
+        "} "
+        "layer { "
+        "  name: 'relu_a' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv_a' "
+        "  top: 'conv_a' "
+        "} "
+        "layer { "
+        "  name: 'conv_b' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv1' "
+        "  top: 'conv_b' "
+        "} "
+        "layer { "
+        "  name: 'pool_c' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: MAX kernel_size: 3 stride: 1 pad: 1 } "
+        "  bottom: 'conv1' "
+        "  top: 'pool_c' "
+        "} "
+        "layer { "
+        "  name: 'conv_c' "
+        "  type: 'Convolution' "
+        "  param { name: 'shared_1x1' } "
+        "  convolution_param { "
+        "    num_output: 4 kernel_size: 1 bias_term: false "
+        "  } "
+        "  bottom: 'pool_c' "
+        "  top: 'conv_c' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'conv_a' "
+        "  bottom: 'conv_b' "
+        "  bottom: 'conv_c' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'concat' "
+        "  top: 'ip' "
+        "} "
+        "layer { "
+        "  name: 'drop' "
+        "  type: 'Dropout' "
+        "  bottom: 'ip' "
+        "  top: 'ip' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} "
+        "layer { "
+        "  name: 'loss_b' "
+        "  type: 'EuclideanLoss' "
+        "  loss_weight: 0.5 "
+        "  bottom: 'conv_b' "
+        "  bottom: 'conv_c' "
+        "  top: 'loss_b' "
+        "} ";
+    if (parallel_layers) {
+      proto += "parallel_layers: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitChainNet(const bool optimize_memory,
+      const int reshape_plan_cache_size = 0) {
+    string proto =
+        "name: 'ChainNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 6 } } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'sig2' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip2' "
+        "  top: 'sig2' "
+        "} "
+        "layer { "
+        "  name: 'flat2' "
+        "  type: 'Flatten' "
+        "  bottom: 'sig2' "
+        "  top: 'flat2' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'flat2' "
+        "  top: 'ip3' "
+        "} "
+        "layer { "
+        "  name: 'tanh3' "
+        "  type: 'TanH' "
+        "  bottom: 'ip3' "
+        "  top: 'tanh3' "
+        "} "
+        "layer { "
+        "  name: 'out' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'tanh3' "
+        "  top: 'out' "
+        "} ";
+    if (optimize_memory) {
+      proto += "optimize_memory: true ";
+    }
+    if (reshape_plan_cache_size) {
+      proto += "reshape_plan_cache_size: " +
+          format_int(reshape_plan_cache_size) + " ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitFoldNet() {
+    const string& proto =
+        "name: 'FoldNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    bias_term: false "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'scale1' "
+        "  type: 'Scale' "
+        "  scale_param { bias_term: true } "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { num_output: 6 } "
+        "  bottom: 'conv1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'bn2' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'ip1' "
+        "  top: 'bn2' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ip1' "
+        "  bottom: 'bn2' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    bias_term: false "
+        "    transpose: true "
+        "  } "
+        "  bottom: 'sum' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'bias2' "
+        "  type: 'Bias' "
+        "  bottom: 'ip2' "
+        "  top: 'bias2' "
+        "} "
+        "layer { "
+        "  name: 'scale2' "
+        "  type: 'Scale' "
+        "  bottom: 'bias2' "
+        "  top: 'out' "
+        "} ";
+    InitNetFromProtoString(proto);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> positive_filler(filler_param);
+    const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+    for (int i = 0; i < layers.size(); ++i) {
+      const vector<shared_ptr<Blob<Dtype> > >& blobs = layers[i]->blobs();
+      for (int j = 0; j < blobs.size(); ++j) {
+        filler.Fill(blobs[j].get());
+      }
+      // Batch norm variances and moving average factors are positive.
+      if (string(layers[i]->type()) == "BatchNorm") {
+        positive_filler.Fill(blobs[1].get());
+        positive_filler.Fill(blobs[2].get());
+      }
+    }
+    filler.Fill(net_->input_blobs()[0]);
+  }
+
+  virtual void InitActivationNet(const bool fuse) {
+    string proto =
+        "name: 'ActivationNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 6 } } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  relu_param { negative_slope: 0.1 } "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'prelu2' "
+        "  type: 'PReLU' "
+        "  prelu_param { filler { type: 'gaussian' std: 0.5 } } "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  eltwise_param { coeff: 1 coeff: -0.5 } "
+        "  bottom: 'conv1' "
+        "  bottom: 'conv2' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'elu3' "
+        "  type: 'ELU' "
+        "  bottom: 'sum' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'sum' "
+        "  top: 'ip4' "
+        "} "
+        "layer { "
+        "  name: 'relu4' "
+        "  type: 'ReLU' "
+        "  fuse_activation: false "
+        "  bottom: 'ip4' "
+        "  top: 'ip4' "
+        "} "
+        "layer { "
+        "  name: 'ip5' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'ip4' "
+        "  top: 'ip5' "
+        "} "
+        "layer { "
+        "  name: 'prelu5' "
+        "  type: 'PReLU' "
+        "  prelu_param { filler { type: 'gaussian' std: 0.5 } } "
+        "  bottom: 'ip5' "
+        "  top: 'ip5' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    if (!fuse) {
+      for (int i = 0; i < param.layer_size(); ++i) {
+        param.mutable_layer(i)->set_fuse_activation(false);
+      }
+    }
+    net_.reset(new Net<Dtype>(param));
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -1342,6 +1769,93 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestMappedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  shared_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], false, true);
+  const int count = shared_params.count();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffeweights";
+  WriteMappedWeights(net_param, filename);
+
+  for (int write = 0; write < 2; ++write) {
+    Caffe::set_random_seed(this->seed_ + 1);
+    this->InitDiffDataSharedWeightsNet();
+    this->net_->CopyTrainedLayersFrom(filename);
+    Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+    Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+    EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+    }
+    // Writing to the weights leaves the file unchanged for the next load.
+    if (!write) {
+      caffe_set(count, Dtype(0), ip1_weights->mutable_cpu_data());
+      EXPECT_EQ(Dtype(0), ip2_weights->cpu_data()[0]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestMappedWeightsRewrite) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffeweights";
+  WriteMappedWeights(net_param, filename);
+  EXPECT_FALSE(boost::filesystem::exists(filename + ".tmp"));
+  MappedWeights* mapped = new MappedWeights(filename);
+  const MappedWeightsIndex_Blob* blob = NULL;
+  for (int i = 0; i < mapped->index().layer_size() && !blob; ++i) {
+    if (mapped->index().layer(i).blobs_size()) {
+      blob = &mapped->index().layer(i).blobs(0);
+    }
+  }
+  ASSERT_TRUE(blob != NULL);
+  const Dtype* values = static_cast<const Dtype*>(mapped->data(*blob));
+  const Dtype value = values[0];
+  ASSERT_NE(value, Dtype(7));
+
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    caffe_set(params[i]->count(), Dtype(7), params[i]->mutable_cpu_data());
+  }
+  net_param.Clear();
+  this->net_->ToProto(&net_param);
+#ifdef _MSC_VER
+  // Windows does not replace a file while it is mapped.
+  delete mapped;
+  mapped = NULL;
+#endif
+  WriteMappedWeights(net_param, filename);
+  EXPECT_FALSE(boost::filesystem::exists(filename + ".tmp"));
+  if (mapped) {
+    // The file is replaced rather than rewritten under the mapping.
+    EXPECT_EQ(values[0], value);
+    delete mapped;
+  }
+  MappedWeights rewritten(filename);
+  const MappedWeightsIndex_Blob* rewritten_blob = NULL;
+  for (int i = 0; i < rewritten.index().layer_size() && !rewritten_blob; ++i) {
+    if (rewritten.index().layer(i).blobs_size()) {
+      rewritten_blob = &rewritten.index().layer(i).blobs(0);
+    }
+  }
+  ASSERT_TRUE(rewritten_blob != NULL);
+  EXPECT_EQ(static_cast<const Dtype*>(rewritten.data(*rewritten_blob))[0],
+      Dtype(7));
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2601,4 +3115,339 @@ TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   ASSERT_TRUE(found_data);
 }
 
+TYPED_TEST(NetTest, TestParallelLayersMatchSerial) {
+  typedef typename TypeParam::Dtype Dtype;
+  ThreadPool::SetGlobalThreads(4);
+  vector<Dtype> losses(2);
+  vector<vector<shared_ptr<Blob<Dtype> > > > blobs(2), params(2);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitBranchyNet(run == 1);
+    EXPECT_EQ(this->net_->parallel_layers(), run == 1);
+    // Twice, so the second pass reuses the cached layer graphs.
+    for (int i = 0; i < 2; ++i) {
+      this->net_->ClearParamDiffs();
+      losses[run] = this->net_->ForwardBackward();
+    }
+    this->CopyNetBlobs(true, &blobs[run]);
+    this->CopyNetParams(true, &params[run]);
+  }
+  ThreadPool::SetGlobalThreads(0);
+  EXPECT_EQ(losses[0], losses[1]);
+  ASSERT_EQ(blobs[0].size(), blobs[1].size());
+  for (int i = 0; i < blobs[0].size(); ++i) {
+    for (int j = 0; j < blobs[0][i]->count(); ++j) {
+      EXPECT_EQ(blobs[0][i]->cpu_data()[j], blobs[1][i]->cpu_data()[j]);
+      EXPECT_EQ(blobs[0][i]->cpu_diff()[j], blobs[1][i]->cpu_diff()[j]);
+    }
+  }
+  ASSERT_EQ(params[0].size(), params[1].size());
+  for (int i = 0; i < params[0].size(); ++i) {
+    for (int j = 0; j < params[0][i]->count(); ++j) {
+      EXPECT_EQ(params[0][i]->cpu_data()[j], params[1][i]->cpu_data()[j]);
+      EXPECT_EQ(params[0][i]->cpu_diff()[j], params[1][i]->cpu_diff()[j]);
+    }
+  }
+}
+
+// Records the learnable params Backward reports, with their diffs then.
+template <typename Dtype>
+class GradientRecorder : public Net<Dtype>::GradientCallback {
+ public:
+  explicit GradientRecorder(const Net<Dtype>* net) : net_(net) {}
+
+  virtual void on_layer_gradients_ready(int layer_id,
+      const vector<int>& learnable_param_ids) {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (int i = 0; i < learnable_param_ids.size(); ++i) {
+      const Blob<Dtype>* param =
+          net_->learnable_params()[learnable_param_ids[i]];
+      layer_ids_[learnable_param_ids[i]].push_back(layer_id);
+      diffs_[learnable_param_ids[i]].assign(param->cpu_diff(),
+          param->cpu_diff() + param->count());
+    }
+  }
+
+  const Net<Dtype>* net_;
+  boost::mutex mutex_;
+  map<int, vector<int> > layer_ids_;
+  map<int, vector<Dtype> > diffs_;
+};
+
+TYPED_TEST(NetTest, TestGradientCallbacks) {
+  typedef typename TypeParam::Dtype Dtype;
+  ThreadPool::SetGlobalThreads(4);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitBranchyNet(run == 1);
+    const Net<Dtype>& net = *this->net_;
+    GradientRecorder<Dtype> recorder(&net);
+    this->net_->add_gradient_callback(&recorder);
+    // Twice, so the second pass counts the layers again.
+    for (int pass = 0; pass < 2; ++pass) {
+      recorder.layer_ids_.clear();
+      recorder.diffs_.clear();
+      this->net_->ClearParamDiffs();
+      this->net_->ForwardBackward();
+      const vector<Blob<Dtype>*>& params = net.learnable_params();
+      ASSERT_EQ(recorder.layer_ids_.size(), params.size());
+      for (int i = 0; i < params.size(); ++i) {
+        // Once, when its diff is final, after the first layer using it.
+        ASSERT_EQ(recorder.layer_ids_[i].size(), 1);
+        // Shared weights are final after the first of their layers.
+        int first_layer = -1;
+        for (int j = net.layers().size() - 1; j >= 0; --j) {
+          const vector<shared_ptr<Blob<Dtype> > >& blobs =
+              net.layers()[j]->blobs();
+          for (int k = 0; k < blobs.size(); ++k) {
+            if (blobs[k]->cpu_data() == params[i]->cpu_data()) {
+              first_layer = j;
+            }
+          }
+        }
+        EXPECT_EQ(recorder.layer_ids_[i][0], first_layer);
+        const vector<Dtype>& diff = recorder.diffs_[i];
+        ASSERT_EQ(diff.size(), params[i]->count());
+        for (int j = 0; j < diff.size(); ++j) {
+          EXPECT_EQ(diff[j], params[i]->cpu_diff()[j]);
+        }
+      }
+    }
+  }
+  ThreadPool::SetGlobalThreads(0);
+}
+
+TYPED_TEST(NetTest, TestParallelLayersFromTo) {
+  typedef typename TypeParam::Dtype Dtype;
+  ThreadPool::SetGlobalThreads(4);
+  Caffe::set_random_seed(this->seed_);
+  this->InitBranchyNet(true);
+  const int num_layers = this->net_->layers().size();
+  // Stop before the dropout so repeated passes compute the same loss.
+  const int concat_id = num_layers - 5;
+  ASSERT_EQ(this->net_->layer_names()[concat_id], "concat");
+  this->net_->ForwardTo(concat_id);
+  Blob<Dtype> concat;
+  concat.CopyFrom(*this->net_->blob_by_name("concat"), false, true);
+  this->net_->set_parallel_layers(false);
+  this->net_->ForwardFromTo(1, concat_id);
+  ThreadPool::SetGlobalThreads(0);
+  const Blob<Dtype>& serial_concat = *this->net_->blob_by_name("concat");
+  for (int i = 0; i < concat.count(); ++i) {
+    EXPECT_EQ(concat.cpu_data()[i], serial_concat.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestOptimizeMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Serial, with planned memory, and with planned memory and parallel layers.
+  vector<shared_ptr<Blob<Dtype> > > outputs(3);
+  ThreadPool::SetGlobalThreads(4);
+  for (int run = 0; run < 3; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitChainNet(run > 0);
+    this->net_->set_parallel_layers(run == 2);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->net_->input_blobs()[0]);
+    // Memory is planned from the first pass and used by the second.
+    this->net_->Forward();
+    this->net_->Forward();
+    outputs[run].reset(new Blob<Dtype>());
+    outputs[run]->CopyFrom(*this->net_->output_blobs()[0], false, true);
+  }
+  ThreadPool::SetGlobalThreads(0);
+  for (int i = 0; i < outputs[0]->count(); ++i) {
+    EXPECT_EQ(outputs[0]->cpu_data()[i], outputs[1]->cpu_data()[i]);
+    EXPECT_EQ(outputs[0]->cpu_data()[i], outputs[2]->cpu_data()[i]);
+  }
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  // ip1 is last read by ip2 and reused by sig2, which flat2 aliases; ip2 and
+  // ip3 alternate the same way. The input and output keep their memory.
+  EXPECT_EQ(blobs[1]->data(), blobs[3]->data());
+  EXPECT_EQ(blobs[3]->data(), blobs[4]->data());
+  EXPECT_EQ(blobs[2]->data(), blobs[5]->data());
+  EXPECT_NE(blobs[1]->data(), blobs[2]->data());
+  EXPECT_NE(blobs[0]->data(), blobs[1]->data());
+  EXPECT_NE(blobs[0]->data(), blobs[2]->data());
+  EXPECT_NE(blobs[7]->data(), blobs[1]->data());
+  EXPECT_NE(blobs[7]->data(), blobs[2]->data());
+  // Looking up a blob gives it and its aliases memory of their own.
+  shared_ptr<Blob<Dtype> > sig2 = this->net_->blob_by_name("sig2");
+  EXPECT_NE(blobs[1]->data(), blobs[3]->data());
+  this->net_->Forward();
+  EXPECT_EQ(sig2->data(), blobs[4]->data());
+  const Blob<Dtype>& ip3 = *blobs[5];
+  for (int i = 0; i < ip3.num(); ++i) {
+    for (int j = 0; j < ip3.channels(); ++j) {
+      Dtype expected = this->net_->layers()[6]->blobs()[1]->cpu_data()[j];
+      for (int k = 0; k < sig2->count(1); ++k) {
+        expected += sig2->data_at(i, k, 0, 0) *
+            this->net_->layers()[6]->blobs()[0]->data_at(j, k, 0, 0);
+      }
+      EXPECT_NEAR(ip3.data_at(i, j, 0, 0), expected, 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestOptimizeMemoryKeepsValues) {
+  typedef typename TypeParam::Dtype Dtype;
+  const char* kNames[] = {"ip2", "tanh3", "out"};
+  vector<shared_ptr<Blob<Dtype> > > expected(3);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitChainNet(run > 0);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->net_->input_blobs()[0]);
+    const vector<Blob<Dtype>*>& output = this->net_->Forward();
+    if (run == 0) {
+      for (int i = 0; i < 3; ++i) {
+        expected[i].reset(new Blob<Dtype>());
+        expected[i]->CopyFrom(*this->net_->blob_by_name(kNames[i]), false,
+            true);
+      }
+      continue;
+    }
+    // The first pass runs before the plan, and its blobs keep their values.
+    for (int j = 0; j < expected[2]->count(); ++j) {
+      EXPECT_EQ(output[0]->cpu_data()[j], expected[2]->cpu_data()[j]);
+    }
+    const Blob<Dtype>& ip2 = *this->net_->blob_by_name("ip2");
+    for (int j = 0; j < expected[0]->count(); ++j) {
+      EXPECT_EQ(ip2.cpu_data()[j], expected[0]->cpu_data()[j]);
+    }
+    // tanh3 is the last blob of its slab, looked up right after the pass
+    // that uses the plan.
+    this->net_->Forward();
+    EXPECT_EQ(this->net_->blobs()[1]->data(), this->net_->blobs()[3]->data());
+    const Blob<Dtype>& tanh3 = *this->net_->blob_by_name("tanh3");
+    for (int j = 0; j < expected[1]->count(); ++j) {
+      EXPECT_EQ(tanh3.cpu_data()[j], expected[1]->cpu_data()[j]);
+    }
+    for (int j = 0; j < expected[0]->count(); ++j) {
+      EXPECT_EQ(ip2.cpu_data()[j], expected[0]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestOptimizeMemoryPinsNamedBlobs) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitChainNet(true);
+  shared_ptr<Blob<Dtype> > ip2 = this->net_->blob_by_name("ip2");
+  this->net_->Forward();
+  this->net_->Forward();
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  EXPECT_EQ(blobs[1]->data(), blobs[3]->data());
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (blobs[i] != ip2) {
+      EXPECT_NE(blobs[i]->data(), ip2->data());
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestReshapePlanCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNums[] = {2, 5, 3};
+  vector<shared_ptr<Blob<Dtype> > > inputs(3);
+  vector<shared_ptr<Blob<Dtype> > > expected(3);
+  Caffe::set_random_seed(this->seed_);
+  this->InitChainNet(false);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < 3; ++i) {
+    vector<int> shape(2);
+    shape[0] = kNums[i];
+    shape[1] = 6;
+    inputs[i].reset(new Blob<Dtype>(shape));
+    filler.Fill(inputs[i].get());
+    this->net_->input_blobs()[0]->CopyFrom(*inputs[i], false, true);
+    this->net_->Forward();
+    expected[i].reset(new Blob<Dtype>());
+    expected[i]->CopyFrom(*this->net_->output_blobs()[0], false, true);
+  }
+  Caffe::set_random_seed(this->seed_);
+  this->InitChainNet(true, 2);
+  // Starts shaped for 2: misses 5, hits 2 and 5, misses 3 and drops 2, which
+  // misses again. Memory is planned at the second pass of a shape.
+  const int kSequence[] = {0, 0, 1, 1, 0, 1, 2, 0};
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  for (int n = 0; n < 8; ++n) {
+    const int i = kSequence[n];
+    this->net_->input_blobs()[0]->CopyFrom(*inputs[i], false, true);
+    this->net_->Reshape();
+    EXPECT_EQ(this->net_->output_blobs()[0]->num(), kNums[i]);
+    this->net_->Forward();
+    const Blob<Dtype>& output = *this->net_->output_blobs()[0];
+    ASSERT_EQ(output.shape(), expected[i]->shape());
+    for (int j = 0; j < output.count(); ++j) {
+      EXPECT_EQ(output.cpu_data()[j], expected[i]->cpu_data()[j]);
+    }
+    // Shapes seen before get back the memory planned for them.
+    if (n == 5) {
+      EXPECT_EQ(blobs[1]->data(), blobs[3]->data());
+      EXPECT_EQ(blobs[2]->data(), blobs[5]->data());
+    }
+  }
+  EXPECT_EQ(this->net_->reshape_plan_hits(), 2);
+  EXPECT_EQ(this->net_->reshape_plan_misses(), 3);
+}
+
+TYPED_TEST(NetTest, TestFoldBatchNorm) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFoldNet();
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  Blob<Dtype> data;
+  data.CopyFrom(*this->net_->input_blobs()[0], false, true);
+  EXPECT_EQ(this->net_->FoldBatchNorm(), 4);
+  // bn2 stays, ip1 being read by sum as well.
+  EXPECT_FALSE(this->net_->has_layer("bn1"));
+  EXPECT_FALSE(this->net_->has_layer("scale1"));
+  EXPECT_TRUE(this->net_->has_layer("bn2"));
+  EXPECT_FALSE(this->net_->has_layer("bias2"));
+  EXPECT_FALSE(this->net_->has_layer("scale2"));
+  EXPECT_EQ(this->net_->layer_by_name("ip2")->blobs().size(), 2);
+  ASSERT_EQ(this->net_->num_outputs(), 1);
+  EXPECT_EQ(this->net_->blob_names()[this->net_->output_blob_indices()[0]],
+      "out");
+  this->net_->input_blobs()[0]->CopyFrom(data);
+  this->net_->Forward();
+  const Blob<Dtype>& output = *this->net_->output_blobs()[0];
+  ASSERT_EQ(output.shape(), expected.shape());
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_NEAR(output.cpu_data()[i], expected.cpu_data()[i],
+        1e-4 * std::max(Dtype(1), std::fabs(expected.cpu_data()[i])));
+  }
+  // Nothing is left to fold.
+  EXPECT_EQ(this->net_->FoldBatchNorm(), 0);
+}
+
+TYPED_TEST(NetTest, TestFuseActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<shared_ptr<Blob<Dtype> > > outputs(2);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(2, 3, 6, 6);
+  filler.Fill(&data);
+  for (int fuse = 0; fuse < 2; ++fuse) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitActivationNet(fuse);
+    const char* fused[] = { "relu1", "prelu2", "elu3", "prelu5" };
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(this->net_->layer_by_name(fused[i])->IsFused(), fuse == 1);
+    }
+    EXPECT_FALSE(this->net_->layer_by_name("relu4")->IsFused());
+    this->net_->input_blobs()[0]->CopyFrom(data);
+    this->net_->Forward();
+    outputs[fuse].reset(new Blob<Dtype>());
+    outputs[fuse]->CopyFrom(*this->net_->output_blobs()[0], false, true);
+  }
+  for (int i = 0; i < outputs[0]->count(); ++i) {
+    EXPECT_NEAR(outputs[0]->cpu_data()[i], outputs[1]->cpu_data()[i],
+        1e-5 * std::max(Dtype(1), std::fabs(outputs[0]->cpu_data()[i])));
+  }
+}
+
 }  // namespace caffe
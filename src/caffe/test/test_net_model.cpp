@@ -0,0 +1,185 @@
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/net_model.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Creates a net of model in the calling thread and runs it repeatedly.
+template <typename Dtype>
+void ForwardInThread(const NetModel<Dtype>* model, Caffe::Brew mode,
+    const Blob<Dtype>* data, Blob<Dtype>* output) {
+  Caffe::set_mode(mode);
+  shared_ptr<Net<Dtype> > net = model->CreateNet();
+  for (int i = 0; i < 10; ++i) {
+    net->input_blobs()[0]->CopyFrom(*data);
+    net->Forward();
+  }
+  output->CopyFrom(*net->output_blobs()[0], false, true);
+}
+
+template <typename TypeParam>
+class NetModelTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  NetModelTest() : data_(2, 3, 5, 5) {
+    const string proto =
+        "name: 'TestNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'scale' "
+        "  type: 'Scale' "
+        "  bottom: 'conv' "
+        "  top: 'scale' "
+        "  scale_param { "
+        "    bias_term: true "
+        "    filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'scale' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&data_);
+  }
+
+  // Runs net on data_ and returns a copy of its output.
+  shared_ptr<Blob<Dtype> > Forward(Net<Dtype>* net) {
+    net->input_blobs()[0]->CopyFrom(data_);
+    net->Forward();
+    shared_ptr<Blob<Dtype> > output(new Blob<Dtype>());
+    output->CopyFrom(*net->output_blobs()[0], false, true);
+    return output;
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+  Blob<Dtype> data_;
+};
+
+TYPED_TEST_CASE(NetModelTest, TestDtypesAndDevices);
+
+TYPED_TEST(NetModelTest, TestSharesParams) {
+  NetModel<typename TypeParam::Dtype> model(*this->net_);
+  for (int n = 0; n < 2; ++n) {
+    shared_ptr<Net<typename TypeParam::Dtype> > net = model.CreateNet();
+    ASSERT_EQ(net->layers().size(), this->net_->layers().size());
+    for (int i = 0; i < net->layers().size(); ++i) {
+      ASSERT_EQ(net->layers()[i]->blobs().size(),
+          this->net_->layers()[i]->blobs().size());
+      for (int j = 0; j < net->layers()[i]->blobs().size(); ++j) {
+        EXPECT_EQ(net->layers()[i]->blobs()[j]->cpu_data(),
+            this->net_->layers()[i]->blobs()[j]->cpu_data());
+      }
+    }
+    EXPECT_NE(net->input_blobs()[0]->cpu_data(),
+        this->net_->input_blobs()[0]->cpu_data());
+  }
+}
+
+TYPED_TEST(NetModelTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  shared_ptr<Blob<Dtype> > expected = this->Forward(this->net_.get());
+  shared_ptr<NetModel<Dtype> > model(new NetModel<Dtype>(*this->net_));
+  shared_ptr<Net<Dtype> > net1 = model->CreateNet();
+  shared_ptr<Net<Dtype> > net2 = model->CreateNet();
+  // The params outlive the net and the model they came from.
+  this->net_.reset();
+  model.reset();
+  for (int n = 0; n < 2; ++n) {
+    shared_ptr<Blob<Dtype> > output = this->Forward(n ? net2.get() :
+        net1.get());
+    ASSERT_EQ(output->shape(), expected->shape());
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_EQ(output->cpu_data()[i], expected->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetModelTest, TestReplicate) {
+  typedef typename TypeParam::Dtype Dtype;
+  shared_ptr<Blob<Dtype> > expected = this->Forward(this->net_.get());
+  NetModel<Dtype> model(*this->net_);
+  shared_ptr<NetModel<Dtype> > replica = model.Replicate();
+  shared_ptr<Net<Dtype> > net = replica->CreateNet();
+  for (int i = 0; i < net->layers().size(); ++i) {
+    for (int j = 0; j < net->layers()[i]->blobs().size(); ++j) {
+      EXPECT_NE(net->layers()[i]->blobs()[j]->cpu_data(),
+          this->net_->layers()[i]->blobs()[j]->cpu_data());
+    }
+  }
+  shared_ptr<Blob<Dtype> > output = this->Forward(net.get());
+  ASSERT_EQ(output->shape(), expected->shape());
+  for (int i = 0; i < output->count(); ++i) {
+    EXPECT_EQ(output->cpu_data()[i], expected->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetModelTest, TestConcurrentForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  shared_ptr<Blob<Dtype> > expected = this->Forward(this->net_.get());
+  NetModel<Dtype> model(*this->net_);
+  const int kThreads = 4;
+  vector<shared_ptr<Blob<Dtype> > > outputs(kThreads);
+  vector<shared_ptr<boost::thread> > threads(kThreads);
+  for (int t = 0; t < kThreads; ++t) {
+    outputs[t].reset(new Blob<Dtype>());
+    threads[t].reset(new boost::thread(&ForwardInThread<Dtype>, &model,
+        Caffe::mode(), &this->data_, outputs[t].get()));
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    threads[t]->join();
+    ASSERT_EQ(outputs[t]->shape(), expected->shape());
+    for (int i = 0; i < expected->count(); ++i) {
+      EXPECT_EQ(outputs[t]->cpu_data()[i], expected->cpu_data()[i]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,103 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/numa.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Binds a thread to node, then allocates and frees a block of size.
+static void AllocateOnNode(int node, size_t size, bool* bound, void** ptr) {
+  *bound = BindThreadToNumaNode(node);
+  *ptr = HostAllocator::Global().Allocate(size);
+  HostAllocator::Global().Free(*ptr, size);
+}
+
+// Binds a thread to node, then allocates a block of size for another thread
+// to free.
+static void AllocateOnNodeForOther(int node, size_t size, bool* bound,
+    void** ptr) {
+  *bound = BindThreadToNumaNode(node);
+  *ptr = HostAllocator::Global().Allocate(size);
+}
+
+static void BindInThread(int node, bool* bound, int* thread_node) {
+  *bound = BindThreadToNumaNode(node);
+  *thread_node = NumaNodeOfThread();
+}
+
+class NumaTest : public ::testing::Test {};
+
+TEST_F(NumaTest, TestTopology) {
+  const int num_nodes = NumaNodeCount();
+  EXPECT_GE(num_nodes, 1);
+  EXPECT_FALSE(NumaNodeCpus(0).empty());
+  EXPECT_TRUE(NumaNodeCpus(num_nodes).empty());
+  EXPECT_EQ(NumaTopologyString().find(num_nodes == 1 ? "1 node:" : "nodes:"),
+      0);
+}
+
+TEST_F(NumaTest, TestPlacementFromString) {
+  EXPECT_EQ(NumaPlacementFromString("none"), NUMA_NONE);
+  EXPECT_EQ(NumaPlacementFromString("bind"), NUMA_BIND);
+  EXPECT_EQ(NumaPlacementFromString("replicate"), NUMA_REPLICATE);
+}
+
+TEST_F(NumaTest, TestBindThread) {
+  EXPECT_EQ(NumaNodeOfThread(), -1);
+  bool bound = false;
+  int thread_node = -2;
+  boost::thread(&BindInThread, 0, &bound, &thread_node).join();
+  EXPECT_EQ(thread_node, bound ? 0 : -1);
+  // Binding another thread leaves this one alone.
+  EXPECT_EQ(NumaNodeOfThread(), -1);
+}
+
+TEST_F(NumaTest, TestAllocatorReusesOnNode) {
+  // Too large for the thread caches, so freed to the node's free lists.
+  const size_t kSize = 4 << 20;
+  bool bound = false;
+  void* node_ptr = NULL;
+  boost::thread(&AllocateOnNode, 0, kSize, &bound, &node_ptr).join();
+  if (!bound) {
+    LOG(ERROR) << "Skipping test: cannot bind to a NUMA node.";
+    return;
+  }
+  // A thread bound to no node does not get the node's block...
+  void* ptr = HostAllocator::Global().Allocate(kSize);
+  EXPECT_NE(ptr, node_ptr);
+  HostAllocator::Global().Free(ptr, kSize);
+  // ...which a thread bound to the node reuses.
+  void* other_ptr = NULL;
+  boost::thread(&AllocateOnNode, 0, kSize, &bound, &other_ptr).join();
+  EXPECT_EQ(other_ptr, node_ptr);
+}
+
+TEST_F(NumaTest, TestAllocatorFreesToPlacementNode) {
+  // Small enough for the thread caches, which only keep blocks of their node.
+  const size_t kSize = 64 << 10;
+  bool bound = false;
+  void* node_ptr = NULL;
+  boost::thread(&AllocateOnNodeForOther, 0, kSize, &bound, &node_ptr).join();
+  if (!bound) {
+    HostAllocator::Global().Free(node_ptr, kSize);
+    LOG(ERROR) << "Skipping test: cannot bind to a NUMA node.";
+    return;
+  }
+  // Freed by a thread bound to no node, the block returns to node 0...
+  HostAllocator::Global().Free(node_ptr, kSize);
+  void* ptr = HostAllocator::Global().Allocate(kSize);
+  EXPECT_NE(ptr, node_ptr);
+  HostAllocator::Global().Free(ptr, kSize);
+  // ...where a thread bound to the node reuses it.
+  void* other_ptr = NULL;
+  boost::thread(&AllocateOnNode, 0, kSize, &bound, &other_ptr).join();
+  EXPECT_EQ(other_ptr, node_ptr);
+}
+
+}  // namespace caffe
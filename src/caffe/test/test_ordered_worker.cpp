@@ -0,0 +1,53 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/ordered_worker.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class OrderedWorkerTest : public ::testing::Test {};
+
+TEST_F(OrderedWorkerTest, TestRunsInOrder) {
+  vector<int> order;
+  {
+    OrderedWorker worker;
+    for (int i = 0; i < 100; ++i) {
+      worker.Push([&order, i]() { order.push_back(i); });
+    }
+    worker.Flush();
+    EXPECT_EQ(order.size(), 100);
+    worker.Push([&order]() { order.push_back(100); });
+  }
+  // The destructor runs the tasks still queued.
+  ASSERT_EQ(order.size(), 101);
+  for (int i = 0; i < order.size(); ++i) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+TEST_F(OrderedWorkerTest, TestReserveBoundsPending) {
+  OrderedWorker worker(2);
+  boost::mutex blocked;
+  blocked.lock();
+  EXPECT_TRUE(worker.Reserve(false));
+  worker.Push([&blocked]() { boost::mutex::scoped_lock lock(blocked); });
+  EXPECT_TRUE(worker.Reserve(false));
+  // Both slots are taken until the first task completes.
+  EXPECT_FALSE(worker.Reserve(false));
+  worker.Push([]() {});
+  EXPECT_FALSE(worker.Reserve(false));
+  blocked.unlock();
+  EXPECT_TRUE(worker.Reserve(true));
+  worker.Push([]() {});
+  worker.Flush();
+  EXPECT_TRUE(worker.Reserve(false));
+  EXPECT_TRUE(worker.Reserve(false));
+  EXPECT_FALSE(worker.Reserve(false));
+}
+
+}  // namespace caffe
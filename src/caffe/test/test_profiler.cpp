@@ -0,0 +1,167 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PercentileTest : public ::testing::Test {};
+
+TEST_F(PercentileTest, TestInterpolates) {
+  vector<double> samples;
+  for (int i = 5; i >= 1; --i) {
+    samples.push_back(i);
+  }
+  EXPECT_DOUBLE_EQ(Percentile(samples, 0), 1);
+  EXPECT_DOUBLE_EQ(Percentile(samples, 25), 2);
+  EXPECT_DOUBLE_EQ(Percentile(samples, 50), 3);
+  EXPECT_DOUBLE_EQ(Percentile(samples, 95), 4.8);
+  EXPECT_DOUBLE_EQ(Percentile(samples, 100), 5);
+  EXPECT_DOUBLE_EQ(Percentile(vector<double>(1, 7), 99), 7);
+}
+
+template <typename Dtype>
+class ProfilerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ProfilerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 6, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ProfilerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ProfilerTest, TestDtypes);
+
+TYPED_TEST(ProfilerTest, TestConvolutionCost) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // 16 outputs, each a 3 x 3 x 3 dot product plus a bias.
+  ASSERT_EQ(this->blob_top_->count(), 16);
+  LayerCost cost = EstimateForwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(cost.flops, 2 * 27 * 16 + 16);
+  EXPECT_EQ(cost.bytes_read, (144 + 108 + 4) * sizeof(TypeParam));
+  EXPECT_EQ(cost.bytes_written, 16 * sizeof(TypeParam));
+  cost = EstimateBackwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, vector<bool>(1, true));
+  EXPECT_EQ(cost.flops, 2 * (2 * 27 * 16) + 16);
+  EXPECT_EQ(cost.bytes_written, (144 + 108 + 4) * sizeof(TypeParam));
+  // Without any gradient to compute, backward costs nothing.
+  layer.set_param_propagate_down(0, false);
+  layer.set_param_propagate_down(1, false);
+  cost = EstimateBackwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, vector<bool>(1, false));
+  EXPECT_EQ(cost.flops, 0);
+  EXPECT_EQ(cost.bytes_read, 0);
+}
+
+TYPED_TEST(ProfilerTest, TestInnerProductCost) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  InnerProductLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const LayerCost cost = EstimateForwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(cost.flops, 2 * 2 * 72 * 10);
+}
+
+TYPED_TEST(ProfilerTest, TestReports) {
+  const string proto =
+      "name: 'profiled' "
+      "layer { name: 'data' type: 'DummyData' top: 'data' top: 'label' "
+      "  dummy_data_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } "
+      "    shape { dim: 2 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 } } "
+      "layer { name: 'pool' type: 'Pooling' bottom: 'conv' top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 3 } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'pool' top: 'ip' "
+      "  inner_product_param { num_output: 2 } } "
+      "layer { name: 'loss' type: 'SoftmaxWithLoss' bottom: 'ip' "
+      "  bottom: 'label' top: 'loss' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<TypeParam> net(param);
+  NetProfiler<TypeParam> profiler(&net);
+  profiler.Run(2);
+  profiler.Run(1);
+  ASSERT_EQ(profiler.layers().size(), 5);
+  EXPECT_EQ(profiler.forward_us().size(), 3);
+  EXPECT_EQ(profiler.backward_us().size(), 3);
+  const LayerProfile& pool = profiler.layers()[2];
+  EXPECT_EQ(pool.name, "pool");
+  EXPECT_EQ(pool.type, "Pooling");
+  EXPECT_EQ(pool.forward_us.size(), 3);
+  EXPECT_EQ(pool.bottom_names[0], "conv");
+  EXPECT_EQ(pool.top_bytes[0], 2 * 4 * sizeof(TypeParam));
+  EXPECT_EQ(pool.forward_cost.flops, 9 * 2 * 4);
+  MachinePeak peak;
+  peak.gflops = 10;
+  peak.gbytes_per_second = 1;
+  profiler.set_peak(peak);
+
+  std::ostringstream json;
+  profiler.WriteJson(&json);
+  EXPECT_NE(json.str().find("\"net\": \"profiled\""), string::npos);
+  EXPECT_NE(json.str().find("\"name\": \"conv\", \"type\": \"Convolution\""),
+      string::npos);
+  EXPECT_NE(json.str().find("\"p99_ms\""), string::npos);
+  EXPECT_NE(json.str().find("\"gflops\": 10"), string::npos);
+  // The net passes add up the costs of the layers.
+  double flops = 0;
+  for (int i = 0; i < profiler.layers().size(); ++i) {
+    flops += profiler.layers()[i].forward_cost.flops;
+  }
+  EXPECT_GT(flops, 0);
+  const size_t net_forward = json.str().find("\n  \"forward\": {");
+  ASSERT_NE(net_forward, string::npos);
+  std::ostringstream forward_flops;
+  forward_flops.precision(10);
+  forward_flops << "\"flops\": " << flops << ",";
+  EXPECT_EQ(json.str().find("\"flops\": ", net_forward),
+      json.str().find(forward_flops.str(), net_forward));
+
+  std::ostringstream trace;
+  profiler.WriteChromeTrace(&trace);
+  // A forward and a backward event per layer and iteration.
+  int events = 0;
+  for (size_t pos = trace.str().find("\"ph\": \"X\""); pos != string::npos;
+       pos = trace.str().find("\"ph\": \"X\"", pos + 1)) {
+    ++events;
+  }
+  EXPECT_EQ(events, 2 * 5 * 3);
+  EXPECT_NE(trace.str().find("\"cat\": \"backward\""), string::npos);
+}
+
+}  // namespace caffe
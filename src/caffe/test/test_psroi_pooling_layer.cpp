@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/psroi_pooling_layer.hpp"
+#include "caffe/layers/roi_pooling_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class PSROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  PSROIPoolingLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 2 * 3 * 3, 6, 8)),
+        blob_bottom_rois_(new Blob<Dtype>(5, 5, 1, 1)),
+        blob_top_data_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // batch_index x1 y1 x2 y2, the last ROI lies partly outside the map.
+    const Dtype rois[] = {
+      0, 0, 0, 7, 5,
+      1, 6, 2, 7, 5,
+      1, 3, 1, 6, 4,
+      0, 3, 3, 3, 3,
+      1, 5, 4, 12, 9,
+    };
+    caffe_copy(25, rois, blob_bottom_rois_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_data_);
+  }
+  virtual ~PSROIPoolingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_rois_;
+    delete blob_top_data_;
+  }
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_data_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(PSROIPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(PSROIPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PSROIPoolingParameter* psroi_pooling_param =
+      layer_param.mutable_psroi_pooling_param();
+  psroi_pooling_param->set_output_dim(2);
+  psroi_pooling_param->set_group_size(3);
+  psroi_pooling_param->set_spatial_scale(1);
+  PSROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 2);
+  EXPECT_EQ(this->blob_top_data_->height(), 3);
+  EXPECT_EQ(this->blob_top_data_->width(), 3);
+  // Reference: average of the bin in the position-sensitive channel.
+  const int height = 6, width = 8;
+  const Dtype* data = this->blob_bottom_data_->cpu_data();
+  const Dtype* rois = this->blob_bottom_rois_->cpu_data();
+  for (int n = 0; n < 5; ++n) {
+    const int b = rois[5 * n];
+    const Dtype roi_start_w = round(rois[5 * n + 1]);
+    const Dtype roi_start_h = round(rois[5 * n + 2]);
+    const Dtype bin_size_w = (round(rois[5 * n + 3]) + 1 - roi_start_w) / 3;
+    const Dtype bin_size_h = (round(rois[5 * n + 4]) + 1 - roi_start_h) / 3;
+    for (int ctop = 0; ctop < 2; ++ctop) {
+      for (int ph = 0; ph < 3; ++ph) {
+        for (int pw = 0; pw < 3; ++pw) {
+          int hstart = floor(ph * bin_size_h + roi_start_h);
+          int hend = ceil((ph + 1) * bin_size_h + roi_start_h);
+          int wstart = floor(pw * bin_size_w + roi_start_w);
+          int wend = ceil((pw + 1) * bin_size_w + roi_start_w);
+          hstart = std::min(std::max(hstart, 0), height);
+          hend = std::min(std::max(hend, 0), height);
+          wstart = std::min(std::max(wstart, 0), width);
+          wend = std::min(std::max(wend, 0), width);
+          const int c = (ctop * 3 + ph) * 3 + pw;
+          Dtype sum = 0;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              sum += data[((b * 18 + c) * height + h) * width + w];
+            }
+          }
+          const Dtype area = (hend - hstart) * (wend - wstart);
+          const Dtype expected = area > 0 ? sum / area : Dtype(0);
+          EXPECT_NEAR(this->blob_top_data_->data_at(n, ctop, ph, pw),
+              expected, 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PSROIPoolingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PSROIPoolingParameter* psroi_pooling_param =
+      layer_param.mutable_psroi_pooling_param();
+  psroi_pooling_param->set_output_dim(2);
+  psroi_pooling_param->set_group_size(3);
+  psroi_pooling_param->set_spatial_scale(1);
+  PSROIPoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(PSROIPoolingLayerTest, TestBackwardDeterministic) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PSROIPoolingParameter* psroi_pooling_param =
+      layer_param.mutable_psroi_pooling_param();
+  psroi_pooling_param->set_output_dim(2);
+  psroi_pooling_param->set_group_size(3);
+  psroi_pooling_param->set_spatial_scale(1);
+  PSROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_data_);
+  caffe_copy(this->blob_top_data_->count(), this->blob_top_data_->cpu_data(),
+      this->blob_top_data_->mutable_cpu_diff());
+  vector<bool> propagate_down(2, true);
+  propagate_down[1] = false;
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Blob<Dtype> first_diff;
+  first_diff.CopyFrom(*this->blob_bottom_data_, true, true);
+  for (int i = 0; i < 3; ++i) {
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    for (int j = 0; j < first_diff.count(); ++j) {
+      EXPECT_EQ(first_diff.cpu_diff()[j],
+          this->blob_bottom_data_->cpu_diff()[j]);
+    }
+  }
+}
+
+// Times the CPU forward pass of PSROIPooling against ROIPooling on an
+// R-FCN sized head: 7x7 bins over 8 x 7 x 7 channels and 128 ROIs.
+TYPED_TEST(PSROIPoolingLayerTest, TestForwardBenchmark) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  const int output_dim = 8, group_size = 7, num_rois = 128;
+  Blob<Dtype> data(1, output_dim * group_size * group_size, 38, 50);
+  Blob<Dtype> rois(num_rois, 5, 1, 1);
+  Blob<Dtype> top;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&data);
+  Dtype* roi_data = rois.mutable_cpu_data();
+  for (int n = 0; n < num_rois; ++n) {
+    roi_data[5 * n] = 0;
+    roi_data[5 * n + 1] = (n * 7) % 30;
+    roi_data[5 * n + 2] = (n * 3) % 20;
+    roi_data[5 * n + 3] = roi_data[5 * n + 1] + 8 + n % 12;
+    roi_data[5 * n + 4] = roi_data[5 * n + 2] + 6 + n % 12;
+  }
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(&data);
+  bottom_vec.push_back(&rois);
+  vector<Blob<Dtype>*> top_vec(1, &top);
+
+  LayerParameter psroi_param;
+  psroi_param.mutable_psroi_pooling_param()->set_output_dim(output_dim);
+  psroi_param.mutable_psroi_pooling_param()->set_group_size(group_size);
+  PSROIPoolingLayer<Dtype> psroi_layer(psroi_param);
+  psroi_layer.SetUp(bottom_vec, top_vec);
+  LayerParameter roi_param;
+  roi_param.mutable_roi_pooling_param()->set_pooled_h(group_size);
+  roi_param.mutable_roi_pooling_param()->set_pooled_w(group_size);
+  ROIPoolingLayer<Dtype> roi_layer(roi_param);
+  roi_layer.SetUp(bottom_vec, top_vec);
+
+  const int iterations = 5;
+  CPUTimer timer;
+  psroi_layer.Reshape(bottom_vec, top_vec);
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    psroi_layer.Forward(bottom_vec, top_vec);
+  }
+  timer.Stop();
+  const float psroi_ms = timer.MilliSeconds() / iterations;
+  roi_layer.Reshape(bottom_vec, top_vec);
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    roi_layer.Forward(bottom_vec, top_vec);
+  }
+  timer.Stop();
+  const float roi_ms = timer.MilliSeconds() / iterations;
+  LOG(INFO) << "PSROIPooling forward: " << psroi_ms << " ms, ROIPooling "
+      << "forward: " << roi_ms << " ms, "
+      << ThreadPool::Global().num_threads() << " threads.";
+}
+
+}  // namespace caffe
@@ -0,0 +1,263 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantization.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class QuantizationKernelTest : public ::testing::Test {};
+
+TEST_F(QuantizationKernelTest, TestGemmS8) {
+  // B is read with a row stride larger than K, as for grouped convolutions.
+  const int M = 3, N = 21, K = 37, ldb = 40;
+  vector<int8_t> A(M * K), B(N * ldb);
+  for (int i = 0; i < A.size(); ++i) {
+    A[i] = static_cast<int8_t>((i * 37) % 255 - 127);
+  }
+  for (int i = 0; i < B.size(); ++i) {
+    B[i] = static_cast<int8_t>((i * 91) % 255 - 127);
+  }
+  vector<int32_t> C(M * N);
+  gemm_s8_cpu(M, N, K, &A[0], K, &B[0], ldb, &C[0], N);
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      int32_t expected = 0;
+      for (int k = 0; k < K; ++k) {
+        expected += A[m * K + k] * B[n * ldb + k];
+      }
+      EXPECT_EQ(C[m * N + n], expected);
+    }
+  }
+}
+
+TEST_F(QuantizationKernelTest, TestGemmS8Extremes) {
+  // Products of -128 and 127 over many values, which the vector kernels
+  // must add up without saturating.
+  const int M = 5, N = 7, K = 1000;
+  vector<int8_t> A(M * K), B(N * K);
+  for (int i = 0; i < A.size(); ++i) {
+    A[i] = (i / K) % 2 ? 127 : -128;
+  }
+  for (int i = 0; i < B.size(); ++i) {
+    B[i] = (i / K) % 3 ? -128 : 127;
+  }
+  vector<int32_t> C(M * N);
+  gemm_s8_cpu(M, N, K, &A[0], K, &B[0], K, &C[0], N);
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      EXPECT_EQ(C[m * N + n], K * A[m * K] * B[n * K]);
+    }
+  }
+}
+
+TEST_F(QuantizationKernelTest, TestQuantizeRows) {
+  // 2 x 3, stored transposed.
+  const float data[] = { 1, -4, 0.5f, 2, -0.25f, 1 };
+  int8_t quantized[6];
+  float scales[2];
+  quantize_rows_cpu(2, 3, data, true, quantized, scales);
+  EXPECT_FLOAT_EQ(scales[0], 127.f / 1);
+  EXPECT_FLOAT_EQ(scales[1], 127.f / 4);
+  const int8_t expected[] = { 127, 64, -32, -127, 64, 32 };
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(quantized[i], expected[i]);
+  }
+  // Values beyond the range saturate.
+  const float values[] = { 3, -3, 0.4f };
+  quantize_cpu(3, values, 127.f / 2, quantized);
+  EXPECT_EQ(quantized[0], 127);
+  EXPECT_EQ(quantized[1], -127);
+  EXPECT_EQ(quantized[2], 25);
+}
+
+template <typename Dtype>
+class QuantizationTest : public CPUDeviceTest<Dtype> {
+ protected:
+  QuantizationTest() {
+    const string proto =
+        "name: 'QuantizedNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 6 } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(QuantizationTest, TestDtypes);
+
+TYPED_TEST(QuantizationTest, TestCalibrateAndQuantize) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  Blob<TypeParam>* data = this->net_->input_blobs()[0];
+  QuantizationCalibrator<TypeParam> calibrator(*this->net_);
+  TypeParam data_min = 0, data_max = 0;
+  for (int i = 0; i < 3; ++i) {
+    filler.Fill(data);
+    for (int j = 0; j < data->count(); ++j) {
+      data_min = std::min(data_min, data->cpu_data()[j]);
+      data_max = std::max(data_max, data->cpu_data()[j]);
+    }
+    this->net_->Forward();
+    calibrator.Observe();
+  }
+  QuantizationTable table;
+  calibrator.ToProto(&table);
+  EXPECT_EQ(table.iterations(), 3);
+  ASSERT_EQ(table.blob_size(), 3);
+  EXPECT_EQ(table.blob(0).name(), "data");
+  EXPECT_FLOAT_EQ(table.blob(0).min(), data_min);
+  EXPECT_FLOAT_EQ(table.blob(0).max(), data_max);
+  // The ReLU works in place, the ip layer reads its output.
+  EXPECT_EQ(table.blob(1).name(), "conv");
+  EXPECT_EQ(table.blob(1).min(), 0);
+  EXPECT_GT(table.blob(1).max(), 0);
+
+  Blob<TypeParam> expected;
+  expected.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  EXPECT_EQ(this->net_->Quantize(table), 2);
+  EXPECT_TRUE(this->net_->layer_by_name("conv")->layer_param()
+      .has_quantization_param());
+  this->net_->Forward();
+  const Blob<TypeParam>& output = *this->net_->output_blobs()[0];
+  TypeParam max_abs = 0;
+  for (int i = 0; i < expected.count(); ++i) {
+    max_abs = std::max(max_abs, std::fabs(expected.cpu_data()[i]));
+  }
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(output.cpu_data()[i], expected.cpu_data()[i], 0.05 * max_abs);
+  }
+  // An empty table restores full precision.
+  EXPECT_EQ(this->net_->Quantize(QuantizationTable()), 0);
+  this->net_->Forward();
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(output.cpu_data()[i], expected.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(QuantizationTest, TestQuantizedWeightsFollowChanges) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  QuantizationTable table;
+  QuantizationTable::BlobRange* range = table.add_blob();
+  range->set_name("conv");
+  range->set_min(0);
+  range->set_max(1);
+  EXPECT_EQ(this->net_->Quantize(table), 1);
+  NetParameter trained;
+  this->net_->ToProto(&trained);
+  this->net_->Forward();
+  Blob<TypeParam> expected;
+  expected.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  // Weights written in place, as by a solver, are quantized again: only the
+  // biases are left.
+  Layer<TypeParam>* ip = this->net_->layer_by_name("ip").get();
+  Blob<TypeParam>* weights = ip->blobs()[0].get();
+  caffe_set(weights->count(), TypeParam(0), weights->mutable_cpu_data());
+  this->net_->Forward();
+  const Blob<TypeParam>& output = *this->net_->output_blobs()[0];
+  const TypeParam* bias = ip->blobs()[1]->cpu_data();
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_EQ(output.cpu_data()[i], bias[i % 5]);
+  }
+  // So are weights copied from a trained net into the same blobs.
+  this->net_->CopyTrainedLayersFrom(trained);
+  this->net_->Forward();
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_EQ(output.cpu_data()[i], expected.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(QuantizationTest, TestQuantizeGroupedConvolution) {
+  // The int8 kernels read the image and weights channels last, a group at a
+  // time.
+  LayerParameter layer_param;
+  layer_param.add_bottom("data");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->set_num_output(4);
+  conv_param->add_kernel_size(3);
+  conv_param->add_pad(1);
+  conv_param->add_stride(2);
+  conv_param->set_group(2);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  conv_param->mutable_bias_filler()->set_type("gaussian");
+  Blob<TypeParam> bottom(2, 6, 7, 5);
+  Blob<TypeParam> top;
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<TypeParam> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<TypeParam>*> bottom_vec(1, &bottom);
+  vector<Blob<TypeParam>*> top_vec(1, &top);
+  ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(bottom_vec, top_vec);
+  layer.Forward(bottom_vec, top_vec);
+  Blob<TypeParam> expected;
+  expected.CopyFrom(top, false, true);
+  EXPECT_TRUE(layer.Quantize(1));
+  layer.Forward(bottom_vec, top_vec);
+  TypeParam max_abs = 0;
+  for (int i = 0; i < expected.count(); ++i) {
+    max_abs = std::max(max_abs, std::fabs(expected.cpu_data()[i]));
+  }
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(top.cpu_data()[i], expected.cpu_data()[i], 0.02 * max_abs);
+  }
+}
+
+}  // namespace caffe
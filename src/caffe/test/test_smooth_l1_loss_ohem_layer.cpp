@@ -0,0 +1,96 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/smooth_l1_loss_ohem_layer.hpp"
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SmoothL1LossOHEMLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SmoothL1LossOHEMLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(10, 8, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(10, 8, 1, 1)),
+        blob_bottom_weights_(new Blob<Dtype>(10, 8, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_instance_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    filler.Fill(this->blob_bottom_label_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    // The weights mask out coordinates, as the OHEM annotator emits them.
+    for (int i = 0; i < blob_bottom_weights_->count(); ++i) {
+      blob_bottom_weights_->mutable_cpu_data()[i] = i % 3 ? 1 : 0;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_weights_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~SmoothL1LossOHEMLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_bottom_weights_;
+    delete blob_top_loss_;
+    delete blob_top_instance_loss_;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_weights_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_instance_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SmoothL1LossOHEMLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SmoothL1LossOHEMLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.add_loss_weight(3.7);
+  SmoothL1LossOHEMLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 1);
+}
+
+TYPED_TEST(SmoothL1LossOHEMLayerTest, TestForwardInstanceLoss) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_top_vec_.push_back(this->blob_top_instance_loss_);
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_normalization(
+      LossParameter_NormalizationMode_NONE);
+  SmoothL1LossOHEMLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Dtype total_loss = 0;
+  for (int n = 0; n < 10; ++n) {
+    Dtype expected = 0;
+    for (int c = 0; c < 8; ++c) {
+      const int index = n * 8 + c;
+      const Dtype val = this->blob_bottom_weights_->cpu_data()[index] *
+          (this->blob_bottom_data_->cpu_data()[index] -
+           this->blob_bottom_label_->cpu_data()[index]);
+      expected += std::abs(val) < 1 ? 0.5 * val * val : std::abs(val) - 0.5;
+    }
+    EXPECT_NEAR(this->blob_top_instance_loss_->cpu_data()[n], expected, 1e-4);
+    total_loss += expected;
+  }
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], total_loss, 1e-3);
+}
+
+}  // namespace caffe
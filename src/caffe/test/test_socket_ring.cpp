@@ -0,0 +1,300 @@
+#include <boost/thread.hpp>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/sgd_solvers.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/socket_ring.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Runs one rank of a ring. The ranks of a test run on threads of the test
+// process, as they would in processes, over real sockets.
+template <typename Dtype>
+static void AllReduceRank(const vector<string>* endpoints, int rank,
+    size_t chunk_bytes, vector<Dtype>* data) {
+  SocketRing ring(*endpoints, rank, chunk_bytes);
+  ring.AllReduce(&(*data)[0], data->size());
+}
+
+template <typename Dtype>
+static void BroadcastRank(const vector<string>* endpoints, int rank,
+    int root, vector<Dtype>* data) {
+  SocketRing ring(*endpoints, rank, 16);
+  ring.Broadcast(&(*data)[0], data->size(), root);
+}
+
+template <typename Dtype>
+class SocketRingTest : public ::testing::Test {
+ protected:
+  // Sockets no other test uses, on the loopback interface.
+  vector<string> TcpEndpoints(int world_size) {
+    const int port = 30000 + caffe_rng_rand() % 20000;
+    return SocketRing::Endpoints("tcp:127.0.0.1:" + format_int(port),
+        world_size);
+  }
+
+  // Sums count values over world_size ranks, sent in chunks of chunk_bytes.
+  void TestAllReduce(const vector<string>& endpoints, int count,
+      size_t chunk_bytes) {
+    const int world_size = endpoints.size();
+    vector<vector<Dtype> > data(world_size, vector<Dtype>(count));
+    vector<Dtype> expected(count, 0);
+    for (int r = 0; r < world_size; ++r) {
+      for (int i = 0; i < count; ++i) {
+        data[r][i] = (r + 1) * 0.5 + i;
+        expected[i] += data[r][i];
+      }
+    }
+    vector<shared_ptr<boost::thread> > ranks;
+    for (int r = 0; r < world_size; ++r) {
+      ranks.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &AllReduceRank<Dtype>, &endpoints, r, chunk_bytes, &data[r])));
+    }
+    for (int r = 0; r < world_size; ++r) {
+      ranks[r]->join();
+    }
+    for (int r = 0; r < world_size; ++r) {
+      for (int i = 0; i < count; ++i) {
+        EXPECT_EQ(data[r][i], expected[i]) << "rank " << r << " index " << i;
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(SocketRingTest, TestDtypes);
+
+TYPED_TEST(SocketRingTest, TestEndpoints) {
+  vector<string> endpoints = SocketRing::Endpoints("tcp:localhost:8600", 3);
+  ASSERT_EQ(endpoints.size(), 3);
+  EXPECT_EQ(endpoints[0], "tcp:localhost:8600");
+  EXPECT_EQ(endpoints[2], "tcp:localhost:8602");
+  endpoints = SocketRing::Endpoints("unix:/tmp/ring", 2);
+  ASSERT_EQ(endpoints.size(), 2);
+  EXPECT_EQ(endpoints[1], "unix:/tmp/ring.1");
+  endpoints = SocketRing::Endpoints("tcp:a:1,tcp:b:2", 2);
+  ASSERT_EQ(endpoints.size(), 2);
+  EXPECT_EQ(endpoints[1], "tcp:b:2");
+}
+
+TYPED_TEST(SocketRingTest, TestAllReduceTcp) {
+  // Chunks smaller than the segments pipeline them.
+  this->TestAllReduce(this->TcpEndpoints(3), 1001, 64);
+}
+
+TYPED_TEST(SocketRingTest, TestAllReduceFewerValuesThanRanks) {
+  this->TestAllReduce(this->TcpEndpoints(4), 3, 256 << 10);
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+TYPED_TEST(SocketRingTest, TestAllReduceUnix) {
+  string path;
+  MakeTempFilename(&path);
+  this->TestAllReduce(SocketRing::Endpoints("unix:" + path, 2), 777, 100);
+}
+#endif
+
+#ifdef __linux__
+TYPED_TEST(SocketRingTest, TestAllReduceProcesses) {
+  const vector<string> endpoints = this->TcpEndpoints(3);
+  const int kCount = 5000;
+  vector<pid_t> children;
+  for (int r = 1; r < 3; ++r) {
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      vector<TypeParam> data(kCount, r);
+      AllReduceRank(&endpoints, r, 1000, &data);
+      for (int i = 0; i < kCount; ++i) {
+        if (data[i] != 3) { _exit(1); }
+      }
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+  vector<TypeParam> data(kCount, 0);
+  AllReduceRank(&endpoints, 0, 1000, &data);
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_EQ(data[i], 3);
+  }
+  for (int i = 0; i < children.size(); ++i) {
+    int status;
+    ASSERT_EQ(waitpid(children[i], &status, 0), children[i]);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+}
+#endif
+
+TYPED_TEST(SocketRingTest, TestBroadcast) {
+  const vector<string> endpoints = this->TcpEndpoints(3);
+  const int kCount = 50;
+  const int kRoot = 1;
+  vector<vector<TypeParam> > data(3, vector<TypeParam>(kCount));
+  for (int r = 0; r < 3; ++r) {
+    for (int i = 0; i < kCount; ++i) {
+      data[r][i] = r * 100 + i;
+    }
+  }
+  vector<shared_ptr<boost::thread> > ranks;
+  for (int r = 0; r < 3; ++r) {
+    ranks.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &BroadcastRank<TypeParam>, &endpoints, r, kRoot, &data[r])));
+  }
+  for (int r = 0; r < 3; ++r) {
+    ranks[r]->join();
+  }
+  for (int r = 0; r < 3; ++r) {
+    for (int i = 0; i < kCount; ++i) {
+      EXPECT_EQ(data[r][i], kRoot * 100 + i);
+    }
+  }
+}
+
+// A least squares problem on constant data, so that every rank computes the
+// gradients of a single solver.
+static const char* kRingSolver =
+    "max_iter: 5 "
+    "base_lr: 0.1 "
+    "lr_policy: 'fixed' "
+    "momentum: 0.9 "
+    "weight_decay: 0.01 "
+    "snapshot_after_train: false "
+    "net_param { "
+    "  name: 'RingNetwork' "
+    "  layer { "
+    "    name: 'data' "
+    "    type: 'DummyData' "
+    "    top: 'data' "
+    "    top: 'targets' "
+    "    dummy_data_param { "
+    "      shape { dim: 4 dim: 6 } "
+    "      shape { dim: 4 dim: 2 } "
+    "      data_filler { type: 'constant' value: 0.5 } "
+    "      data_filler { type: 'constant' value: 1 } "
+    "    } "
+    "  } "
+    "  layer { "
+    "    name: 'innerprod' "
+    "    type: 'InnerProduct' "
+    "    bottom: 'data' "
+    "    top: 'innerprod' "
+    "    inner_product_param { "
+    "      num_output: 2 "
+    "      weight_filler { type: 'gaussian' std: 1.0 } "
+    "      bias_filler { type: 'gaussian' std: 1.0 } "
+    "    } "
+    "  } "
+    "  layer { "
+    "    name: 'loss' "
+    "    type: 'EuclideanLoss' "
+    "    bottom: 'innerprod' "
+    "    bottom: 'targets' "
+    "  } "
+    "} ";
+
+// Trains one rank, its parameters initialized from its own seed, and copies
+// them to params. The rank first trains alone for solo_iters iterations, as
+// if it resumed from a snapshot of its own.
+template <typename Dtype>
+static void TrainRank(const vector<string>* endpoints, int rank, int seed,
+    size_t bucket_bytes, int iter_size, int solo_iters, vector<Dtype>* params) {
+  Caffe::set_random_seed(seed);
+  SolverParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(kRingSolver, &param));
+  param.set_iter_size(iter_size);
+  RingSync<Dtype>::ConfigureRank(rank, &param);
+  shared_ptr<Solver<Dtype> > solver(new SGDSolver<Dtype>(param));
+  if (solo_iters > 0) {
+    solver->Step(solo_iters);
+  }
+  if (endpoints) {
+    SocketRing ring(*endpoints, rank);
+    RingSync<Dtype> sync(solver, &ring, bucket_bytes);
+    sync.Run();
+    EXPECT_EQ(sync.solver()->iter(), param.max_iter());
+    EXPECT_GE(sync.comm_iteration_ms(), 0);
+    if (bucket_bytes) {
+      // The bias then the weights of the inner product.
+      EXPECT_EQ(sync.num_buckets(), 2);
+      EXPECT_GE(sync.hidden_comm_iteration_ms(), 0);
+      EXPECT_LE(sync.hidden_comm_iteration_ms(), sync.comm_iteration_ms());
+      std::ostringstream trace;
+      sync.WriteChromeTrace(&trace);
+      EXPECT_NE(trace.str().find("\"bucket 1\""), string::npos);
+      EXPECT_NE(trace.str().find("\"forward backward\""), string::npos);
+    }
+    // The parameters live in the buffers of sync.
+    params->assign(sync.data(), sync.data() + sync.size());
+  } else {
+    solver->Solve();
+    const vector<Blob<Dtype>*>& blobs = solver->net()->learnable_params();
+    for (int i = 0; i < blobs.size(); ++i) {
+      params->insert(params->end(), blobs[i]->cpu_data(),
+          blobs[i]->cpu_data() + blobs[i]->count());
+    }
+  }
+}
+
+template <typename Dtype>
+static void TestRingSync(const vector<string>& endpoints, size_t bucket_bytes,
+    int iter_size, int solo_iters = 0) {
+  const int kSeed = 1701;
+  vector<Dtype> expected;
+  TrainRank<Dtype>(NULL, 0, kSeed, 0, iter_size, 0, &expected);
+
+  vector<vector<Dtype> > params(2);
+  vector<shared_ptr<boost::thread> > ranks;
+  for (int r = 0; r < 2; ++r) {
+    // Rank 1 starts from other parameters and solver state, replaced by
+    // those of rank 0.
+    ranks.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &TrainRank<Dtype>, &endpoints, r, kSeed + r, bucket_bytes,
+        iter_size, r ? solo_iters : 0, &params[r])));
+  }
+  for (int r = 0; r < 2; ++r) {
+    ranks[r]->join();
+  }
+  for (int r = 0; r < 2; ++r) {
+    ASSERT_EQ(params[r].size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_NEAR(params[r][i], expected[i], 1e-5) << "rank " << r;
+    }
+  }
+}
+
+TYPED_TEST(SocketRingTest, TestRingSync) {
+  TestRingSync<TypeParam>(this->TcpEndpoints(2), 0, 1);
+}
+
+TYPED_TEST(SocketRingTest, TestRingSyncBuckets) {
+  // Buckets of a single param, reduced during backward.
+  TestRingSync<TypeParam>(this->TcpEndpoints(2), 1, 1);
+}
+
+TYPED_TEST(SocketRingTest, TestRingSyncSolverState) {
+  // Rank 1 continues from rank 0's iteration and history, not its own.
+  TestRingSync<TypeParam>(this->TcpEndpoints(2), 1, 1, 2);
+}
+
+TYPED_TEST(SocketRingTest, TestRingSyncBucketsIterSize) {
+  // The buckets wait for the gradients of the last backward pass.
+  TestRingSync<TypeParam>(this->TcpEndpoints(2), 1, 2);
+}
+
+}  // namespace caffe
@@ -0,0 +1,102 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/softmax_loss_ohem_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SoftmaxWithLossOHEMLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SoftmaxWithLossOHEMLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(10, 5, 2, 3)),
+        blob_bottom_label_(new Blob<Dtype>(10, 1, 2, 3)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_prob_(new Blob<Dtype>()),
+        blob_top_instance_loss_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    filler_param.set_std(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % 5;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~SoftmaxWithLossOHEMLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+    delete blob_top_prob_;
+    delete blob_top_instance_loss_;
+  }
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_prob_;
+  Blob<Dtype>* const blob_top_instance_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SoftmaxWithLossOHEMLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SoftmaxWithLossOHEMLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.add_loss_weight(3);
+  SoftmaxWithLossOHEMLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SoftmaxWithLossOHEMLayerTest, TestForwardInstanceLoss) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_top_vec_.push_back(this->blob_top_prob_);
+  this->blob_top_vec_.push_back(this->blob_top_instance_loss_);
+  LayerParameter layer_param;
+  // Only the first top is a loss.
+  layer_param.add_loss_weight(1);
+  layer_param.add_loss_weight(0);
+  layer_param.add_loss_weight(0);
+  layer_param.mutable_loss_param()->set_ignore_label(2);
+  layer_param.mutable_loss_param()->set_normalization(
+      LossParameter_NormalizationMode_NONE);
+  SoftmaxWithLossOHEMLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  const Dtype* prob = this->blob_top_prob_->cpu_data();
+  const Dtype* instance_loss = this->blob_top_instance_loss_->cpu_data();
+  Dtype total_loss = 0;
+  for (int n = 0; n < 10; ++n) {
+    for (int s = 0; s < 6; ++s) {
+      const int label_value = label[n * 6 + s];
+      Dtype expected = 0;
+      if (label_value != 2) {
+        expected = -log(std::max(prob[(n * 5 + label_value) * 6 + s],
+            Dtype(FLT_MIN)));
+      }
+      EXPECT_NEAR(instance_loss[n * 6 + s], expected, 1e-4);
+      total_loss += instance_loss[n * 6 + s];
+    }
+  }
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], total_loss, 1e-3);
+}
+
+}  // namespace caffe
@@ -0,0 +1,91 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/task_graph.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TaskGraphTest : public ::testing::Test {};
+
+TEST_F(TaskGraphTest, TestRunsEveryTaskOnce) {
+  ThreadPool pool(4);
+  TaskGraph graph(50);
+  vector<int> runs(50, 0);
+  graph.Run(&pool, [&](int task) { ++runs[task]; });
+  for (int i = 0; i < runs.size(); ++i) {
+    EXPECT_EQ(runs[i], 1);
+  }
+}
+
+TEST_F(TaskGraphTest, TestDependencies) {
+  // A diamond repeated a few times: 0 -> {1, 2, 3} -> 4 -> {5, 6, 7} -> 8...
+  const int num_levels = 10;
+  ThreadPool pool(4);
+  TaskGraph graph(4 * num_levels + 1);
+  for (int level = 0; level < num_levels; ++level) {
+    const int join = 4 * level;
+    for (int i = 1; i <= 3; ++i) {
+      graph.AddDependency(join, join + i);
+      graph.AddDependency(join + i, join + 4);
+    }
+  }
+  boost::mutex mutex;
+  vector<int> finished(graph.num_tasks(), 0);
+  graph.Run(&pool, [&](int task) {
+    boost::mutex::scoped_lock lock(mutex);
+    if (task % 4 == 0 && task > 0) {
+      for (int i = 1; i <= 3; ++i) {
+        EXPECT_EQ(finished[task - i], 1);
+      }
+    } else if (task > 0) {
+      EXPECT_EQ(finished[task - task % 4], 1);
+    }
+    ++finished[task];
+  });
+  for (int i = 0; i < finished.size(); ++i) {
+    EXPECT_EQ(finished[i], 1);
+  }
+}
+
+TEST_F(TaskGraphTest, TestPinToCaller) {
+  ThreadPool pool(4);
+  TaskGraph graph(40);
+  for (int task = 0; task < 40; task += 3) {
+    graph.PinToCaller(task);
+  }
+  const boost::thread::id caller = boost::this_thread::get_id();
+  boost::mutex mutex;
+  vector<int> runs(40, 0);
+  graph.Run(&pool, [&](int task) {
+    if (task % 3 == 0) {
+      EXPECT_TRUE(boost::this_thread::get_id() == caller);
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    ++runs[task];
+  });
+  for (int i = 0; i < runs.size(); ++i) {
+    EXPECT_EQ(runs[i], 1);
+  }
+}
+
+TEST_F(TaskGraphTest, TestSingleThread) {
+  ThreadPool pool(1);
+  TaskGraph graph(20);
+  for (int task = 1; task < 20; ++task) {
+    graph.AddDependency(task - 1, task);
+  }
+  vector<int> order;
+  graph.Run(&pool, [&](int task) { order.push_back(task); });
+  ASSERT_EQ(order.size(), 20);
+  for (int i = 0; i < order.size(); ++i) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+}  // namespace caffe
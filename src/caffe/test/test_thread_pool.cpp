@@ -0,0 +1,82 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {};
+
+TEST_F(ThreadPoolTest, TestRunCoversRange) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  for (int count = 0; count < 100; count += 7) {
+    vector<int> visits(count, 0);
+    pool.Run(count, [&](int begin, int end) {
+      EXPECT_LE(0, begin);
+      EXPECT_LT(begin, end);
+      EXPECT_LE(end, count);
+      for (int i = begin; i < end; ++i) {
+        ++visits[i];
+      }
+    });
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(visits[i], 1);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestGrain) {
+  ThreadPool pool(4);
+  pool.Run(100, [](int begin, int end) {
+    EXPECT_TRUE(end - begin >= 30 || end == 100);
+  }, 30);
+}
+
+TEST_F(ThreadPoolTest, TestNestedRun) {
+  ThreadPool pool(3);
+  vector<int> visits(20 * 20, 0);
+  pool.Run(20, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      pool.Run(20, [&, i](int inner_begin, int inner_end) {
+        for (int j = inner_begin; j < inner_end; ++j) {
+          ++visits[i * 20 + j];
+        }
+      });
+    }
+  });
+  for (int i = 0; i < visits.size(); ++i) {
+    EXPECT_EQ(visits[i], 1);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestConcurrentRun) {
+  ThreadPool pool(4);
+  const int num_callers = 4, count = 1000;
+  vector<vector<int> > visits(num_callers, vector<int>(count, 0));
+  vector<shared_ptr<boost::thread> > callers;
+  for (int t = 0; t < num_callers; ++t) {
+    callers.push_back(shared_ptr<boost::thread>(new boost::thread([&, t]() {
+      for (int k = 0; k < 10; ++k) {
+        pool.Run(count, [&, t](int begin, int end) {
+          for (int i = begin; i < end; ++i) {
+            ++visits[t][i];
+          }
+        });
+      }
+    })));
+  }
+  for (int t = 0; t < num_callers; ++t) {
+    callers[t]->join();
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(visits[t][i], 10);
+    }
+  }
+}
+
+}  // namespace caffe
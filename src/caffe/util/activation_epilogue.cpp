@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "caffe/util/activation_epilogue.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool ActivationEpilogue<Dtype>::Init(Layer<Dtype>* activation) {
+  const LayerParameter& param = activation->layer_param();
+  const string type = activation->type();
+  type_ = NONE;
+  slopes_.reset();
+  if (type == "ReLU") {
+    type_ = RELU;
+    alpha_ = param.relu_param().negative_slope();
+  } else if (type == "ELU") {
+    type_ = ELU;
+    alpha_ = param.elu_param().alpha();
+  } else if (type == "PReLU") {
+    // PReLULayer::LayerSetUp checked the slopes against its bottom.
+    if (activation->blobs().size() != 1) { return false; }
+    type_ = PRELU;
+    channel_shared_ = param.prelu_param().channel_shared();
+    slopes_ = activation->blobs()[0];
+  }
+  return type_ != NONE;
+}
+
+template <typename Dtype>
+void ActivationEpilogue<Dtype>::ApplyChannel(int c, int count,
+    Dtype* data) const {
+  switch (type_) {
+  case RELU:
+    for (int i = 0; i < count; ++i) {
+      data[i] = std::max(data[i], Dtype(0))
+          + alpha_ * std::min(data[i], Dtype(0));
+    }
+    break;
+  case PRELU: {
+    const Dtype slope = slopes_->cpu_data()[channel_shared_ ? 0 : c];
+    for (int i = 0; i < count; ++i) {
+      data[i] = std::max(data[i], Dtype(0))
+          + slope * std::min(data[i], Dtype(0));
+    }
+    break;
+  }
+  case ELU:
+    for (int i = 0; i < count; ++i) {
+      data[i] = std::max(data[i], Dtype(0))
+          + alpha_ * (exp(std::min(data[i], Dtype(0))) - Dtype(1));
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+template <typename Dtype>
+void ActivationEpilogue<Dtype>::Apply(int channels, int inner,
+    Dtype* data) const {
+  if (type_ != PRELU || channel_shared_) {
+    ApplyChannel(0, channels * inner, data);
+    return;
+  }
+  for (int c = 0; c < channels; ++c) {
+    ApplyChannel(c, inner, data + c * inner);
+  }
+}
+
+template <typename Dtype>
+void ActivationEpilogue<Dtype>::Apply(Blob<Dtype>* blob) const {
+  const int channels = blob->num_axes() > 1 ? blob->shape(1) : 1;
+  const int inner = blob->num_axes() > 2 ? blob->count(2) : 1;
+  const int dim = channels * inner;
+  Dtype* data = blob->mutable_cpu_data();
+  for (int offset = 0; offset < blob->count(); offset += dim) {
+    Apply(channels, inner, data + offset);
+  }
+}
+
+INSTANTIATE_CLASS(ActivationEpilogue);
+
+}  // namespace caffe
@@ -1,295 +1,511 @@
+#include <algorithm>
+#include <functional>
+
 #include "caffe/util/box.hpp"
+#include "caffe/util/math_functions.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAFFE_BOX_USE_SSE2
+#endif
 
 namespace caffe {
 
+	template <typename Dtype>
+	void BoxSet<Dtype>::Reshape(const int box_dimensions, const int size) {
+		CHECK_GT(box_dimensions, 0);
+		CHECK_GE(size, 0);
+		box_dimensions_ = box_dimensions;
+		size_ = size;
+		min_location_.resize(std::max(box_dimensions * size, 1));
+		max_location_.resize(std::max(box_dimensions * size, 1));
+		volumes_.resize(std::max(size, 1));
+	}
+
+	template <typename Dtype>
+	void BoxSet<Dtype>::UpdateVolumes() {
+		std::fill(volumes_.begin(), volumes_.begin() + size_, Dtype(1));
+		for (int d = 0; d < box_dimensions_; ++d) {
+			const Dtype *min_loc = min_location(d);
+			const Dtype *max_loc = max_location(d);
+			for (int i = 0; i < size_; ++i) {
+				volumes_[i] *= max_loc[i] - min_loc[i];
+			}
+		}
+	}
+
+	template class BoxSet<float>;
+	template class BoxSet<double>;
+
+	template <typename Dtype>
+	int CountDefBoxes(const Blob<Dtype> *def_location, const int box_dimensions) {
+		CHECK_GE(def_location->num_axes(), 3);
+		CHECK_EQ(def_location->shape(0), 2);
+		CHECK_EQ(def_location->shape(1) % (2 * box_dimensions), 0);
+		const int shape_kinds = def_location->shape(1) / (2 * box_dimensions);
+		return shape_kinds * def_location->count(2);
+	}
+
+	template int CountDefBoxes(const Blob<float> *def_location, const int box_dimensions);
+	template int CountDefBoxes(const Blob<double> *def_location, const int box_dimensions);
+
 	template <typename Dtype>
 	void ExtractGroundTruth(const Blob<Dtype> *label, const Blob<Dtype> *location,
-		const int box_dimensions, vector<vector<GTBox<Dtype>>> &boxes){
+		const int box_dimensions, vector<GTBoxes<Dtype> > &boxes){
 		const int num_axes = label->num_axes();
 		CHECK_EQ(num_axes, location->num_axes());
 		CHECK_GE(num_axes, 3);
 		const int num = label->shape(0);
 		CHECK_EQ(num, location->shape(0));
-		int channel_offset = 1;
 		CHECK_EQ(label->shape(1), 1);
 		for (int i = 2; i < num_axes; ++i) {
-			int shape = location->shape(i);
-			CHECK_EQ(shape, label->shape(i));
-			channel_offset *= shape;
+			CHECK_EQ(location->shape(i), label->shape(i));
 		}
-		if (boxes.size() != num)
-			boxes.resize(num);
+		CHECK_EQ(location->shape(1), 2 * box_dimensions);
+		const int channel_offset = label->count(2);
+		boxes.resize(num);
 
 		const Dtype *label_data = label->cpu_data();
+		const Dtype *location_data = location->cpu_data();
 		for (int n = 0; n < num; ++n) {
+			GTBoxes<Dtype> &gt = boxes[n];
+			gt.boxes.Reshape(box_dimensions, channel_offset);
+			gt.labels.resize(channel_offset);
+			const Dtype *image_label = label_data + label->offset(n);
 			for (int i = 0; i < channel_offset; ++i) {
-				GTBox<Dtype> box;
-				box.lable_ = &(label_data[i]);
-				boxes[n].push_back(box);
+				gt.labels[i] = static_cast<int>(image_label[i]);
+			}
+			const Dtype *image_location = location_data + location->offset(n);
+			for (int d = 0; d < box_dimensions; ++d) {
+				caffe_copy(channel_offset, image_location + d * channel_offset,
+					gt.boxes.mutable_min_location(d));
+				caffe_copy(channel_offset, image_location + (box_dimensions + d) * channel_offset,
+					gt.boxes.mutable_max_location(d));
 			}
+			gt.boxes.UpdateVolumes();
 		}
+	}
 
-		const Dtype *location_data = location->cpu_data();
-		CHECK_EQ(location->shape(1) % 2, 0);
-		CHECK_EQ(box_dimensions, location->shape(1) / 2);
-		for (int n = 0; n < num; ++n) {
-			for (int i = 0; i < channel_offset; ++i) {
-				GTBox<Dtype> &box = boxes[n][i];
-				for (size_t d = 0; d < box_dimensions; ++d) {
-					int index = d*channel_offset + i;
-					box.min_location_.push_back(&(location_data[index]));
-				}
-				for (size_t d = box_dimensions; d < 2 * box_dimensions; ++d) {
-					int index = d*channel_offset + i;
-					box.max_location_.push_back(&(location_data[index]));
+	template void ExtractGroundTruth(const Blob<float> *label, const Blob<float> *location,
+		const int box_dimensions, vector<GTBoxes<float> > &boxes);
+	template void ExtractGroundTruth(const Blob<double> *label, const Blob<double> *location,
+		const int box_dimensions, vector<GTBoxes<double> > &boxes);
+
+	template <typename Dtype>
+	void ExtractDefBoxes(const Blob<Dtype> *def_location, const int box_dimensions,
+		const int offset, DefBoxes<Dtype> &def_boxes) {
+		const int count = CountDefBoxes(def_location, box_dimensions);
+		CHECK_EQ(def_boxes.boxes.box_dimensions(), box_dimensions);
+		CHECK_LE(offset + count, def_boxes.boxes.size());
+		CHECK_EQ(def_boxes.variances.size(), def_boxes.boxes.size());
+		const int shape_kinds = def_location->shape(1) / (2 * box_dimensions);
+		const int channel_offset = def_location->count(2);
+		const Dtype *def_loc_data = def_location->cpu_data();
+		const Dtype *variance_data = def_loc_data + def_location->offset(1);
+		for (int k = 0; k < shape_kinds; ++k) {
+			for (int d = 0; d < box_dimensions; ++d) {
+				const int min_index = (2 * k * box_dimensions + d) * channel_offset;
+				const int max_index = min_index + box_dimensions * channel_offset;
+				Dtype *min_loc = def_boxes.boxes.mutable_min_location(d) + offset + k;
+				Dtype *max_loc = def_boxes.boxes.mutable_max_location(d) + offset + k;
+				Dtype *min_var = def_boxes.variances.mutable_min_location(d) + offset + k;
+				Dtype *max_var = def_boxes.variances.mutable_max_location(d) + offset + k;
+				for (int i = 0; i < channel_offset; ++i) {
+					min_loc[i * shape_kinds] = def_loc_data[min_index + i];
+					max_loc[i * shape_kinds] = def_loc_data[max_index + i];
+					min_var[i * shape_kinds] = variance_data[min_index + i];
+					max_var[i * shape_kinds] = variance_data[max_index + i];
 				}
 			}
 		}
 	}
 
-	template void ExtractGroundTruth(const Blob<float> *label, const Blob<float> *location,
-		const int box_dimensions, vector<vector<GTBox<float>>> &boxes);
-	template void ExtractGroundTruth(const Blob<double> *label, const Blob<double> *location,
-		const int box_dimensions, vector<vector<GTBox<double>>> &boxes);
+	template void ExtractDefBoxes(const Blob<float> *def_location, const int box_dimensions,
+		const int offset, DefBoxes<float> &def_boxes);
+	template void ExtractDefBoxes(const Blob<double> *def_location, const int box_dimensions,
+		const int offset, DefBoxes<double> &def_boxes);
+
+	template <typename Dtype>
+	void ReshapePredBoxes(const int num, const int box_dimensions,
+		const bool share_location, const int num_classes, const int num_boxes,
+		vector<PredBoxes<Dtype> > &pred_boxes) {
+		const int loc_classes = share_location ? 1 : num_classes;
+		pred_boxes.resize(num);
+		for (int n = 0; n < num; ++n) {
+			pred_boxes[n].locations.resize(loc_classes);
+			for (int c = 0; c < loc_classes; ++c) {
+				pred_boxes[n].locations[c].Reshape(box_dimensions, num_boxes);
+			}
+			pred_boxes[n].confidences.resize(num_classes * num_boxes);
+		}
+	}
+
+	template void ReshapePredBoxes(const int num, const int box_dimensions,
+		const bool share_location, const int num_classes, const int num_boxes,
+		vector<PredBoxes<float> > &pred_boxes);
+	template void ReshapePredBoxes(const int num, const int box_dimensions,
+		const bool share_location, const int num_classes, const int num_boxes,
+		vector<PredBoxes<double> > &pred_boxes);
 
 	template <typename Dtype>
-	void ExtractPredBoxes(const Blob<Dtype> *def_location, const Blob<Dtype> *pred_location,
+	void ExtractPredBoxes(const Blob<Dtype> *pred_location,
 		const Blob<Dtype> *pred_confidence, const int box_dimensions,
-		const bool share_location, const int num_classes, int &num,
-		vector<vector<DefBox<Dtype>>> &def_boxes,
-		vector<vector<vector<DRBox<Dtype>>>> &dr_boxes) {
-		const int num_axes = def_location->num_axes();
-		CHECK_EQ(num_axes, pred_location->num_axes());
+		const bool share_location, const int num_classes, const int offset,
+		vector<PredBoxes<Dtype> > &pred_boxes) {
+		const int num_axes = pred_location->num_axes();
 		CHECK_EQ(num_axes, pred_confidence->num_axes());
 		CHECK_GE(num_axes, 3);
-		num = pred_location->shape(0);
-		CHECK_EQ(def_location->shape(0), 2);
+		const int num = pred_location->shape(0);
 		CHECK_EQ(pred_confidence->shape(0), num);
-
-		const int def_loc_channels = def_location->shape(1);
-		const int pred_loc_channels = pred_location->shape(1);
-		const int pred_conf_channels = pred_confidence->shape(1);
-		CHECK_EQ(def_loc_channels % (box_dimensions * 2), 0);
-		const int shape_kinds = def_loc_channels / (box_dimensions * 2);
-		CHECK_EQ(share_location, (def_loc_channels == pred_loc_channels));
-		CHECK_EQ(pred_loc_channels%shape_kinds, 0);
-		CHECK_EQ(num_classes, pred_conf_channels / shape_kinds);
-		if (!share_location){
-			CHECK_EQ(0, pred_loc_channels % def_loc_channels);
-			CHECK_EQ(num_classes, pred_loc_channels / def_loc_channels);
-		}
-		int channel_offset = 1;
+		CHECK_EQ(static_cast<int>(pred_boxes.size()), num);
 		for (int i = 2; i < num_axes; ++i){
-			const int shape = def_location->shape(i);
-			CHECK_EQ(shape, pred_location->shape(i));
-			CHECK_EQ(shape, pred_confidence->shape(i));
-			channel_offset *= shape;
-		}
-		if (!def_boxes.empty()){
-			def_boxes.resize(num);
-		}
-		else{
-			CHECK_EQ(def_boxes.size(), num);
-		}
-		if (!dr_boxes.empty()){
-			dr_boxes.resize(num);
+			CHECK_EQ(pred_location->shape(i), pred_confidence->shape(i));
 		}
-		else{
-			CHECK_EQ(dr_boxes.size(), num);
-		}
-		//def_location: K1 K2 ... KN
-		//pred_location: 
+		//pred_location:
 		//  share_location = true:  LK1 LK2 ... LKN.
 		//  share_location = false: LK1C1 LK1C2 ... LK1CN LK2C1 LK2C2 ... LK2CN ...... LKMC1 LKMC2 ... LKMCM.
 		//  note:
-		//    LK: Location of each kinds of box shape. 
-		//        Example of 2D: 
+		//    LK: Location of each kinds of box shape.
+		//        Example of 2D:
 		//          Xmin Ymin Xmax Ymax;
 		//     C: The classification of each kinds of box shape.
 		//pred_confidence: K1C1 K1C2 ... K1CN K2C1 K2C2 ... K2CN ...... KMC1 KMC2 ... KMCM.
 		const int loc_classes = share_location ? 1 : num_classes;
-		// Ki -> Ki+1 offset
-
-		const int loc_kinds_offset = 2 * box_dimensions * loc_classes * channel_offset;
-		const int conf_kinds_offset = num_classes*channel_offset;
-		for (int n = 0; n < num; ++n) {
-			if (dr_boxes[n].empty()){
-				dr_boxes[n].resize(num_classes);
-			}
-			else{
-				CHECK_EQ(num_classes, dr_boxes[n].size());
-			}
-		}
-		const Dtype *def_loc_data = def_location->cpu_data();
+		CHECK_EQ(pred_confidence->shape(1) % num_classes, 0);
+		const int shape_kinds = pred_confidence->shape(1) / num_classes;
+		CHECK_EQ(pred_location->shape(1), 2 * box_dimensions * loc_classes * shape_kinds);
+		const int channel_offset = pred_location->count(2);
+		const int num_boxes = shape_kinds * channel_offset;
 		const Dtype *pred_loc_data = pred_location->cpu_data();
 		const Dtype *pred_conf_data = pred_confidence->cpu_data();
-		const Dtype *variance_data = def_loc_data + def_location->offset(vector<int>(1, 1));
 		for (int n = 0; n < num; ++n) {
-			for (int i = 0; i < channel_offset; ++i) {
-				for (int k = 0; k < shape_kinds; ++k) {
-					DefBox<Dtype> def_box;
-					const int start = 2 * k * box_dimensions;
-					const int middle = (2 * k + 1)*box_dimensions;
-					const int end = 2 * (k + 1)*box_dimensions;
-					for (int d = start; d < middle; ++d) {
-						int box_index = d*channel_offset + i;
-						def_box.min_location_.push_back(&def_loc_data[box_index]);
-						def_box.min_variances_.push_back(&variance_data[box_index]);
+			PredBoxes<Dtype> &pred = pred_boxes[n];
+			CHECK_EQ(static_cast<int>(pred.locations.size()), loc_classes);
+			const int total_boxes = pred.locations[0].size();
+			CHECK_LE(offset + num_boxes, total_boxes);
+			const Dtype *image_loc = pred_loc_data + pred_location->offset(n);
+			const Dtype *image_conf = pred_conf_data + pred_confidence->offset(n);
+			for (int k = 0; k < shape_kinds; ++k) {
+				for (int c = 0; c < loc_classes; ++c) {
+					BoxSet<Dtype> &loc = pred.locations[c];
+					const int start = (k * loc_classes + c) * 2 * box_dimensions;
+					for (int d = 0; d < box_dimensions; ++d) {
+						const Dtype *min_src = image_loc + (start + d) * channel_offset;
+						const Dtype *max_src = image_loc + (start + box_dimensions + d) * channel_offset;
+						Dtype *min_dst = loc.mutable_min_location(d) + offset + k;
+						Dtype *max_dst = loc.mutable_max_location(d) + offset + k;
+						for (int i = 0; i < channel_offset; ++i) {
+							min_dst[i * shape_kinds] = min_src[i];
+							max_dst[i * shape_kinds] = max_src[i];
+						}
 					}
-					for (int d = middle; d < end; ++d) {
-						int box_index = d*channel_offset + i;
-						def_box.max_location_.push_back(&def_loc_data[box_index]);
-						def_box.max_variances_.push_back(&variance_data[box_index]);
+				}
+				for (int c = 0; c < num_classes; ++c) {
+					const Dtype *conf_src = image_conf + (k * num_classes + c) * channel_offset;
+					Dtype *conf_dst = &pred.confidences[c * total_boxes + offset + k];
+					for (int i = 0; i < channel_offset; ++i) {
+						conf_dst[i * shape_kinds] = conf_src[i];
 					}
-					int last_def_box_id = def_boxes[num].size();
-					def_boxes[num].push_back(def_box);
-					for (int c = 0; c < num_classes; ++c) {
-						DRBox<Dtype> dr_box;
-						int loc_class_id = share_location ? 0 : c;
-						for (int d = start; d < middle; ++d) {
-							int box_index = d*channel_offset + i;
-							int loc_index = k*loc_kinds_offset + loc_class_id*channel_offset + box_index;
-							dr_box.min_location_.push_back(&pred_loc_data[loc_index]);
-						}
-						for (int d = middle; d < end; ++d) {
-							int box_index = d*channel_offset + i;
-							int loc_index = k*loc_kinds_offset + loc_class_id*channel_offset + box_index;
-							dr_box.max_location_.push_back(&pred_loc_data[loc_index]);
+				}
+			}
+		}
+	}
+
+	template void ExtractPredBoxes(const Blob<float> *pred_location,
+		const Blob<float> *pred_confidence, const int box_dimensions,
+		const bool share_location, const int num_classes, const int offset,
+		vector<PredBoxes<float> > &pred_boxes);
+	template void ExtractPredBoxes(const Blob<double> *pred_location,
+		const Blob<double> *pred_confidence, const int box_dimensions,
+		const bool share_location, const int num_classes, const int offset,
+		vector<PredBoxes<double> > &pred_boxes);
+
+	template <typename Dtype>
+	void ScatterPredDiffs(const vector<PredBoxes<Dtype> > &pred_diffs,
+		const int box_dimensions, const bool share_location, const int num_classes,
+		const int offset, Blob<Dtype> *pred_location, Blob<Dtype> *pred_confidence) {
+		const int num = pred_location->shape(0);
+		CHECK_EQ(static_cast<int>(pred_diffs.size()), num);
+		const int loc_classes = share_location ? 1 : num_classes;
+		const int shape_kinds = pred_confidence->shape(1) / num_classes;
+		const int channel_offset = pred_location->count(2);
+		Dtype *loc_diff = pred_location->mutable_cpu_diff();
+		Dtype *conf_diff = pred_confidence->mutable_cpu_diff();
+		for (int n = 0; n < num; ++n) {
+			const PredBoxes<Dtype> &pred = pred_diffs[n];
+			const int total_boxes = pred.locations[0].size();
+			Dtype *image_loc = loc_diff + pred_location->offset(n);
+			Dtype *image_conf = conf_diff + pred_confidence->offset(n);
+			for (int k = 0; k < shape_kinds; ++k) {
+				for (int c = 0; c < loc_classes; ++c) {
+					const BoxSet<Dtype> &loc = pred.locations[c];
+					const int start = (k * loc_classes + c) * 2 * box_dimensions;
+					for (int d = 0; d < box_dimensions; ++d) {
+						Dtype *min_dst = image_loc + (start + d) * channel_offset;
+						Dtype *max_dst = image_loc + (start + box_dimensions + d) * channel_offset;
+						const Dtype *min_src = loc.min_location(d) + offset + k;
+						const Dtype *max_src = loc.max_location(d) + offset + k;
+						for (int i = 0; i < channel_offset; ++i) {
+							min_dst[i] = min_src[i * shape_kinds];
+							max_dst[i] = max_src[i * shape_kinds];
 						}
-						const int conf_index = k*conf_kinds_offset + c*channel_offset + i;
-						dr_box.conf_ = &pred_conf_data[conf_index];
-						dr_box.def_box_ = &def_boxes[num][last_def_box_id];
-						int last_dr_box_id = dr_boxes.size();
-						dr_boxes[num][c].push_back(dr_box);
-						def_boxes[num][last_def_box_id].dr_boxes_.push_back(&dr_boxes[num][c][last_dr_box_id]);
+					}
+				}
+				for (int c = 0; c < num_classes; ++c) {
+					Dtype *conf_dst = image_conf + (k * num_classes + c) * channel_offset;
+					const Dtype *conf_src = &pred.confidences[c * total_boxes + offset + k];
+					for (int i = 0; i < channel_offset; ++i) {
+						conf_dst[i] = conf_src[i * shape_kinds];
 					}
 				}
 			}
 		}
 	}
 
-	template void ExtractPredBoxes(const Blob<float> *def_location, const Blob<float> *pred_location,
-		const Blob<float> *pred_confidence, const int box_dimensions,
-		const bool share_location, const int num_classes, int &num,
-		vector<vector<DefBox<float>>> &def_boxes,
-		vector<vector<vector<DRBox<float>>>> &dr_boxes);
+	template void ScatterPredDiffs(const vector<PredBoxes<float> > &pred_diffs,
+		const int box_dimensions, const bool share_location, const int num_classes,
+		const int offset, Blob<float> *pred_location, Blob<float> *pred_confidence);
+	template void ScatterPredDiffs(const vector<PredBoxes<double> > &pred_diffs,
+		const int box_dimensions, const bool share_location, const int num_classes,
+		const int offset, Blob<double> *pred_location, Blob<double> *pred_confidence);
 
-	template void ExtractPredBoxes(const Blob<double> *def_location, const Blob<double> *pred_location,
-		const Blob<double> *pred_confidence, const int box_dimensions,
-		const bool share_location, const int num_classes, int &num,
-		vector<vector<DefBox<double>>> &def_boxes,
-		vector<vector<vector<DRBox<double>>>> &dr_boxes);
+	template <typename Dtype>
+	void EncodeBox(const BoxSet<Dtype> &gt_boxes, const int gt_index,
+		const DefBoxes<Dtype> &def_boxes, const int def_index, Dtype *code) {
+		const int box_dimensions = gt_boxes.box_dimensions();
+		for (int d = 0; d < box_dimensions; ++d) {
+			const Dtype def_min = def_boxes.boxes.min_location(d)[def_index];
+			const Dtype def_max = def_boxes.boxes.max_location(d)[def_index];
+			const Dtype extent = def_max - def_min;
+			CHECK_GT(extent, 0) << "Default box " << def_index << " is empty.";
+			code[d] = (gt_boxes.min_location(d)[gt_index] - def_min) /
+				(extent * def_boxes.variances.min_location(d)[def_index]);
+			code[box_dimensions + d] = (gt_boxes.max_location(d)[gt_index] - def_max) /
+				(extent * def_boxes.variances.max_location(d)[def_index]);
+		}
+	}
+
+	template void EncodeBox(const BoxSet<float> &gt_boxes, const int gt_index,
+		const DefBoxes<float> &def_boxes, const int def_index, float *code);
+	template void EncodeBox(const BoxSet<double> &gt_boxes, const int gt_index,
+		const DefBoxes<double> &def_boxes, const int def_index, double *code);
 
 	template <typename Dtype>
-	Dtype JaccardOverlap(const Box<Dtype> *box1, const Box<Dtype> *box2){
-		const auto box_dimensions_ = box1->min_location_.size();
-		CHECK_EQ(box1->max_location_.size(), box_dimensions_);
-		CHECK_EQ(box2->min_location_.size(), box_dimensions_);
-		CHECK_EQ(box2->max_location_.size(), box_dimensions_);
-		vector<Dtype> len_overlap(box_dimensions_, 0);
-		vector<Dtype> len_gt_box(box_dimensions_, 0);
-		vector<Dtype> len_def_box(box_dimensions_, 0);
-		for (int i = 0; i < box_dimensions_; i++) {
-			len_overlap[i] = min(*box1->max_location_[i], *box2->max_location_[i])
-				- max(*box1->min_location_[i], *box2->min_location_[i]);
-			if (len_overlap[i] <= 0) {
+	void DecodeBoxes(const DefBoxes<Dtype> &def_boxes, const BoxSet<Dtype> &codes,
+		BoxSet<Dtype> &boxes) {
+		const int box_dimensions = codes.box_dimensions();
+		const int size = codes.size();
+		CHECK_EQ(def_boxes.boxes.box_dimensions(), box_dimensions);
+		CHECK_EQ(def_boxes.boxes.size(), size);
+		boxes.Reshape(box_dimensions, size);
+		for (int d = 0; d < box_dimensions; ++d) {
+			const Dtype *def_min = def_boxes.boxes.min_location(d);
+			const Dtype *def_max = def_boxes.boxes.max_location(d);
+			const Dtype *min_var = def_boxes.variances.min_location(d);
+			const Dtype *max_var = def_boxes.variances.max_location(d);
+			const Dtype *min_code = codes.min_location(d);
+			const Dtype *max_code = codes.max_location(d);
+			Dtype *min_loc = boxes.mutable_min_location(d);
+			Dtype *max_loc = boxes.mutable_max_location(d);
+			for (int i = 0; i < size; ++i) {
+				const Dtype extent = def_max[i] - def_min[i];
+				min_loc[i] = def_min[i] + min_code[i] * extent * min_var[i];
+				max_loc[i] = def_max[i] + max_code[i] * extent * max_var[i];
+			}
+		}
+		boxes.UpdateVolumes();
+	}
+
+	template void DecodeBoxes(const DefBoxes<float> &def_boxes, const BoxSet<float> &codes,
+		BoxSet<float> &boxes);
+	template void DecodeBoxes(const DefBoxes<double> &def_boxes, const BoxSet<double> &codes,
+		BoxSet<double> &boxes);
+
+	template <typename Dtype>
+	Dtype JaccardOverlap(const BoxSet<Dtype> &boxes1, const int index1,
+		const BoxSet<Dtype> &boxes2, const int index2){
+		const int box_dimensions = boxes1.box_dimensions();
+		CHECK_EQ(boxes2.box_dimensions(), box_dimensions);
+		Dtype overlap_volume = 1;
+		for (int d = 0; d < box_dimensions; ++d) {
+			const Dtype len = std::min(boxes1.max_location(d)[index1], boxes2.max_location(d)[index2])
+				- std::max(boxes1.min_location(d)[index1], boxes2.min_location(d)[index2]);
+			if (len <= 0) {
 				return 0;
 			}
-			len_gt_box[i] = *box1->max_location_[i] - *box1->min_location_[i];
-			len_def_box[i] = *box2->max_location_[i] - *box2->min_location_[i];
+			overlap_volume *= len;
+		}
+		return overlap_volume /
+			(boxes1.volumes()[index1] + boxes2.volumes()[index2] - overlap_volume);
+	}
+
+	template float JaccardOverlap(const BoxSet<float> &boxes1, const int index1,
+		const BoxSet<float> &boxes2, const int index2);
+	template double JaccardOverlap(const BoxSet<double> &boxes1, const int index1,
+		const BoxSet<double> &boxes2, const int index2);
+
+	// Generic N-D kernel: one sweep per dimension over contiguous coordinates,
+	// which the compiler vectorizes.
+	template <typename Dtype>
+	static void JaccardOverlapsND(const BoxSet<Dtype> &boxes1, const int index1,
+		const BoxSet<Dtype> &boxes2, const int begin, Dtype *overlaps) {
+		const int size = boxes2.size();
+		std::fill(overlaps + begin, overlaps + size, Dtype(1));
+		for (int d = 0; d < boxes1.box_dimensions(); ++d) {
+			const Dtype min1 = boxes1.min_location(d)[index1];
+			const Dtype max1 = boxes1.max_location(d)[index1];
+			const Dtype *min2 = boxes2.min_location(d);
+			const Dtype *max2 = boxes2.max_location(d);
+			for (int j = begin; j < size; ++j) {
+				const Dtype len = std::min(max1, max2[j]) - std::max(min1, min2[j]);
+				overlaps[j] *= len > 0 ? len : Dtype(0);
+			}
 		}
-		Dtype overlap_area = 1;
-		Dtype gt_box_area = 1;
-		Dtype def_box_area = 1;
-		for (int i = 0; i < box_dimensions_; i++) {
-			overlap_area *= len_overlap[i];
-			gt_box_area *= len_gt_box[i];
-			def_box_area *= len_def_box[i];
+		const Dtype volume1 = boxes1.volumes()[index1];
+		const Dtype *volume2 = boxes2.volumes();
+		for (int j = begin; j < size; ++j) {
+			const Dtype inter = overlaps[j];
+			overlaps[j] = inter > 0 ? inter / (volume1 + volume2[j] - inter) : Dtype(0);
 		}
-		return overlap_area / (gt_box_area + def_box_area - overlap_area);
 	}
 
-	template float JaccardOverlap(const Box<float> *box1, const Box<float> *box2);
-	template double JaccardOverlap(const Box<double> *box1, const Box<double> *box2);
+	template <typename Dtype>
+	void JaccardOverlaps(const BoxSet<Dtype> &boxes1, const int index1,
+		const BoxSet<Dtype> &boxes2, Dtype *overlaps) {
+		CHECK_EQ(boxes1.box_dimensions(), boxes2.box_dimensions());
+		JaccardOverlapsND(boxes1, index1, boxes2, 0, overlaps);
+	}
 
+	template <>
+	void JaccardOverlaps(const BoxSet<float> &boxes1, const int index1,
+		const BoxSet<float> &boxes2, float *overlaps) {
+		CHECK_EQ(boxes1.box_dimensions(), boxes2.box_dimensions());
+		int begin = 0;
+#ifdef CAFFE_BOX_USE_SSE2
+		if (boxes1.box_dimensions() == 2) {
+			const int size = boxes2.size();
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 min1_x = _mm_set1_ps(boxes1.min_location(0)[index1]);
+			const __m128 max1_x = _mm_set1_ps(boxes1.max_location(0)[index1]);
+			const __m128 min1_y = _mm_set1_ps(boxes1.min_location(1)[index1]);
+			const __m128 max1_y = _mm_set1_ps(boxes1.max_location(1)[index1]);
+			const __m128 volume1 = _mm_set1_ps(boxes1.volumes()[index1]);
+			const float *min2_x = boxes2.min_location(0);
+			const float *max2_x = boxes2.max_location(0);
+			const float *min2_y = boxes2.min_location(1);
+			const float *max2_y = boxes2.max_location(1);
+			const float *volume2 = boxes2.volumes();
+			for (; begin + 4 <= size; begin += 4) {
+				__m128 len_x = _mm_sub_ps(_mm_min_ps(max1_x, _mm_loadu_ps(max2_x + begin)),
+					_mm_max_ps(min1_x, _mm_loadu_ps(min2_x + begin)));
+				__m128 len_y = _mm_sub_ps(_mm_min_ps(max1_y, _mm_loadu_ps(max2_y + begin)),
+					_mm_max_ps(min1_y, _mm_loadu_ps(min2_y + begin)));
+				const __m128 inter = _mm_mul_ps(_mm_max_ps(len_x, zero), _mm_max_ps(len_y, zero));
+				const __m128 uni = _mm_sub_ps(_mm_add_ps(volume1, _mm_loadu_ps(volume2 + begin)), inter);
+				const __m128 valid = _mm_cmpgt_ps(inter, zero);
+				_mm_storeu_ps(overlaps + begin, _mm_and_ps(valid, _mm_div_ps(inter, uni)));
+			}
+		}
+#endif
+		JaccardOverlapsND(boxes1, index1, boxes2, begin, overlaps);
+	}
+
+	template void JaccardOverlaps(const BoxSet<double> &boxes1, const int index1,
+		const BoxSet<double> &boxes2, double *overlaps);
 
 	template <typename Dtype>
-	void JaccardOverlaps(const vector<Box<Dtype>> *gt_boxes, const vector<vector<Box<Dtype>>> *pred_boxes,
-		const MultiBoxLossParameter_MatchType match_type, const bool share_location, const int background_label,
-		vector<map<int, map<const Box<Dtype> *, map<const Box<Dtype>*, Dtype>>>> &overlaps) {
-		overlaps.resize(2);
-		const int gt_size = gt_boxes->size();
-		for (size_t i = 0; i < gt_size; i++) {
-			const Box<Dtype> *gt_box = &gt_boxes->at(i);
-			const int label = *gt_box->lable_;
-			if (label >= 0){
-				CHECK_NE(label, background_label);
-				if (share_location){
-					const int num_classes = pred_boxes->size();
-					for (size_t c = 0; c < num_classes; c++) {
-						const auto &loc_boxes = pred_boxes->at(c);
-						const int loc_size = loc_boxes.size();
-						for (size_t j = 0; j < loc_size; j++) {
-							const Box<Dtype> *pred_box = &loc_boxes[i];
-							Dtype overlap = JaccardOverlap(gt_box, pred_box);
-							overlaps[0][c][gt_box][pred_box] = overlap;
-							overlaps[1][c][pred_box][gt_box] = overlap;
-						}
-					}
+	void JaccardOverlaps(const GTBoxes<Dtype> &gt_boxes, const BoxSet<Dtype> &pred_boxes,
+		const int background_label, const int label_filter,
+		BoxOverlaps<Dtype> &overlaps) {
+		const int gt_size = gt_boxes.boxes.size();
+		const int pred_size = pred_boxes.size();
+		overlaps.num_gt = gt_size;
+		overlaps.num_pred = pred_size;
+		overlaps.row_offsets.assign(gt_size + 1, 0);
+		overlaps.pred_indices.clear();
+		overlaps.values.clear();
+		vector<Dtype> row(std::max(pred_size, 1));
+		for (int g = 0; g < gt_size; ++g) {
+			overlaps.row_offsets[g] = overlaps.values.size();
+			const int label = gt_boxes.labels[g];
+			if (label < 0 || (label_filter >= 0 && label != label_filter)) {
+				continue;
+			}
+			CHECK_NE(label, background_label);
+			JaccardOverlaps(gt_boxes.boxes, g, pred_boxes, &row[0]);
+			for (int j = 0; j < pred_size; ++j) {
+				if (row[j] > 0) {
+					overlaps.pred_indices.push_back(j);
+					overlaps.values.push_back(row[j]);
 				}
-
 			}
 		}
+		overlaps.row_offsets[gt_size] = overlaps.values.size();
 	}
 
-	template void JaccardOverlaps(const vector<Box<float>> *gt_boxes, const vector<vector<Box<float>>> *pred_boxes,
-		const MultiBoxLossParameter_MatchType match_type, const bool share_location, const int background_label,
-		vector<map<int, map<const Box<float> *, map<const Box<float>*, float>>>> &overlaps);
+	template void JaccardOverlaps(const GTBoxes<float> &gt_boxes, const BoxSet<float> &pred_boxes,
+		const int background_label, const int label_filter,
+		BoxOverlaps<float> &overlaps);
+	template void JaccardOverlaps(const GTBoxes<double> &gt_boxes, const BoxSet<double> &pred_boxes,
+		const int background_label, const int label_filter,
+		BoxOverlaps<double> &overlaps);
 
-	template void JaccardOverlaps(const vector<Box<double>> *gt_boxes, const vector<vector<Box<double>>> *pred_boxes,
-		const MultiBoxLossParameter_MatchType match_type, const bool share_location, const int background_label,
-		vector<map<int, map<const Box<double> *, map<const Box<double>*, double>>>> &overlaps);
+	// Best unmatched prediction of one ground truth row, last one on ties.
+	template <typename Dtype>
+	static int BestUnmatched(const BoxOverlaps<Dtype> &overlaps, const int g,
+		const vector<int> &match_indices, Dtype &best_overlap) {
+		int best = -1;
+		best_overlap = 0;
+		for (int e = overlaps.row_offsets[g]; e < overlaps.row_offsets[g + 1]; ++e) {
+			const int p = overlaps.pred_indices[e];
+			if (match_indices[p] >= 0) {
+				continue;
+			}
+			if (overlaps.values[e] >= best_overlap) {
+				best_overlap = overlaps.values[e];
+				best = p;
+			}
+		}
+		return best;
+	}
 
 	template <typename Dtype>
-	void MathBoxes(const vector<map<int, map<const Box<Dtype> *, map<const Box<Dtype>*, Dtype>>>> *overlaps,
+	void MatchBoxes(const BoxOverlaps<Dtype> &overlaps,
 		const MultiBoxLossParameter_MatchType match_type, const float overlap_threshold,
-		map<const Box<Dtype> *, const Box<Dtype> *> &match_boxes) {
+		vector<int> &match_indices, vector<Dtype> &match_overlaps) {
+		const int num_gt = overlaps.num_gt;
+		match_indices.assign(overlaps.num_pred, -1);
+		match_overlaps.assign(overlaps.num_pred, Dtype(0));
 		if (match_type == MultiBoxLossParameter_MatchType_BIPARTITE){
 			//Find max overlap between gt_boxes and pred_boxes.
 			//Each of gt_boxes only have one pred_boxes,and each of pred_boxes aslo have only one gt_boxes.
-			for (const auto &overlap : overlaps->at(0)){
-				list<const Box<Dtype> *> gt_boxes;
-				for (auto gt_iter = overlap.second.begin(); gt_iter != overlap.second.end(); ++gt_iter) {
-					gt_boxes.push_back(gt_iter->first);
+			//The best unmatched prediction of every ground truth is cached and
+			//only recomputed when another ground truth takes it.
+			vector<int> best_pred(num_gt, -1);
+			vector<Dtype> best_overlap(num_gt, Dtype(0));
+			for (int g = 0; g < num_gt; ++g) {
+				best_pred[g] = BestUnmatched(overlaps, g, match_indices, best_overlap[g]);
+			}
+			for (int step = 0; step < num_gt; ++step) {
+				int max_gt = -1;
+				Dtype max_overlap = 0;
+				for (int g = 0; g < num_gt; ++g) {
+					if (best_pred[g] >= 0 && best_overlap[g] >= max_overlap) {
+						max_overlap = best_overlap[g];
+						max_gt = g;
+					}
 				}
-				while (!gt_boxes.empty()) {
-					list<const Box<Dtype> *>::iterator max_gt_iter;
-					const Box<Dtype> * max_pred_box = nullptr;
-					Dtype max_overlap = 0;
-					for (auto gt_iter = gt_boxes.begin(); gt_iter != gt_boxes.end(); ++gt_iter) {
-						for (auto gt_box = gt_boxes.begin(); gt_box != gt_boxes.end(); ++gt_box) {
-							const auto pred_boxes = overlap.second.find(*gt_box);
-							if (pred_boxes == overlap.second.end()){
-								LOG(FATAL) << "Caculate overlap function have error.";
-								break;
-							};
-							for (const auto &pred_box : pred_boxes->second){
-								if (match_boxes.find(pred_box.first) != match_boxes.end()){
-									continue;
-								}
-								const Dtype value = overlap.second.at(*gt_box).at(pred_box.first);
-								if (value >= max_overlap){
-									max_overlap = value;
-									max_gt_iter = gt_iter;
-									max_pred_box = pred_box.first;
-								}
-							}
-						}
+				if (max_gt < 0) {
+					break;
+				}
+				const int max_pred = best_pred[max_gt];
+				match_indices[max_pred] = max_gt;
+				match_overlaps[max_pred] = max_overlap;
+				best_pred[max_gt] = -1;
+				for (int g = 0; g < num_gt; ++g) {
+					if (best_pred[g] == max_pred) {
+						best_pred[g] = BestUnmatched(overlaps, g, match_indices, best_overlap[g]);
 					}
-					CHECK_GE(max_overlap, static_cast<float>(overlap_threshold));
-					match_boxes[max_pred_box] = *max_gt_iter;
-					gt_boxes.erase(max_gt_iter);
 				}
 			}
 		}
@@ -297,83 +513,162 @@ namespace caffe {
 			//Find max overlap between pred_boxes and gt_boxes.
 			//Each of gt_boxes only have mulit pred_boxes if overlap is greater than overlap threshold,
 			//and each of pred_boxes have only one gt_boxes which the overlap is maximum.
-			for (const auto &overlap : overlaps->at(1)){
-				for (const auto &pred_box : overlap.second) {
-					//find max_overlap
-					const Box<Dtype> *max_gt_box = nullptr;
-					Dtype max_overlap = 0;
-					for (const auto &gt_box : pred_box.second) {
-						if (gt_box.second > max_overlap) {
-							max_overlap = gt_box.second;
-							max_gt_box = gt_box.first;
-						}
-					}
-					if (max_overlap >= static_cast<Dtype>(overlap_threshold)){
-						match_boxes[pred_box.first] = max_gt_box;
+			for (int g = 0; g < num_gt; ++g) {
+				for (int e = overlaps.row_offsets[g]; e < overlaps.row_offsets[g + 1]; ++e) {
+					const int p = overlaps.pred_indices[e];
+					if (overlaps.values[e] > match_overlaps[p]) {
+						match_overlaps[p] = overlaps.values[e];
+						match_indices[p] = g;
 					}
 				}
 			}
-
+			for (int p = 0; p < overlaps.num_pred; ++p) {
+				if (match_overlaps[p] < static_cast<Dtype>(overlap_threshold)) {
+					match_indices[p] = -1;
+					match_overlaps[p] = 0;
+				}
+			}
 		}
 		else {
 			LOG(FATAL) << "Unknown matching type.";
 		}
 	}
 
-	template void MathBoxes(const vector<map<int, map<const Box<float> *, map<const Box<float>*, float>>>> *overlaps,
+	template void MatchBoxes(const BoxOverlaps<float> &overlaps,
 		const MultiBoxLossParameter_MatchType match_type, const float overlap_threshold,
-		map<const Box<float> *, const Box<float> *> &match_boxes);
-
-	template void MathBoxes(const vector<map<int, map<const Box<double> *, map<const Box<double>*, double>>>> *overlaps,
+		vector<int> &match_indices, vector<float> &match_overlaps);
+	template void MatchBoxes(const BoxOverlaps<double> &overlaps,
 		const MultiBoxLossParameter_MatchType match_type, const float overlap_threshold,
-		map<const Box<double> *, const Box<double> *> &match_boxes);
+		vector<int> &match_indices, vector<double> &match_overlaps);
 
+	template <typename Dtype>
+	void MaxOverlaps(const BoxOverlaps<Dtype> &overlaps, vector<Dtype> &max_overlaps) {
+		max_overlaps.assign(overlaps.num_pred, Dtype(0));
+		const int num_entries = overlaps.values.size();
+		for (int e = 0; e < num_entries; ++e) {
+			Dtype &value = max_overlaps[overlaps.pred_indices[e]];
+			value = std::max(value, overlaps.values[e]);
+		}
+	}
+
+	template void MaxOverlaps(const BoxOverlaps<float> &overlaps, vector<float> &max_overlaps);
+	template void MaxOverlaps(const BoxOverlaps<double> &overlaps, vector<double> &max_overlaps);
 
 	template <typename Dtype>
-	void ExtractNegtiveBox(const vector<vector<Box<Dtype>>> *pred_boxes,
-		const bool share_location, const int background_label,
-		list<pair<const int, const Box<Dtype> *>> &negatives) {
-		list<pair<const Box<Dtype> *, pair<const int, Dtype>>> max_conf_box;
-		const int num_classes = static_cast<int>(pred_boxes->size());
+	void ExtractNegativeBoxes(const PredBoxes<Dtype> &pred_boxes, const int num_classes,
+		const int background_label, const vector<int> &match_indices,
+		const vector<Dtype> &max_overlaps, const float overlap_threshold,
+		vector<pair<Dtype, int> > &negatives) {
 		CHECK_GT(num_classes, 0);
-		const int conf_box_size = static_cast<int>((pred_boxes->at(background_label).size()));
-		for (int i = 0; i < conf_box_size; ++i) {
-			Dtype max_conf = 0;
-			int max_class = 0;
-			for (int j = 0; j < num_classes; j++) {
-				const auto &class_pred_box = pred_boxes->at(j);
-				CHECK_EQ(static_cast<int>(class_pred_box.size()), conf_box_size);
-				const Dtype *pred_conf = class_pred_box[i].conf_;
-
-				if (*pred_conf > max_conf) {
-					max_conf = *pred_conf;
-					max_class = j;
+		const int num_boxes = pred_boxes.confidences.size() / num_classes;
+		CHECK_EQ(static_cast<int>(match_indices.size()), num_boxes);
+		CHECK_EQ(static_cast<int>(max_overlaps.size()), num_boxes);
+		vector<Dtype> max_conf(num_boxes, Dtype(0));
+		vector<int> max_class(num_boxes, 0);
+		for (int c = 0; c < num_classes; ++c) {
+			const Dtype *conf = &pred_boxes.confidences[c * num_boxes];
+			for (int i = 0; i < num_boxes; ++i) {
+				if (conf[i] > max_conf[i]) {
+					max_conf[i] = conf[i];
+					max_class[i] = c;
 				}
 			}
-			if (max_class != background_label){
-				bool unsaved = true;
-				for (auto iter = max_conf_box.begin(); iter != max_conf_box.end(); ++iter) {
-					if (max_conf >= iter->second.second){
-						max_conf_box.insert(iter, make_pair(&pred_boxes->at(max_class).at(i), make_pair(max_class, max_conf)));
-						unsaved = false;
-						break;
-					}
-				}
-				if (unsaved)
-					max_conf_box.push_back(make_pair(&pred_boxes->at(max_class).at(i), make_pair(max_class, max_conf)));
+		}
+		negatives.clear();
+		for (int i = 0; i < num_boxes; ++i) {
+			if (match_indices[i] < 0 && max_class[i] != background_label &&
+				max_overlaps[i] < static_cast<Dtype>(overlap_threshold)) {
+				negatives.push_back(make_pair(max_conf[i], i));
 			}
 		}
+	}
+
+	template void ExtractNegativeBoxes(const PredBoxes<float> &pred_boxes, const int num_classes,
+		const int background_label, const vector<int> &match_indices,
+		const vector<float> &max_overlaps, const float overlap_threshold,
+		vector<pair<float, int> > &negatives);
+	template void ExtractNegativeBoxes(const PredBoxes<double> &pred_boxes, const int num_classes,
+		const int background_label, const vector<int> &match_indices,
+		const vector<double> &max_overlaps, const float overlap_threshold,
+		vector<pair<double, int> > &negatives);
 
-		for (const auto &box : max_conf_box) {
-			negatives.push_front(make_pair(box.second.first, box.first));
+	// Most confident first, lower box id first on ties.
+	template <typename Dtype>
+	static bool HarderNegative(const pair<Dtype, int> &a, const pair<Dtype, int> &b) {
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	}
+
+	template <typename Dtype>
+	void SelectHardNegatives(const int num_negatives, vector<pair<Dtype, int> > &negatives) {
+		const int num_keep = std::max(0, std::min(num_negatives, static_cast<int>(negatives.size())));
+		if (num_keep < static_cast<int>(negatives.size())) {
+			std::nth_element(negatives.begin(), negatives.begin() + num_keep, negatives.end(),
+				HarderNegative<Dtype>);
+			negatives.resize(num_keep);
 		}
+		std::sort(negatives.begin(), negatives.end(), HarderNegative<Dtype>);
 	}
 
-	template void ExtractNegtiveBox(const vector<vector<Box<float>>> *pred_boxes,
-		const bool share_location, const int background_label,
-		list<pair<const int, const Box<float> *>> &negatives);
+	template void SelectHardNegatives(const int num_negatives, vector<pair<float, int> > &negatives);
+	template void SelectHardNegatives(const int num_negatives, vector<pair<double, int> > &negatives);
+
+	template <typename Dtype>
+	void ApplyNMS(const BoxSet<Dtype> &boxes, const Dtype *scores,
+		const float score_threshold, const float nms_threshold, const int top_k,
+		vector<int> &indices) {
+		// The candidates form a heap whose top is the least confident one, so
+		// that only top_k of them are ever held.
+		vector<pair<Dtype, int> > candidates;
+		const int size = boxes.size();
+		for (int i = 0; i < size; ++i) {
+			if (scores[i] <= static_cast<Dtype>(score_threshold)) {
+				continue;
+			}
+			const pair<Dtype, int> candidate(scores[i], i);
+			if (top_k < 0 || static_cast<int>(candidates.size()) < top_k) {
+				candidates.push_back(candidate);
+				std::push_heap(candidates.begin(), candidates.end(), HarderNegative<Dtype>);
+			}
+			else if (top_k > 0 && HarderNegative(candidate, candidates.front())) {
+				std::pop_heap(candidates.begin(), candidates.end(), HarderNegative<Dtype>);
+				candidates.back() = candidate;
+				std::push_heap(candidates.begin(), candidates.end(), HarderNegative<Dtype>);
+			}
+		}
+		std::sort_heap(candidates.begin(), candidates.end(), HarderNegative<Dtype>);
+		// Gather the candidates, most confident first, to run the vectorized
+		// overlap kernel over them.
+		const int num_candidates = candidates.size();
+		BoxSet<Dtype> sorted;
+		sorted.Reshape(boxes.box_dimensions(), num_candidates);
+		for (int d = 0; d < boxes.box_dimensions(); ++d) {
+			for (int j = 0; j < num_candidates; ++j) {
+				sorted.mutable_min_location(d)[j] = boxes.min_location(d)[candidates[j].second];
+				sorted.mutable_max_location(d)[j] = boxes.max_location(d)[candidates[j].second];
+			}
+		}
+		sorted.UpdateVolumes();
+		indices.clear();
+		vector<bool> suppressed(num_candidates, false);
+		vector<Dtype> overlaps(std::max(num_candidates, 1));
+		for (int j = 0; j < num_candidates; ++j) {
+			if (suppressed[j]) {
+				continue;
+			}
+			indices.push_back(candidates[j].second);
+			JaccardOverlaps(sorted, j, sorted, &overlaps[0]);
+			for (int k = j + 1; k < num_candidates; ++k) {
+				if (overlaps[k] > static_cast<Dtype>(nms_threshold)) {
+					suppressed[k] = true;
+				}
+			}
+		}
+	}
 
-	template void ExtractNegtiveBox(const vector<vector<Box<double>>> *pred_boxes,
-		const bool share_location, const int background_label,
-		list<pair<const int, const Box<double> *>> &negatives);
+	template void ApplyNMS(const BoxSet<float> &boxes, const float *scores,
+		const float score_threshold, const float nms_threshold, const int top_k,
+		vector<int> &indices);
+	template void ApplyNMS(const BoxSet<double> &boxes, const double *scores,
+		const float score_threshold, const float nms_threshold, const int top_k,
+		vector<int> &indices);
 }
@@ -0,0 +1,111 @@
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/util/datum_view.hpp"
+
+namespace caffe {
+
+// Wire types of the protobuf encoding.
+enum { kVarint = 0, kFixed64 = 1, kLengthDelimited = 2, kFixed32 = 5 };
+
+static bool ReadVarint(const char** p, const char* end, uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(*(*p)++);
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+void DatumView::Clear() {
+  data_shape_.Clear();
+  label_shape_.Clear();
+  data_ = label_ = NULL;
+  data_size_ = label_size_ = 0;
+  encoded_ = false;
+}
+
+bool DatumView::Parse(const char* buffer, size_t size) {
+  Clear();
+  const char* p = buffer;
+  const char* end = buffer + size;
+  while (p < end) {
+    uint64_t tag;
+    if (!ReadVarint(&p, end, &tag)) {
+      return false;
+    }
+    const int field = static_cast<int>(tag >> 3);
+    const int wire_type = static_cast<int>(tag & 7);
+    uint64_t value;
+    switch (wire_type) {
+    case kVarint:
+      if (!ReadVarint(&p, end, &value)) {
+        return false;
+      }
+      if (field == Datum::kEncodedFieldNumber) {
+        encoded_ = value != 0;
+      }
+      break;
+    case kLengthDelimited:
+      if (!ReadVarint(&p, end, &value) ||
+          value > static_cast<uint64_t>(end - p)) {
+        return false;
+      }
+      if (field == Datum::kDataShapeFieldNumber ||
+          field == Datum::kLabelShapeFieldNumber) {
+        // Repeated messages merge, as in the generated parser.
+        DatumShape shape;
+        if (!shape.ParseFromArray(p, static_cast<int>(value))) {
+          return false;
+        }
+        (field == Datum::kDataShapeFieldNumber ? data_shape_ : label_shape_)
+            .MergeFrom(shape);
+      } else if (field == Datum::kDataFieldNumber) {
+        data_ = p;
+        data_size_ = value;
+      } else if (field == Datum::kLabelFieldNumber) {
+        label_ = p;
+        label_size_ = value;
+      }
+      p += value;
+      break;
+    case kFixed64:
+      if (end - p < 8) {
+        return false;
+      }
+      p += 8;
+      break;
+    case kFixed32:
+      if (end - p < 4) {
+        return false;
+      }
+      p += 4;
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DatumView::ParseOwned(string* buffer) {
+  buffer_.swap(*buffer);
+  return Parse(buffer_.data(), buffer_.size());
+}
+
+void DatumView::Reset(const Datum& datum) {
+  data_shape_.CopyFrom(datum.data_shape());
+  label_shape_.CopyFrom(datum.label_shape());
+  data_ = datum.data().data();
+  data_size_ = datum.data().size();
+  label_ = datum.label().data();
+  label_size_ = datum.label().size();
+  encoded_ = datum.encoded();
+}
+
+}  // namespace caffe
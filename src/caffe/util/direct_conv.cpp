@@ -0,0 +1,220 @@
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/direct_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Output columns [*begin, *end) read input column ow * stride + offset inside
+// [0, width).
+static inline void valid_range(const int offset, const int stride,
+    const int width, const int output_w, int* begin, int* end) {
+  *begin = offset >= 0 ? 0 : (stride - 1 - offset) / stride;
+  *end = width - 1 - offset >= 0 ?
+      std::min(output_w, (width - 1 - offset) / stride + 1) : 0;
+  *begin = std::min(*begin, *end);
+}
+
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* data_im, const int num, const int channels,
+    const int height, const int width, const Dtype* weights, const Dtype* bias,
+    const int num_output, const int group, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_out) {
+  const int in_group = channels / group;
+  const int out_group = num_output / group;
+  const int output_h =
+      (height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w =
+      (width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  // One output plane per task, accumulated one input row at a time so that
+  // the rows stay in cache over the kernel columns.
+  ParallelFor(num * num_output, [&](int begin, int end) {
+    for (int task = begin; task < end; ++task) {
+      const int n = task / num_output;
+      const int o = task % num_output;
+      const int gr = o / out_group;
+      Dtype* out = data_out + task * output_h * output_w;
+      caffe_set(output_h * output_w, bias ? bias[o] : Dtype(0), out);
+      for (int ic = 0; ic < in_group; ++ic) {
+        const Dtype* im = data_im +
+            (n * channels + gr * in_group + ic) * height * width;
+        const Dtype* filter =
+            weights + (o * in_group + ic) * kernel_h * kernel_w;
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          for (int oh = 0; oh < output_h; ++oh) {
+            const int h = oh * stride_h - pad_h + kh * dilation_h;
+            if (h < 0 || h >= height) {
+              continue;
+            }
+            const Dtype* in_row = im + h * width;
+            Dtype* out_row = out + oh * output_w;
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              const Dtype w = filter[kh * kernel_w + kw];
+              const int offset = kw * dilation_w - pad_w;
+              int ow_begin, ow_end;
+              valid_range(offset, stride_w, width, output_w, &ow_begin,
+                  &ow_end);
+              if (stride_w == 1) {
+                const Dtype* in = in_row + offset;
+                for (int ow = ow_begin; ow < ow_end; ++ow) {
+                  out_row[ow] += w * in[ow];
+                }
+              } else {
+                for (int ow = ow_begin; ow < ow_end; ++ow) {
+                  out_row[ow] += w * in_row[ow * stride_w + offset];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+template <typename Dtype>
+void direct_conv_backward_data_cpu(const Dtype* diff_out, const int num,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* diff_im) {
+  const int in_group = channels / group;
+  const int out_group = num_output / group;
+  const int output_h =
+      (height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w =
+      (width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  // One input plane per task gathers from the outputs of its group, so no two
+  // tasks write the same values.
+  ParallelFor(num * channels, [&](int begin, int end) {
+    for (int task = begin; task < end; ++task) {
+      const int n = task / channels;
+      const int c = task % channels;
+      const int gr = c / in_group;
+      const int ic = c % in_group;
+      Dtype* im = diff_im + task * height * width;
+      caffe_set(height * width, Dtype(0), im);
+      for (int oc = 0; oc < out_group; ++oc) {
+        const int o = gr * out_group + oc;
+        const Dtype* out =
+            diff_out + (n * num_output + o) * output_h * output_w;
+        const Dtype* filter =
+            weights + (o * in_group + ic) * kernel_h * kernel_w;
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          for (int oh = 0; oh < output_h; ++oh) {
+            const int h = oh * stride_h - pad_h + kh * dilation_h;
+            if (h < 0 || h >= height) {
+              continue;
+            }
+            Dtype* in_row = im + h * width;
+            const Dtype* out_row = out + oh * output_w;
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              const Dtype w = filter[kh * kernel_w + kw];
+              const int offset = kw * dilation_w - pad_w;
+              int ow_begin, ow_end;
+              valid_range(offset, stride_w, width, output_w, &ow_begin,
+                  &ow_end);
+              for (int ow = ow_begin; ow < ow_end; ++ow) {
+                in_row[ow * stride_w + offset] += w * out_row[ow];
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+template <typename Dtype>
+void direct_conv_backward_weights_cpu(const Dtype* data_im,
+    const Dtype* diff_out, const int num, const int channels,
+    const int height, const int width, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* diff_weights) {
+  const int in_group = channels / group;
+  const int out_group = num_output / group;
+  const int output_h =
+      (height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w =
+      (width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  // One filter per task, summed over the images in order.
+  ParallelFor(num_output * in_group, [&](int begin, int end) {
+    for (int task = begin; task < end; ++task) {
+      const int o = task / in_group;
+      const int ic = task % in_group;
+      const int c = (o / out_group) * in_group + ic;
+      Dtype* filter_diff = diff_weights + task * kernel_h * kernel_w;
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const int offset = kw * dilation_w - pad_w;
+          int ow_begin, ow_end;
+          valid_range(offset, stride_w, width, output_w, &ow_begin, &ow_end);
+          Dtype sum = 0;
+          for (int n = 0; n < num; ++n) {
+            const Dtype* im = data_im + (n * channels + c) * height * width;
+            const Dtype* out =
+                diff_out + (n * num_output + o) * output_h * output_w;
+            for (int oh = 0; oh < output_h; ++oh) {
+              const int h = oh * stride_h - pad_h + kh * dilation_h;
+              if (h < 0 || h >= height) {
+                continue;
+              }
+              const Dtype* in_row = im + h * width;
+              const Dtype* out_row = out + oh * output_w;
+              for (int ow = ow_begin; ow < ow_end; ++ow) {
+                sum += out_row[ow] * in_row[ow * stride_w + offset];
+              }
+            }
+          }
+          filter_diff[kh * kernel_w + kw] += sum;
+        }
+      }
+    }
+  });
+}
+
+// Explicit instantiation
+template void direct_conv_cpu<float>(const float* data_im, const int num,
+    const int channels, const int height, const int width,
+    const float* weights, const float* bias, const int num_output,
+    const int group, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, float* data_out);
+template void direct_conv_cpu<double>(const double* data_im, const int num,
+    const int channels, const int height, const int width,
+    const double* weights, const double* bias, const int num_output,
+    const int group, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, double* data_out);
+template void direct_conv_backward_data_cpu<float>(const float* diff_out,
+    const int num, const int channels, const int height, const int width,
+    const float* weights, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* diff_im);
+template void direct_conv_backward_data_cpu<double>(const double* diff_out,
+    const int num, const int channels, const int height, const int width,
+    const double* weights, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* diff_im);
+template void direct_conv_backward_weights_cpu<float>(const float* data_im,
+    const float* diff_out, const int num, const int channels,
+    const int height, const int width, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* diff_weights);
+template void direct_conv_backward_weights_cpu<double>(const double* data_im,
+    const double* diff_out, const int num, const int channels,
+    const int height, const int width, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* diff_weights);
+
+}  // namespace caffe
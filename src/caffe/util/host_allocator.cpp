@@ -0,0 +1,280 @@
+#include <boost/thread.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+// Cached sizes are powers of two, from 2^kMinClass to 2^kMaxClass bytes.
+static const int kMinClass = 6;
+static const int kMaxClass = 26;
+// Each thread keeps up to kThreadCacheBlocks blocks of each class up to
+// 2^kMaxThreadClass bytes.
+static const int kMaxThreadClass = 20;
+static const int kThreadCacheBlocks = 4;
+static const size_t kAlignment = 64;
+static const size_t kHugePageSize = 2 << 20;
+static const size_t kDefaultCacheLimit = static_cast<size_t>(1) << 30;
+
+// The size class of size, or -1 if it is too large to be cached.
+static int SizeClass(size_t size) {
+  int cls = kMinClass;
+  while (cls <= kMaxClass && (static_cast<size_t>(1) << cls) < size) {
+    ++cls;
+  }
+  return cls <= kMaxClass ? cls : -1;
+}
+
+static void* SystemAllocate(size_t size) {
+  const size_t alignment = size >= kHugePageSize ? kHugePageSize : kAlignment;
+  void* ptr = NULL;
+#ifdef _MSC_VER
+  ptr = _aligned_malloc(size, alignment);
+#else
+  if (posix_memalign(&ptr, alignment, size) != 0) {
+    ptr = NULL;
+  }
+#endif
+  CHECK(ptr) << "host allocation of size " << size << " failed";
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (size >= kHugePageSize) {
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+// The free lists of the calling thread: those of its NUMA node, plus 1, or
+// 0 if it is not bound to one.
+static int ThreadSlot() {
+  return NumaNodeOfThread() + 1;
+}
+
+// Cached blocks are followed by the slot of the thread that allocated them
+// from the system, and so placed them, which they are freed to.
+static int* BlockSlot(void* ptr, int cls) {
+  return reinterpret_cast<int*>(
+      static_cast<char*>(ptr) + (static_cast<size_t>(1) << cls));
+}
+
+static void SystemFree(void* ptr) {
+#ifdef _MSC_VER
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+class HostAllocator::sync {
+ public:
+  // Guards the shared free lists.
+  boost::mutex mutex_;
+  boost::thread_specific_ptr<ThreadCache> thread_cache_;
+  std::atomic<size_t> cache_limit_;
+  std::atomic<size_t> bytes_in_use_;
+  std::atomic<size_t> bytes_cached_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+struct HostAllocator::ThreadCache {
+  explicit ThreadCache(HostAllocator* allocator)
+      : allocator(allocator), blocks(kMaxThreadClass + 1) {}
+  // Hands the blocks over to the shared free lists when the thread exits.
+  // They were all placed on the node of the thread.
+  ~ThreadCache() {
+    for (int cls = 0; cls < blocks.size(); ++cls) {
+      for (int i = 0; i < blocks[cls].size(); ++i) {
+        allocator->sync_->bytes_cached_ -= static_cast<size_t>(1) << cls;
+        allocator->FreeShared(blocks[cls][i], cls);
+      }
+    }
+  }
+
+  HostAllocator* allocator;
+  // The cached blocks, by size class.
+  vector<vector<void*> > blocks;
+};
+
+static HostAllocator* global_allocator_ = NULL;
+static boost::once_flag global_allocator_once_ = BOOST_ONCE_INIT;
+
+HostAllocator& HostAllocator::Global() {
+  // Never destroyed, as memory may be freed until the process exits.
+  boost::call_once(global_allocator_once_, [] {
+    global_allocator_ = new HostAllocator();
+  });
+  return *global_allocator_;
+}
+
+HostAllocator::HostAllocator()
+    : sync_(new sync()) {
+  sync_->cache_limit_ = kDefaultCacheLimit;
+  sync_->bytes_in_use_ = 0;
+  sync_->bytes_cached_ = 0;
+  sync_->hits_ = 0;
+  sync_->misses_ = 0;
+}
+
+HostAllocator::ThreadCache* HostAllocator::thread_cache() {
+  ThreadCache* cache = sync_->thread_cache_.get();
+  if (!cache) {
+    cache = new ThreadCache(this);
+    sync_->thread_cache_.reset(cache);
+  }
+  return cache;
+}
+
+vector<vector<void*> >& HostAllocator::shared_free_lists(int slot) {
+  if (slot >= free_lists_.size()) {
+    free_lists_.resize(slot + 1, vector<vector<void*> >(kMaxClass + 1));
+  }
+  return free_lists_[slot];
+}
+
+void* HostAllocator::Allocate(size_t size) {
+  const int cls = SizeClass(size);
+  if (cls < 0) {
+    sync_->bytes_in_use_ += size;
+    ++sync_->misses_;
+    return SystemAllocate(size);
+  }
+  const size_t block_size = static_cast<size_t>(1) << cls;
+  sync_->bytes_in_use_ += block_size;
+  void* ptr = NULL;
+  if (cls <= kMaxThreadClass) {
+    vector<void*>& blocks = thread_cache()->blocks[cls];
+    if (!blocks.empty()) {
+      ptr = blocks.back();
+      blocks.pop_back();
+    }
+  }
+  if (!ptr) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    vector<void*>& free_list = shared_free_lists(ThreadSlot())[cls];
+    if (!free_list.empty()) {
+      ptr = free_list.back();
+      free_list.pop_back();
+    }
+  }
+  if (ptr) {
+    sync_->bytes_cached_ -= block_size;
+    ++sync_->hits_;
+    return ptr;
+  }
+  ++sync_->misses_;
+  ptr = SystemAllocate(block_size + sizeof(int));
+  *BlockSlot(ptr, cls) = ThreadSlot();
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr, size_t size) {
+  if (!ptr) { return; }
+  const int cls = SizeClass(size);
+  if (cls < 0) {
+    sync_->bytes_in_use_ -= size;
+    SystemFree(ptr);
+    return;
+  }
+  const size_t block_size = static_cast<size_t>(1) << cls;
+  sync_->bytes_in_use_ -= block_size;
+  // The thread caches only blocks of its node.
+  if (cls <= kMaxThreadClass && *BlockSlot(ptr, cls) == ThreadSlot() &&
+      sync_->bytes_cached_ + block_size <= sync_->cache_limit_) {
+    vector<void*>& blocks = thread_cache()->blocks[cls];
+    if (blocks.size() < kThreadCacheBlocks) {
+      blocks.push_back(ptr);
+      sync_->bytes_cached_ += block_size;
+      return;
+    }
+  }
+  FreeShared(ptr, cls);
+}
+
+void HostAllocator::FreeShared(void* ptr, int cls) {
+  const size_t block_size = static_cast<size_t>(1) << cls;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    if (sync_->bytes_cached_ + block_size <= sync_->cache_limit_) {
+      shared_free_lists(*BlockSlot(ptr, cls))[cls].push_back(ptr);
+      sync_->bytes_cached_ += block_size;
+      return;
+    }
+  }
+  SystemFree(ptr);
+}
+
+void HostAllocator::ReleaseCachedMemory() {
+  vector<void*> released;
+  ThreadCache* cache = sync_->thread_cache_.get();
+  if (cache) {
+    for (int cls = 0; cls < cache->blocks.size(); ++cls) {
+      for (int i = 0; i < cache->blocks[cls].size(); ++i) {
+        released.push_back(cache->blocks[cls][i]);
+        sync_->bytes_cached_ -= static_cast<size_t>(1) << cls;
+      }
+      cache->blocks[cls].clear();
+    }
+  }
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    for (int slot = 0; slot < free_lists_.size(); ++slot) {
+      for (int cls = 0; cls < free_lists_[slot].size(); ++cls) {
+        vector<void*>& free_list = free_lists_[slot][cls];
+        for (int i = 0; i < free_list.size(); ++i) {
+          released.push_back(free_list[i]);
+          sync_->bytes_cached_ -= static_cast<size_t>(1) << cls;
+        }
+        free_list.clear();
+      }
+    }
+  }
+  for (int i = 0; i < released.size(); ++i) {
+    SystemFree(released[i]);
+  }
+}
+
+void HostAllocator::set_cache_limit(size_t bytes) {
+  sync_->cache_limit_ = bytes;
+  if (sync_->bytes_cached_ > bytes) {
+    ReleaseCachedMemory();
+  }
+}
+
+size_t HostAllocator::cache_limit() const {
+  return sync_->cache_limit_;
+}
+
+size_t HostAllocator::bytes_in_use() const {
+  return sync_->bytes_in_use_;
+}
+
+size_t HostAllocator::bytes_cached() const {
+  return sync_->bytes_cached_;
+}
+
+uint64_t HostAllocator::hits() const {
+  return sync_->hits_;
+}
+
+uint64_t HostAllocator::misses() const {
+  return sync_->misses_;
+}
+
+float HostAllocator::hit_rate() const {
+  const uint64_t hits = sync_->hits_;
+  const uint64_t total = hits + sync_->misses_;
+  return total ? static_cast<float>(hits) / total : 0.f;
+}
+
+}  // namespace caffe
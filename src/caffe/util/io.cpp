@@ -78,6 +78,13 @@ namespace caffe {
 		CHECK(proto.SerializeToOstream(&output));
 	}
 
+	void RenameFileOver(const string& temp_filename, const string& filename) {
+		boost::system::error_code error;
+		boost::filesystem::rename(temp_filename, filename, error);
+		CHECK(!error) << "Cannot rename " << temp_filename << " to " << filename
+			<< ": " << error.message();
+	}
+
 #ifdef USE_OPENCV
 	cv::Mat ReadImageToCVMat(const string& filename,
 		const int height, const int width, const bool is_color) {
@@ -345,6 +352,25 @@ namespace caffe {
 		}
 		return cv_img;
 	}
+	// The encoded bytes of a view are decoded where they are, without the
+	// copy to a vector.
+	static cv::Mat DecodeDatumViewToCVMat(const DatumView& datum, int flag) {
+		CHECK(datum.encoded()) << "Datum not encoded";
+		const cv::Mat buffer(1, static_cast<int>(datum.data_size()), CV_8UC1,
+			const_cast<char*>(datum.data()));
+		cv::Mat cv_img = cv::imdecode(buffer, flag);
+		if (!cv_img.data) {
+			LOG(ERROR) << "Could not decode datum ";
+		}
+		return cv_img;
+	}
+	cv::Mat DecodeDatumToCVMatNative(const DatumView& datum) {
+		return DecodeDatumViewToCVMat(datum, -1);
+	}
+	cv::Mat DecodeDatumToCVMat(const DatumView& datum, bool is_color) {
+		return DecodeDatumViewToCVMat(datum, is_color ? CV_LOAD_IMAGE_COLOR :
+			CV_LOAD_IMAGE_GRAYSCALE);
+	}
 
 	// If Datum is encoded will decoded using DecodeDatumToCVMat and CVMatToDatum
 	// If Datum is not encoded will do nothing
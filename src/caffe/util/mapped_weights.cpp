@@ -0,0 +1,119 @@
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+namespace caffe {
+
+using boost::interprocess::copy_on_write;
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_only;
+
+static const char kMappedWeightsMagic[8] =
+    {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'P'};
+static const uint32_t kMappedWeightsVersion = 1;
+
+// Pads the file with zeros up to the next multiple of the alignment.
+static uint64_t AlignOutput(std::ofstream* output) {
+  const uint64_t offset = output->tellp();
+  const uint64_t aligned = (offset + kMappedWeightsAlignment - 1) /
+      kMappedWeightsAlignment * kMappedWeightsAlignment;
+  const char zeros[kMappedWeightsAlignment] = {0};
+  output->write(zeros, aligned - offset);
+  return aligned;
+}
+
+void WriteMappedWeights(const NetParameter& param, const string& filename) {
+  // Nets may map the file being replaced, which must not change under them.
+  const string temp_filename = filename + ".tmp";
+  std::ofstream output(temp_filename.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  CHECK(output) << "Cannot open " << temp_filename;
+  MappedWeightsHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMappedWeightsMagic, sizeof(header.magic));
+  header.version = kMappedWeightsVersion;
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  MappedWeightsIndex index;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    if (layer.blobs_size() == 0) { continue; }
+    MappedWeightsIndex_Layer* index_layer = index.add_layer();
+    index_layer->set_name(layer.name());
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      MappedWeightsIndex_Blob* index_blob = index_layer->add_blobs();
+      if (blob.has_shape()) {
+        index_blob->mutable_shape()->CopyFrom(blob.shape());
+      } else {
+        // Legacy 4D blobs.
+        index_blob->mutable_shape()->add_dim(blob.num());
+        index_blob->mutable_shape()->add_dim(blob.channels());
+        index_blob->mutable_shape()->add_dim(blob.height());
+        index_blob->mutable_shape()->add_dim(blob.width());
+      }
+      index_blob->set_offset(AlignOutput(&output));
+      index_blob->set_double_data(blob.double_data_size() > 0);
+      if (index_blob->double_data()) {
+        output.write(reinterpret_cast<const char*>(blob.double_data().data()),
+            blob.double_data_size() * sizeof(double));
+      } else {
+        output.write(reinterpret_cast<const char*>(blob.data().data()),
+            blob.data_size() * sizeof(float));
+      }
+    }
+  }
+  string serialized;
+  index.SerializeToString(&serialized);
+  header.index_offset = AlignOutput(&output);
+  header.index_size = serialized.size();
+  output.write(serialized.data(), serialized.size());
+  output.seekp(0);
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.close();
+  CHECK(output) << "Error writing " << temp_filename;
+  RenameFileOver(temp_filename, filename);
+}
+
+bool IsMappedWeightsFile(const string& filename) {
+  const string extension = ".caffeweights";
+  return filename.size() >= extension.size() &&
+      filename.compare(filename.size() - extension.size(), extension.size(),
+          extension) == 0;
+}
+
+MappedWeights::MappedWeights(const string& filename)
+    : filename_(filename), file_(filename.c_str(), read_only),
+      region_(file_, copy_on_write) {
+  CHECK_GE(region_.get_size(), sizeof(MappedWeightsHeader))
+      << "Not a mapped weights file: " << filename;
+  const MappedWeightsHeader* header =
+      static_cast<const MappedWeightsHeader*>(region_.get_address());
+  CHECK_EQ(memcmp(header->magic, kMappedWeightsMagic, sizeof(header->magic)),
+      0) << "Not a mapped weights file: " << filename;
+  CHECK_EQ(header->version, kMappedWeightsVersion)
+      << "Unsupported mapped weights version in " << filename;
+  CHECK_LE(header->index_offset + header->index_size, region_.get_size())
+      << "Truncated mapped weights file: " << filename;
+  CHECK(index_.ParseFromArray(
+      static_cast<const char*>(region_.get_address()) + header->index_offset,
+      header->index_size)) << "Corrupt mapped weights index in " << filename;
+}
+
+void* MappedWeights::data(const MappedWeightsIndex_Blob& blob) {
+  uint64_t count = 1;
+  for (int i = 0; i < blob.shape().dim_size(); ++i) {
+    count *= blob.shape().dim(i);
+  }
+  const uint64_t bytes = count *
+      (blob.double_data() ? sizeof(double) : sizeof(float));
+  CHECK_LE(blob.offset() + bytes, region_.get_size())
+      << "Truncated mapped weights file: " << filename_;
+  return static_cast<char*>(region_.get_address()) + blob.offset();
+}
+
+}  // namespace caffe
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/memory_planner.hpp"
+
+namespace caffe {
+
+int MemoryPlanner::AddBuffer(size_t size, int begin, int end) {
+  CHECK_LE(begin, end);
+  Buffer buffer;
+  buffer.size = size;
+  buffer.begin = begin;
+  buffer.end = end;
+  buffer.slab = -1;
+  buffers_.push_back(buffer);
+  return buffers_.size() - 1;
+}
+
+void MemoryPlanner::Plan() {
+  slab_sizes_.clear();
+  vector<pair<int, int> > order;
+  for (int i = 0; i < buffers_.size(); ++i) {
+    order.push_back(make_pair(buffers_[i].begin, i));
+  }
+  std::sort(order.begin(), order.end());
+  // (end, slab) of the buffers placed so far and still holding their slab.
+  vector<pair<int, int> > live;
+  vector<int> free_slabs;
+  for (int i = 0; i < order.size(); ++i) {
+    Buffer& buffer = buffers_[order[i].second];
+    for (int j = 0; j < live.size(); ) {
+      if (live[j].first < buffer.begin) {
+        free_slabs.push_back(live[j].second);
+        live[j] = live.back();
+        live.pop_back();
+      } else {
+        ++j;
+      }
+    }
+    int best = -1;
+    for (int j = 0; j < free_slabs.size(); ++j) {
+      const size_t size = slab_sizes_[free_slabs[j]];
+      if (best < 0) {
+        best = j;
+        continue;
+      }
+      const size_t best_size = slab_sizes_[free_slabs[best]];
+      const bool fits = size >= buffer.size;
+      const bool best_fits = best_size >= buffer.size;
+      // The smallest slab that fits, otherwise the largest one.
+      if ((fits && (!best_fits || size < best_size)) ||
+          (!fits && !best_fits && size > best_size)) {
+        best = j;
+      }
+    }
+    if (best >= 0) {
+      buffer.slab = free_slabs[best];
+      free_slabs.erase(free_slabs.begin() + best);
+      slab_sizes_[buffer.slab] = std::max(slab_sizes_[buffer.slab],
+          buffer.size);
+    } else {
+      buffer.slab = slab_sizes_.size();
+      slab_sizes_.push_back(buffer.size);
+    }
+    live.push_back(make_pair(buffer.end, buffer.slab));
+  }
+}
+
+size_t MemoryPlanner::buffer_bytes() const {
+  size_t bytes = 0;
+  for (int i = 0; i < buffers_.size(); ++i) {
+    bytes += buffers_[i].size;
+  }
+  return bytes;
+}
+
+size_t MemoryPlanner::slab_bytes() const {
+  size_t bytes = 0;
+  for (int i = 0; i < slab_sizes_.size(); ++i) {
+    bytes += slab_sizes_[i];
+  }
+  return bytes;
+}
+
+}  // namespace caffe
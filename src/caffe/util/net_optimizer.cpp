@@ -0,0 +1,193 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/net_optimizer.hpp"
+
+namespace caffe {
+
+// The values of a blob, whether stored as floats or doubles.
+static vector<double> BlobValues(const BlobProto& blob) {
+  if (blob.double_data_size() > 0) {
+    return vector<double>(blob.double_data().begin(),
+        blob.double_data().end());
+  }
+  return vector<double>(blob.data().begin(), blob.data().end());
+}
+
+static void SetBlobValues(const vector<double>& values, bool as_double,
+    BlobProto* blob) {
+  blob->clear_data();
+  blob->clear_double_data();
+  for (int i = 0; i < values.size(); ++i) {
+    if (as_double) {
+      blob->add_double_data(values[i]);
+    } else {
+      blob->add_data(static_cast<float>(values[i]));
+    }
+  }
+}
+
+// The number of output channels of a layer whose weights and bias can absorb
+// a per channel affine transform of its top, or 0.
+static int FoldableChannels(const LayerParameter& layer) {
+  if (layer.bottom_size() != 1 || layer.top_size() != 1 ||
+      layer.blobs_size() == 0 || layer.blobs_size() > 2) {
+    return 0;
+  }
+  // Changing shared weights would change the layers sharing them.
+  for (int i = 0; i < layer.param_size(); ++i) {
+    if (layer.param(i).name().size() > 0) { return 0; }
+  }
+  int channels = 0;
+  if (layer.type() == "Convolution") {
+    if (layer.convolution_param().axis() != 1) { return 0; }
+    channels = layer.convolution_param().num_output();
+  } else if (layer.type() == "InnerProduct") {
+    if (layer.inner_product_param().axis() != 1) { return 0; }
+    channels = layer.inner_product_param().num_output();
+  }
+  if (channels == 0 || BlobValues(layer.blobs(0)).size() % channels != 0 ||
+      (layer.blobs_size() == 2 &&
+       BlobValues(layer.blobs(1)).size() != channels)) {
+    return 0;
+  }
+  return channels;
+}
+
+// Turns layer into y = scale * x + shift over the channels of x, or returns
+// false if it is not such a transform.
+static bool ChannelTransform(const LayerParameter& layer, Phase phase,
+    int channels, vector<double>* scale, vector<double>* shift) {
+  if (layer.bottom_size() != 1 || layer.top_size() != 1) { return false; }
+  if (layer.type() == "BatchNorm") {
+    const BatchNormParameter& batch_norm_param = layer.batch_norm_param();
+    const bool use_global_stats = batch_norm_param.has_use_global_stats() ?
+        batch_norm_param.use_global_stats() : phase == TEST;
+    if (!use_global_stats || layer.blobs_size() != 3) { return false; }
+    const vector<double> mean = BlobValues(layer.blobs(0));
+    const vector<double> variance = BlobValues(layer.blobs(1));
+    const vector<double> factor = BlobValues(layer.blobs(2));
+    if (mean.size() != channels || variance.size() != channels ||
+        factor.size() != 1) {
+      return false;
+    }
+    // The statistics are sums weighted by the moving average factor, as in
+    // BatchNormLayer::Forward_cpu.
+    const double normalizer = factor[0] == 0 ? 0 : 1 / factor[0];
+    scale->resize(channels);
+    shift->resize(channels);
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = 1 / std::sqrt(variance[c] * normalizer +
+          batch_norm_param.eps());
+      (*shift)[c] = -mean[c] * normalizer * (*scale)[c];
+    }
+    return true;
+  }
+  if (layer.type() == "Scale") {
+    const ScaleParameter& scale_param = layer.scale_param();
+    if (scale_param.axis() != 1 || scale_param.num_axes() != 1 ||
+        layer.blobs_size() != (scale_param.bias_term() ? 2 : 1)) {
+      return false;
+    }
+    *scale = BlobValues(layer.blobs(0));
+    *shift = scale_param.bias_term() ? BlobValues(layer.blobs(1)) :
+        vector<double>(channels, 0);
+    return scale->size() == channels && shift->size() == channels;
+  }
+  if (layer.type() == "Bias") {
+    const BiasParameter& bias_param = layer.bias_param();
+    if (bias_param.axis() != 1 || bias_param.num_axes() != 1 ||
+        layer.blobs_size() != 1) {
+      return false;
+    }
+    scale->assign(channels, 1);
+    *shift = BlobValues(layer.blobs(0));
+    return shift->size() == channels;
+  }
+  return false;
+}
+
+int FoldBatchNorm(const NetParameter& param, NetParameter* folded) {
+  map<string, int> num_readers;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).bottom_size(); ++j) {
+      ++num_readers[param.layer(i).bottom(j)];
+    }
+  }
+  folded->CopyFrom(param);
+  folded->clear_layer();
+  int num_folded = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& producer = param.layer(i);
+    LayerParameter* layer = folded->add_layer();
+    layer->CopyFrom(producer);
+    const int channels = FoldableChannels(producer);
+    if (channels == 0) { continue; }
+    // The transform of all the layers folded so far.
+    vector<double> scale(channels, 1);
+    vector<double> shift(channels, 0);
+    string top = producer.top(0);
+    string names;
+    int end = i + 1;
+    for (; end < param.layer_size(); ++end) {
+      const LayerParameter& next = param.layer(end);
+      if (next.bottom_size() != 1 || next.bottom(0) != top ||
+          next.top_size() != 1 || next.top(0) == producer.bottom(0)) {
+        break;
+      }
+      // Other readers of a top that is not overwritten in place would see
+      // the folded values.
+      if (next.top(0) != top && num_readers[top] != 1) { break; }
+      const Phase phase = next.has_phase() ? next.phase() :
+          param.state().phase();
+      vector<double> next_scale, next_shift;
+      if (!ChannelTransform(next, phase, channels, &next_scale,
+          &next_shift)) {
+        break;
+      }
+      for (int c = 0; c < channels; ++c) {
+        scale[c] *= next_scale[c];
+        shift[c] = next_scale[c] * shift[c] + next_shift[c];
+      }
+      top = next.top(0);
+      names += (names.empty() ? "" : ", ") + next.name();
+    }
+    if (end == i + 1) { continue; }
+
+    const bool as_double = producer.blobs(0).double_data_size() > 0;
+    vector<double> weights = BlobValues(producer.blobs(0));
+    // Transposed inner product weights hold one output per column.
+    const bool transpose = producer.type() == "InnerProduct" &&
+        producer.inner_product_param().transpose();
+    const int dim = weights.size() / channels;
+    for (int k = 0; k < weights.size(); ++k) {
+      weights[k] *= scale[transpose ? k % channels : k / dim];
+    }
+    SetBlobValues(weights, as_double, layer->mutable_blobs(0));
+    vector<double> bias(channels, 0);
+    if (producer.blobs_size() == 2) {
+      bias = BlobValues(producer.blobs(1));
+    } else {
+      layer->add_blobs()->mutable_shape()->add_dim(channels);
+      if (producer.type() == "Convolution") {
+        layer->mutable_convolution_param()->set_bias_term(true);
+      } else {
+        layer->mutable_inner_product_param()->set_bias_term(true);
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      bias[c] = scale[c] * bias[c] + shift[c];
+    }
+    SetBlobValues(bias, as_double, layer->mutable_blobs(1));
+    layer->set_top(0, top);
+    LOG(INFO) << "Folding " << names << " into " << producer.name();
+    num_folded += end - i - 1;
+    i = end - 1;
+  }
+  return num_folded;
+}
+
+}  // namespace caffe
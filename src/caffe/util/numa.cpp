@@ -0,0 +1,167 @@
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#elif defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+NumaPlacement NumaPlacementFromString(const string& placement) {
+  if (placement == "none") {
+    return NUMA_NONE;
+  } else if (placement == "bind") {
+    return NUMA_BIND;
+  } else if (placement == "replicate") {
+    return NUMA_REPLICATE;
+  }
+  LOG(FATAL) << "Unknown NUMA placement " << placement
+      << ", expected none, bind or replicate.";
+  return NUMA_NONE;
+}
+
+#ifdef __linux__
+// Reads a sysfs list such as "0-3,8,10-11".
+static vector<int> ReadSysfsList(const string& path) {
+  vector<int> values;
+  std::ifstream file(path.c_str());
+  string list;
+  if (!(file >> list)) {
+    return values;
+  }
+  std::istringstream ranges(list);
+  string range;
+  while (std::getline(ranges, range, ',')) {
+    const size_t dash = range.find('-');
+    const int first = atoi(range.c_str());
+    const int last = dash == string::npos ? first :
+        atoi(range.c_str() + dash + 1);
+    for (int value = first; value <= last; ++value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+#endif
+
+int NumaNodeCount() {
+#ifdef _MSC_VER
+  ULONG highest = 0;
+  return GetNumaHighestNodeNumber(&highest) ? highest + 1 : 1;
+#elif defined(__linux__)
+  const vector<int> nodes = ReadSysfsList("/sys/devices/system/node/online");
+  return nodes.empty() ? 1 : nodes.back() + 1;
+#else
+  return 1;
+#endif
+}
+
+vector<int> NumaNodeCpus(int node) {
+  vector<int> cpus;
+#ifdef _MSC_VER
+  ULONGLONG mask = 0;
+  if (GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+    for (int cpu = 0; cpu < 64; ++cpu) {
+      if (mask & (1ULL << cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#elif defined(__linux__)
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  cpus = ReadSysfsList(path.str());
+#endif
+  // Without a topology, the one node has every CPU.
+  if (cpus.empty() && node == 0 && NumaNodeCount() == 1) {
+    for (int cpu = 0; cpu < boost::thread::hardware_concurrency(); ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+static boost::thread_specific_ptr<int> thread_node_;
+
+bool BindThreadToNumaNode(int node) {
+  const vector<int> cpus = NumaNodeCpus(node);
+  if (cpus.empty()) {
+    return false;
+  }
+#ifdef _MSC_VER
+  DWORD_PTR mask = 0;
+  for (int i = 0; i < cpus.size(); ++i) {
+    if (cpus[i] < 8 * sizeof(mask)) {
+      mask |= static_cast<DWORD_PTR>(1) << cpus[i];
+    }
+  }
+  // Windows then allocates the pages a thread first touches on its node.
+  if (!SetThreadAffinityMask(GetCurrentThread(), mask)) {
+    return false;
+  }
+#elif defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int i = 0; i < cpus.size(); ++i) {
+    CPU_SET(cpus[i], &cpu_set);
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return false;
+  }
+  // Prefer the node for the pages the thread first touches, without libnuma.
+  const int kBits = 8 * sizeof(unsigned long);  // NOLINT(runtime/int)
+  vector<unsigned long> nodes(node / kBits + 1, 0);  // NOLINT(runtime/int)
+  nodes[node / kBits] |= 1UL << (node % kBits);
+  if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodes[0],
+      nodes.size() * kBits + 1) != 0) {
+    return false;
+  }
+#else
+  return false;
+#endif
+  thread_node_.reset(new int(node));
+  return true;
+}
+
+int NumaNodeOfThread() {
+  const int* node = thread_node_.get();
+  return node ? *node : -1;
+}
+
+string NumaTopologyString() {
+  const int num_nodes = NumaNodeCount();
+  std::ostringstream topology;
+  topology << num_nodes << (num_nodes == 1 ? " node:" : " nodes:");
+  for (int node = 0; node < num_nodes; ++node) {
+    const vector<int> cpus = NumaNodeCpus(node);
+    topology << " " << node << " [";
+    for (int i = 0; i < cpus.size(); ++i) {
+      int last = i;
+      while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+        ++last;
+      }
+      topology << (i ? "," : "") << cpus[i];
+      if (last > i) {
+        topology << "-" << cpus[last];
+      }
+      i = last;
+    }
+    topology << "]";
+  }
+  return topology.str();
+}
+
+}  // namespace caffe
@@ -0,0 +1,86 @@
+#include <boost/thread.hpp>
+
+#include "caffe/util/ordered_worker.hpp"
+
+namespace caffe {
+
+class OrderedWorker::sync {
+ public:
+  boost::mutex mutex_;
+  // Signaled when a task is queued or the worker stops.
+  boost::condition_variable queued_;
+  // Signaled when a task completes.
+  boost::condition_variable done_;
+};
+
+OrderedWorker::OrderedWorker(int max_pending)
+    : max_pending_(max_pending),
+      reserved_(0),
+      pending_(0),
+      must_stop_(false),
+      sync_(new sync()) {
+  CHECK_GE(max_pending, 0);
+  thread_.reset(new boost::thread(&OrderedWorker::Entry, this));
+}
+
+OrderedWorker::~OrderedWorker() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    must_stop_ = true;
+  }
+  sync_->queued_.notify_one();
+  thread_->join();
+}
+
+bool OrderedWorker::Reserve(bool wait) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (max_pending_ == 0) {
+    return true;
+  }
+  while (reserved_ + pending_ >= max_pending_) {
+    if (!wait) {
+      return false;
+    }
+    sync_->done_.wait(lock);
+  }
+  ++reserved_;
+  return true;
+}
+
+void OrderedWorker::Push(const boost::function<void()>& task) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (reserved_ > 0) {
+    --reserved_;
+  }
+  tasks_.push_back(task);
+  ++pending_;
+  sync_->queued_.notify_one();
+}
+
+void OrderedWorker::Flush() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (pending_ > 0) {
+    sync_->done_.wait(lock);
+  }
+}
+
+void OrderedWorker::Entry() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!must_stop_ && tasks_.empty()) {
+      sync_->queued_.wait(lock);
+    }
+    if (tasks_.empty()) {
+      return;
+    }
+    const boost::function<void()> task = tasks_.front();
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+    --pending_;
+    sync_->done_.notify_all();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Floating point operations of the forward pass of the layers with a known
+// cost, the bias excluded.
+template <typename Dtype>
+static double ForwardFlops(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const string type = layer->type();
+  double flops = 0;
+  if (type == "Convolution" || type == "Deconvolution" ||
+      type == "InnerProduct") {
+    // Each output of a convolution or inner product takes a dot product with
+    // a row of the weights, and each input of a deconvolution is scattered
+    // with one.
+    const Blob<Dtype>& weights = *layer->blobs()[0];
+    const bool transposed = type == "InnerProduct" &&
+        layer->layer_param().inner_product_param().transpose();
+    const int rows = transposed ? weights.shape(1) : weights.shape(0);
+    const double row_size = static_cast<double>(weights.count()) / rows;
+    const vector<Blob<Dtype>*>& outputs = type == "Deconvolution" ?
+        bottom : top;
+    for (int i = 0; i < outputs.size(); ++i) {
+      flops += 2 * row_size * outputs[i]->count();
+    }
+  } else if (type == "Pooling") {
+    const PoolingParameter& pool_param = layer->layer_param().pooling_param();
+    double window;
+    if (pool_param.global_pooling()) {
+      window = static_cast<double>(bottom[0]->count(2));
+    } else if (pool_param.has_kernel_size()) {
+      window = pool_param.kernel_size() * pool_param.kernel_size();
+    } else {
+      window = pool_param.kernel_h() * pool_param.kernel_w();
+    }
+    flops = window * top[0]->count();
+  }
+  return flops;
+}
+
+template <typename Dtype>
+static double BiasFlops(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& top) {
+  const string type = layer->type();
+  if ((type == "Convolution" || type == "Deconvolution" ||
+       type == "InnerProduct") && layer->blobs().size() > 1) {
+    double count = 0;
+    for (int i = 0; i < top.size(); ++i) {
+      count += top[i]->count();
+    }
+    return count;
+  }
+  return 0;
+}
+
+template <typename Dtype>
+LayerCost EstimateForwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LayerCost cost;
+  cost.flops = ForwardFlops(layer, bottom, top) + BiasFlops(layer, top);
+  for (int i = 0; i < bottom.size(); ++i) {
+    cost.bytes_read += bottom[i]->count() * sizeof(Dtype);
+  }
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    cost.bytes_read += layer->blobs()[i]->count() * sizeof(Dtype);
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    cost.bytes_written += top[i]->count() * sizeof(Dtype);
+  }
+  return cost;
+}
+
+template <typename Dtype>
+LayerCost EstimateBackwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down) {
+  LayerCost cost;
+  bool data_gradient = false;
+  for (int i = 0; i < propagate_down.size(); ++i) {
+    data_gradient = data_gradient || propagate_down[i];
+  }
+  bool param_gradient = false;
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    param_gradient = param_gradient || layer->param_propagate_down(i);
+  }
+  const double flops = ForwardFlops(layer, bottom, top);
+  if (data_gradient) {
+    cost.flops += flops;
+  }
+  if (param_gradient) {
+    cost.flops += flops + BiasFlops(layer, top);
+  }
+  if (!data_gradient && !param_gradient) {
+    return cost;
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    cost.bytes_read += top[i]->count() * sizeof(Dtype);
+  }
+  for (int i = 0; i < bottom.size(); ++i) {
+    cost.bytes_read += bottom[i]->count() * sizeof(Dtype);
+    if (i < propagate_down.size() && propagate_down[i]) {
+      cost.bytes_written += bottom[i]->count() * sizeof(Dtype);
+    }
+  }
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    const double bytes = layer->blobs()[i]->count() * sizeof(Dtype);
+    cost.bytes_read += bytes;
+    if (layer->param_propagate_down(i)) {
+      cost.bytes_written += bytes;
+    }
+  }
+  return cost;
+}
+
+double Percentile(vector<double> samples, double p) {
+  CHECK(!samples.empty()) << "Percentile of no samples.";
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 100);
+  std::sort(samples.begin(), samples.end());
+  const double rank = p / 100 * (samples.size() - 1);
+  const int lower = static_cast<int>(rank);
+  if (lower + 1 >= samples.size()) {
+    return samples.back();
+  }
+  const double fraction = rank - lower;
+  return samples[lower] * (1 - fraction) + samples[lower + 1] * fraction;
+}
+
+MachinePeak MeasureMachinePeak() {
+  const int kGemmSize = 1024;
+  const int kCopyCount = 16 << 20;
+  const int kRepeats = 5;
+  MachinePeak peak;
+  Blob<float> a(1, 1, kGemmSize, kGemmSize);
+  Blob<float> b(1, 1, kGemmSize, kGemmSize);
+  Blob<float> c(1, 1, kGemmSize, kGemmSize);
+  caffe_set(a.count(), 1.f, a.mutable_cpu_data());
+  caffe_set(b.count(), 1.f, b.mutable_cpu_data());
+  Blob<float> from(1, 1, 1, kCopyCount);
+  Blob<float> to(1, 1, 1, kCopyCount);
+  caffe_set(from.count(), 1.f, from.mutable_cpu_data());
+  Timer timer;
+  for (int r = 0; r < kRepeats; ++r) {
+    timer.Start();
+    if (Caffe::mode() == Caffe::CPU) {
+      caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, kGemmSize, kGemmSize,
+          kGemmSize, 1.f, a.cpu_data(), b.cpu_data(), 0.f,
+          c.mutable_cpu_data());
+    } else {
+#ifndef CPU_ONLY
+      caffe_gpu_gemm<float>(CblasNoTrans, CblasNoTrans, kGemmSize, kGemmSize,
+          kGemmSize, 1.f, a.gpu_data(), b.gpu_data(), 0.f,
+          c.mutable_gpu_data());
+#else
+      NO_GPU;
+#endif
+    }
+    const double seconds = timer.Seconds();
+    if (r > 0 && seconds > 0) {
+      peak.gflops = std::max(peak.gflops,
+          2. * kGemmSize * kGemmSize * kGemmSize / seconds / 1e9);
+    }
+  }
+  for (int r = 0; r < kRepeats; ++r) {
+    timer.Start();
+    if (Caffe::mode() == Caffe::CPU) {
+      // Split so that the copy uses the memory bandwidth of every core.
+      const float* src = from.cpu_data();
+      float* dst = to.mutable_cpu_data();
+      ParallelFor(kCopyCount, [&](int begin, int end) {
+        caffe_copy(end - begin, src + begin, dst + begin);
+      }, 1 << 16);
+    } else {
+#ifndef CPU_ONLY
+      caffe_copy(kCopyCount, from.gpu_data(), to.mutable_gpu_data());
+#else
+      NO_GPU;
+#endif
+    }
+    const double seconds = timer.Seconds();
+    if (r > 0 && seconds > 0) {
+      peak.gbytes_per_second = std::max(peak.gbytes_per_second,
+          2. * kCopyCount * sizeof(float) / seconds / 1e9);
+    }
+  }
+  return peak;
+}
+
+template <typename Dtype>
+NetProfiler<Dtype>::NetProfiler(Net<Dtype>* net)
+    : net_(net), clock_us_(0), has_peak_(false) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net->layers();
+  layers_.resize(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    LayerProfile& profile = layers_[i];
+    const vector<Blob<Dtype>*>& bottom = net->bottom_vecs()[i];
+    const vector<Blob<Dtype>*>& top = net->top_vecs()[i];
+    profile.name = net->layer_names()[i];
+    profile.type = layers[i]->type();
+    for (int j = 0; j < bottom.size(); ++j) {
+      profile.bottom_names.push_back(net->blob_names()[net->bottom_ids(i)[j]]);
+      profile.bottom_bytes.push_back(bottom[j]->count() * sizeof(Dtype));
+    }
+    for (int j = 0; j < top.size(); ++j) {
+      profile.top_names.push_back(net->blob_names()[net->top_ids(i)[j]]);
+      profile.top_bytes.push_back(top[j]->count() * sizeof(Dtype));
+    }
+    profile.param_bytes = 0;
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      profile.param_bytes += layers[i]->blobs()[j]->count() * sizeof(Dtype);
+    }
+    profile.forward_cost = EstimateForwardCost(layers[i].get(), bottom, top);
+    profile.backward_cost = EstimateBackwardCost(layers[i].get(), bottom, top,
+        net->bottom_need_backward()[i]);
+  }
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Run(int iterations) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  const vector<vector<Blob<Dtype>*> >& bottom_vecs = net_->bottom_vecs();
+  const vector<vector<Blob<Dtype>*> >& top_vecs = net_->top_vecs();
+  const vector<vector<bool> >& bottom_need_backward =
+      net_->bottom_need_backward();
+  Timer timer;
+  for (int j = 0; j < iterations; ++j) {
+    const int iteration = forward_us_.size();
+    double forward_us = 0;
+    for (int i = 0; i < layers.size(); ++i) {
+      timer.Start();
+      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
+      const double us = timer.MicroSeconds();
+      layers_[i].forward_us.push_back(us);
+      TraceEvent event = { i, iteration, false, clock_us_, us };
+      events_.push_back(event);
+      clock_us_ += us;
+      forward_us += us;
+    }
+    double backward_us = 0;
+    for (int i = layers.size() - 1; i >= 0; --i) {
+      timer.Start();
+      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
+          bottom_vecs[i]);
+      const double us = timer.MicroSeconds();
+      layers_[i].backward_us.push_back(us);
+      TraceEvent event = { i, iteration, true, clock_us_, us };
+      events_.push_back(event);
+      clock_us_ += us;
+      backward_us += us;
+    }
+    forward_us_.push_back(forward_us);
+    backward_us_.push_back(backward_us);
+  }
+}
+
+static double Mean(const vector<double>& samples) {
+  double sum = 0;
+  for (int i = 0; i < samples.size(); ++i) {
+    sum += samples[i];
+  }
+  return samples.empty() ? 0 : sum / samples.size();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::LogSummary() const {
+  CHECK(!forward_us_.empty()) << "No iterations were profiled.";
+  LOG(INFO) << "Per layer percentiles (ms) and rates at the median: ";
+  for (int i = 0; i < layers_.size(); ++i) {
+    const LayerProfile& profile = layers_[i];
+    for (int pass = 0; pass < 2; ++pass) {
+      const vector<double>& samples =
+          pass ? profile.backward_us : profile.forward_us;
+      const LayerCost& cost = pass ? profile.backward_cost :
+          profile.forward_cost;
+      const double p50 = Percentile(samples, 50);
+      std::ostringstream line;
+      line << std::setfill(' ') << std::setw(10) << profile.name
+          << (pass ? "\tbackward" : "\tforward")
+          << " p50: " << p50 / 1000
+          << " p95: " << Percentile(samples, 95) / 1000
+          << " p99: " << Percentile(samples, 99) / 1000;
+      if (p50 > 0) {
+        const double gflops = cost.flops / p50 / 1e3;
+        const double gbytes =
+            (cost.bytes_read + cost.bytes_written) / p50 / 1e3;
+        if (cost.flops > 0) {
+          line << " GFLOP/s: " << gflops;
+          if (has_peak_ && peak_.gflops > 0) {
+            line << " (" << 100 * gflops / peak_.gflops << "%)";
+          }
+        }
+        line << " GB/s: " << gbytes;
+        if (has_peak_ && peak_.gbytes_per_second > 0) {
+          line << " (" << 100 * gbytes / peak_.gbytes_per_second << "%)";
+        }
+      }
+      LOG(INFO) << line.str();
+    }
+  }
+}
+
+// Writes s as a JSON string.
+static void WriteJsonString(std::ostream* out, const string& s) {
+  *out << '"';
+  for (int i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      *out << '\\' << c;
+    } else if (c < 0x20) {
+      const char* hex = "0123456789abcdef";
+      *out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+    } else {
+      *out << c;
+    }
+  }
+  *out << '"';
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WritePass(std::ostream* out, const LayerCost& cost,
+    const vector<double>& samples) const {
+  const double p50 = Percentile(samples, 50);
+  const double bytes = cost.bytes_read + cost.bytes_written;
+  *out << "{\"mean_ms\": " << Mean(samples) / 1000
+      << ", \"p50_ms\": " << p50 / 1000
+      << ", \"p95_ms\": " << Percentile(samples, 95) / 1000
+      << ", \"p99_ms\": " << Percentile(samples, 99) / 1000
+      << ", \"flops\": " << cost.flops
+      << ", \"bytes_read\": " << cost.bytes_read
+      << ", \"bytes_written\": " << cost.bytes_written;
+  if (p50 > 0) {
+    const double gflops = cost.flops / p50 / 1e3;
+    const double gbytes = bytes / p50 / 1e3;
+    *out << ", \"gflops_per_second\": " << gflops
+        << ", \"gbytes_per_second\": " << gbytes;
+    if (has_peak_ && peak_.gflops > 0 && peak_.gbytes_per_second > 0) {
+      // Roofline: the pass is bound by compute when its arithmetic intensity
+      // reaches the ratio of the two peaks.
+      const double intensity = bytes > 0 ? cost.flops / bytes : 0;
+      const double ridge = peak_.gflops / peak_.gbytes_per_second;
+      *out << ", \"flops_peak_fraction\": " << gflops / peak_.gflops
+          << ", \"bandwidth_peak_fraction\": "
+          << gbytes / peak_.gbytes_per_second
+          << ", \"arithmetic_intensity\": " << intensity
+          << ", \"bound\": \"" << (intensity >= ridge ? "compute" : "memory")
+          << "\"";
+    }
+  }
+  *out << "}";
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WriteJson(std::ostream* out) const {
+  CHECK(!forward_us_.empty()) << "No iterations were profiled.";
+  const std::streamsize precision = out->precision(10);
+  *out << "{\n  \"net\": ";
+  WriteJsonString(out, net_->name());
+  *out << ",\n  \"iterations\": " << forward_us_.size();
+  if (has_peak_) {
+    *out << ",\n  \"peak\": {\"gflops\": " << peak_.gflops
+        << ", \"gbytes_per_second\": " << peak_.gbytes_per_second << "}";
+  }
+  LayerCost forward_cost;
+  LayerCost backward_cost;
+  for (int i = 0; i < layers_.size(); ++i) {
+    forward_cost.flops += layers_[i].forward_cost.flops;
+    forward_cost.bytes_read += layers_[i].forward_cost.bytes_read;
+    forward_cost.bytes_written += layers_[i].forward_cost.bytes_written;
+    backward_cost.flops += layers_[i].backward_cost.flops;
+    backward_cost.bytes_read += layers_[i].backward_cost.bytes_read;
+    backward_cost.bytes_written += layers_[i].backward_cost.bytes_written;
+  }
+  *out << ",\n  \"forward\": ";
+  WritePass(out, forward_cost, forward_us_);
+  *out << ",\n  \"backward\": ";
+  WritePass(out, backward_cost, backward_us_);
+  *out << ",\n  \"layers\": [";
+  for (int i = 0; i < layers_.size(); ++i) {
+    const LayerProfile& profile = layers_[i];
+    *out << (i ? ",\n" : "\n") << "    {\"name\": ";
+    WriteJsonString(out, profile.name);
+    *out << ", \"type\": ";
+    WriteJsonString(out, profile.type);
+    *out << ",\n     \"bottoms\": [";
+    for (int j = 0; j < profile.bottom_names.size(); ++j) {
+      *out << (j ? ", " : "") << "{\"name\": ";
+      WriteJsonString(out, profile.bottom_names[j]);
+      *out << ", \"bytes\": " << profile.bottom_bytes[j] << "}";
+    }
+    *out << "],\n     \"tops\": [";
+    for (int j = 0; j < profile.top_names.size(); ++j) {
+      *out << (j ? ", " : "") << "{\"name\": ";
+      WriteJsonString(out, profile.top_names[j]);
+      *out << ", \"bytes\": " << profile.top_bytes[j] << "}";
+    }
+    *out << "],\n     \"param_bytes\": " << profile.param_bytes
+        << ",\n     \"forward\": ";
+    WritePass(out, profile.forward_cost, profile.forward_us);
+    *out << ",\n     \"backward\": ";
+    WritePass(out, profile.backward_cost, profile.backward_us);
+    *out << "}";
+  }
+  *out << "\n  ]\n}\n";
+  out->precision(precision);
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WriteChromeTrace(std::ostream* out) const {
+  const std::streamsize precision = out->precision(15);
+  *out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (int i = 0; i < events_.size(); ++i) {
+    const TraceEvent& event = events_[i];
+    const LayerProfile& profile = layers_[event.layer];
+    *out << (i ? ",\n" : "\n") << "  {\"name\": ";
+    WriteJsonString(out, profile.name);
+    *out << ", \"cat\": \"" << (event.backward ? "backward" : "forward")
+        << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0"
+        << ", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us
+        << ", \"args\": {\"type\": ";
+    WriteJsonString(out, profile.type);
+    *out << ", \"iteration\": " << event.iteration << "}}";
+  }
+  *out << "\n]}\n";
+  out->precision(precision);
+}
+
+template LayerCost EstimateForwardCost(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template LayerCost EstimateForwardCost(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+template LayerCost EstimateBackwardCost(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top,
+    const vector<bool>& propagate_down);
+template LayerCost EstimateBackwardCost(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top,
+    const vector<bool>& propagate_down);
+
+INSTANTIATE_CLASS(NetProfiler);
+
+}  // namespace caffe
@@ -0,0 +1,525 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/quantization.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+// gemm_s8_cpu uses the widest of SSE2, AVX2 and AVX-512 VNNI (on 256 bit
+// vectors) that both the compiler and the processor support, checking the
+// processor when the library loads.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAFFE_GEMM_S8_USE_SSE2
+#endif
+#if defined(CAFFE_GEMM_S8_USE_SSE2) && (defined(__clang__) || \
+    (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || \
+    (defined(_MSC_VER) && _MSC_VER >= 1800))
+#include <immintrin.h>
+#define CAFFE_GEMM_S8_USE_AVX2
+#endif
+#if defined(CAFFE_GEMM_S8_USE_AVX2) && \
+    ((defined(__clang__) && __clang_major__ >= 8) || \
+    (defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8) || \
+    (defined(_MSC_VER) && _MSC_VER >= 1920))
+#define CAFFE_GEMM_S8_USE_VNNI
+#endif
+// GCC and Clang only emit the instructions of the processors a function
+// targets; MSVC emits any intrinsic.
+#ifdef __GNUC__
+#define CAFFE_GEMM_S8_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CAFFE_GEMM_S8_TARGET(isa)
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace caffe {
+
+// The rows of B multiplied by every row of A in one task, small enough to
+// stay in cache while the rows of A go by.
+static const int kGemmBlockN = 16;
+// Each kernel computes a tile of dot products of 2 rows of A with 4 rows of
+// B, keeping the 8 sums in registers over all of K.
+static const int kGemmTileM = 2;
+static const int kGemmTileN = 4;
+
+// Computes the tile sums[i * kGemmTileN + j] = a[i] . b[j] over K values.
+typedef void (*GemmS8Tile)(const int K, const int8_t* const* a,
+    const int8_t* const* b, int32_t* sums);
+
+#ifdef CAFFE_GEMM_S8_USE_SSE2
+// Sign extends the 16 values at p to two vectors of int16.
+static inline void load_s16(const int8_t* p, __m128i* low, __m128i* high) {
+  const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  *low = _mm_srai_epi16(_mm_unpacklo_epi8(values, values), 8);
+  *high = _mm_srai_epi16(_mm_unpackhi_epi8(values, values), 8);
+}
+
+static inline void gemm_s8_step_sse2(const int8_t* const* a,
+    const int8_t* const* b, const int k, __m128i* c) {
+  __m128i a_low[kGemmTileM], a_high[kGemmTileM];
+  for (int i = 0; i < kGemmTileM; ++i) {
+    load_s16(a[i] + k, &a_low[i], &a_high[i]);
+  }
+  for (int j = 0; j < kGemmTileN; ++j) {
+    __m128i b_low, b_high;
+    load_s16(b[j] + k, &b_low, &b_high);
+    for (int i = 0; i < kGemmTileM; ++i) {
+      __m128i& sum = c[i * kGemmTileN + j];
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(a_low[i], b_low));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(a_high[i], b_high));
+    }
+  }
+}
+
+// Adds up the lanes of c[0], ..., c[3] into the 4 lanes of the result.
+static inline __m128i reduce_sse2(const __m128i* c) {
+  const __m128i sum01 = _mm_add_epi32(_mm_unpacklo_epi32(c[0], c[1]),
+      _mm_unpackhi_epi32(c[0], c[1]));
+  const __m128i sum23 = _mm_add_epi32(_mm_unpacklo_epi32(c[2], c[3]),
+      _mm_unpackhi_epi32(c[2], c[3]));
+  return _mm_add_epi32(_mm_unpacklo_epi64(sum01, sum23),
+      _mm_unpackhi_epi64(sum01, sum23));
+}
+
+// Copies the last K - k values of the rows to zero padded rows of width
+// values, which add nothing to the dot products.
+static void pad_tail(const int K, const int k, const int width,
+    const int8_t* const* a, const int8_t* const* b, int8_t* padded,
+    const int8_t** padded_a, const int8_t** padded_b) {
+  memset(padded, 0, (kGemmTileM + kGemmTileN) * width);
+  for (int i = 0; i < kGemmTileM; ++i) {
+    padded_a[i] = padded + i * width;
+    memcpy(padded + i * width, a[i] + k, K - k);
+  }
+  for (int j = 0; j < kGemmTileN; ++j) {
+    padded_b[j] = padded + (kGemmTileM + j) * width;
+    memcpy(padded + (kGemmTileM + j) * width, b[j] + k, K - k);
+  }
+}
+
+static void gemm_s8_tile_sse2(const int K, const int8_t* const* a,
+    const int8_t* const* b, int32_t* sums) {
+  __m128i c[kGemmTileM * kGemmTileN];
+  for (int i = 0; i < kGemmTileM * kGemmTileN; ++i) {
+    c[i] = _mm_setzero_si128();
+  }
+  int k = 0;
+  for (; k + 16 <= K; k += 16) {
+    gemm_s8_step_sse2(a, b, k, c);
+  }
+  if (k < K) {
+    int8_t padded[(kGemmTileM + kGemmTileN) * 16];
+    const int8_t* padded_a[kGemmTileM];
+    const int8_t* padded_b[kGemmTileN];
+    pad_tail(K, k, 16, a, b, padded, padded_a, padded_b);
+    gemm_s8_step_sse2(padded_a, padded_b, 0, c);
+  }
+  for (int i = 0; i < kGemmTileM; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i * kGemmTileN),
+        reduce_sse2(c + i * kGemmTileN));
+  }
+}
+#else
+static void gemm_s8_tile_scalar(const int K, const int8_t* const* a,
+    const int8_t* const* b, int32_t* sums) {
+  for (int i = 0; i < kGemmTileM; ++i) {
+    for (int j = 0; j < kGemmTileN; ++j) {
+      int32_t sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += static_cast<int32_t>(a[i][k]) * b[j][k];
+      }
+      sums[i * kGemmTileN + j] = sum;
+    }
+  }
+}
+#endif  // CAFFE_GEMM_S8_USE_SSE2
+
+#ifdef CAFFE_GEMM_S8_USE_AVX2
+// The SSE2 kernel on 256 bit vectors, multiplying 16 values a step.
+CAFFE_GEMM_S8_TARGET("avx2")
+static inline void gemm_s8_step_avx2(const int8_t* const* a,
+    const int8_t* const* b, const int k, __m256i* c) {
+  __m256i a_s16[kGemmTileM];
+  for (int i = 0; i < kGemmTileM; ++i) {
+    a_s16[i] = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a[i] + k)));
+  }
+  for (int j = 0; j < kGemmTileN; ++j) {
+    const __m256i b_s16 = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b[j] + k)));
+    for (int i = 0; i < kGemmTileM; ++i) {
+      __m256i& sum = c[i * kGemmTileN + j];
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a_s16[i], b_s16));
+    }
+  }
+}
+
+CAFFE_GEMM_S8_TARGET("avx2")
+static inline __m128i reduce_avx2(const __m256i* c) {
+  const __m256i sums = _mm256_hadd_epi32(_mm256_hadd_epi32(c[0], c[1]),
+      _mm256_hadd_epi32(c[2], c[3]));
+  return _mm_add_epi32(_mm256_castsi256_si128(sums),
+      _mm256_extracti128_si256(sums, 1));
+}
+
+CAFFE_GEMM_S8_TARGET("avx2")
+static void gemm_s8_tile_avx2(const int K, const int8_t* const* a,
+    const int8_t* const* b, int32_t* sums) {
+  __m256i c[kGemmTileM * kGemmTileN];
+  for (int i = 0; i < kGemmTileM * kGemmTileN; ++i) {
+    c[i] = _mm256_setzero_si256();
+  }
+  int k = 0;
+  for (; k + 16 <= K; k += 16) {
+    gemm_s8_step_avx2(a, b, k, c);
+  }
+  if (k < K) {
+    int8_t padded[(kGemmTileM + kGemmTileN) * 16];
+    const int8_t* padded_a[kGemmTileM];
+    const int8_t* padded_b[kGemmTileN];
+    pad_tail(K, k, 16, a, b, padded, padded_a, padded_b);
+    gemm_s8_step_avx2(padded_a, padded_b, 0, c);
+  }
+  for (int i = 0; i < kGemmTileM; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i * kGemmTileN),
+        reduce_avx2(c + i * kGemmTileN));
+  }
+}
+#endif  // CAFFE_GEMM_S8_USE_AVX2
+
+#ifdef CAFFE_GEMM_S8_USE_VNNI
+// vpdpbusd multiplies unsigned by signed bytes, adding 4 products at a time
+// to each int32 lane, 32 values a step. B is made unsigned by adding 128,
+// which adds 128 times the sum of the row of A to each sum, and is taken
+// back out by gemm_s8_cpu.
+CAFFE_GEMM_S8_TARGET("avx2,avx512vl,avx512vnni")
+static inline void gemm_s8_step_vnni(const int8_t* const* a,
+    const int8_t* const* b, const int k, __m256i* c) {
+  const __m256i offset = _mm256_set1_epi8(-128);
+  __m256i a_s8[kGemmTileM];
+  for (int i = 0; i < kGemmTileM; ++i) {
+    a_s8[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[i] + k));
+  }
+  for (int j = 0; j < kGemmTileN; ++j) {
+    const __m256i b_u8 = _mm256_xor_si256(offset,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[j] + k)));
+    for (int i = 0; i < kGemmTileM; ++i) {
+      __m256i& sum = c[i * kGemmTileN + j];
+      sum = _mm256_dpbusd_epi32(sum, b_u8, a_s8[i]);
+    }
+  }
+}
+
+CAFFE_GEMM_S8_TARGET("avx2,avx512vl,avx512vnni")
+static void gemm_s8_tile_vnni(const int K, const int8_t* const* a,
+    const int8_t* const* b, int32_t* sums) {
+  __m256i c[kGemmTileM * kGemmTileN];
+  for (int i = 0; i < kGemmTileM * kGemmTileN; ++i) {
+    c[i] = _mm256_setzero_si256();
+  }
+  int k = 0;
+  for (; k + 32 <= K; k += 32) {
+    gemm_s8_step_vnni(a, b, k, c);
+  }
+  if (k < K) {
+    // The padding of B becomes 128, times the padding of A, 0.
+    int8_t padded[(kGemmTileM + kGemmTileN) * 32];
+    const int8_t* padded_a[kGemmTileM];
+    const int8_t* padded_b[kGemmTileN];
+    pad_tail(K, k, 32, a, b, padded, padded_a, padded_b);
+    gemm_s8_step_vnni(padded_a, padded_b, 0, c);
+  }
+  for (int i = 0; i < kGemmTileM; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i * kGemmTileN),
+        reduce_avx2(c + i * kGemmTileN));
+  }
+}
+#endif  // CAFFE_GEMM_S8_USE_VNNI
+
+// The fastest kernel the processor runs, and whether it offsets B by 128.
+struct GemmS8Kernel {
+  GemmS8Tile tile;
+  bool unsigned_b;
+};
+
+static GemmS8Kernel SelectGemmS8Kernel() {
+  GemmS8Kernel kernel;
+  kernel.unsigned_b = false;
+#ifdef CAFFE_GEMM_S8_USE_SSE2
+  kernel.tile = gemm_s8_tile_sse2;
+#else
+  kernel.tile = gemm_s8_tile_scalar;
+#endif
+#ifdef CAFFE_GEMM_S8_USE_AVX2
+  bool avx2, vnni;
+#ifdef _MSC_VER
+  // AVX2 and AVX-512 VL and VNNI, with the OS saving their registers.
+  int info[4];
+  __cpuid(info, 1);
+  const bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+      (_xgetbv(0) & 0x6) == 0x6;
+  const bool os_avx512 = os_avx && (_xgetbv(0) & 0xe6) == 0xe6;
+  __cpuidex(info, 7, 0);
+  avx2 = os_avx && (info[1] & (1 << 5));
+  vnni = os_avx512 && (info[1] & (1 << 31)) && (info[2] & (1 << 11));
+#else
+  __builtin_cpu_init();
+  avx2 = __builtin_cpu_supports("avx2");
+  vnni = false;
+#ifdef CAFFE_GEMM_S8_USE_VNNI
+  vnni = __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512vnni");
+#endif
+#endif  // _MSC_VER
+  if (avx2) {
+    kernel.tile = gemm_s8_tile_avx2;
+  }
+#ifdef CAFFE_GEMM_S8_USE_VNNI
+  if (avx2 && vnni) {
+    kernel.tile = gemm_s8_tile_vnni;
+    kernel.unsigned_b = true;
+  }
+#endif
+#endif  // CAFFE_GEMM_S8_USE_AVX2
+  return kernel;
+}
+
+static const GemmS8Kernel gemm_s8_kernel = SelectGemmS8Kernel();
+
+template <typename Dtype>
+static inline int8_t quantize(const Dtype value, const float scale) {
+  const float scaled =
+      std::min(127.f, std::max(-127.f, static_cast<float>(value) * scale));
+  return static_cast<int8_t>(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+template <typename Dtype>
+void quantize_cpu(const int count, const Dtype* data, const float scale,
+    int8_t* quantized) {
+  for (int i = 0; i < count; ++i) {
+    quantized[i] = quantize(data[i], scale);
+  }
+}
+
+template <typename Dtype>
+void quantize_rows_cpu(const int rows, const int cols, const Dtype* data,
+    const bool transposed, int8_t* quantized, float* scales) {
+  const int row_stride = transposed ? 1 : cols;
+  const int col_stride = transposed ? rows : 1;
+  for (int r = 0; r < rows; ++r) {
+    const Dtype* row = data + r * row_stride;
+    float max_abs = 0;
+    for (int c = 0; c < cols; ++c) {
+      max_abs = std::max(max_abs, std::fabs(static_cast<float>(
+          row[c * col_stride])));
+    }
+    scales[r] = max_abs > 0 ? 127 / max_abs : 1;
+    for (int c = 0; c < cols; ++c) {
+      quantized[r * cols + c] = quantize(row[c * col_stride], scales[r]);
+    }
+  }
+}
+
+template <typename Dtype>
+void quantize_channels_last_cpu(const int channels, const int spatial_dim,
+    const Dtype* data, const float scale, int8_t* quantized) {
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* channel = data + c * spatial_dim;
+    for (int i = 0; i < spatial_dim; ++i) {
+      quantized[i * channels + c] = quantize(channel[i], scale);
+    }
+  }
+}
+
+void im2row_s8_cpu(const int8_t* data_im, const int channels, const int group,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, int8_t* data_row) {
+  const int output_h =
+      (height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w =
+      (width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int row_size = channels * kernel_h * kernel_w;
+  const int group_channels = channels / group;
+  ParallelFor(output_h, [&](int begin, int end) {
+    for (int oh = begin; oh < end; ++oh) {
+      for (int ow = 0; ow < output_w; ++ow) {
+        int8_t* row = data_row + (oh * output_w + ow) * row_size;
+        // The channels of a group at each kernel position are contiguous in
+        // the image.
+        for (int g = 0; g < group; ++g) {
+          const int8_t* im = data_im + g * group_channels;
+          for (int kh = 0; kh < kernel_h; ++kh) {
+            const int h = oh * stride_h - pad_h + kh * dilation_h;
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              const int w = ow * stride_w - pad_w + kw * dilation_w;
+              if (h >= 0 && h < height && w >= 0 && w < width) {
+                memcpy(row, im + (h * width + w) * channels, group_channels);
+              } else {
+                memset(row, 0, group_channels);
+              }
+              row += group_channels;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+void gemm_s8_cpu(const int M, const int N, const int K, const int8_t* A,
+    const int lda, const int8_t* B, const int ldb, int32_t* C,
+    const int ldc) {
+  const GemmS8Kernel& kernel = gemm_s8_kernel;
+  vector<int32_t> offsets(M, 0);
+  if (kernel.unsigned_b) {
+    for (int m = 0; m < M; ++m) {
+      for (int k = 0; k < K; ++k) {
+        offsets[m] += 128 * A[m * lda + k];
+      }
+    }
+  }
+  const int num_blocks = (N + kGemmBlockN - 1) / kGemmBlockN;
+  ParallelFor(num_blocks, [&](int begin, int end) {
+    const int8_t* a[kGemmTileM];
+    const int8_t* b[kGemmTileN];
+    int32_t sums[kGemmTileM * kGemmTileN];
+    for (int block = begin; block < end; ++block) {
+      const int n_begin = block * kGemmBlockN;
+      const int n_end = std::min(N, n_begin + kGemmBlockN);
+      for (int m = 0; m < M; m += kGemmTileM) {
+        const int rows = std::min(kGemmTileM, M - m);
+        // Tiles past the edges of A and B repeat its last row, and drop the
+        // sums.
+        for (int i = 0; i < kGemmTileM; ++i) {
+          a[i] = A + (m + std::min(i, rows - 1)) * lda;
+        }
+        for (int n = n_begin; n < n_end; n += kGemmTileN) {
+          const int cols = std::min(kGemmTileN, n_end - n);
+          for (int j = 0; j < kGemmTileN; ++j) {
+            b[j] = B + (n + std::min(j, cols - 1)) * ldb;
+          }
+          kernel.tile(K, a, b, sums);
+          for (int i = 0; i < rows; ++i) {
+            int32_t* c = C + (m + i) * ldc + n;
+            for (int j = 0; j < cols; ++j) {
+              c[j] = sums[i * kGemmTileN + j] - offsets[m + i];
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+template <typename Dtype>
+void Int8Weights<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const int cols, const bool transposed, const int kernel_size) {
+  CHECK_EQ(weights.count(), rows * cols);
+  const Dtype* data = weights.cpu_data();
+  if (weights.data()->version() == version_ && data_.size() == rows * cols) {
+    return;
+  }
+  data_.resize(rows * cols);
+  scales_.resize(rows);
+  quantize_rows_cpu(rows, cols, data, transposed, &data_[0], &scales_[0]);
+  if (kernel_size > 1) {
+    const int channels = cols / kernel_size;
+    vector<int8_t> row(cols);
+    for (int r = 0; r < rows; ++r) {
+      int8_t* quantized = &data_[0] + r * cols;
+      for (int c = 0; c < channels; ++c) {
+        for (int k = 0; k < kernel_size; ++k) {
+          row[k * channels + c] = quantized[c * kernel_size + k];
+        }
+      }
+      std::copy(row.begin(), row.end(), quantized);
+    }
+  }
+  version_ = weights.data()->version();
+}
+
+template <typename Dtype>
+void Int8Weights<Dtype>::Clear() {
+  version_ = 0;
+  data_.clear();
+  scales_.clear();
+}
+
+template <typename Dtype>
+QuantizationCalibrator<Dtype>::QuantizationCalibrator(const Net<Dtype>& net)
+    : iterations_(0) {
+  std::set<int> blob_ids;
+  for (int i = 0; i < net.layers().size(); ++i) {
+    if (string(net.layers()[i]->type()) == "Split") {
+      continue;
+    }
+    const vector<int>& top_ids = net.top_ids(i);
+    for (int j = 0; j < top_ids.size(); ++j) {
+      if (!blob_ids.insert(top_ids[j]).second) {
+        continue;
+      }
+      names_.push_back(net.blob_names()[top_ids[j]]);
+      blobs_.push_back(net.blobs()[top_ids[j]].get());
+    }
+  }
+  min_.assign(blobs_.size(), 0);
+  max_.assign(blobs_.size(), 0);
+}
+
+template <typename Dtype>
+void QuantizationCalibrator<Dtype>::Observe() {
+  for (int i = 0; i < blobs_.size(); ++i) {
+    const Dtype* data = blobs_[i]->cpu_data();
+    for (int j = 0; j < blobs_[i]->count(); ++j) {
+      const float value = data[j];
+      min_[i] = std::min(min_[i], value);
+      max_[i] = std::max(max_[i], value);
+    }
+  }
+  ++iterations_;
+}
+
+template <typename Dtype>
+void QuantizationCalibrator<Dtype>::ToProto(QuantizationTable* table) const {
+  table->Clear();
+  for (int i = 0; i < blobs_.size(); ++i) {
+    QuantizationTable::BlobRange* range = table->add_blob();
+    range->set_name(names_[i]);
+    range->set_min(min_[i]);
+    range->set_max(max_[i]);
+  }
+  table->set_iterations(iterations_);
+}
+
+template void quantize_cpu<float>(const int count, const float* data,
+    const float scale, int8_t* quantized);
+template void quantize_cpu<double>(const int count, const double* data,
+    const float scale, int8_t* quantized);
+template void quantize_channels_last_cpu<float>(const int channels,
+    const int spatial_dim, const float* data, const float scale,
+    int8_t* quantized);
+template void quantize_channels_last_cpu<double>(const int channels,
+    const int spatial_dim, const double* data, const float scale,
+    int8_t* quantized);
+template void quantize_rows_cpu<float>(const int rows, const int cols,
+    const float* data, const bool transposed, int8_t* quantized,
+    float* scales);
+template void quantize_rows_cpu<double>(const int rows, const int cols,
+    const double* data, const bool transposed, int8_t* quantized,
+    float* scales);
+
+INSTANTIATE_CLASS(Int8Weights);
+INSTANTIATE_CLASS(QuantizationCalibrator);
+
+}  // namespace caffe
@@ -0,0 +1,305 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/ordered_worker.hpp"
+#include "caffe/util/socket_ring.hpp"
+
+namespace caffe {
+
+// How long a rank waits for the next one to listen, and between attempts.
+static const int kConnectTimeoutMs = 300000;
+static const int kConnectRetryMs = 100;
+
+// A connection to a neighbour in the ring. Errors are fatal, as the other
+// ranks cannot go on without this one.
+class RingLink {
+ public:
+  virtual ~RingLink() {}
+  virtual void Read(void* data, size_t bytes) = 0;
+  virtual void Write(const void* data, size_t bytes) = 0;
+};
+
+template <typename Protocol>
+class StreamLink : public RingLink {
+ public:
+  explicit StreamLink(boost::asio::io_service* io_service)
+      : socket_(*io_service) {}
+
+  virtual void Read(void* data, size_t bytes) {
+    boost::system::error_code error;
+    boost::asio::read(socket_, boost::asio::buffer(data, bytes), error);
+    CHECK(!error) << "Cannot receive from the previous rank: "
+        << error.message();
+  }
+  virtual void Write(const void* data, size_t bytes) {
+    boost::system::error_code error;
+    boost::asio::write(socket_, boost::asio::buffer(data, bytes), error);
+    CHECK(!error) << "Cannot send to the next rank: " << error.message();
+  }
+
+  typename Protocol::socket socket_;
+};
+
+// Writes chunks to the next rank in order, on its own thread, so that the
+// ranks receive while they send.
+class RingSender {
+ public:
+  explicit RingSender(RingLink* link) : link_(link) {}
+
+  // Queues bytes of data, which must not change until they are written.
+  void Send(const void* data, size_t bytes) {
+    worker_.Push([this, data, bytes]() { link_->Write(data, bytes); });
+  }
+
+  // Waits for the chunks queued so far to be written.
+  void Flush() { worker_.Flush(); }
+
+ private:
+  RingLink* link_;
+  OrderedWorker worker_;
+};
+
+class SocketRing::sync {
+ public:
+  boost::asio::io_service io_service_;
+  shared_ptr<RingLink> next_;
+  shared_ptr<RingLink> prev_;
+  shared_ptr<RingSender> sender_;
+  // The chunk being received, before it is summed.
+  vector<char> received_;
+  // The Unix socket to remove, if this rank listens on one.
+  string socket_path_;
+};
+
+// Small chunks must not wait for the acknowledgement of the previous ones.
+static void SetNoDelay(boost::asio::ip::tcp::socket* socket) {
+  socket->set_option(boost::asio::ip::tcp::no_delay(true));
+}
+
+template <typename Socket>
+static void SetNoDelay(Socket* socket) {}
+
+template <typename Protocol>
+static void ConnectRing(boost::asio::io_service* io_service,
+    const typename Protocol::endpoint& listen,
+    const typename Protocol::endpoint& next, int rank, int world_size,
+    shared_ptr<RingLink>* next_link, shared_ptr<RingLink>* prev_link) {
+  typename Protocol::acceptor acceptor(*io_service);
+  acceptor.open(listen.protocol());
+  acceptor.set_option(
+      typename Protocol::acceptor::reuse_address(true));
+  acceptor.bind(listen);
+  acceptor.listen();
+
+  const int next_rank = (rank + 1) % world_size;
+  const int prev_rank = (rank + world_size - 1) % world_size;
+  shared_ptr<StreamLink<Protocol> > next_stream(
+      new StreamLink<Protocol>(io_service));
+  // The next rank may not listen yet.
+  boost::system::error_code error;
+  for (int waited = 0; ; waited += kConnectRetryMs) {
+    next_stream->socket_.connect(next, error);
+    if (!error) { break; }
+    next_stream->socket_.close();
+    CHECK_LT(waited, kConnectTimeoutMs) << "Cannot connect to rank "
+        << next_rank << ": " << error.message();
+    boost::this_thread::sleep(
+        boost::posix_time::milliseconds(kConnectRetryMs));
+  }
+  shared_ptr<StreamLink<Protocol> > prev_stream(
+      new StreamLink<Protocol>(io_service));
+  acceptor.accept(prev_stream->socket_, error);
+  CHECK(!error) << "Cannot accept rank " << prev_rank << ": "
+      << error.message();
+  SetNoDelay(&next_stream->socket_);
+  SetNoDelay(&prev_stream->socket_);
+
+  // Check that the ranks were given the same endpoints.
+  int32_t peer = rank;
+  next_stream->Write(&peer, sizeof(peer));
+  prev_stream->Read(&peer, sizeof(peer));
+  CHECK_EQ(peer, prev_rank) << "Rank " << peer << " connected to rank "
+      << rank << " instead of rank " << prev_rank;
+  *next_link = next_stream;
+  *prev_link = prev_stream;
+}
+
+static boost::asio::ip::tcp::endpoint ResolveTcp(
+    boost::asio::io_service* io_service, const string& endpoint) {
+  const string address = endpoint.substr(4);
+  const size_t colon = address.rfind(':');
+  CHECK_NE(colon, string::npos) << "Need a port in " << endpoint;
+  boost::asio::ip::tcp::resolver resolver(*io_service);
+  boost::asio::ip::tcp::resolver::query query(address.substr(0, colon),
+      address.substr(colon + 1));
+  boost::system::error_code error;
+  boost::asio::ip::tcp::resolver::iterator it =
+      resolver.resolve(query, error);
+  CHECK(!error && it != boost::asio::ip::tcp::resolver::iterator())
+      << "Cannot resolve " << endpoint << ": " << error.message();
+  return *it;
+}
+
+SocketRing::SocketRing(const vector<string>& endpoints, int rank,
+    size_t chunk_bytes)
+    : rank_(rank),
+      world_size_(endpoints.size()),
+      chunk_bytes_(chunk_bytes),
+      sync_(new sync()) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, world_size_);
+  if (world_size_ == 1) {
+    return;
+  }
+  const string& listen = endpoints[rank];
+  const string& next = endpoints[(rank + 1) % world_size_];
+  if (boost::starts_with(listen, "unix:")) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    CHECK(boost::starts_with(next, "unix:"))
+        << "All the ranks must use the same kind of socket.";
+    typedef boost::asio::local::stream_protocol protocol;
+    sync_->socket_path_ = listen.substr(5);
+    // Remove the socket a previous run left.
+    std::remove(sync_->socket_path_.c_str());
+    ConnectRing<protocol>(&sync_->io_service_,
+        protocol::endpoint(sync_->socket_path_),
+        protocol::endpoint(next.substr(5)), rank_, world_size_,
+        &sync_->next_, &sync_->prev_);
+#else
+    LOG(FATAL) << "Unix sockets are not supported on this platform.";
+#endif
+  } else if (boost::starts_with(listen, "tcp:")) {
+    CHECK(boost::starts_with(next, "tcp:"))
+        << "All the ranks must use the same kind of socket.";
+    typedef boost::asio::ip::tcp protocol;
+    ConnectRing<protocol>(&sync_->io_service_,
+        ResolveTcp(&sync_->io_service_, listen),
+        ResolveTcp(&sync_->io_service_, next), rank_, world_size_,
+        &sync_->next_, &sync_->prev_);
+  } else {
+    LOG(FATAL) << "Unknown socket " << listen
+        << ", expected tcp:<address>:<port> or unix:<path>.";
+  }
+  sync_->sender_.reset(new RingSender(sync_->next_.get()));
+  LOG(INFO) << "Rank " << rank_ << " of " << world_size_
+      << " connected to rank " << (rank_ + 1) % world_size_;
+}
+
+SocketRing::~SocketRing() {
+  sync_->sender_.reset();
+  sync_->next_.reset();
+  sync_->prev_.reset();
+  if (sync_->socket_path_.size()) {
+    std::remove(sync_->socket_path_.c_str());
+  }
+}
+
+vector<string> SocketRing::Endpoints(const string& spec, int world_size) {
+  vector<string> endpoints;
+  boost::split(endpoints, spec, boost::is_any_of(","));
+  if (endpoints.size() == world_size) {
+    return endpoints;
+  }
+  CHECK_EQ(endpoints.size(), 1) << "Need one endpoint, or one per rank, in "
+      << spec;
+  const string base = endpoints[0];
+  endpoints.clear();
+  for (int r = 0; r < world_size; ++r) {
+    if (boost::starts_with(base, "tcp:")) {
+      const size_t colon = base.rfind(':');
+      CHECK_GT(colon, 3) << "Need a port in " << base;
+      const int port = atoi(base.substr(colon + 1).c_str());
+      endpoints.push_back(base.substr(0, colon + 1) + format_int(port + r));
+    } else {
+      endpoints.push_back(base + "." + format_int(r));
+    }
+  }
+  return endpoints;
+}
+
+template <typename Dtype>
+void SocketRing::AllReduce(Dtype* data, size_t count) {
+  if (world_size_ == 1) {
+    return;
+  }
+  const int n = world_size_;
+  const size_t chunk = std::max<size_t>(1, chunk_bytes_ / sizeof(Dtype));
+  vector<size_t> segments(n + 1);
+  for (int s = 0; s <= n; ++s) {
+    segments[s] = count * s / n;
+  }
+  sync_->received_.resize(chunk * sizeof(Dtype));
+  Dtype* received = reinterpret_cast<Dtype*>(&sync_->received_[0]);
+  RingLink* prev = sync_->prev_.get();
+  RingSender* sender = sync_->sender_.get();
+
+  // The reduce-scatter starts from the segment of this rank.
+  for (size_t begin = segments[rank_]; begin < segments[rank_ + 1];
+       begin += chunk) {
+    sender->Send(data + begin,
+        std::min(chunk, segments[rank_ + 1] - begin) * sizeof(Dtype));
+  }
+  // Step s receives segment rank - s - 1, summed into data for the first
+  // n - 1 steps and copied for the last n - 1, and forwards it after all
+  // but the last step. Rank r ends the reduce-scatter with segment r + 1
+  // summed over all the ranks, which starts the all-gather.
+  const int steps = 2 * (n - 1);
+  for (int step = 0; step < steps; ++step) {
+    const int segment = ((rank_ - step - 1) % n + n) % n;
+    const size_t end = segments[segment + 1];
+    for (size_t begin = segments[segment]; begin < end; begin += chunk) {
+      const size_t size = std::min(chunk, end - begin);
+      if (step < n - 1) {
+        prev->Read(received, size * sizeof(Dtype));
+        caffe_axpy<Dtype>(size, Dtype(1), received, data + begin);
+      } else {
+        prev->Read(data + begin, size * sizeof(Dtype));
+      }
+      if (step < steps - 1) {
+        sender->Send(data + begin, size * sizeof(Dtype));
+      }
+    }
+  }
+  sender->Flush();
+}
+
+template <typename Dtype>
+void SocketRing::Broadcast(Dtype* data, size_t count, int root) {
+  if (world_size_ == 1) {
+    return;
+  }
+  const size_t chunk = std::max<size_t>(1, chunk_bytes_ / sizeof(Dtype));
+  const bool forward = (rank_ + 1) % world_size_ != root;
+  for (size_t begin = 0; begin < count; begin += chunk) {
+    const size_t bytes = std::min(chunk, count - begin) * sizeof(Dtype);
+    if (rank_ != root) {
+      sync_->prev_->Read(data + begin, bytes);
+    }
+    if (forward) {
+      sync_->sender_->Send(data + begin, bytes);
+    }
+  }
+  sync_->sender_->Flush();
+}
+
+template void SocketRing::AllReduce<float>(float* data, size_t count);
+template void SocketRing::AllReduce<double>(double* data, size_t count);
+template void SocketRing::Broadcast<float>(float* data, size_t count,
+    int root);
+template void SocketRing::Broadcast<double>(double* data, size_t count,
+    int root);
+template void SocketRing::Broadcast<char>(char* data, size_t count,
+    int root);
+template void SocketRing::Broadcast<uint64_t>(uint64_t* data, size_t count,
+    int root);
+
+}  // namespace caffe
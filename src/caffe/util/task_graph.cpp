@@ -0,0 +1,124 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+
+#include "caffe/util/task_graph.hpp"
+
+namespace caffe {
+
+struct TaskGraph::State {
+  boost::mutex mutex_;
+  // Signaled when a task becomes ready or the last task finishes.
+  boost::condition_variable task_ready_;
+  vector<std::deque<int> > lanes_;
+  // Ready tasks that must run on the caller.
+  std::deque<int> pinned_;
+  // Unfinished predecessors of every task.
+  vector<int> waiting_;
+  int remaining_;
+  boost::thread::id caller_;
+};
+
+TaskGraph::TaskGraph(int num_tasks)
+    : successors_(num_tasks),
+      num_predecessors_(num_tasks, 0),
+      pinned_(num_tasks, false) {
+}
+
+void TaskGraph::AddDependency(int before, int after) {
+  CHECK_GE(before, 0);
+  CHECK_LT(before, after) << "Dependencies must follow the task order.";
+  CHECK_LT(after, num_tasks());
+  vector<int>& successors = successors_[before];
+  if (std::find(successors.begin(), successors.end(), after) ==
+      successors.end()) {
+    successors.push_back(after);
+    ++num_predecessors_[after];
+  }
+}
+
+void TaskGraph::PinToCaller(int task) {
+  CHECK_GE(task, 0);
+  CHECK_LT(task, num_tasks());
+  pinned_[task] = true;
+}
+
+void TaskGraph::RunLane(State* state, int lane,
+    const TaskFunction& func) const {
+  const bool is_caller = boost::this_thread::get_id() == state->caller_;
+  const int num_lanes = state->lanes_.size();
+  boost::mutex::scoped_lock lock(state->mutex_);
+  while (state->remaining_ > 0) {
+    int task = -1;
+    if (is_caller && !state->pinned_.empty()) {
+      task = state->pinned_.front();
+      state->pinned_.pop_front();
+    } else if (!state->lanes_[lane].empty()) {
+      task = state->lanes_[lane].back();
+      state->lanes_[lane].pop_back();
+    } else {
+      for (int i = 1; i < num_lanes; ++i) {
+        std::deque<int>& victim = state->lanes_[(lane + i) % num_lanes];
+        if (!victim.empty()) {
+          task = victim.front();
+          victim.pop_front();
+          break;
+        }
+      }
+    }
+    if (task < 0) {
+      state->task_ready_.wait(lock);
+      continue;
+    }
+    lock.unlock();
+    func(task);
+    lock.lock();
+    bool notify = --state->remaining_ == 0;
+    const vector<int>& successors = successors_[task];
+    for (int i = 0; i < successors.size(); ++i) {
+      const int next = successors[i];
+      if (--state->waiting_[next] == 0) {
+        if (pinned_[next]) {
+          state->pinned_.push_back(next);
+        } else {
+          state->lanes_[lane].push_back(next);
+        }
+        notify = true;
+      }
+    }
+    if (notify) {
+      state->task_ready_.notify_all();
+    }
+  }
+}
+
+void TaskGraph::Run(ThreadPool* pool, const TaskFunction& func) const {
+  if (num_tasks() == 0) {
+    return;
+  }
+  State state;
+  state.lanes_.resize(pool->num_threads());
+  state.waiting_ = num_predecessors_;
+  state.remaining_ = num_tasks();
+  state.caller_ = boost::this_thread::get_id();
+  for (int task = 0; task < num_tasks(); ++task) {
+    if (num_predecessors_[task] == 0) {
+      if (pinned_[task]) {
+        state.pinned_.push_back(task);
+      } else {
+        // Reversed so that the first task sits at the back of the deque.
+        state.lanes_[0].push_front(task);
+      }
+    }
+  }
+  // Every pool thread, the caller included, takes at most one lane until the
+  // graph is done, so the caller always gets one and pinned tasks can run.
+  pool->Run(state.lanes_.size(), [&](int begin, int end) {
+    for (int lane = begin; lane < end; ++lane) {
+      RunLane(&state, lane, func);
+    }
+  });
+}
+
+}  // namespace caffe
@@ -0,0 +1,159 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <map>
+
+#include "caffe/util/numa.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+struct ThreadPool::Job {
+  const RangeFunction* func;
+  int count;
+  int chunk;
+  // First index not handed out yet.
+  int next;
+  // Chunks handed out and not finished yet, plus the ones not handed out.
+  int pending;
+};
+
+class ThreadPool::sync {
+ public:
+  boost::mutex mutex_;
+  // Signaled when a job is queued or the pool stops.
+  boost::condition_variable job_queued_;
+  // Signaled when a chunk finishes.
+  boost::condition_variable chunk_done_;
+};
+
+ThreadPool::ThreadPool(int num_threads, int numa_node)
+    : num_threads_(std::max(num_threads, 1)),
+      numa_node_(numa_node),
+      must_stop_(false),
+      sync_(new sync()) {
+  for (int i = 1; i < num_threads_; ++i) {
+    workers_.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&ThreadPool::WorkerEntry, this)));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    must_stop_ = true;
+  }
+  sync_->job_queued_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+bool ThreadPool::ClaimChunk(Job* job, int* begin, int* end) {
+  if (job->next >= job->count) {
+    return false;
+  }
+  *begin = job->next;
+  *end = std::min(job->next + job->chunk, job->count);
+  job->next = *end;
+  if (job->next >= job->count) {
+    jobs_.erase(std::find(jobs_.begin(), jobs_.end(), job));
+  }
+  return true;
+}
+
+void ThreadPool::WorkerEntry() {
+  if (numa_node_ >= 0) {
+    BindThreadToNumaNode(numa_node_);
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!must_stop_ && jobs_.empty()) {
+      sync_->job_queued_.wait(lock);
+    }
+    if (must_stop_) {
+      return;
+    }
+    Job* job = jobs_.front();
+    int begin, end;
+    ClaimChunk(job, &begin, &end);
+    lock.unlock();
+    (*job->func)(begin, end);
+    lock.lock();
+    if (--job->pending == 0) {
+      sync_->chunk_done_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::Run(int count, const RangeFunction& func, int grain) {
+  if (count <= 0) {
+    return;
+  }
+  grain = std::max(grain, 1);
+  if (num_threads_ == 1 || count <= grain) {
+    func(0, count);
+    return;
+  }
+  // A few chunks per thread balance uneven work without much overhead.
+  const int num_chunks = 4 * num_threads_;
+  Job job;
+  job.func = &func;
+  job.count = count;
+  job.chunk = std::max(grain, (count + num_chunks - 1) / num_chunks);
+  job.next = 0;
+  job.pending = (count + job.chunk - 1) / job.chunk;
+
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  jobs_.push_back(&job);
+  sync_->job_queued_.notify_all();
+  int begin, end;
+  while (ClaimChunk(&job, &begin, &end)) {
+    lock.unlock();
+    func(begin, end);
+    lock.lock();
+    --job.pending;
+  }
+  while (job.pending > 0) {
+    sync_->chunk_done_.wait(lock);
+  }
+}
+
+static boost::mutex global_pool_mutex_;
+static shared_ptr<ThreadPool> global_pool_;
+static std::map<int, shared_ptr<ThreadPool> > numa_node_pools_;
+
+ThreadPool& ThreadPool::Global() {
+  const int numa_node = NumaNodeOfThread();
+  boost::mutex::scoped_lock lock(global_pool_mutex_);
+  if (numa_node >= 0) {
+    shared_ptr<ThreadPool>& pool = numa_node_pools_[numa_node];
+    if (!pool) {
+      pool.reset(new ThreadPool(NumaNodeCpus(numa_node).size(), numa_node));
+    }
+    return *pool;
+  }
+  if (!global_pool_) {
+    global_pool_.reset(new ThreadPool(boost::thread::hardware_concurrency()));
+  }
+  return *global_pool_;
+}
+
+void ThreadPool::SetGlobalThreads(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  boost::mutex::scoped_lock lock(global_pool_mutex_);
+  numa_node_pools_.clear();
+  if (!global_pool_ || global_pool_->num_threads() != num_threads) {
+    global_pool_.reset();
+    global_pool_.reset(new ThreadPool(num_threads));
+  }
+}
+
+void ParallelFor(int count, const ThreadPool::RangeFunction& func,
+    int grain) {
+  ThreadPool::Global().Run(count, func, grain);
+}
+
+}  // namespace caffe
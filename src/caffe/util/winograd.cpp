@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// Transforms of Lavin and Gray, "Fast Algorithms for Convolutional Neural
+// Networks": Y = A^T [(G g G^T) .* (B^T d B)] A. The filter transform G runs
+// once per call and goes through a table, the sparse B^T and A^T are written
+// out.
+static const double kG2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1,
+};
+static const double kG4[6 * 3] = {
+  1. / 4,       0,      0,
+  -1. / 6, -1. / 6, -1. / 6,
+  -1. / 6,  1. / 6, -1. / 6,
+  1. / 24, 1. / 12,  1. / 6,
+  1. / 24, -1. / 12, 1. / 6,
+  0,            0,      1,
+};
+
+// The number of output tiles handled together, enough columns for the
+// gemms while the transformed tiles of a group stay in cache.
+static const int kTileBlock = 64;
+
+// out (rows x rows) = left * x * left^T, with left rows x cols and x
+// cols x cols. tmp holds rows x cols values.
+template <typename Dtype>
+static inline void sandwich(const Dtype* left, const int rows, const int cols,
+    const Dtype* x, Dtype* tmp, Dtype* out) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < cols; ++k) {
+        sum += left[i * cols + k] * x[k * cols + j];
+      }
+      tmp[i * cols + j] = sum;
+    }
+  }
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < rows; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < cols; ++k) {
+        sum += tmp[i * cols + k] * left[j * cols + k];
+      }
+      out[i * rows + j] = sum;
+    }
+  }
+}
+
+// out = B^T d along one line of tile + 2 values.
+template <typename Dtype>
+static inline void input_transform(const int tile, const Dtype* d,
+    const int d_stride, Dtype* out, const int out_stride) {
+  const Dtype d0 = d[0], d1 = d[d_stride], d2 = d[2 * d_stride],
+      d3 = d[3 * d_stride];
+  if (tile == 2) {
+    out[0] = d0 - d2;
+    out[out_stride] = d1 + d2;
+    out[2 * out_stride] = d2 - d1;
+    out[3 * out_stride] = d1 - d3;
+  } else {
+    const Dtype d4 = d[4 * d_stride], d5 = d[5 * d_stride];
+    out[0] = 4 * d0 - 5 * d2 + d4;
+    out[out_stride] = d3 + d4 - 4 * (d1 + d2);
+    out[2 * out_stride] = d4 - d3 + 4 * (d1 - d2);
+    out[3 * out_stride] = d4 - d2 + 2 * (d3 - d1);
+    out[4 * out_stride] = d4 - d2 + 2 * (d1 - d3);
+    out[5 * out_stride] = 4 * d1 - 5 * d3 + d5;
+  }
+}
+
+// out = A^T m along one line of tile + 2 values.
+template <typename Dtype>
+static inline void output_transform(const int tile, const Dtype* m,
+    const int m_stride, Dtype* out, const int out_stride) {
+  const Dtype m0 = m[0], m1 = m[m_stride], m2 = m[2 * m_stride],
+      m3 = m[3 * m_stride];
+  if (tile == 2) {
+    out[0] = m0 + m1 + m2;
+    out[out_stride] = m1 - m2 - m3;
+  } else {
+    const Dtype m4 = m[4 * m_stride], m5 = m[5 * m_stride];
+    out[0] = m0 + m1 + m2 + m3 + m4;
+    out[out_stride] = m1 - m2 + 2 * (m3 - m4);
+    out[2 * out_stride] = m1 + m2 + 4 * (m3 + m4);
+    out[3 * out_stride] = m1 - m2 + 8 * (m3 - m4) + m5;
+  }
+}
+
+template <typename Dtype>
+void winograd_conv_cpu(const Dtype* data_im, const int num,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const Dtype* bias, const int num_output,
+    const int group, const int pad_h, const int pad_w, const int tile,
+    Dtype* data_out) {
+  CHECK(tile == 2 || tile == 4) << "Winograd tiles are 2x2 or 4x4.";
+  const int alpha = tile + 2;
+  const int alpha_sq = alpha * alpha;
+  const double* g = tile == 2 ? kG2 : kG4;
+  const vector<Dtype> G(g, g + alpha * 3);
+  const int in_group = channels / group;
+  const int out_group = num_output / group;
+  const int output_h = height + 2 * pad_h - 2;
+  const int output_w = width + 2 * pad_w - 2;
+  const int tiles_h = (output_h + tile - 1) / tile;
+  const int tiles_w = (output_w + tile - 1) / tile;
+  const int num_tiles = tiles_h * tiles_w;
+  const int num_blocks = (num_tiles + kTileBlock - 1) / kTileBlock;
+
+  // Filters transformed into group x alpha^2 matrices of
+  // out_group x in_group values.
+  vector<Dtype> transformed(alpha_sq * num_output * in_group);
+  ParallelFor(num_output, [&](int begin, int end) {
+    Dtype tmp[6 * 3], u[6 * 6];
+    for (int o = begin; o < end; ++o) {
+      const int gr = o / out_group;
+      const int oc = o % out_group;
+      for (int ic = 0; ic < in_group; ++ic) {
+        sandwich(&G[0], alpha, 3, weights + (o * in_group + ic) * 9, tmp, u);
+        for (int xi = 0; xi < alpha_sq; ++xi) {
+          transformed[((gr * alpha_sq + xi) * out_group + oc) * in_group + ic]
+              = u[xi];
+        }
+      }
+    }
+  });
+
+  ParallelFor(num * group * num_blocks, [&](int begin, int end) {
+    vector<Dtype> input_tiles(alpha_sq * in_group * kTileBlock);
+    vector<Dtype> output_tiles(alpha_sq * out_group * kTileBlock);
+    Dtype d[6 * 6], tmp[6 * 6], v[6 * 6], y[4 * 4];
+    for (int task = begin; task < end; ++task) {
+      const int block = task % num_blocks;
+      const int gr = (task / num_blocks) % group;
+      const int n = task / num_blocks / group;
+      const int first_tile = block * kTileBlock;
+      const int block_tiles = std::min(kTileBlock, num_tiles - first_tile);
+      // Input tiles overlap by two rows and columns.
+      for (int ic = 0; ic < in_group; ++ic) {
+        const Dtype* im = data_im +
+            ((n * channels) + gr * in_group + ic) * height * width;
+        for (int b = 0; b < block_tiles; ++b) {
+          const int h0 = ((first_tile + b) / tiles_w) * tile - pad_h;
+          const int w0 = ((first_tile + b) % tiles_w) * tile - pad_w;
+          if (h0 >= 0 && h0 + alpha <= height && w0 >= 0 &&
+              w0 + alpha <= width) {
+            // Columns of the tile inside the image, then its rows.
+            const Dtype* patch = im + h0 * width + w0;
+            for (int j = 0; j < alpha; ++j) {
+              input_transform(tile, patch + j, width, tmp + j, alpha);
+            }
+          } else {
+            for (int i = 0; i < alpha; ++i) {
+              const int h = h0 + i;
+              for (int j = 0; j < alpha; ++j) {
+                const int w = w0 + j;
+                d[i * alpha + j] = (h >= 0 && h < height && w >= 0 &&
+                    w < width) ? im[h * width + w] : Dtype(0);
+              }
+            }
+            for (int j = 0; j < alpha; ++j) {
+              input_transform(tile, d + j, alpha, tmp + j, alpha);
+            }
+          }
+          for (int i = 0; i < alpha; ++i) {
+            input_transform(tile, tmp + i * alpha, 1, v + i * alpha, 1);
+          }
+          for (int xi = 0; xi < alpha_sq; ++xi) {
+            input_tiles[(xi * in_group + ic) * block_tiles + b] = v[xi];
+          }
+        }
+      }
+      // One product per position of the transformed tile.
+      for (int xi = 0; xi < alpha_sq; ++xi) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_group,
+            block_tiles, in_group, Dtype(1),
+            &transformed[(gr * alpha_sq + xi) * out_group * in_group],
+            &input_tiles[xi * in_group * block_tiles], Dtype(0),
+            &output_tiles[xi * out_group * block_tiles]);
+      }
+      for (int oc = 0; oc < out_group; ++oc) {
+        const int o = gr * out_group + oc;
+        Dtype* out = data_out + (n * num_output + o) * output_h * output_w;
+        const Dtype bias_value = bias ? bias[o] : Dtype(0);
+        for (int b = 0; b < block_tiles; ++b) {
+          for (int xi = 0; xi < alpha_sq; ++xi) {
+            v[xi] = output_tiles[(xi * out_group + oc) * block_tiles + b];
+          }
+          for (int j = 0; j < alpha; ++j) {
+            output_transform(tile, v + j, alpha, tmp + j, alpha);
+          }
+          for (int i = 0; i < tile; ++i) {
+            output_transform(tile, tmp + i * alpha, 1, y + i * tile, 1);
+          }
+          const int h0 = ((first_tile + b) / tiles_w) * tile;
+          const int w0 = ((first_tile + b) % tiles_w) * tile;
+          const int rows = std::min(tile, output_h - h0);
+          const int cols = std::min(tile, output_w - w0);
+          for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+              out[(h0 + i) * output_w + w0 + j] = y[i * tile + j] + bias_value;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+// Explicit instantiation
+template void winograd_conv_cpu<float>(const float* data_im, const int num,
+    const int channels, const int height, const int width,
+    const float* weights, const float* bias, const int num_output,
+    const int group, const int pad_h, const int pad_w, const int tile,
+    float* data_out);
+template void winograd_conv_cpu<double>(const double* data_im, const int num,
+    const int channels, const int height, const int width,
+    const double* weights, const double* bias, const int num_output,
+    const int group, const int pad_h, const int pad_w, const int tile,
+    double* data_out);
+
+}  // namespace caffe
@@ -6,14 +6,29 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/asio.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/data_reader.hpp"
+#include "caffe/inference_server.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/numa.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/quantization.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/socket_ring.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -46,8 +61,76 @@ DEFINE_string(snapshot, "",
 DEFINE_string(weights, "",
     "Optional; the pretrained weights to initialize finetuning, "
     "separated by ','. Cannot be set simultaneously with snapshot.");
+DEFINE_bool(fold_batch_norm, false,
+    "Optional; for 'test' and 'serve', fold the BatchNorm, Scale and Bias layers into "
+    "the weights of the Convolution and InnerProduct layers they follow.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(quantization_table, "",
+    "For 'calibrate', the quantization table to write. Optional for 'test', "
+    "'time' and 'serve'; run the Convolution and InnerProduct layers with "
+    "int8 weights and inputs on the CPU, within the ranges of this table.");
+DEFINE_bool(profile, false,
+    "Optional; for 'time', also report per layer percentiles, estimated "
+    "FLOPs and bytes, and the achieved rates against the measured peak of "
+    "the machine.");
+DEFINE_string(profile_json, "",
+    "Optional; for 'time', write the profile as JSON to this file. "
+    "Implies -profile.");
+DEFINE_string(profile_trace, "",
+    "Optional; for 'time', write every layer pass as a Chrome trace "
+    "(chrome://tracing) to this file. Implies -profile.");
+DEFINE_string(listen, "tcp:127.0.0.1:8500",
+    "For 'serve', the socket to listen on: tcp:<address>:<port> or "
+    "unix:<path>.");
+DEFINE_int32(max_batch_size, 8,
+    "For 'serve', the most items run through the net in one batch.");
+DEFINE_int32(batch_timeout_ms, 5,
+    "For 'serve', how long a request waits for its batch to fill, in "
+    "milliseconds.");
+DEFINE_int32(serve_threads, 1,
+    "For 'serve', the number of nets running batches concurrently.");
+DEFINE_int32(max_request_mb, 64,
+    "For 'serve', the largest request accepted, in megabytes; the "
+    "connection of a client sending a larger one is closed.");
+DEFINE_int32(stats_interval, 60,
+    "For 'serve', log the serving stats every this many seconds; 0 to "
+    "never log them.");
+DEFINE_string(numa, "none",
+    "Optional; for 'serve' and 'time', spread the nets over the NUMA nodes: "
+    "none, bind (bind each net's threads to a node) or replicate (also copy "
+    "the weights to each node). 'time' then also measures the forward "
+    "throughput of one net per node.");
+DEFINE_int32(replicas, 1,
+    "Optional; for 'train' on CPU, run this many solver replicas on their "
+    "own threads, sharing the weights. The effective training batch size is "
+    "multiplied by the number of replicas.");
+DEFINE_int32(scaling_iterations, 10,
+    "Optional; with -replicas, run the replicas one at a time for this many "
+    "first iterations, to report the scaling efficiency against one "
+    "replica.");
+DEFINE_int32(rank, 0,
+    "Optional; for 'train' across processes, the rank of this one, from 0 "
+    "to -world_size - 1. Rank 0 tests and snapshots.");
+DEFINE_int32(world_size, 1,
+    "Optional; for 'train', the number of processes training together on "
+    "CPU, summing their gradients over -ring. Data layers split their "
+    "source between them.");
+DEFINE_string(ring, "tcp:127.0.0.1:8600",
+    "Optional; with -world_size, the socket of each rank, tcp:<address>:"
+    "<port> or unix:<path> separated by ',', or a single one, rank r then "
+    "using port + r or path.r.");
+DEFINE_int32(ring_bucket_kb, 4096,
+    "Optional; with -world_size, sum the gradients in buckets of about this "
+    "many KB as soon as backward has computed them, overlapping the "
+    "communication with the rest of backward; 0 to sum them all after "
+    "backward.");
+DEFINE_string(ring_trace, "",
+    "Optional; with -world_size, write the backward passes and the gradient "
+    "reductions of the first iterations as a Chrome trace (chrome://tracing) "
+    "to this file, rank r > 0 writing to file.r.");
+DEFINE_int32(host_cache_mb, 1024,
+    "Optional; the most freed host memory kept for reuse, in MB.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -177,6 +260,17 @@ caffe::SolverAction::Enum GetRequestedAction(
   return caffe::SolverAction::NONE;
 }
 
+// Quantize the layers of the net with the ranges of -quantization_table,
+// if given.
+static void QuantizeFromFlags(Net<float>* net) {
+  if (FLAGS_quantization_table.empty()) {
+    return;
+  }
+  caffe::QuantizationTable table;
+  caffe::ReadProtoFromTextFileOrDie(FLAGS_quantization_table, &table);
+  LOG(INFO) << "Running " << net->Quantize(table) << " layers in int8.";
+}
+
 // Train / Finetune a model.
 int train() {
   CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to train.";
@@ -210,7 +304,11 @@ int train() {
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    CHECK_GE(FLAGS_replicas, 1) << "Need at least one replica.";
+    Caffe::set_solver_count(FLAGS_replicas);
   } else {
+    CHECK_EQ(FLAGS_replicas, 1) << "-replicas is for CPU training.";
+    CHECK_EQ(FLAGS_world_size, 1) << "-world_size is for CPU training.";
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
       s << (i ? ", " : "") << gpus[i];
@@ -229,9 +327,19 @@ int train() {
     Caffe::set_solver_count(gpus.size());
   }
 
+  CHECK_GE(FLAGS_world_size, 1) << "Need at least one process.";
+  if (FLAGS_world_size > 1) {
+    CHECK_EQ(FLAGS_replicas, 1) << "Train with -replicas or -world_size.";
+    LOG(INFO) << "Training as rank " << FLAGS_rank << " of "
+        << FLAGS_world_size;
+    caffe::DataReader::set_process_shard(FLAGS_rank, FLAGS_world_size);
+    caffe::RingSync<float>::ConfigureRank(FLAGS_rank, &solver_param);
+  }
+
+  // Only rank 0 snapshots, on SIGHUP too.
   caffe::SignalHandler signal_handler(
         GetRequestedAction(FLAGS_sigint_effect),
-        GetRequestedAction(FLAGS_sighup_effect));
+        GetRequestedAction(FLAGS_rank > 0 ? "none" : FLAGS_sighup_effect));
 
   shared_ptr<caffe::Solver<float> >
       solver(caffe::SolverRegistry<float>::CreateSolver(solver_param));
@@ -248,6 +356,27 @@ int train() {
   if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.Run(gpus);
+  } else if (FLAGS_replicas > 1) {
+    caffe::CPUSync<float> sync(solver, NULL, solver->param());
+    sync.Run(FLAGS_replicas, FLAGS_scaling_iterations);
+  } else if (FLAGS_world_size > 1) {
+    caffe::SocketRing ring(
+        caffe::SocketRing::Endpoints(FLAGS_ring, FLAGS_world_size),
+        FLAGS_rank);
+    CHECK_GE(FLAGS_ring_bucket_kb, 0);
+    caffe::RingSync<float> sync(solver, &ring,
+        static_cast<size_t>(FLAGS_ring_bucket_kb) << 10);
+    sync.Run();
+    if (FLAGS_ring_trace.size()) {
+      string path = FLAGS_ring_trace;
+      if (FLAGS_rank > 0) {
+        path += "." + boost::lexical_cast<string>(FLAGS_rank);
+      }
+      std::ofstream trace(path.c_str());
+      CHECK(trace) << "Cannot write " << path;
+      sync.WriteChromeTrace(&trace);
+      LOG(INFO) << "Wrote the trace to " << path;
+    }
   } else {
     LOG(INFO) << "Starting Optimization";
     solver->Solve();
@@ -283,6 +412,10 @@ int test() {
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  if (FLAGS_fold_batch_norm) {
+    caffe_net.FoldBatchNorm();
+  }
+  QuantizeFromFlags(&caffe_net);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<int> test_score_output_id;
@@ -331,6 +464,191 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Calibrate: measure the ranges of the blobs of a TEST net over its first
+// batches for int8 inference, then compare the outputs of the quantized net
+// with those of the original one over the next batches.
+int calibrate() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to calibrate.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to calibrate.";
+  CHECK_GT(FLAGS_quantization_table.size(), 0)
+      << "Need a quantization table to write.";
+  vector<string> stages = get_stages_from_flags();
+  LOG(INFO) << "Use CPU, the only device running int8 layers.";
+  Caffe::set_mode(Caffe::CPU);
+
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  param.mutable_state()->set_level(FLAGS_level);
+  for (int i = 0; i < stages.size(); ++i) {
+    param.mutable_state()->add_stage(stages[i]);
+  }
+  // The blobs are read after each Forward, so they must keep their values.
+  param.set_optimize_memory(false);
+  Net<float> caffe_net(param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  if (FLAGS_fold_batch_norm) {
+    caffe_net.FoldBatchNorm();
+  }
+
+  LOG(INFO) << "Calibrating over " << FLAGS_iterations << " batches.";
+  caffe::QuantizationCalibrator<float> calibrator(caffe_net);
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    caffe_net.Forward();
+    calibrator.Observe();
+  }
+  caffe::QuantizationTable table;
+  calibrator.ToProto(&table);
+  caffe::WriteProtoToTextFile(table, FLAGS_quantization_table);
+  LOG(INFO) << "Wrote the ranges of " << table.blob_size() << " blobs to "
+      << FLAGS_quantization_table;
+
+  // Each batch runs in full precision, then again in int8 from the first
+  // layer after the data layers, on the same data.
+  const int num_quantized = caffe_net.Quantize(table);
+  vector<std::pair<Layer<float>*, float> > quantized;
+  for (int i = 0; i < caffe_net.layers().size(); ++i) {
+    const caffe::LayerParameter& layer_param =
+        caffe_net.layers()[i]->layer_param();
+    if (layer_param.has_quantization_param()) {
+      quantized.push_back(std::make_pair(caffe_net.layers()[i].get(),
+          layer_param.quantization_param().bottom_max()));
+    }
+  }
+  int start = 0;
+  while (start < caffe_net.layers().size() &&
+      caffe_net.bottom_vecs()[start].empty()) {
+    ++start;
+  }
+  LOG(INFO) << "Comparing " << num_quantized << " int8 layers with full "
+      << "precision over " << FLAGS_iterations << " batches.";
+  const vector<Blob<float>*>& outputs = caffe_net.output_blobs();
+  vector<double> fp32_sum(outputs.size(), 0);
+  vector<double> int8_sum(outputs.size(), 0);
+  vector<double> abs_diff_sum(outputs.size(), 0);
+  vector<double> max_abs_diff(outputs.size(), 0);
+  vector<int> counts(outputs.size(), 0);
+  vector<int> top1_agreed(outputs.size(), 0);
+  vector<int> top1_items(outputs.size(), 0);
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    for (int j = 0; j < quantized.size(); ++j) {
+      quantized[j].first->Quantize(0);
+    }
+    caffe_net.Forward();
+    vector<vector<float> > fp32_outputs(outputs.size());
+    for (int j = 0; j < outputs.size(); ++j) {
+      fp32_outputs[j].assign(outputs[j]->cpu_data(),
+          outputs[j]->cpu_data() + outputs[j]->count());
+    }
+    for (int j = 0; j < quantized.size(); ++j) {
+      quantized[j].first->Quantize(quantized[j].second);
+    }
+    caffe_net.ForwardFrom(start);
+    for (int j = 0; j < outputs.size(); ++j) {
+      const float* fp32 = &fp32_outputs[j][0];
+      const float* int8 = outputs[j]->cpu_data();
+      for (int k = 0; k < outputs[j]->count(); ++k) {
+        fp32_sum[j] += fp32[k];
+        int8_sum[j] += int8[k];
+        const double diff = std::fabs(int8[k] - fp32[k]);
+        abs_diff_sum[j] += diff;
+        max_abs_diff[j] = std::max(max_abs_diff[j], diff);
+      }
+      counts[j] += outputs[j]->count();
+      // Scores of several classes per item.
+      if (outputs[j]->num_axes() == 2 && outputs[j]->shape(1) > 1) {
+        const int classes = outputs[j]->shape(1);
+        for (int n = 0; n < outputs[j]->shape(0); ++n) {
+          const float* fp32_scores = fp32 + n * classes;
+          const float* int8_scores = int8 + n * classes;
+          top1_agreed[j] +=
+              std::max_element(fp32_scores, fp32_scores + classes) -
+              fp32_scores == std::max_element(int8_scores,
+                  int8_scores + classes) - int8_scores;
+          ++top1_items[j];
+        }
+      }
+    }
+  }
+  for (int j = 0; j < outputs.size(); ++j) {
+    const string& output_name =
+        caffe_net.blob_names()[caffe_net.output_blob_indices()[j]];
+    if (counts[j] == FLAGS_iterations) {
+      // A score per batch, such as an accuracy or a loss.
+      const double fp32_mean = fp32_sum[j] / FLAGS_iterations;
+      const double int8_mean = int8_sum[j] / FLAGS_iterations;
+      LOG(INFO) << output_name << ": fp32 = " << fp32_mean << ", int8 = "
+          << int8_mean << ", delta = " << int8_mean - fp32_mean;
+      continue;
+    }
+    ostringstream top1;
+    if (top1_items[j]) {
+      top1 << ", top-1 agreement " << 100. * top1_agreed[j] / top1_items[j]
+          << "%";
+    }
+    LOG(INFO) << output_name << ": mean |int8 - fp32| = "
+        << abs_diff_sum[j] / counts[j] << ", max " << max_abs_diff[j]
+        << top1.str();
+  }
+  return 0;
+}
+RegisterBrewFunction(calibrate);
+
+// Runs forward passes of a net created from model on node, once all the
+// nodes are ready, and stores their average time in ms.
+static void TimeNumaNode(const caffe::NetModel<float>* model,
+    caffe::NumaPlacement numa, int node, Caffe::Brew mode,
+    boost::barrier* ready, double* forward_ms) {
+  Caffe::set_mode(mode);
+  if (!caffe::BindThreadToNumaNode(node)) {
+    LOG(WARNING) << "Cannot bind to NUMA node " << node;
+  }
+  shared_ptr<caffe::NetModel<float> > replica;
+  if (numa == caffe::NUMA_REPLICATE) {
+    replica = model->Replicate();
+  }
+  shared_ptr<Net<float> > net =
+      replica ? replica->CreateNet() : model->CreateNet();
+  net->Forward();
+  ready->wait();
+  Timer timer;
+  timer.Start();
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    net->Forward();
+  }
+  *forward_ms = timer.MilliSeconds() / FLAGS_iterations;
+}
+
+// Measures the forward throughput of the model with one net per NUMA node,
+// all running at once.
+static void TimeNumaNodes(const Net<float>& caffe_net,
+    caffe::NumaPlacement numa) {
+  const caffe::NetModel<float> model(caffe_net);
+  const int num_nodes = caffe::NumaNodeCount();
+  LOG(INFO) << "NUMA topology: " << caffe::NumaTopologyString();
+  LOG(INFO) << "*** NUMA benchmark begins ***";
+  LOG(INFO) << "Running one net per node, with "
+      << (numa == caffe::NUMA_REPLICATE ? "a copy of the weights per node." :
+          "the weights shared by all nodes.");
+  boost::barrier ready(num_nodes);
+  vector<double> forward_ms(num_nodes);
+  boost::thread_group threads;
+  for (int node = 0; node < num_nodes; ++node) {
+    threads.create_thread(boost::bind(&TimeNumaNode, &model, numa, node,
+        Caffe::mode(), &ready, &forward_ms[node]));
+  }
+  threads.join_all();
+  double forwards_per_second = 0;
+  for (int node = 0; node < num_nodes; ++node) {
+    LOG(INFO) << "Node " << node << " average Forward pass: "
+        << forward_ms[node] << " ms.";
+    forwards_per_second += 1000 / forward_ms[node];
+  }
+  LOG(INFO) << "Total throughput: " << forwards_per_second
+      << " forward passes/s.";
+  LOG(INFO) << "*** NUMA benchmark ends ***";
+}
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
@@ -350,6 +668,7 @@ int time() {
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  QuantizeFromFlags(&caffe_net);
 
   // Do a clean forward and backward pass, so that memory allocation are done
   // and future iterations will be more stable.
@@ -363,53 +682,41 @@ int time() {
   caffe_net.Backward();
 
   const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
-  const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
+  const bool profile = FLAGS_profile || FLAGS_profile_json.size() ||
+      FLAGS_profile_trace.size();
+  caffe::NetProfiler<float> profiler(&caffe_net);
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
   Timer total_timer;
   total_timer.Start();
-  Timer forward_timer;
-  Timer backward_timer;
-  Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
   for (int j = 0; j < FLAGS_iterations; ++j) {
     Timer iter_timer;
     iter_timer.Start();
-    forward_timer.Start();
-    for (int i = 0; i < layers.size(); ++i) {
-      timer.Start();
-      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
-    }
-    forward_time += forward_timer.MicroSeconds();
-    backward_timer.Start();
-    for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
-    }
-    backward_time += backward_timer.MicroSeconds();
+    profiler.Run(1);
     LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
       << iter_timer.MilliSeconds() << " ms.";
   }
+  total_timer.Stop();
   LOG(INFO) << "Average time per layer: ";
   for (int i = 0; i < layers.size(); ++i) {
-    const caffe::string& layername = layers[i]->layer_param().name();
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+    const caffe::LayerProfile& layer_profile = profiler.layers()[i];
+    double forward_time = 0.0;
+    double backward_time = 0.0;
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      forward_time += layer_profile.forward_us[j];
+      backward_time += layer_profile.backward_us[j];
+    }
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << layer_profile.name <<
+      "\tforward: " << forward_time / 1000 / FLAGS_iterations << " ms.";
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << layer_profile.name <<
+      "\tbackward: " << backward_time / 1000 / FLAGS_iterations << " ms.";
+  }
+  double forward_time = 0.0;
+  double backward_time = 0.0;
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    forward_time += profiler.forward_us()[j];
+    backward_time += profiler.backward_us()[j];
   }
-  total_timer.Stop();
   LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
@@ -418,10 +725,242 @@ int time() {
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  const caffe::NumaPlacement numa = caffe::NumaPlacementFromString(FLAGS_numa);
+  if (numa != caffe::NUMA_NONE) {
+    TimeNumaNodes(caffe_net, numa);
+  }
+  if (profile) {
+    LOG(INFO) << "Measuring the peak of the machine.";
+    const caffe::MachinePeak peak = caffe::MeasureMachinePeak();
+    LOG(INFO) << "Peak: " << peak.gflops << " GFLOP/s, "
+      << peak.gbytes_per_second << " GB/s.";
+    profiler.set_peak(peak);
+    profiler.LogSummary();
+    if (FLAGS_profile_json.size()) {
+      std::ofstream json(FLAGS_profile_json.c_str());
+      CHECK(json) << "Cannot write " << FLAGS_profile_json;
+      profiler.WriteJson(&json);
+      LOG(INFO) << "Wrote the profile to " << FLAGS_profile_json;
+    }
+    if (FLAGS_profile_trace.size()) {
+      std::ofstream trace(FLAGS_profile_trace.c_str());
+      CHECK(trace) << "Cannot write " << FLAGS_profile_trace;
+      profiler.WriteChromeTrace(&trace);
+      LOG(INFO) << "Wrote the trace to " << FLAGS_profile_trace;
+    }
+  }
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Serve: run the requests of clients through a model, in batches.
+//
+// Each message on a connection is a serialized ServeRequest or
+// ServeResponse, preceded by its size as 4 little-endian bytes. Messages of
+// more than max_size bytes are rejected before they are read.
+template <typename Stream>
+static bool ReadMessage(Stream* stream, google::protobuf::Message* message,
+    uint32_t max_size) {
+  unsigned char header[4];
+  boost::system::error_code error;
+  boost::asio::read(*stream, boost::asio::buffer(header), error);
+  if (error) { return false; }
+  const uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16) |
+      (static_cast<uint32_t>(header[3]) << 24);
+  if (size > max_size) {
+    LOG(WARNING) << "Closing a connection sending a message of " << size
+        << " bytes, more than " << max_size;
+    return false;
+  }
+  string data(size, '\0');
+  if (size > 0) {
+    boost::asio::read(*stream, boost::asio::buffer(&data[0], size), error);
+  }
+  return !error && message->ParseFromString(data);
+}
+
+template <typename Stream>
+static bool WriteMessage(Stream* stream,
+    const google::protobuf::Message& message) {
+  string data;
+  message.SerializeToString(&data);
+  unsigned char header[4];
+  for (int i = 0; i < 4; ++i) {
+    header[i] = (data.size() >> (8 * i)) & 0xff;
+  }
+  vector<boost::asio::const_buffer> buffers;
+  buffers.push_back(boost::asio::buffer(header));
+  buffers.push_back(boost::asio::buffer(data));
+  boost::system::error_code error;
+  boost::asio::write(*stream, buffers, error);
+  return !error;
+}
+
+// Checks that a request input holds items of the shape the net takes.
+static string CheckServeInput(const caffe::BlobProto& input,
+    const vector<int>& input_shape) {
+  const int num_axes = input.shape().dim_size();
+  if (num_axes != input_shape.size()) {
+    return "the input must have " + caffe::format_int(input_shape.size()) +
+        " axes, with the items along the first";
+  }
+  int64_t count = 1;
+  for (int i = 0; i < num_axes; ++i) {
+    if (i > 0 && input.shape().dim(i) != input_shape[i]) {
+      return "input axis " + caffe::format_int(i) + " must be " +
+          caffe::format_int(input_shape[i]);
+    }
+    count *= input.shape().dim(i);
+  }
+  if (count <= 0 || count > INT_MAX) {
+    return "the input must hold at least one item";
+  }
+  if (input.data_size() != count && input.double_data_size() != count) {
+    return "the input must hold " + caffe::format_int(static_cast<int>(count)) +
+        " values";
+  }
+  return "";
+}
+
+template <typename Stream>
+static void ServeConnection(shared_ptr<Stream> stream,
+    caffe::InferenceServer<float>* server) {
+  const uint32_t max_size =
+      static_cast<uint32_t>(FLAGS_max_request_mb) << 20;
+  caffe::ServeRequest request;
+  while (ReadMessage(stream.get(), &request, max_size)) {
+    caffe::ServeResponse response;
+    if (request.stats()) {
+      server->GetStats(response.mutable_stats());
+    }
+    if (request.has_input()) {
+      const string error = CheckServeInput(request.input(),
+          server->input_shape());
+      if (error.size()) {
+        response.set_error(error);
+      } else {
+        Blob<float> input;
+        input.FromProto(request.input());
+        vector<shared_ptr<Blob<float> > > outputs;
+        server->Infer(input, &outputs);
+        for (int i = 0; i < outputs.size(); ++i) {
+          outputs[i]->ToProto(response.add_output());
+          response.add_output_name(server->output_names()[i]);
+        }
+      }
+    }
+    if (!WriteMessage(stream.get(), response)) { break; }
+  }
+}
+
+template <typename Protocol>
+static void AcceptConnections(boost::asio::io_service* io_service,
+    typename Protocol::acceptor* acceptor,
+    caffe::InferenceServer<float>* server) {
+  LOG(INFO) << "Serving on " << FLAGS_listen;
+  while (true) {
+    shared_ptr<typename Protocol::socket> socket(
+        new typename Protocol::socket(*io_service));
+    boost::system::error_code error;
+    acceptor->accept(*socket, error);
+    if (error) {
+      LOG(WARNING) << "Cannot accept a connection: " << error.message();
+      continue;
+    }
+    boost::thread(&ServeConnection<typename Protocol::socket>, socket,
+        server).detach();
+  }
+}
+
+static void LogServeStats(const caffe::InferenceServer<float>* server) {
+  while (true) {
+    boost::this_thread::sleep(
+        boost::posix_time::seconds(FLAGS_stats_interval));
+    caffe::ServeStats stats;
+    server->GetStats(&stats);
+    ostringstream batch_sizes;
+    for (int i = 0; i < stats.batch_size_count_size(); ++i) {
+      if (stats.batch_size_count(i)) {
+        batch_sizes << " " << i + 1 << ":" << stats.batch_size_count(i);
+      }
+    }
+    LOG(INFO) << "Served " << stats.requests() << " requests, queue depth "
+        << stats.queue_depth() << ", latency p50 " << stats.latency_p50_ms()
+        << " ms, p99 " << stats.latency_p99_ms() << " ms, batch sizes"
+        << batch_sizes.str();
+    const caffe::HostAllocator& allocator = caffe::HostAllocator::Global();
+    LOG(INFO) << "Host memory in use " << (allocator.bytes_in_use() >> 20)
+        << " MB, cached " << (allocator.bytes_cached() >> 20)
+        << " MB, cache hit rate " << allocator.hit_rate();
+  }
+}
+
+int serve() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to serve.";
+  CHECK(FLAGS_max_request_mb > 0 && FLAGS_max_request_mb < 4096)
+      << "max_request_mb must be between 1 and 4095.";
+  vector<string> stages = get_stages_from_flags();
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  // Instantiate the caffe net, and share its weights with the serving nets.
+  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  if (FLAGS_fold_batch_norm) {
+    caffe_net.FoldBatchNorm();
+  }
+  QuantizeFromFlags(&caffe_net);
+  caffe::NetModel<float> model(caffe_net);
+  caffe::InferenceServer<float> server(model, FLAGS_serve_threads,
+      FLAGS_max_batch_size, FLAGS_batch_timeout_ms,
+      caffe::NumaPlacementFromString(FLAGS_numa));
+  LOG(INFO) << "Batching up to " << server.max_batch_size() << " items, "
+      << "waiting up to " << FLAGS_batch_timeout_ms << " ms.";
+  if (FLAGS_stats_interval > 0) {
+    boost::thread(&LogServeStats, &server).detach();
+  }
+
+  boost::asio::io_service io_service;
+  if (boost::starts_with(FLAGS_listen, "unix:")) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    typedef boost::asio::local::stream_protocol protocol;
+    const string path = FLAGS_listen.substr(5);
+    // Remove the socket a previous server left.
+    std::remove(path.c_str());
+    protocol::acceptor acceptor(io_service, protocol::endpoint(path));
+    AcceptConnections<protocol>(&io_service, &acceptor, &server);
+#else
+    LOG(FATAL) << "Unix sockets are not supported on this platform.";
+#endif
+  } else if (boost::starts_with(FLAGS_listen, "tcp:")) {
+    typedef boost::asio::ip::tcp protocol;
+    const string address = FLAGS_listen.substr(4);
+    const size_t colon = address.rfind(':');
+    CHECK_NE(colon, string::npos) << "Need a port to listen on in "
+        << FLAGS_listen;
+    const protocol::endpoint endpoint(
+        boost::asio::ip::address::from_string(address.substr(0, colon)),
+        atoi(address.substr(colon + 1).c_str()));
+    protocol::acceptor acceptor(io_service, endpoint);
+    AcceptConnections<protocol>(&io_service, &acceptor, &server);
+  } else {
+    LOG(FATAL) << "Unknown socket " << FLAGS_listen
+        << ", expected tcp:<address>:<port> or unix:<path>.";
+  }
+  return 0;
+}
+RegisterBrewFunction(serve);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -434,9 +973,14 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  serve           serve a model over a socket, batching requests\n"
+      "  calibrate       measure activation ranges for int8 inference");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  CHECK_GE(FLAGS_host_cache_mb, 0);
+  caffe::HostAllocator::Global().set_cache_limit(
+      static_cast<size_t>(FLAGS_host_cache_mb) << 20);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -0,0 +1,184 @@
+// This program converts trained weights to the mapped weights format, which
+// nets use in place from a memory mapping instead of parsing and copying.
+// Usage:
+//    convert_weights [FLAGS] WEIGHTS_IN WEIGHTS_OUT.caffeweights
+// WEIGHTS_IN is a .caffemodel binary proto or a .caffemodel.h5 HDF5 file.
+// With --model, the net is also loaded from both files and their load time
+// and resident memory are reported. Each load runs in a process of its own,
+//    convert_weights --model=MODEL --measure_only WEIGHTS
+// so that its peak memory is that of the load alone.
+
+#ifdef _MSC_VER
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "",
+    "Optional; the net definition to load from both weights files, reporting "
+    "their load time and resident memory.");
+DEFINE_bool(measure_only, false,
+    "Only load the net of --model from the weights file given, and report "
+    "its load time and resident memory.");
+
+// The current and the peak resident memory of the process, in bytes.
+static void ResidentMemory(size_t* current, size_t* peak) {
+  *current = *peak = 0;
+#ifdef _MSC_VER
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+      sizeof(counters))) {
+    *current = counters.WorkingSetSize;
+    *peak = counters.PeakWorkingSetSize;
+  }
+#else
+  FILE* status = fopen("/proc/self/status", "r");
+  if (!status) { return; }
+  char line[256];
+  while (fgets(line, sizeof(line), status)) {
+    size_t kb;
+    if (sscanf(line, "VmRSS: %zu kB", &kb) == 1) {  // NOLINT(runtime/printf)
+      *current = kb * 1024;
+    } else if (sscanf(line, "VmHWM: %zu kB", &kb) == 1) {  // NOLINT
+      *peak = kb * 1024;
+    }
+  }
+  fclose(status);
+#endif
+}
+
+// Loads the net with the weights, reads every weight so that mapped pages
+// are resident too, and logs the time and memory it took. The peak is that
+// of the process, so nothing else must have been loaded before.
+static void ReportLoad(const string& weights) {
+  size_t current_before, peak_before;
+  ResidentMemory(&current_before, &peak_before);
+  Timer timer;
+  timer.Start();
+  Net<float> net(FLAGS_model, TEST);
+  net.CopyTrainedLayersFrom(weights);
+  const double load_ms = timer.MilliSeconds();
+  double sum = 0;
+  for (int i = 0; i < net.learnable_params().size(); ++i) {
+    sum += net.learnable_params()[i]->asum_data();
+  }
+  size_t current, peak;
+  ResidentMemory(&current, &peak);
+  LOG(INFO) << weights << ": loaded in " << load_ms << " ms, resident "
+      << (current - current_before) / 1048576.0 << " MB, peak "
+      << (peak - current_before) / 1048576.0 << " MB (weights abs sum "
+      << sum << ")";
+}
+
+// Runs program --measure_only on the weights in a new process, and returns
+// its exit code, or -1 if it could not run.
+static int ReportLoadInChild(const char* program, const string& weights) {
+  const string model_flag = "--model=" + FLAGS_model;
+#ifdef _MSC_VER
+  string command = "\"" + string(program) + "\" --measure_only \"" +
+      model_flag + "\" \"" + weights + "\"";
+  std::vector<char> command_line(command.begin(), command.end());
+  command_line.push_back(0);
+  STARTUPINFOA startup_info = { sizeof(startup_info) };
+  PROCESS_INFORMATION process;
+  if (!CreateProcessA(NULL, &command_line[0], NULL, NULL, FALSE, 0, NULL,
+      NULL, &startup_info, &process)) {
+    return -1;
+  }
+  WaitForSingleObject(process.hProcess, INFINITE);
+  DWORD exit_code = 1;
+  GetExitCodeProcess(process.hProcess, &exit_code);
+  CloseHandle(process.hThread);
+  CloseHandle(process.hProcess);
+  return exit_code;
+#else
+  const pid_t pid = fork();
+  if (pid == 0) {
+    execlp(program, program, "--measure_only", model_flag.c_str(),
+        weights.c_str(), static_cast<char*>(NULL));
+    _exit(127);
+  }
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+    return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert trained weights to the mapped weights "
+        "format\n"
+        "Usage:\n"
+        "    convert_weights [FLAGS] WEIGHTS_IN WEIGHTS_OUT.caffeweights\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_measure_only && argc == 2 && !FLAGS_model.empty()) {
+    ReportLoad(argv[1]);
+    return 0;
+  }
+  if (argc != 3 || FLAGS_measure_only) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_weights");
+    return 1;
+  }
+  const string input_filename(argv[1]);
+  const string output_filename(argv[2]);
+  if (!IsMappedWeightsFile(output_filename)) {
+    LOG(ERROR) << "The output file must have the .caffeweights extension";
+    return 1;
+  }
+
+  {
+    // Scoped so that the parsed weights are freed before any report.
+    NetParameter param;
+    if (input_filename.size() >= 3 &&
+        input_filename.compare(input_filename.size() - 3, 3, ".h5") == 0) {
+      // HDF5 weights can only be read into a net.
+      CHECK(!FLAGS_model.empty()) << "Converting HDF5 weights needs --model";
+      Net<float> net(FLAGS_model, TEST);
+      net.CopyTrainedLayersFrom(input_filename);
+      net.ToProto(&param);
+    } else {
+      ReadNetParamsFromBinaryFileOrDie(input_filename, &param);
+    }
+    WriteMappedWeights(param, output_filename);
+  }
+  LOG(INFO) << "Wrote mapped weights to " << output_filename;
+
+  if (!FLAGS_model.empty()) {
+    // This process has parsed the whole input, so each load is measured in a
+    // process of its own.
+    const string weights[] = { output_filename, input_filename };
+    for (int i = 0; i < 2; ++i) {
+      const int exit_code = ReportLoadInChild(argv[0], weights[i]);
+      if (exit_code != 0) {
+        LOG(ERROR) << "Loading " << weights[i] << " failed with exit code "
+            << exit_code;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}